@@ -73,6 +73,18 @@ enum AlarmStatus {
     ALARM_STATUS_MAX,
 };
 
+/**
+ * @brief Enumerates the encodings of the Zigbee attribute messages published to (and received from) MQTT.
+ *
+ * @details Both encodings carry the same fields under the same keys. The control messages (device metadata, log
+ *          levels, command results) are always JSON.
+ */
+enum MqttFormat {
+    MQTT_FORMAT_JSON,                   // JSON text (default)
+    MQTT_FORMAT_MSGPACK,                // MessagePack
+    MQTT_FORMAT_MAX,
+};
+
 /**
  * @brief Returns a human-readable string representation of the given state.
  *
@@ -427,6 +439,9 @@ struct g_config_t {
     String mqtt_username;
     String mqtt_password;
     String mqtt_cert;
+    int mqtt_batch_ms;                  // telemetry reports of one device are batched for this time (0 = batching off)
+    int mqtt_batch_bytes;               // a batch is published earlier when its payload would exceed this size
+    int mqtt_format;                    // encoding of the attribute messages (MqttFormat)
 
     int alarm_countdown_s;              // countdown before alarm is started after locking process
     int alarm_e_countdown_s;            // TODO add new param to app - countdown before alarm start emergency notifications after 'alarm_e_threshold' is reached
@@ -134,7 +134,7 @@ bool saveNewPassword(String &inputDoublePassword) {
     int secondDelimiterPos = inputDoublePassword.lastIndexOf('#');
 
     if (firstDelimiterPos == -1 || secondDelimiterPos == -1 || firstDelimiterPos == secondDelimiterPos) {
-        esplogW(TAG_LIB_AUTH, "(saveNewPassword)", "Failed to save new password! Password string parsing error! Unexpected string format: %s", inputDoublePassword);
+        esplogW(TAG_LIB_AUTH, "(saveNewPassword)", "Failed to save new password! Password string parsing error! Unexpected string format: %s", inputDoublePassword.c_str());
         displayNotification(NOTIFICATION_AUTH_SET_ERROR);
         return false;
     }
@@ -143,7 +143,7 @@ bool saveNewPassword(String &inputDoublePassword) {
     String secondPassword = inputDoublePassword.substring(firstDelimiterPos+1, secondDelimiterPos);
     
     if (firstPassword != secondPassword) {
-        esplogW(TAG_LIB_AUTH, "(saveNewPassword)", "Failed to save new password! Different passwords were written on setup!\n - first:  %s\n - second: %s", firstPassword, secondPassword);
+        esplogW(TAG_LIB_AUTH, "(saveNewPassword)", "Failed to save new password! Different passwords were written on setup!\n - first:  %s\n - second: %s", firstPassword.c_str(), secondPassword.c_str());
         displayNotification(NOTIFICATION_AUTH_SET_ERROR);
         return false;
     }
@@ -279,7 +279,7 @@ bool addRfid(String &inputRfid) {
 
     rfidFile.close();
     if (recordFound) {
-        esplogW(TAG_LIB_AUTH, "(addRfid)", "RFID UID already added: %s! Ignoring...", inputRfid);
+        esplogW(TAG_LIB_AUTH, "(addRfid)", "RFID UID already added: %s! Ignoring...", inputRfid.c_str());
         displayNotification(NOTIFICATION_RFID_ADD_SUCCESS);
         return true;
     }
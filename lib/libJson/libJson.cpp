@@ -16,6 +16,9 @@ void setDefaultConfig(g_config_t *g_config) {
     g_config->mqtt_username = "";
     g_config->mqtt_password = "";
     g_config->mqtt_cert = "";
+    g_config->mqtt_batch_ms = 0;
+    g_config->mqtt_batch_bytes = MQTT_BATCH_BYTES_DEFAULT;
+    g_config->mqtt_format = MQTT_FORMAT_JSON;
 
     g_config->alarm_countdown_s = 120;
     g_config->alarm_e_countdown_s = 120;
@@ -40,6 +43,9 @@ void setInvalidonfig(g_config_t *g_config) {
     g_config->mqtt_username = "INVALID";
     g_config->mqtt_password = "INVALID";
     g_config->mqtt_cert = "INVALID";
+    g_config->mqtt_batch_ms = -1;
+    g_config->mqtt_batch_bytes = -1;
+    g_config->mqtt_format = -1;
 
     g_config->alarm_countdown_s = -1;
     g_config->alarm_e_countdown_s = -1;
@@ -81,6 +87,9 @@ bool saveConfig(g_config_t *g_config) {
     mqtt["mqtt_username"] = g_config->mqtt_username;
     mqtt["mqtt_password"] = g_config->mqtt_password;
     mqtt["mqtt_cert"] = g_config->mqtt_cert;
+    mqtt["mqtt_batch_ms"] = g_config->mqtt_batch_ms;
+    mqtt["mqtt_batch_bytes"] = g_config->mqtt_batch_bytes;
+    mqtt["mqtt_format"] = g_config->mqtt_format;
 
     JsonObject alarm = doc["alarm"].to<JsonObject>();
     alarm["alarm_countdown"] = g_config->alarm_countdown_s;
@@ -169,6 +178,15 @@ bool rewriteConfig(g_config_t *src, g_config_t *dst) {
     if (src->mqtt_cert != "INVALID") {
         dst->mqtt_cert = src->mqtt_cert;
     }
+    if (src->mqtt_batch_ms != -1) {
+        dst->mqtt_batch_ms = src->mqtt_batch_ms;
+    }
+    if (src->mqtt_batch_bytes != -1) {
+        dst->mqtt_batch_bytes = src->mqtt_batch_bytes;
+    }
+    if (src->mqtt_format != -1) {
+        dst->mqtt_format = src->mqtt_format;
+    }
 
     if (src->alarm_countdown_s != -1) {
         dst->alarm_countdown_s = src->alarm_countdown_s;
@@ -283,6 +301,13 @@ bool loadConfig(g_config_t * g_config, const char* filepath) {
     g_config->mqtt_username = doc["mqtt"]["mqtt_username"].as<String>();
     g_config->mqtt_password = doc["mqtt"]["mqtt_password"].as<String>();
     g_config->mqtt_cert = doc["mqtt"]["mqtt_cert"].as<String>();
+    // optional, the config files saved before batching was added do not have them
+    g_config->mqtt_batch_ms = doc["mqtt"]["mqtt_batch_ms"] | 0;
+    g_config->mqtt_batch_bytes = doc["mqtt"]["mqtt_batch_bytes"] | MQTT_BATCH_BYTES_DEFAULT;
+    g_config->mqtt_format = doc["mqtt"]["mqtt_format"] | MQTT_FORMAT_JSON;
+    if (g_config->mqtt_format < 0 || g_config->mqtt_format >= MQTT_FORMAT_MAX) {
+        g_config->mqtt_format = MQTT_FORMAT_JSON;
+    }
 
     g_config->alarm_countdown_s = doc["alarm"]["alarm_countdown"].as<int>();
     g_config->alarm_e_countdown_s = doc["alarm"]["alarm_countdown_e"].as<int>();
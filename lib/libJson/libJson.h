@@ -19,6 +19,7 @@
 #define CONFIG_FILE_PATH "/config/"
 #define CONFIG_FILE String(String(CONFIG_FILE_PATH)+String(CONFIG_FILE_NAME)).c_str()
 #define CONFIG_UPLOAD_FILE String(String(CONFIG_FILE_PATH)+String(CONFIG_FILE_UPLOAD_NAME)).c_str()
+#define MQTT_BATCH_BYTES_DEFAULT 2048   // default payload size at which a batch of telemetry reports is published
 
 /**
  * @brief Resets the configuration data to default values.
@@ -189,6 +190,7 @@ bool rewriteConfig(g_config_t *src, g_config_t *dst);
  * @note The function expects a JSON structure with the following fields:
  *       - wifi: ssid, password, ip, gateway, subnet
  *       - mqtt: mqtt_tls, mqtt_broker, mqtt_port, mqtt_id, mqtt_topic, mqtt_username, mqtt_password, mqtt_cert
+ *         (optional: mqtt_batch_ms, mqtt_batch_bytes, mqtt_format, the defaults are used if they are missing)
  *       - alarm: alarm_countdown, alarm_countdown_e, alarm_threshold_w, alarm_threshold_e, alarm_telephone
  *
  *          Example usage:
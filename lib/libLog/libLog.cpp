@@ -0,0 +1,1116 @@
+#include "libLog.h"
+#include "utils.h"
+
+static const char log_level_chars[LOG_LEVEL_MAX] = {'I', 'W', 'E'};
+static const char *log_level_colors[LOG_LEVEL_MAX] = {"\033[1;32m", "\033[1;33m", "\033[1;31m"};
+static const char *log_dropped_format = "%lu log records dropped! (total: %lu)";
+
+typedef enum {
+    LOG_ARG_NONE,                       // no argument ("%%" or unknown conversion)
+    LOG_ARG_INT,                        // 4 bytes
+    LOG_ARG_INT64,                      // 8 bytes
+    LOG_ARG_DOUBLE,                     // 8 bytes
+    LOG_ARG_STRING,                     // 1 byte length + characters
+    LOG_ARG_POINTER,                    // 4 bytes
+    LOG_ARG_SKIP,                       // consumed, but not captured ("%n")
+} log_arg_t;
+
+typedef struct {
+    const char* start;                  // position of '%'
+    const char* end;                    // position after the conversion character
+    uint8_t stars;                      // number of '*' width/precision arguments
+    bool precision_star;                // the precision is given by the last '*' argument
+    int32_t precision;                  // precision of the conversion (-1 = none)
+    char length;                        // length modifier class ('\0', 'l', 'L', 'z', 't')
+    log_arg_t type;                     // argument type
+} log_spec_t;
+
+// ring buffer shared between producers (any task) and the log writer
+static log_record_t log_ring[LOG_QUEUE_SLOTS];
+static volatile uint32_t log_enqueue_pos = 0;
+static volatile uint32_t log_dequeue_pos = 0;
+static log_stats_t log_stats = {0, 0, 0, 0};
+static uint32_t log_dropped_reported = 0;
+static SemaphoreHandle_t log_mutex = NULL;
+
+// log writer state, guarded by log_mutex
+static File log_file;
+static bool log_file_opened = false;
+static bool log_file_failed = false;
+static size_t log_file_size = 0;
+static uint32_t log_segment_first = 0;
+static uint32_t log_segment_next = 0;
+
+// last records kept in RTC memory across resets, appended under log_crash_mux (also from esplogE)
+static RTC_NOINIT_ATTR log_crash_t log_crash_rtc;
+static portMUX_TYPE log_crash_mux = portMUX_INITIALIZER_UNLOCKED;
+static log_crash_t * log_crash_report = NULL;
+
+// formatted records kept in RAM for the live log tail, guarded by log_history_mutex
+typedef struct {
+    uint32_t seq;
+    uint8_t level;
+    char line[LOG_HISTORY_LINE_MAX];
+} log_history_t;
+
+static log_history_t log_history[LOG_HISTORY_RECORDS];
+static uint32_t log_history_next = 1;
+static SemaphoreHandle_t log_history_mutex = NULL;
+static log_sink_t log_sink = NULL;
+static char log_write_buf[LOG_WRITE_BUF_SIZE];
+static size_t log_write_len = 0;
+static unsigned long log_last_flush = 0;
+
+static void logPrintSerial(log_level_t level, unsigned long timestamp, const log_tag_t* tag, const char* fx, const char* message) {
+    const char *color = log_level_colors[level];
+    char c = log_level_chars[level];
+
+    if (tag != NULL && fx != NULL && fx[0] != '\0') {
+        Serial.printf("%s%c [%lu]\033[1;39m %s%s: %s \033[1;90m(fx: %s)\033[0m\n", color, c, timestamp, tag->color, tag->name, message, fx);
+    } else if (tag != NULL) {
+        Serial.printf("%s%c [%lu]\033[1;39m %s%s: %s\033[0m\n", color, c, timestamp, tag->color, tag->name, message);
+    } else {
+        Serial.printf("%s%c [%lu]\033[1;39m %s\033[0m\n", color, c, timestamp, message);
+    }
+}
+
+static int logFormatFileLine(char* buffer, size_t buffer_len, log_level_t level, unsigned long timestamp, const log_tag_t* tag, const char* fx, const char* message) {
+    char c = log_level_chars[level];
+
+    if (tag != NULL && fx != NULL && fx[0] != '\0') {
+        return snprintf(buffer, buffer_len, "%c [%lu] %s: %s (fx: %s)\n", c, timestamp, tag->name, message, fx);
+    } else if (tag != NULL) {
+        return snprintf(buffer, buffer_len, "%c [%lu] %s: %s\n", c, timestamp, tag->name, message);
+    } else {
+        return snprintf(buffer, buffer_len, "%c [%lu] %s\n", c, timestamp, message);
+    }
+}
+
+// *********************************************************************************************************************
+
+static const char* logNextSpec(const char* format, log_spec_t* spec) {
+    const char* p = strchr(format, '%');
+    if (p == NULL) {
+        return NULL;
+    }
+
+    spec->start = p;
+    spec->stars = 0;
+    spec->precision_star = false;
+    spec->precision = -1;
+    spec->length = '\0';
+    spec->type = LOG_ARG_NONE;
+
+    p++;
+    while (*p != '\0' && strchr("-+ #0'", *p) != NULL) {p++;}
+    if (*p == '*') {spec->stars++; p++;} else {while (isdigit((unsigned char)*p)) {p++;}}
+    if (*p == '.') {
+        p++;
+        if (*p == '*') {
+            spec->stars++;
+            spec->precision_star = true;
+            p++;
+        } else {
+            spec->precision = 0;
+            while (isdigit((unsigned char)*p)) {
+                spec->precision = spec->precision < 0xFFFF ? spec->precision * 10 + (*p - '0') : spec->precision;
+                p++;
+            }
+        }
+    }
+
+    while (*p != '\0' && strchr("hlLqjzt", *p) != NULL) {
+        if (*p == 'l') {
+            spec->length = spec->length == 'l' ? 'L' : 'l';
+        } else if (*p == 'L' || *p == 'q' || *p == 'j') {
+            spec->length = 'L';
+        } else if (*p == 'z' || *p == 't') {
+            spec->length = *p;
+        }
+        p++;
+    }
+
+    switch (*p) {
+        case 'd': case 'i': case 'o': case 'u': case 'x': case 'X': case 'c':
+            spec->type = spec->length == 'L' ? LOG_ARG_INT64 : LOG_ARG_INT;
+            break;
+        case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+            spec->type = LOG_ARG_DOUBLE;
+            break;
+        case 's':
+            spec->type = LOG_ARG_STRING;
+            break;
+        case 'p':
+            spec->type = LOG_ARG_POINTER;
+            break;
+        case 'n':
+            spec->type = LOG_ARG_SKIP;
+            break;
+        default:
+            spec->stars = 0;
+            break;
+    }
+
+    spec->end = *p != '\0' ? p + 1 : p;
+    return spec->end;
+}
+
+static bool logPackBytes(uint8_t* buffer, size_t buffer_len, size_t* offset, const void* data, size_t len) {
+    if (*offset + len > buffer_len) {
+        return false;
+    }
+    memcpy(buffer + *offset, data, len);
+    *offset += len;
+    return true;
+}
+
+static bool logUnpackBytes(const uint8_t* buffer, size_t buffer_len, size_t* offset, void* data, size_t len) {
+    if (*offset + len > buffer_len) {
+        return false;
+    }
+    memcpy(data, buffer + *offset, len);
+    *offset += len;
+    return true;
+}
+
+static size_t logPackArgs(uint8_t* buffer, size_t buffer_len, bool* truncated, const char* format, va_list args) {
+    size_t offset = 0;
+    log_spec_t spec;
+    const char* p = format;
+    *truncated = false;
+
+    while ((p = logNextSpec(p, &spec)) != NULL) {
+        bool ok = true;
+
+        for (uint8_t i = 0; i < spec.stars && ok; i++) {
+            int32_t star = va_arg(args, int);
+            ok = logPackBytes(buffer, buffer_len, &offset, &star, sizeof(star));
+            // a negative precision is taken as if it was omitted
+            if (spec.precision_star && i == spec.stars - 1) {
+                spec.precision = star >= 0 ? star : -1;
+            }
+        }
+
+        if (ok && spec.type == LOG_ARG_INT) {
+            uint32_t value;
+            if (spec.length == 'l') {
+                value = (uint32_t)va_arg(args, unsigned long);
+            } else if (spec.length == 'z') {
+                value = (uint32_t)va_arg(args, size_t);
+            } else if (spec.length == 't') {
+                value = (uint32_t)va_arg(args, ptrdiff_t);
+            } else {
+                value = va_arg(args, unsigned int);
+            }
+            ok = logPackBytes(buffer, buffer_len, &offset, &value, sizeof(value));
+        } else if (ok && spec.type == LOG_ARG_INT64) {
+            uint64_t value = va_arg(args, unsigned long long);
+            ok = logPackBytes(buffer, buffer_len, &offset, &value, sizeof(value));
+        } else if (ok && spec.type == LOG_ARG_DOUBLE) {
+            double value = va_arg(args, double);
+            ok = logPackBytes(buffer, buffer_len, &offset, &value, sizeof(value));
+        } else if (ok && spec.type == LOG_ARG_POINTER) {
+            uint32_t value = (uint32_t)(uintptr_t)va_arg(args, void*);
+            ok = logPackBytes(buffer, buffer_len, &offset, &value, sizeof(value));
+        } else if (ok && spec.type == LOG_ARG_SKIP) {
+            (void)va_arg(args, void*);
+        } else if (ok && spec.type == LOG_ARG_STRING) {
+            const char* str = va_arg(args, const char*);
+            if (str == NULL) {
+                str = "(null)";
+            }
+            if (offset + 1 > buffer_len) {
+                ok = false;
+            } else {
+                size_t max_len = buffer_len - offset - 1 < 255 ? buffer_len - offset - 1 : 255;
+                // the precision bounds the characters read, the string does not have to be terminated ("%.*s" of a buffer)
+                if (spec.precision >= 0 && (size_t)spec.precision < max_len) {
+                    max_len = spec.precision;
+                }
+                size_t len = strnlen(str, max_len);
+                buffer[offset++] = (uint8_t)len;
+                memcpy(buffer + offset, str, len);
+                offset += len;
+                // keep the captured part of a long string, but stop capturing
+                ok = (spec.precision >= 0 && len == (size_t)spec.precision) || str[len] == '\0';
+            }
+        }
+
+        if (!ok) {
+            *truncated = true;
+            break;
+        }
+    }
+
+    return offset;
+}
+
+template <typename T>
+static int logRenderValue(char* buffer, size_t buffer_len, const char* spec, uint8_t stars, const int32_t* star, T value) {
+    if (stars == 0) {
+        return snprintf(buffer, buffer_len, spec, value);
+    } else if (stars == 1) {
+        return snprintf(buffer, buffer_len, spec, (int)star[0], value);
+    }
+    return snprintf(buffer, buffer_len, spec, (int)star[0], (int)star[1], value);
+}
+
+static size_t logRender(char* buffer, size_t buffer_len, const char* format, const uint8_t* args, size_t args_len) {
+    size_t len = 0;
+    size_t offset = 0;
+    bool exhausted = false;
+    log_spec_t spec;
+    const char* p = format;
+    const char* next;
+
+    if (buffer_len == 0) {
+        return 0;
+    }
+    buffer[0] = '\0';
+
+    while (len < buffer_len - 1) {
+        const char* literal = p;
+        next = logNextSpec(p, &spec);
+        const char* literal_end = next != NULL ? spec.start : p + strlen(p);
+
+        size_t literal_len = literal_end - literal;
+        if (literal_len > buffer_len - 1 - len) {
+            literal_len = buffer_len - 1 - len;
+        }
+        memcpy(buffer + len, literal, literal_len);
+        len += literal_len;
+        buffer[len] = '\0';
+
+        if (next == NULL) {
+            break;
+        }
+        p = next;
+
+        if (spec.type == LOG_ARG_NONE) {
+            // "%%" or unknown conversion, print it as it is
+            size_t spec_len = spec.end - spec.start;
+            const char* spec_text = spec.end[-1] == '%' ? "%" : spec.start;
+            spec_len = spec.end[-1] == '%' ? 1 : spec_len;
+            if (spec_len > buffer_len - 1 - len) {
+                spec_len = buffer_len - 1 - len;
+            }
+            memcpy(buffer + len, spec_text, spec_len);
+            len += spec_len;
+            buffer[len] = '\0';
+            continue;
+        }
+
+        if (spec.type == LOG_ARG_SKIP) {
+            continue;
+        }
+
+        // copy the specifier without its long length modifiers, the captured value width is given by its type
+        char fmt[24];
+        size_t fmt_len = 0;
+        for (const char* c = spec.start; c < spec.end - 1 && fmt_len < sizeof(fmt) - 4; c++) {
+            if (strchr("lLqjzt", *c) == NULL) {
+                fmt[fmt_len++] = *c;
+            }
+        }
+        if (spec.type == LOG_ARG_INT64) {
+            fmt[fmt_len++] = 'l';
+            fmt[fmt_len++] = 'l';
+        }
+        fmt[fmt_len++] = spec.end[-1];
+        fmt[fmt_len] = '\0';
+
+        int32_t star[2] = {0, 0};
+        bool ok = !exhausted;
+        for (uint8_t i = 0; i < spec.stars && ok; i++) {
+            ok = logUnpackBytes(args, args_len, &offset, &star[i], sizeof(int32_t));
+        }
+
+        int ret = -1;
+        if (ok && spec.type == LOG_ARG_INT) {
+            uint32_t value;
+            if ((ok = logUnpackBytes(args, args_len, &offset, &value, sizeof(value)))) {
+                ret = logRenderValue(buffer + len, buffer_len - len, fmt, spec.stars, star, (unsigned int)value);
+            }
+        } else if (ok && spec.type == LOG_ARG_INT64) {
+            uint64_t value;
+            if ((ok = logUnpackBytes(args, args_len, &offset, &value, sizeof(value)))) {
+                ret = logRenderValue(buffer + len, buffer_len - len, fmt, spec.stars, star, (unsigned long long)value);
+            }
+        } else if (ok && spec.type == LOG_ARG_DOUBLE) {
+            double value;
+            if ((ok = logUnpackBytes(args, args_len, &offset, &value, sizeof(value)))) {
+                ret = logRenderValue(buffer + len, buffer_len - len, fmt, spec.stars, star, value);
+            }
+        } else if (ok && spec.type == LOG_ARG_POINTER) {
+            uint32_t value;
+            if ((ok = logUnpackBytes(args, args_len, &offset, &value, sizeof(value)))) {
+                ret = logRenderValue(buffer + len, buffer_len - len, fmt, spec.stars, star, (void*)(uintptr_t)value);
+            }
+        } else if (ok && spec.type == LOG_ARG_STRING) {
+            uint8_t str_len;
+            char str[LOG_ARGS_MAX];
+            if ((ok = logUnpackBytes(args, args_len, &offset, &str_len, sizeof(str_len)))) {
+                // the last string may be stored partially, if the arguments were truncated
+                size_t available = args_len - offset < str_len ? args_len - offset : str_len;
+                memcpy(str, args + offset, available);
+                str[available] = '\0';
+                offset += available;
+                ret = logRenderValue(buffer + len, buffer_len - len, fmt, spec.stars, star, (const char*)str);
+            }
+        }
+
+        if (!ok) {
+            // the arguments were truncated, print a placeholder instead of the missing value
+            exhausted = true;
+            ret = snprintf(buffer + len, buffer_len - len, "<?>");
+        }
+
+        if (ret > 0) {
+            len += (size_t)ret < buffer_len - len ? (size_t)ret : buffer_len - 1 - len;
+        }
+    }
+
+    return len;
+}
+
+#ifdef LOG_BINARY
+static uint32_t logHash(const char* str) {
+    // FNV-1a, the decoder uses the same function to build its table of string literals
+    static struct {const char* ptr; uint32_t hash;} cache[64];
+
+    if (str == NULL) {
+        return 0;
+    }
+
+    uint8_t index = ((uintptr_t)str >> 2) & 63;
+    if (cache[index].ptr == str) {
+        return cache[index].hash;
+    }
+
+    uint32_t hash = 2166136261UL;
+    for (const char* c = str; *c != '\0'; c++) {
+        hash ^= (uint8_t)*c;
+        hash *= 16777619UL;
+    }
+
+    cache[index].ptr = str;
+    cache[index].hash = hash;
+    return hash;
+}
+
+static size_t logFormatBinaryRecord(uint8_t* buffer, size_t buffer_len, const log_record_t* record) {
+    size_t len = LOG_BINARY_HEADER_SIZE + record->args_len;
+    if (len > buffer_len) {
+        return 0;
+    }
+
+    uint32_t timestamp = (uint32_t)record->timestamp;
+    uint32_t format_id = logHash(record->format);
+    uint32_t fx_id = logHash(record->fx);
+
+    buffer[0] = LOG_BINARY_RECORD_MAGIC;
+    buffer[1] = (uint8_t)len;
+    buffer[2] = (uint8_t)record->level | (record->args_truncated ? 0x80 : 0x00);
+    buffer[3] = record->tag != NULL ? record->tag->id : LOG_TAG_NONE;
+    memcpy(buffer + 4, &timestamp, sizeof(timestamp));
+    memcpy(buffer + 8, &format_id, sizeof(format_id));
+    memcpy(buffer + 12, &fx_id, sizeof(fx_id));
+    memcpy(buffer + LOG_BINARY_HEADER_SIZE, record->args, record->args_len);
+    return len;
+}
+#endif
+
+// *********************************************************************************************************************
+
+static bool logFileOpen() {
+    if (log_file_opened) {
+        return true;
+    }
+
+    log_file = SD.open(LOG_FILE, FILE_APPEND);
+    if (!log_file) {
+        log_stats.file_errors++;
+        if (!log_file_failed) {
+            Serial.print("\033[1;31m");
+            Serial.printf(" -> failed to open log file");
+            Serial.print("\033[1;39m\n");
+            log_file_failed = true;
+        }
+        return false;
+    }
+
+    log_file_opened = true;
+    log_file_failed = false;
+    log_file_size = log_file.size();
+    log_last_flush = millis();
+
+#ifdef LOG_BINARY
+    if (log_file_size == 0) {
+        log_file_size += log_file.write((const uint8_t*)LOG_BINARY_FILE_MAGIC, strlen(LOG_BINARY_FILE_MAGIC));
+    }
+#endif
+    return true;
+}
+
+static void logFileClose() {
+    if (log_file_opened) {
+        log_file.close();
+        log_file_opened = false;
+    }
+}
+
+const char* logSegmentPath(uint32_t generation, char* buffer, size_t buffer_len) {
+    snprintf(buffer, buffer_len, "%s%s%08lu%s", LOG_FILE_PATH, LOG_SEGMENT_PREFIX, (unsigned long)generation, LOG_FILE_EXT);
+    return buffer;
+}
+
+static bool logSegmentParse(const char* name, uint32_t* generation) {
+    // older cores return the full path of the directory entry
+    const char* base = strrchr(name, '/');
+    base = base != NULL ? base + 1 : name;
+
+    size_t prefix_len = strlen(LOG_SEGMENT_PREFIX);
+    if (strncmp(base, LOG_SEGMENT_PREFIX, prefix_len) != 0) {
+        return false;
+    }
+
+    char* end;
+    unsigned long value = strtoul(base + prefix_len, &end, 10);
+    if (end == base + prefix_len || strcmp(end, LOG_FILE_EXT) != 0) {
+        return false;
+    }
+
+    *generation = (uint32_t)value;
+    return true;
+}
+
+static void logSegmentPrune() {
+    char path[32];
+    while (log_segment_next - log_segment_first > LOG_SEGMENTS) {
+        SD.remove(logSegmentPath(log_segment_first, path, sizeof(path)));
+        log_segment_first++;
+    }
+}
+
+static void logSegmentScan() {
+    File dir = SD.open(LOG_FILE_DIR);
+    if (!dir || !dir.isDirectory()) {
+        SD.mkdir(LOG_FILE_DIR);
+        log_segment_first = 0;
+        log_segment_next = 0;
+        return;
+    }
+
+    bool found = false;
+    uint32_t first = 0;
+    uint32_t last = 0;
+    File entry;
+    while ((entry = dir.openNextFile())) {
+        uint32_t generation;
+        if (!entry.isDirectory() && logSegmentParse(entry.name(), &generation)) {
+            if (!found || generation < first) {first = generation;}
+            if (!found || generation > last) {last = generation;}
+            found = true;
+        }
+        entry.close();
+    }
+    dir.close();
+
+    log_segment_first = found ? first : 0;
+    log_segment_next = found ? last + 1 : 0;
+    logSegmentPrune();
+}
+
+static bool logFileTorn() {
+    File file = SD.open(LOG_FILE, FILE_READ);
+    if (!file) {
+        return false;
+    }
+
+    size_t size = file.size();
+    bool torn = false;
+
+#ifdef LOG_BINARY
+    // walk the record headers, the last record has to end exactly at the end of the file
+    size_t magic_len = strlen(LOG_BINARY_FILE_MAGIC);
+    size_t pos = magic_len;
+    torn = size < magic_len;
+    while (!torn && pos < size) {
+        uint8_t header[2];
+        if (!file.seek(pos) || file.read(header, sizeof(header)) != sizeof(header) ||
+            header[0] != LOG_BINARY_RECORD_MAGIC || header[1] < LOG_BINARY_HEADER_SIZE || pos + header[1] > size) {
+            torn = true;
+            break;
+        }
+        pos += header[1];
+    }
+#else
+    // every complete text record ends with a new line
+    if (size > 0 && file.seek(size - 1)) {
+        torn = file.read() != '\n';
+    }
+#endif
+
+    file.close();
+    return torn;
+}
+
+static void logFileRotate() {
+    char path[32];
+    logFileClose();
+
+    // rename is atomic on the file system, the active segment is either complete under the new name or untouched
+    logSegmentPath(log_segment_next, path, sizeof(path));
+    if (!SD.rename(LOG_FILE, path)) {
+        SD.remove(path);
+        if (!SD.rename(LOG_FILE, path)) {
+            log_stats.file_errors++;
+            SD.remove(LOG_FILE);
+        }
+    }
+
+    log_segment_next++;
+    logSegmentPrune();
+    log_file_size = 0;
+}
+
+static void logFileWrite(const char* data, size_t len) {
+    if (len == 0 || !logFileOpen()) {
+        return;
+    }
+
+    size_t written = log_file.write((const uint8_t*)data, len);
+    if (written != len) {
+        log_stats.file_errors++;
+    }
+
+    log_file_size += written;
+    if (log_file_size >= LOG_FILE_MAX_SIZE) {
+        logFileRotate();
+    }
+}
+
+static void logFileAppend(const char* line, size_t len) {
+    if (len >= LOG_WRITE_BUF_SIZE) {
+        len = LOG_WRITE_BUF_SIZE - 1;
+    }
+
+    if (log_write_len + len > LOG_WRITE_BUF_SIZE) {
+        logFileWrite(log_write_buf, log_write_len);
+        log_write_len = 0;
+    }
+
+    memcpy(log_write_buf + log_write_len, line, len);
+    log_write_len += len;
+}
+
+// *********************************************************************************************************************
+
+static void logFillRecord(log_record_t * record, log_level_t level, const log_tag_t* tag, const char* fx, const char* format, va_list args) {
+    bool truncated;
+
+    record->level = level;
+    record->timestamp = millis();
+    record->tag = tag;
+    record->fx = fx;
+    record->format = format;
+    record->args_len = (uint8_t)logPackArgs(record->args, sizeof(record->args), &truncated, format, args);
+    record->args_truncated = truncated;
+}
+
+static void logBuildRecord(log_record_t * record, log_level_t level, const log_tag_t* tag, const char* fx, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    logFillRecord(record, level, tag, fx, format, args);
+    va_end(args);
+}
+
+static bool logEnqueue(log_level_t level, const log_tag_t* tag, const char* fx, const char* format, va_list args) {
+    uint32_t pos = __atomic_load_n(&log_enqueue_pos, __ATOMIC_RELAXED);
+    log_record_t * record;
+
+    // reserve a slot (multi-producer, lock-free)
+    for (;;) {
+        record = &log_ring[pos & (LOG_QUEUE_SLOTS - 1)];
+        uint32_t seq = __atomic_load_n(&record->seq, __ATOMIC_ACQUIRE);
+        int32_t diff = (int32_t)(seq - pos);
+
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&log_enqueue_pos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            __atomic_fetch_add(&log_stats.dropped, 1, __ATOMIC_RELAXED);
+            return false;
+        } else {
+            pos = __atomic_load_n(&log_enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+
+    logFillRecord(record, level, tag, fx, format, args);
+
+    // publish the slot to the log writer
+    __atomic_store_n(&record->seq, pos + 1, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&log_stats.enqueued, 1, __ATOMIC_RELAXED);
+    return true;
+}
+
+static bool logDequeue(log_record_t ** record) {
+    uint32_t pos = log_dequeue_pos;
+    log_record_t * slot = &log_ring[pos & (LOG_QUEUE_SLOTS - 1)];
+    uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+
+    if (seq != pos + 1) {
+        return false;
+    }
+
+    *record = slot;
+    return true;
+}
+
+static void logRelease(log_record_t * record) {
+    uint32_t pos = log_dequeue_pos;
+    __atomic_store_n(&record->seq, pos + LOG_QUEUE_SLOTS, __ATOMIC_RELEASE);
+    log_dequeue_pos = pos + 1;
+}
+
+static void logNotify(log_level_t level) {
+    if (handleTaskLog == NULL) {
+        // log writer is not running yet, write out synchronously
+        logFlush(true);
+        return;
+    }
+
+    uint32_t pending = log_enqueue_pos - log_dequeue_pos;
+    if (level >= LOG_LEVEL_WARN || pending >= LOG_QUEUE_SLOTS / 2) {
+        xTaskNotifyGive(handleTaskLog);
+    }
+}
+
+static bool logMessage(log_level_t level, const log_tag_t* tag, const char* fx, const char* format, va_list args) {
+    if (log_mutex == NULL) {
+        // logger is not initialised yet, print to serial monitor only
+        char message[LOG_MESSAGE_MAX];
+        if (vsnprintf(message, sizeof(message), format, args) < 0) {
+            return false;
+        }
+        logPrintSerial(level, millis(), tag, fx, message);
+        return true;
+    }
+
+    bool ret = logEnqueue(level, tag, fx, format, args);
+    logNotify(level);
+    return ret;
+}
+
+static void logCrashAppend(log_level_t level, const log_tag_t* tag, unsigned long timestamp, const char* message) {
+    portENTER_CRITICAL(&log_crash_mux);
+    if (log_crash_rtc.magic != LOG_CRASH_MAGIC || log_crash_rtc.head >= LOG_CRASH_RECORDS) {
+        // not recovered yet (logging before initLog), start over instead of writing out of bounds
+        log_crash_rtc.magic = LOG_CRASH_MAGIC;
+        log_crash_rtc.head = 0;
+        log_crash_rtc.count = 0;
+    }
+    log_crash_record_t * record = &log_crash_rtc.records[log_crash_rtc.head];
+    record->level = (uint8_t)level;
+    record->tag = tag != NULL ? tag->id : LOG_TAG_NONE;
+    record->timestamp = (uint32_t)timestamp;
+    strncpy(record->message, message, sizeof(record->message) - 1);
+    record->message[sizeof(record->message) - 1] = '\0';
+
+    log_crash_rtc.head = (log_crash_rtc.head + 1) % LOG_CRASH_RECORDS;
+    if (log_crash_rtc.count < LOG_CRASH_RECORDS) {
+        log_crash_rtc.count++;
+    }
+    portEXIT_CRITICAL(&log_crash_mux);
+}
+
+static bool logCrashValid(esp_reset_reason_t reason) {
+    // RTC memory holds random data after power on
+    if (reason == ESP_RST_POWERON || log_crash_rtc.magic != LOG_CRASH_MAGIC ||
+        log_crash_rtc.head >= LOG_CRASH_RECORDS || log_crash_rtc.count > LOG_CRASH_RECORDS) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < log_crash_rtc.count; i++) {
+        if (log_crash_rtc.records[i].level >= LOG_LEVEL_MAX) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void logCrashWriteFile(const log_crash_t * report) {
+    File file = SD.open(LOG_CRASH_FILE, FILE_APPEND);
+    if (file && file.size() >= LOG_FILE_MAX_SIZE) {
+        file.close();
+        SD.remove(LOG_CRASH_FILE);
+        file = SD.open(LOG_CRASH_FILE, FILE_APPEND);
+    }
+    if (!file) {
+        log_stats.file_errors++;
+        return;
+    }
+
+    char tag_name[16];
+    file.printf("=== reset reason: %s, last %lu log records ===\n", logResetReasonName(report->reset_reason), (unsigned long)report->count);
+    for (uint32_t i = 0; i < report->count; i++) {
+        const log_crash_record_t * record = &report->records[i];
+        const char* tag = record->tag < TAG_ID_MAX ? logTagName(&log_tags[record->tag], tag_name, sizeof(tag_name)) : "-";
+        file.printf("%c [%lu] %s: %s\n", log_level_chars[record->level], (unsigned long)record->timestamp, tag, record->message);
+    }
+    file.close();
+}
+
+static void logCrashRecover() {
+    esp_reset_reason_t reason = esp_reset_reason();
+
+    if (logCrashValid(reason)) {
+        log_crash_report = (log_crash_t*)malloc(sizeof(log_crash_t));
+    }
+
+    if (log_crash_report != NULL) {
+        // copy the records from the oldest one, the error record of esplogE may be stored before the pending
+        // records written out by its flush, so keep them ordered by timestamp
+        uint32_t count = log_crash_rtc.count;
+        uint32_t start = (log_crash_rtc.head + LOG_CRASH_RECORDS - count) % LOG_CRASH_RECORDS;
+        for (uint32_t i = 0; i < count; i++) {
+            log_crash_record_t record = log_crash_rtc.records[(start + i) % LOG_CRASH_RECORDS];
+            record.message[sizeof(record.message) - 1] = '\0';
+
+            uint32_t j = i;
+            while (j > 0 && log_crash_report->records[j - 1].timestamp > record.timestamp) {
+                log_crash_report->records[j] = log_crash_report->records[j - 1];
+                j--;
+            }
+            log_crash_report->records[j] = record;
+        }
+
+        log_crash_report->magic = LOG_CRASH_MAGIC;
+        log_crash_report->head = count % LOG_CRASH_RECORDS;
+        log_crash_report->count = count;
+        log_crash_report->reset_reason = (uint32_t)reason;
+        logCrashWriteFile(log_crash_report);
+    }
+
+    log_crash_rtc.magic = LOG_CRASH_MAGIC;
+    log_crash_rtc.head = 0;
+    log_crash_rtc.count = 0;
+    log_crash_rtc.reset_reason = 0;
+}
+
+static void logHistoryAppend(log_level_t level, const char* line, size_t len) {
+    uint32_t seq;
+
+    if (log_history_mutex == NULL || xSemaphoreTake(log_history_mutex, portMAX_DELAY) != pdTRUE) {
+        return;
+    }
+
+    // the line is stored without its new line character
+    seq = log_history_next++;
+    log_history_t * entry = &log_history[seq & (LOG_HISTORY_RECORDS - 1)];
+    len = len > 0 && line[len - 1] == '\n' ? len - 1 : len;
+    len = len < sizeof(entry->line) ? len : sizeof(entry->line) - 1;
+    entry->seq = seq;
+    entry->level = (uint8_t)level;
+    memcpy(entry->line, line, len);
+    entry->line[len] = '\0';
+
+    xSemaphoreGive(log_history_mutex);
+
+    if (log_sink != NULL) {
+        log_sink(seq, level, entry->line);
+    }
+}
+
+static void logWriteRecord(const log_record_t * record) {
+    char message[LOG_MESSAGE_MAX];
+    logRender(message, sizeof(message), record->format, record->args, record->args_len);
+    logPrintSerial(record->level, record->timestamp, record->tag, record->fx, message);
+
+    // error records are stored to RTC memory directly by esplogE
+    if (record->level < LOG_LEVEL_ERROR) {
+        logCrashAppend(record->level, record->tag, record->timestamp, message);
+    }
+
+    char line[LOG_MESSAGE_MAX + 96];
+    int len = logFormatFileLine(line, sizeof(line), record->level, record->timestamp, record->tag, record->fx, message);
+    len = len < 0 ? 0 : ((size_t)len < sizeof(line) ? len : sizeof(line) - 1);
+    logHistoryAppend(record->level, line, (size_t)len);
+
+#ifdef LOG_BINARY
+    uint8_t data[LOG_BINARY_HEADER_SIZE + LOG_ARGS_MAX];
+    size_t data_len = logFormatBinaryRecord(data, sizeof(data), record);
+    logFileAppend((const char*)data, data_len);
+#else
+    logFileAppend(line, (size_t)len);
+#endif
+}
+
+// *********************************************************************************************************************
+
+bool initLog() {
+    for (uint32_t i = 0; i < LOG_QUEUE_SLOTS; i++) {
+        log_ring[i].seq = i;
+    }
+    log_enqueue_pos = 0;
+    log_dequeue_pos = 0;
+
+    // recover the segment store, a torn active segment is sealed by rotation
+    logSegmentScan();
+    if (logFileTorn()) {
+        logFileRotate();
+    }
+
+    // recover the last records of the previous run before this run starts to overwrite them
+    logCrashRecover();
+
+    // the mutexes are kept when the logger is initialised again (the segment store is recovered from the SD card)
+    if (log_history_mutex == NULL) {
+        log_history_mutex = xSemaphoreCreateMutex();
+    }
+    if (log_mutex == NULL) {
+        log_mutex = xSemaphoreCreateMutex();
+    }
+    if (log_mutex == NULL || log_history_mutex == NULL) {
+        Serial.print("\033[1;31m");
+        Serial.printf("[initLog]: Failed to create log mutex!\n");
+        Serial.print("\033[1;39m");
+        return false;
+    }
+
+    if (log_crash_report != NULL) {
+        esplogW(TAG_LIB_UTILS, "(initLog)", "Previous run ended by reset: %s! Last %lu log records were recovered to: %s",
+            logResetReasonName(log_crash_report->reset_reason), (unsigned long)log_crash_report->count, LOG_CRASH_FILE);
+    }
+
+    return true;
+}
+
+void logFlush(bool force_flush) {
+    if (log_mutex == NULL || xSemaphoreTake(log_mutex, portMAX_DELAY) != pdTRUE) {
+        return;
+    }
+
+    log_record_t * record;
+    while (logDequeue(&record)) {
+        logWriteRecord(record);
+        logRelease(record);
+        log_stats.written++;
+    }
+
+    // report records lost due to ring buffer overflow
+    uint32_t dropped = log_stats.dropped;
+    if (dropped != log_dropped_reported) {
+        static log_record_t dropped_record;
+        logBuildRecord(&dropped_record, LOG_LEVEL_WARN, TAG_LIB_UTILS, NULL, log_dropped_format,
+            (unsigned long)(dropped - log_dropped_reported), (unsigned long)dropped);
+        logWriteRecord(&dropped_record);
+        log_dropped_reported = dropped;
+    }
+
+    logFileWrite(log_write_buf, log_write_len);
+    log_write_len = 0;
+
+    if (log_file_opened && (force_flush || millis() - log_last_flush >= LOG_FLUSH_PERIOD_MS)) {
+        log_file.flush();
+        log_last_flush = millis();
+    }
+
+    xSemaphoreGive(log_mutex);
+}
+
+void logClose() {
+    logFlush(true);
+
+    if (log_mutex == NULL || xSemaphoreTake(log_mutex, portMAX_DELAY) != pdTRUE) {
+        return;
+    }
+
+    logFileClose();
+    xSemaphoreGive(log_mutex);
+}
+
+void logClear() {
+    char path[32];
+    bool locked = log_mutex != NULL && xSemaphoreTake(log_mutex, portMAX_DELAY) == pdTRUE;
+
+    logFileClose();
+    SD.remove(LOG_FILE);
+    for (uint32_t generation = log_segment_first; generation != log_segment_next; generation++) {
+        SD.remove(logSegmentPath(generation, path, sizeof(path)));
+    }
+    log_segment_first = log_segment_next;
+    log_file_size = 0;
+
+    if (locked) {
+        xSemaphoreGive(log_mutex);
+    }
+}
+
+bool logGetSegments(uint32_t* first, uint32_t* next) {
+    *first = log_segment_first;
+    *next = log_segment_next;
+    return log_segment_first != log_segment_next;
+}
+
+void logHistoryRange(uint32_t* first, uint32_t* next) {
+    if (log_history_mutex == NULL || xSemaphoreTake(log_history_mutex, portMAX_DELAY) != pdTRUE) {
+        *first = *next = 1;
+        return;
+    }
+
+    *next = log_history_next;
+    *first = log_history_next > LOG_HISTORY_RECORDS ? log_history_next - LOG_HISTORY_RECORDS : 1;
+    xSemaphoreGive(log_history_mutex);
+}
+
+bool logHistoryGet(uint32_t seq, char* buffer, size_t buffer_len, log_level_t* level) {
+    bool ret = false;
+
+    if (buffer_len == 0 || log_history_mutex == NULL || xSemaphoreTake(log_history_mutex, portMAX_DELAY) != pdTRUE) {
+        return false;
+    }
+
+    const log_history_t * entry = &log_history[seq & (LOG_HISTORY_RECORDS - 1)];
+    if (seq != 0 && seq < log_history_next && entry->seq == seq) {
+        strncpy(buffer, entry->line, buffer_len - 1);
+        buffer[buffer_len - 1] = '\0';
+        if (level != NULL) {
+            *level = (log_level_t)entry->level;
+        }
+        ret = true;
+    }
+
+    xSemaphoreGive(log_history_mutex);
+    return ret;
+}
+
+void logSetSink(log_sink_t sink) {
+    log_sink = sink;
+}
+
+const log_crash_t* logCrashGet() {
+    return log_crash_report;
+}
+
+void logCrashRelease() {
+    log_crash_t * report = log_crash_report;
+    log_crash_report = NULL;
+    free(report);
+}
+
+const char* logResetReasonName(uint32_t reason) {
+    switch ((esp_reset_reason_t)reason) {
+        case ESP_RST_POWERON: return "POWERON";
+        case ESP_RST_EXT: return "EXT";
+        case ESP_RST_SW: return "SW";
+        case ESP_RST_PANIC: return "PANIC";
+        case ESP_RST_INT_WDT: return "INT_WDT";
+        case ESP_RST_TASK_WDT: return "TASK_WDT";
+        case ESP_RST_WDT: return "WDT";
+        case ESP_RST_DEEPSLEEP: return "DEEPSLEEP";
+        case ESP_RST_BROWNOUT: return "BROWNOUT";
+        case ESP_RST_SDIO: return "SDIO";
+        default: return "UNKNOWN";
+    }
+}
+
+log_stats_t logGetStats() {
+    return log_stats;
+}
+
+bool logSetLevel(const char* name, log_level_t level) {
+    if (name == NULL || level < LOG_LEVEL_INFO || level >= LOG_LEVEL_MAX) {
+        return false;
+    }
+
+    bool all = strcmp(name, "*") == 0 || strcasecmp(name, "all") == 0;
+    bool found = false;
+    char tag_name[16];
+
+    for (int i = 0; i < TAG_ID_MAX; i++) {
+        if (all || strcasecmp(logTagName(&log_tags[i], tag_name, sizeof(tag_name)), name) == 0) {
+            log_tags[i].level = level;
+            found = true;
+        }
+    }
+
+    return found;
+}
+
+bool logParseLevel(const char* str, log_level_t* level) {
+    if (str == NULL || level == NULL) {
+        return false;
+    }
+
+    if (strcasecmp(str, "info") == 0 || strcasecmp(str, "i") == 0 || strcmp(str, "0") == 0) {
+        *level = LOG_LEVEL_INFO;
+    } else if (strcasecmp(str, "warn") == 0 || strcasecmp(str, "warning") == 0 || strcasecmp(str, "w") == 0 || strcmp(str, "1") == 0) {
+        *level = LOG_LEVEL_WARN;
+    } else if (strcasecmp(str, "error") == 0 || strcasecmp(str, "e") == 0 || strcmp(str, "2") == 0) {
+        *level = LOG_LEVEL_ERROR;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+const char* logLevelName(log_level_t level) {
+    switch (level) {
+        case LOG_LEVEL_INFO: return "info";
+        case LOG_LEVEL_WARN: return "warn";
+        case LOG_LEVEL_ERROR: return "error";
+        default: return "unknown";
+    }
+}
+
+const char* logTagName(const log_tag_t* tag, char* buffer, size_t buffer_len) {
+    if (buffer_len == 0) {
+        return buffer;
+    }
+
+    const char* start = tag->name;
+    while (*start == ' ') {start++;}
+
+    size_t len = strlen(start);
+    while (len > 0 && start[len - 1] == ' ') {len--;}
+    if (len >= buffer_len) {
+        len = buffer_len - 1;
+    }
+
+    memcpy(buffer, start, len);
+    buffer[len] = '\0';
+    return buffer;
+}
+
+bool logWrite(log_level_t level, const log_tag_t* tag, const char* fx, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    bool ret = logMessage(level, tag, fx, format, args);
+    va_end(args);
+    return ret;
+}
+
+bool esplogE(const log_tag_t* tag, const char* fx, const char* format, ...) {
+    va_list args;
+    va_list args_crash;
+    va_start(args, format);
+
+    // keep the error in RTC memory first, it survives the reboot even if the SD card failed
+    char message[LOG_CRASH_MESSAGE_MAX];
+    va_copy(args_crash, args);
+    if (vsnprintf(message, sizeof(message), format, args_crash) < 0) {
+        message[0] = '\0';
+    }
+    va_end(args_crash);
+    logCrashAppend(LOG_LEVEL_ERROR, tag, millis(), message);
+
+    bool ret = logMessage(LOG_LEVEL_ERROR, tag, fx, format, args);
+    va_end(args);
+
+    logFlush(true);
+    rebootESP();
+    return ret;
+}
@@ -0,0 +1,513 @@
+/**
+ * @file libLog.h
+ * @brief Contains functions and definitions for asynchronous logging to serial monitor and SD card.
+ *
+ * Contains functions and definitions for asynchronous logging to serial monitor and SD card.
+ * Log records are enqueued by the calling task into a lock-free ring buffer and written out by the log writer task.
+ * The calling task only captures the raw arguments of the message, formatting is deferred to the log writer task.
+ *
+ * The log is stored on SD card as a rotating segment store. Records are appended to the active segment `LOG_FILE`,
+ * which is renamed to the next numbered segment (`/log/segNNNNNNNN.txt`) when it reaches `LOG_FILE_MAX_SIZE`.
+ * Only the last `LOG_SEGMENTS` rotated segments are kept. The segments are kept across reboots.
+ *
+ * The last `LOG_CRASH_RECORDS` records are also kept in RTC memory, which survives software resets, panics and
+ * watchdog resets. After such reset the records and the reset reason are written to `LOG_CRASH_FILE` during boot,
+ * and kept in RAM until they are published over MQTT, so the cause of a reboot is not lost when the SD card failed.
+ *
+ * The last `LOG_HISTORY_RECORDS` formatted records are kept in RAM with increasing sequence numbers, so the live
+ * log tail can be served (and resumed from a sequence number) without reading the SD card.
+ *
+ * Log records are filtered by level at two places. `LOG_LEVEL_MIN` removes the lower level calls at compile time
+ * (including evaluation of their arguments), the runtime level of each tag filters the remaining calls before
+ * their arguments are evaluated. The runtime levels can be changed through the web server or MQTT.
+ *
+ * When `LOG_BINARY` is defined, the log file is written in a compact binary format instead of text. Each record
+ * stores a tag id, hashes of the format string and function name, a timestamp and the raw argument bytes.
+ * The readable text is rebuilt on the host by `tools/log_decoder.py`, which hashes the string literals of the sources.
+ *
+ * Binary log file layout (little endian):
+ * - file header: `LOG_BINARY_FILE_MAGIC` (8 bytes)
+ * - record header (16 bytes):
+ *   - `[0]` record magic `LOG_BINARY_RECORD_MAGIC`
+ *   - `[1]` total length of the record including the header
+ *   - `[2]` log level (bit 7 is set when the arguments were truncated)
+ *   - `[3]` tag id (`LOG_TAG_NONE` if the record has no tag)
+ *   - `[4..7]` timestamp (millis)
+ *   - `[8..11]` FNV-1a hash of the format string
+ *   - `[12..15]` FNV-1a hash of the function name (0 if the record has no function name)
+ * - record arguments, in order of the format specifiers:
+ *   - `*` width/precision, integers, characters and pointers: 4 bytes
+ *   - `ll`/`j` integers and floating point numbers: 8 bytes
+ *   - strings: 1 byte length followed by the characters (without terminating null character)
+ */
+
+#ifndef LIBLOG_H_DEFINITION
+#define LIBLOG_H_DEFINITION
+
+#include <Arduino.h>
+#include <SD.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_attr.h"
+#include "esp_system.h"
+
+#ifdef LOG_BINARY
+#define LOG_FILE_EXT ".bin"
+#define LOG_FILE_MIME "application/octet-stream"
+#else
+#define LOG_FILE_EXT ".txt"
+#define LOG_FILE_MIME "text/plain"
+#endif
+#define LOG_FILE_NAME "logfile" LOG_FILE_EXT
+#define LOG_FILE_DIR "/log"
+#define LOG_FILE_PATH "/log/"
+#define LOG_FILE String(String(LOG_FILE_PATH)+String(LOG_FILE_NAME)).c_str()
+#define LOG_FILE_MAX_SIZE 10 * 1024 // maximal size of one log segment 10 kB
+#define LOG_SEGMENT_PREFIX "seg"    // rotated log segments are named /log/segNNNNNNNN.txt (generation number)
+#define LOG_SEGMENTS 16             // number of rotated log segments kept on SD card (oldest are removed)
+#define LOG_HISTORY_RECORDS 32      // number of formatted records kept in RAM for the live log tail (must be power of 2)
+#define LOG_HISTORY_LINE_MAX 160    // maximal length of the record kept in RAM for the live log tail
+#define LOG_CRASH_FILE "/log/crash.txt"     // reports of the records recovered from RTC memory after reset
+#define LOG_CRASH_RECORDS 16        // number of last log records kept in RTC memory
+#define LOG_CRASH_MESSAGE_MAX 96    // maximal length of log message kept in RTC memory
+#define LOG_CRASH_MAGIC 0x4C4F4752  // marks valid content of RTC memory
+
+#define LOG_QUEUE_SLOTS 32          // number of log records buffered for the log writer (must be power of 2)
+#define LOG_MESSAGE_MAX 256         // maximal length of formatted log message (longer messages are truncated)
+#define LOG_ARGS_MAX 192            // maximal size of captured arguments of one record (must be lower than 240)
+#define LOG_WRITE_BUF_SIZE 2048     // size of the batch buffer for SD card writes
+#define LOG_WRITER_PERIOD_MS 250    // period in which the log writer drains the queue
+#define LOG_FLUSH_PERIOD_MS 2000    // period in which the log file is flushed to SD card
+
+#ifndef LOG_LEVEL_MIN
+#define LOG_LEVEL_MIN 0             // compile-time minimal log level (0 - info, 1 - warning), lower level calls are removed
+#endif
+#ifndef LOG_LEVEL_DEFAULT
+#define LOG_LEVEL_DEFAULT LOG_LEVEL_INFO    // runtime log level of every tag after boot
+#endif
+
+#if LOG_LEVEL_MIN > 1
+#error "LOG_LEVEL_MIN can not exceed 1, error logs can not be removed (esplogE reboots the device)"
+#endif
+
+#define LOG_BINARY_FILE_MAGIC "ESPLOGB1"
+#define LOG_BINARY_RECORD_MAGIC 0xA5
+#define LOG_BINARY_HEADER_SIZE 16
+#define LOG_TAG_NONE 0xFF
+
+extern TaskHandle_t handleTaskLog;
+
+/**
+ * @brief Enumerates the log levels of the log records.
+ */
+typedef enum {
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_WARN,
+    LOG_LEVEL_ERROR,
+    LOG_LEVEL_MAX,
+} log_level_t;
+
+/**
+ * @brief Struct representing a log tag.
+ *
+ * The `id` is stored in the binary log records and has to match the position of the tag in the tag table,
+ * so the decoder can map it back to the name.
+ */
+typedef struct {
+    uint8_t id;                         // tag id
+    const char* name;                   // tag name (static string)
+    const char* color;                  // ANSI color of the tag on serial monitor (static string)
+    volatile log_level_t level;         // runtime log level, records with lower level are not logged
+} log_tag_t;
+
+/**
+ * @brief Struct representing a single slot of the log ring buffer.
+ *
+ * The `seq` field is used for synchronisation between producers and the log writer. A producer may write
+ * the slot only when `seq` equals its reserved position, the log writer may read it only when `seq` equals position + 1.
+ */
+typedef struct {
+    volatile uint32_t seq;              // slot sequence number
+    log_level_t level;                  // log level
+    uint8_t args_len;                   // number of captured argument bytes
+    bool args_truncated;                // arguments did not fit to the slot
+    unsigned long timestamp;            // time of logging (millis)
+    const log_tag_t* tag;               // log tag (static)
+    const char* fx;                     // function name (static string)
+    const char* format;                 // format string (static string)
+    uint8_t args[LOG_ARGS_MAX];         // captured raw arguments
+} log_record_t;
+
+/**
+ * @brief Struct holding the logger statistics.
+ */
+typedef struct {
+    uint32_t enqueued;                  // number of records accepted to the ring buffer
+    uint32_t dropped;                   // number of records dropped because the ring buffer was full
+    uint32_t written;                   // number of records written out by the log writer
+    uint32_t file_errors;               // number of failed attempts to open or write the log file
+} log_stats_t;
+
+/**
+ * @brief Callback called by the log writer for every written record (e.g. to stream the live log tail).
+ *
+ * @param seq Sequence number of the record (see `logHistoryGet()`).
+ * @param level Log level of the record.
+ * @param line Formatted record (same format as the text log file, without new line character).
+ *
+ * @warning The callback is executed by the log writer with the writer mutex held, it must not log and must not block.
+ */
+typedef void (*log_sink_t)(uint32_t seq, log_level_t level, const char* line);
+
+/**
+ * @brief Struct representing a log record kept in RTC memory.
+ */
+typedef struct {
+    uint8_t level;                      // log level
+    uint8_t tag;                        // tag id (`LOG_TAG_NONE` if the record has no tag)
+    uint32_t timestamp;                 // time of logging (millis)
+    char message[LOG_CRASH_MESSAGE_MAX];// formatted message (truncated)
+} log_crash_record_t;
+
+/**
+ * @brief Struct representing the circular buffer of the last log records kept in RTC memory.
+ *
+ * The same struct holds the crash report recovered during boot, the records are ordered from the oldest one
+ * and `reset_reason` holds the reason of the last reset (`esp_reset_reason_t`).
+ */
+typedef struct {
+    uint32_t magic;                     // LOG_CRASH_MAGIC if the content is valid
+    uint32_t head;                      // position of the next record
+    uint32_t count;                     // number of valid records
+    uint32_t reset_reason;              // reason of the reset (only in the recovered report)
+    log_crash_record_t records[LOG_CRASH_RECORDS];
+} log_crash_t;
+
+/**
+ * @brief Initialises the logger.
+ *
+ * This function prepares the ring buffer and creates the mutex protecting the log writer side. It has to be called
+ * once, after the SD card is mounted and before any other task starts logging. A later call (with the log file closed,
+ * see `logClose()`) recovers the segment store from the SD card again and keeps the mutexes.
+ *
+ * The segment store is recovered from the SD card. The numbered segments are scanned to find the oldest and
+ * the next generation, segments over the `LOG_SEGMENTS` limit are removed, and the active segment is rotated if its
+ * last write was torn (e.g. by a power loss), so the records of the new run start in a clean segment.
+ *
+ * The last log records of the previous run are recovered from RTC memory (unless the device was powered on),
+ * appended to `LOG_CRASH_FILE` together with the reset reason and kept in RAM for `logCrashGet()`.
+ *
+ * @return bool
+ * - `true` if the logger was initialised successfully.
+ * - `false` if the mutex could not be created.
+ *
+ * @details
+ * Until the log writer task (`handleTaskLog`) is created, every log call drains the ring buffer synchronously,
+ * so the messages logged during setup are written out immediately.
+ */
+bool initLog();
+
+/**
+ * @brief Drains the log ring buffer and writes all pending records to the serial monitor and the log file.
+ *
+ * This function is executed periodically by the log writer task, but it can be called from any task which needs
+ * all pending records written out (e.g. before reboot).
+ *
+ * @param force_flush If `true`, the log file is flushed to the SD card even if `LOG_FLUSH_PERIOD_MS` did not elapse yet.
+ *
+ * @return void
+ *
+ * @details
+ * The function performs the following actions:
+ * - Takes the writer mutex, so only one task drains the ring buffer at a time.
+ * - Formats every pending record from the captured arguments and prints it to the serial monitor.
+ * - Stores the formatted record to the RAM history for the live log tail and passes it to the log sink.
+ * - Collects the file lines (or binary records with `LOG_BINARY`) into a batch buffer, which is written to the log file in large chunks.
+ * - Keeps the log file open between calls and tracks its size in RAM, rotating it to the next numbered segment
+ *   when `LOG_FILE_MAX_SIZE` is reached and removing the oldest segment over `LOG_SEGMENTS`.
+ * - Reports the number of dropped records, if the ring buffer overflowed since the last call.
+ */
+void logFlush(bool force_flush = false);
+
+/**
+ * @brief Closes the log file handle held by the log writer.
+ *
+ * All pending records are written out first. The log file is reopened automatically by the next `logFlush()` call.
+ * This is useful before the log files are removed or downloaded.
+ *
+ * @return void
+ */
+void logClose();
+
+/**
+ * @brief Removes the active log segment and all rotated segments from the SD card.
+ *
+ * The generation counter is not reset, the next rotated segment continues with the next generation number.
+ *
+ * @return void
+ */
+void logClear();
+
+/**
+ * @brief Returns the range of the rotated log segments on the SD card.
+ *
+ * @param first Pointer where the generation of the oldest kept segment is stored.
+ * @param next Pointer where the generation of the next segment is stored (the newest kept segment is `next - 1`).
+ *
+ * @return bool
+ * - `true` if at least one rotated segment exists.
+ * - `false` if there are no rotated segments.
+ */
+bool logGetSegments(uint32_t* first, uint32_t* next);
+
+/**
+ * @brief Builds the path of the rotated log segment.
+ *
+ * @param generation Generation number of the segment.
+ * @param buffer Buffer where the path is stored.
+ * @param buffer_len Size of the buffer (at least 24 bytes).
+ *
+ * @return const char* Pointer to the buffer.
+ */
+const char* logSegmentPath(uint32_t generation, char* buffer, size_t buffer_len);
+
+/**
+ * @brief Returns the range of the sequence numbers of the records kept in RAM for the live log tail.
+ *
+ * @param first Pointer where the sequence number of the oldest kept record is stored.
+ * @param next Pointer where the sequence number of the next record is stored (no records kept if `first == next`).
+ *
+ * @return void
+ *
+ * @details
+ * Sequence numbers start at 1 and increase with every written record, so a client can resume the tail from
+ * the last sequence number it received. Records older than `first` were already overwritten.
+ */
+void logHistoryRange(uint32_t* first, uint32_t* next);
+
+/**
+ * @brief Copies the formatted record of the given sequence number kept in RAM.
+ *
+ * @param seq Sequence number of the record.
+ * @param buffer Buffer where the formatted record is stored.
+ * @param buffer_len Size of the buffer.
+ * @param level Optional pointer where the log level of the record is stored.
+ *
+ * @return bool
+ * - `true` if the record was copied.
+ * - `false` if the record was already overwritten or it was not written yet.
+ */
+bool logHistoryGet(uint32_t seq, char* buffer, size_t buffer_len, log_level_t* level = NULL);
+
+/**
+ * @brief Sets the callback called for every written record, `NULL` removes it.
+ *
+ * @param sink Callback function (see `log_sink_t`).
+ *
+ * @return void
+ */
+void logSetSink(log_sink_t sink);
+
+/**
+ * @brief Returns the crash report recovered from RTC memory during boot.
+ *
+ * @return const log_crash_t*
+ * - Pointer to the report with the last log records of the previous run and the reset reason.
+ * - `NULL` if the device was powered on (RTC memory content is not valid) or the report was already released.
+ */
+const log_crash_t* logCrashGet();
+
+/**
+ * @brief Releases the crash report recovered during boot (e.g. after it was published).
+ *
+ * @return void
+ */
+void logCrashRelease();
+
+/**
+ * @brief Returns the name of the reset reason (e.g. `PANIC`, `TASK_WDT`, `SW`).
+ *
+ * @param reason Reset reason (`esp_reset_reason_t`).
+ *
+ * @return const char* Name of the reset reason (static string).
+ */
+const char* logResetReasonName(uint32_t reason);
+
+/**
+ * @brief Returns the statistics of the logger.
+ *
+ * @return log_stats_t Copy of the logger statistics.
+ */
+log_stats_t logGetStats();
+
+/**
+ * @brief Checks whether the records of the given level are logged for the given tag.
+ *
+ * @param tag Log tag (`NULL` for records without tag, which are always logged).
+ * @param level Log level of the record.
+ *
+ * @return bool
+ * - `true` if the level is equal or higher than the runtime level of the tag.
+ * - `false` if the record would be filtered out.
+ */
+inline bool logLevelEnabled(const log_tag_t* tag, log_level_t level) {
+    return tag == NULL || level >= tag->level;
+}
+
+/**
+ * @brief Placeholder of the log calls removed at compile time by `LOG_LEVEL_MIN`.
+ *
+ * @return bool Always `true` (same as a record filtered out by the runtime level).
+ */
+inline bool logFiltered() {
+    return true;
+}
+
+/**
+ * @brief Sets the runtime log level of the tag.
+ *
+ * @param name Name of the tag (case insensitive, without padding, e.g. `ZIGBEE` or `lib-mqtt`), `all` or `*` sets all tags.
+ * @param level New runtime log level of the tag.
+ *
+ * @return bool
+ * - `true` if the level was set.
+ * - `false` if no tag of this name exists or the level is invalid.
+ */
+bool logSetLevel(const char* name, log_level_t level);
+
+/**
+ * @brief Parses the name of the log level.
+ *
+ * @param str Name of the level (`info`, `warn`, `warning`, `error`, the first letter or the number of the level).
+ * @param level Pointer where the parsed level is stored.
+ *
+ * @return bool
+ * - `true` if the level was parsed successfully.
+ * - `false` if the string is not a valid level name.
+ */
+bool logParseLevel(const char* str, log_level_t* level);
+
+/**
+ * @brief Returns the name of the log level (`info`, `warn` or `error`).
+ *
+ * @param level Log level.
+ *
+ * @return const char* Name of the level (static string).
+ */
+const char* logLevelName(log_level_t level);
+
+/**
+ * @brief Returns the name of the tag without padding.
+ *
+ * @param tag Log tag.
+ * @param buffer Buffer where the name is stored.
+ * @param buffer_len Size of the buffer.
+ *
+ * @return const char* Pointer to the buffer.
+ */
+const char* logTagName(const log_tag_t* tag, char* buffer, size_t buffer_len);
+
+/**
+ * @brief Enqueues a log record of the given level to the log ring buffer.
+ *
+ * This function is called by the `esplogI` and `esplogW` macros after the level of the record was checked,
+ * it does not check the runtime level of the tag by itself.
+ *
+ * @param level Log level of the record.
+ * @param tag Optional tag associated with the log message.
+ * @param fx Optional string representing the function name where the log is being generated.
+ * @param format A format string for the log message (string literal), similar to `printf` format.
+ *
+ * @return bool
+ * - `true` if the log message was enqueued successfully.
+ * - `false` if the ring buffer was full and the message was dropped.
+ */
+bool logWrite(log_level_t level, const log_tag_t* tag, const char* fx, const char* format, ...);
+
+/**
+ * @brief Logs an informational message to both the serial monitor and a log file.
+ *
+ * This macro formats an informational log message, including a timestamp, and enqueues it to the log ring buffer.
+ * The message is written to the serial monitor and appended to the log file on the SD card by the log writer task.
+ *
+ * @param tag Optional tag associated with the log message. If provided, it will be printed before the message.
+ * @param fx Optional string representing the function name where the log is being generated. If provided, it will be printed in parentheses after the message.
+ * @param format A format string for the log message, similar to `printf` format. Additional parameters can be passed to format the message.
+ *               It has to be a string literal, the record references it until it is written out by the log writer task.
+ *
+ * @return bool
+ * - `true` if the log message was enqueued successfully or it was filtered out by its level.
+ * - `false` if the ring buffer was full and the message was dropped.
+ *
+ * @details
+ * The macro performs the following actions:
+ * - Checks the runtime level of the tag, the arguments are not evaluated when the record is filtered out.
+ *   The call is removed completely when `LOG_LEVEL_MIN` is higher than info.
+ * - Retrieves the current timestamp in milliseconds using `millis()`.
+ * - Reserves a slot in the log ring buffer in O(1), without locking.
+ * - Walks the format string and copies the raw arguments into the reserved slot (strings are copied by value,
+ *   so temporary strings may be passed). The message is not formatted by the calling task.
+ * - Publishes the slot to the log writer task, which formats and outputs it to the serial monitor with a color-coded
+ *   format indicating it is an informational log (green), and appends it to the log file (as text or binary record).
+ *
+ * This function is useful for generating logs that include timestamps, tags, and function names, helping with debugging and monitoring system behavior.
+ */
+#if LOG_LEVEL_MIN > 0
+#define esplogI(tag, fx, format, ...) logFiltered()
+#else
+#define esplogI(tag, fx, format, ...) \
+    (logLevelEnabled((tag), LOG_LEVEL_INFO) ? logWrite(LOG_LEVEL_INFO, (tag), (fx), (format), ##__VA_ARGS__) : true)
+#endif
+
+/**
+ * @brief Logs a warning message to both the serial monitor and a log file.
+ *
+ * This macro formats a warning log message, including a timestamp, and enqueues it to the log ring buffer.
+ * The message is written to the serial monitor and appended to the log file on the SD card by the log writer task.
+ *
+ * @param tag Optional tag associated with the log message. If provided, it will be printed before the message.
+ * @param fx Optional string representing the function name where the log is being generated. If provided, it will be printed in parentheses after the message.
+ * @param format A format string for the log message, similar to `printf` format. Additional parameters can be passed to format the message.
+ *               It has to be a string literal, the record references it until it is written out by the log writer task.
+ *
+ * @return bool
+ * - `true` if the log message was enqueued successfully or it was filtered out by its level.
+ * - `false` if the ring buffer was full and the message was dropped.
+ *
+ * @details
+ * The macro performs the same actions as `esplogI`, the record is output as a warning log (yellow).
+ * The log writer task is woken up immediately, so the warning is not delayed by the writer period.
+ *
+ * This function is useful for generating logs that highlight warnings or potential issues, including relevant context like tags and function names.
+ */
+#define esplogW(tag, fx, format, ...) \
+    (logLevelEnabled((tag), LOG_LEVEL_WARN) ? logWrite(LOG_LEVEL_WARN, (tag), (fx), (format), ##__VA_ARGS__) : true)
+
+/**
+ * @brief Logs an error message to both the serial monitor and a log file, and reboots the system.
+ *
+ * This function formats an error log message, including a timestamp, and enqueues it to the log ring buffer.
+ * The message is stored to RTC memory first, so it survives the reboot even if the SD card write fails.
+ * All pending log records are then written out synchronously and the system is rebooted using the `rebootESP` function.
+ *
+ * @param tag Optional tag associated with the log message. If provided, it will be printed before the message.
+ * @param fx Optional string representing the function name where the log is being generated. If provided, it will be printed in parentheses after the message.
+ * @param format A format string for the log message, similar to `printf` format. Additional parameters can be passed to format the message.
+ *               It has to be a string literal, the record references it until it is written out by the log writer task.
+ *
+ * @return bool
+ * - `true` if the log message was enqueued successfully.
+ * - `false` if the ring buffer was full and the message was dropped.
+ *
+ * @details
+ * The function performs the same actions as `esplogI`, the record is output as an error log (red).
+ * Error records are never filtered out, neither at compile time nor by the runtime level of the tag.
+ * Afterwards it calls `logFlush()` so the error is stored on the SD card before the `rebootESP` function is called.
+ *
+ * This function is useful for logging critical errors that require the system to reboot in order to recover.
+ */
+bool esplogE(const log_tag_t* tag, const char* fx, const char* format, ...);
+
+#endif
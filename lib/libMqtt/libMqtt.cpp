@@ -8,153 +8,1568 @@ extern g_vars_t * g_vars_ptr;
 extern g_config_t * g_config_ptr;
 extern QueueHandle_t mqttQueue;
 
+static bool mqtt_publish_load(const char * topic, const uint8_t * load, size_t len, bool retained);
+static bool mqtt_send(const char * topic, const uint8_t * load, size_t len, bool retained);
+static bool mqtt_log_line(const char * load, size_t len);
+
+// command topics below the configured topic, a further level is the correlation id (e.g. <topic>/write/in/42)
+static const char * const mqtt_command_paths[MQTT_COMMAND_MAX] = {"/write/in", "/read/in", "/device/in", "/rules/in", "/log/level/in"};
+static const char * const mqtt_command_names[MQTT_COMMAND_MAX] = {"write", "read", "device", "rules", "log_level"};
+
+typedef struct {
+    mqtt_command_kind_t kind;
+    char id[MQTT_COMMAND_ID_MAX + 1];   // correlation id ("" if the topic has none)
+    char * load;                        // copy of the payload (null terminated), freed by the command worker
+    size_t len;                         // length of the payload (a MessagePack payload may contain zeros)
+} mqtt_command_t;
+
+// acknowledge of a Zigbee frame of a command, the token identifies the command slot and its generation
+typedef struct {
+    uint32_t token;
+    bool success;
+} mqtt_command_ack_t;
+
+// read/write command waiting for the acknowledges of its Zigbee frames (owned by the command worker only)
+typedef struct {
+    bool used;
+    uint32_t generation;
+    mqtt_command_kind_t kind;
+    char id[MQTT_COMMAND_ID_MAX + 1];
+    size_t frames;
+    size_t acked;
+    size_t failed;
+    bool incomplete;                    // not all attributes were sent to the Zigbee module
+    unsigned long started;
+} mqtt_command_slot_t;
+
+static QueueHandle_t mqtt_command_queue = NULL;
+static QueueHandle_t mqtt_command_acks = NULL;
+// counts the queued commands and acknowledges, so the worker can wait for both queues at once
+static SemaphoreHandle_t mqtt_command_pending = NULL;
+static mqtt_command_slot_t mqtt_command_slots[MQTT_COMMAND_SLOTS];
+static uint32_t mqtt_command_generation = 0;
+
+bool mqtt_command_init() {
+    if (mqtt_command_pending != NULL) {
+        return true;
+    }
+
+    mqtt_command_queue = xQueueCreate(MQTT_COMMAND_QUEUE_SIZE, sizeof(mqtt_command_t));
+    mqtt_command_acks = xQueueCreate(MQTT_COMMAND_ACKS_SIZE, sizeof(mqtt_command_ack_t));
+    mqtt_command_pending = xSemaphoreCreateCounting(MQTT_COMMAND_QUEUE_SIZE + MQTT_COMMAND_ACKS_SIZE, 0);
+
+    return mqtt_command_queue != NULL && mqtt_command_acks != NULL && mqtt_command_pending != NULL;
+}
+
+// publishes the result of a command to <topic>/command/out/<id>
+static void mqtt_command_reply(mqtt_command_kind_t kind, const char * id, const char * status, const mqtt_command_slot_t * slot, bool log) {
+    JsonDocument doc;
+    doc["id"] = id;
+    doc["command"] = mqtt_command_names[kind];
+    doc["status"] = status;
+    if (slot != NULL) {
+        doc["frames"] = slot->frames;
+        doc["acked"] = slot->acked;
+        doc["failed"] = slot->failed;
+        doc["duration_ms"] = millis() - slot->started;
+    }
+
+    char topic[MQTT_OUTBOX_TOPIC_MAX];
+    char load[MQTT_COMMAND_REPLY_MAX];
+    int topic_len = snprintf(topic, sizeof(topic), "%s/command/out%s%s", g_config_ptr->mqtt_topic.c_str(), id[0] != '\0' ? "/" : "", id);
+    size_t len = serializeJson(doc, load, sizeof(load));
+    if (topic_len <= 0 || (size_t)topic_len >= sizeof(topic) || len == 0) {
+        esplogW(TAG_LIB_MQTT, "(mqtt_command_reply)", "Failed to build the command result! (id: %s, status: %s)", id, status);
+        return;
+    }
+
+    // the rejected commands are answered from mqtt.loop() with the client locked, they are sent right away (the outbox
+    // is locked before the client by the publishing tasks) and the SD card log is skipped there
+    if (log) {
+        mqtt_publish_raw(topic, load, len);
+    } else {
+        mqtt_send(topic, (const uint8_t *)load, len, false);
+    }
+}
+
+static bool mqtt_command_enqueue(mqtt_command_kind_t kind, const char * id, const byte * message, unsigned int length) {
+    if (mqtt_command_pending == NULL) {
+        return false;
+    }
+
+    mqtt_command_t command;
+    command.kind = kind;
+    strlcpy(command.id, id, sizeof(command.id));
+    command.load = (char *)malloc(length + 1);
+    if (command.load == NULL) {
+        return false;
+    }
+    memcpy(command.load, message, length);
+    command.load[length] = '\0';
+    command.len = length;
+
+    if (xQueueSend(mqtt_command_queue, &command, 0) != pdPASS) {
+        free(command.load);
+        return false;
+    }
+
+    xSemaphoreGive(mqtt_command_pending);
+    return true;
+}
+
 void mqtt_callback(char* topic, byte* message, unsigned int length) {
-    String mqtt_topic = String(topic);
-    String mqtt_load;
-    for (int i = 0; i < length; i++) {
-        mqtt_load += (char)message[i];
+    // only the topic is classified here, the command is executed by the command worker (see mqtt_command_process()),
+    // so mqtt.loop() never waits for the UART or the SD card and the keepalives are not delayed
+    const char * prefix = g_config_ptr->mqtt_topic.c_str();
+    size_t prefix_len = g_config_ptr->mqtt_topic.length();
+    mqtt_command_kind_t kind = MQTT_COMMAND_MAX;
+    const char * id = "";
+
+    if (strncmp(topic, prefix, prefix_len) == 0) {
+        for (int i = 0; i < MQTT_COMMAND_MAX; i++) {
+            size_t path_len = strlen(mqtt_command_paths[i]);
+            const char * rest = topic + prefix_len + path_len;
+            if (strncmp(topic + prefix_len, mqtt_command_paths[i], path_len) == 0 && (*rest == '\0' || *rest == '/')) {
+                kind = (mqtt_command_kind_t)i;
+                id = *rest == '/' ? rest + 1 : rest;
+                break;
+            }
+        }
     }
 
-    String write_prefix = g_config_ptr->mqtt_topic + String("/write/in");
-    String read_prefix  = g_config_ptr->mqtt_topic + String("/read/in");
+    if (kind == MQTT_COMMAND_MAX) {
+        esplogW(TAG_LIB_MQTT, "(mqtt_callback)", "Undefined MQTT message was received! (topic: %s, length: %u)", topic, length);
+        return;
+    }
 
-    if (mqtt_topic.startsWith(write_prefix)) {
-        esplogI(TAG_LIB_MQTT, "(mqtt_callback)", "MQTT write command received! (topic: %s, load: %s)", mqtt_topic.c_str(), mqtt_load.c_str());
+    if (strlen(id) > MQTT_COMMAND_ID_MAX) {
+        esplogW(TAG_LIB_MQTT, "(mqtt_callback)", "MQTT command id is too long, command ignored! (topic: %s, max: %d)", topic, MQTT_COMMAND_ID_MAX);
+        return;
+    }
 
-        esp_zb_ieee_addr_t ieee_addr;
-        iot_alarm_attr_load_t* attr = create_attr("\0", "\0", "\0", 0, ieee_addr, 0, 0, 0, 0, 0, ESP_ZB_ZCL_ATTR_TYPE_U8, 0);
-        if (unpack_attr(attr, mqtt_load)) {
-            esplogI(TAG_LIB_MQTT, "(mqtt_callback)", "MQTT message was unpacked successfully!");
-            zigbeeAttrWrite(attr);
-        } else {
-            esplogW(TAG_LIB_MQTT, "(mqtt_callback)", "Failed to unpack MQTT message!");
+    esplogI(TAG_LIB_MQTT, "(mqtt_callback)", "MQTT %s command received! (topic: %s, length: %u)", mqtt_command_names[kind], topic, length);
+    if (!mqtt_command_enqueue(kind, id, message, length)) {
+        esplogW(TAG_LIB_MQTT, "(mqtt_callback)", "MQTT command queue is full, command rejected! (topic: %s)", topic);
+        mqtt_command_reply(kind, id, "busy", NULL, false);
+    }
+}
+
+// called by the zigbee task, the acknowledge is only passed to the command worker
+static void mqtt_command_done(uint8_t seq, message_type_t id, bool success, void* ctx) {
+    mqtt_command_ack_t ack = {(uint32_t)(uintptr_t)ctx, success};
+    if (xQueueSend(mqtt_command_acks, &ack, 0) != pdPASS) {
+        // the command is reported as timed out
+        esplogW(TAG_LIB_MQTT, "(mqtt_command_done)", "MQTT command acknowledge dropped! (seq: %d)", seq);
+        return;
+    }
+    xSemaphoreGive(mqtt_command_pending);
+}
+
+static void mqtt_command_finish(mqtt_command_slot_t * slot, const char * status) {
+    esplogI(TAG_LIB_MQTT, "(mqtt_command_finish)", "MQTT %s command finished! (id: %s, status: %s, frames: %u, acked: %u, failed: %u)",
+        mqtt_command_names[slot->kind], slot->id, status, (unsigned)slot->frames, (unsigned)slot->acked, (unsigned)slot->failed);
+    mqtt_command_reply(slot->kind, slot->id, status, slot, true);
+    slot->used = false;
+}
+
+static void mqtt_command_ack(const mqtt_command_ack_t * ack) {
+    mqtt_command_slot_t * slot = &mqtt_command_slots[ack->token % MQTT_COMMAND_SLOTS];
+    // a late acknowledge of a command which already timed out
+    if (!slot->used || slot->generation != ack->token / MQTT_COMMAND_SLOTS) {
+        return;
+    }
+
+    if (ack->success) {
+        slot->acked++;
+    } else {
+        slot->failed++;
+    }
+
+    if (slot->acked + slot->failed >= slot->frames) {
+        mqtt_command_finish(slot, slot->failed == 0 && !slot->incomplete ? "done" : "failed");
+    }
+}
+
+// MessagePack map (fixmap, map16, map32) and array (fixarray, array16, array32), no JSON text starts with these bytes
+static bool mqtt_msgpack_map(uint8_t c) {
+    return (c >= 0x80 && c <= 0x8F) || c == 0xDE || c == 0xDF;
+}
+
+static bool mqtt_msgpack_array(uint8_t c) {
+    return (c >= 0x90 && c <= 0x9F) || c == 0xDC || c == 0xDD;
+}
+
+// parses the attributes and sends them to the Zigbee module, the frames are acknowledged through the callback
+// (JSON and MessagePack commands are accepted whatever the configured format is, they are told apart by the first byte)
+static bool mqtt_attr_command(const char * load, size_t len, bool write, zigbee_command_cb_t cb, void * ctx, size_t * frames) {
+    *frames = 0;
+
+    const uint8_t first = len > 0 ? (uint8_t)load[0] : 0;
+    bool msgpack = mqtt_msgpack_map(first) || mqtt_msgpack_array(first);
+    if (!msgpack) {
+        while (isspace((unsigned char)*load)) {
+            load++;
+        }
+    }
+
+    // an array of attributes is sent as one batched command
+    if (msgpack ? mqtt_msgpack_array(first) : *load == '[') {
+        iot_alarm_attr_load_t * attrs = (iot_alarm_attr_load_t *)calloc(MQTT_ATTR_BATCH_MAX, sizeof(iot_alarm_attr_load_t));
+        if (attrs == NULL) {
+            esplogW(TAG_LIB_MQTT, "(mqtt_attr_command)", "Failed to allocate memory for attributes!");
+            return false;
         }
-        destroy_attr(&attr);
-    } else if (mqtt_topic.startsWith(read_prefix)) {
-        esplogI(TAG_LIB_MQTT, "(mqtt_callback)", "MQTT read command received! (topic: %s, load: %s)", mqtt_topic.c_str(), mqtt_load.c_str());
 
-        esp_zb_ieee_addr_t ieee_addr;
-        iot_alarm_attr_load_t* attr = create_attr("\0", "\0", "\0", 0, ieee_addr, 0, 0, 0, 0, 0, ESP_ZB_ZCL_ATTR_TYPE_U8, 0);
-        if (unpack_attr(attr, mqtt_load)) {
-            esplogI(TAG_LIB_MQTT, "(mqtt_callback)", "MQTT message was unpacked successfully!");
-            zigbeeAttrRead(attr);
+        size_t count = 0;
+        bool ret = msgpack ?
+            unpack_attr_batch_msgpack(attrs, MQTT_ATTR_BATCH_MAX, &count, (const uint8_t *)load, len) :
+            unpack_attr_batch(attrs, MQTT_ATTR_BATCH_MAX, &count, String(load));
+        if (ret) {
+            esplogI(TAG_LIB_MQTT, "(mqtt_attr_command)", "MQTT message was unpacked successfully! (attributes: %u)", (unsigned)count);
+            ret = write ? zigbeeAttrWriteBatch(attrs, count, cb, ctx, frames) : zigbeeAttrReadBatch(attrs, count, cb, ctx, frames);
         } else {
-            esplogW(TAG_LIB_MQTT, "(mqtt_callback)", "Failed to unpack MQTT message!");
+            esplogW(TAG_LIB_MQTT, "(mqtt_attr_command)", "Failed to unpack MQTT message!");
         }
-        destroy_attr(&attr);
+
+        free(attrs);
+        return ret;
+    }
+
+    esp_zb_ieee_addr_t ieee_addr;
+    iot_alarm_attr_load_t* attr = create_attr("\0", "\0", "\0", 0, ieee_addr, 0, 0, 0, 0, 0, ESP_ZB_ZCL_ATTR_TYPE_U8, 0);
+    bool ret = attr != NULL && (msgpack ? unpack_attr_msgpack(attr, (const uint8_t *)load, len) : unpack_attr(attr, String(load)));
+    if (ret) {
+        esplogI(TAG_LIB_MQTT, "(mqtt_attr_command)", "MQTT message was unpacked successfully!");
+        ret = write ? zigbeeAttrWrite(attr, cb, ctx) : zigbeeAttrRead(attr, cb, ctx);
+        *frames = ret ? 1 : 0;
     } else {
-        esplogW(TAG_LIB_MQTT, "(mqtt_callback)", "Undefined MQTT message was received! (topic: %s, load: %s)", mqtt_topic.c_str(), mqtt_load.c_str());
+        esplogW(TAG_LIB_MQTT, "(mqtt_attr_command)", "Failed to unpack MQTT message!");
     }
+    destroy_attr(&attr);
+    return ret;
 }
 
-bool mqtt_publish(String topic, String load) {
+static void mqtt_command_execute(mqtt_command_t * command) {
+    if (command->kind == MQTT_COMMAND_WRITE || command->kind == MQTT_COMMAND_READ) {
+        mqtt_command_slot_t * slot = NULL;
+        size_t index = 0;
+        for (; index < MQTT_COMMAND_SLOTS; index++) {
+            if (!mqtt_command_slots[index].used) {
+                slot = &mqtt_command_slots[index];
+                break;
+            }
+        }
+
+        if (slot == NULL) {
+            esplogW(TAG_LIB_MQTT, "(mqtt_command_execute)", "Too many MQTT commands in flight, command rejected! (id: %s)", command->id);
+            mqtt_command_reply(command->kind, command->id, "busy", NULL, true);
+            return;
+        }
+
+        // the generation tells a late acknowledge of the previous command in the slot apart
+        slot->used = true;
+        slot->generation = ++mqtt_command_generation;
+        slot->kind = command->kind;
+        strlcpy(slot->id, command->id, sizeof(slot->id));
+        slot->frames = 0;
+        slot->acked = 0;
+        slot->failed = 0;
+        slot->started = millis();
+
+        void * ctx = (void *)(uintptr_t)(slot->generation * MQTT_COMMAND_SLOTS + index);
+        slot->incomplete = !mqtt_attr_command(command->load, command->len, command->kind == MQTT_COMMAND_WRITE, mqtt_command_done, ctx, &slot->frames);
+
+        // nothing was sent, no acknowledge will come (the acknowledges of the sent frames are handled later by this task)
+        if (slot->frames == 0) {
+            mqtt_command_finish(slot, "failed");
+        }
+        return;
+    }
+
+    String load(command->load);
+    load.trim();
+
     bool ret = false;
-    const int maxMessageSize = 200;
-
-    if (mqtt.connected()) {
-        esplogI(TAG_LIB_MQTT, "(mqtt_publish)", "Publishing: [%s] \n%s", topic.c_str(), load.c_str());
-        if (load.length() > maxMessageSize) {
-            int numChunks = load.length() / maxMessageSize + (load.length() % maxMessageSize != 0);
-
-            if (mqtt.beginPublish(topic.c_str(), load.length(), false)) {
-                for (int i = 0; i < numChunks; i++) {
-                    int startIdx = i * maxMessageSize;
-                    int endIdx = (i + 1) * maxMessageSize;
-                    String chunk = load.substring(startIdx, endIdx);
-                    
-                    mqtt.print(chunk);
-                    // esplogI(TAG_LIB_MQTT, "(mqtt_publish)", "Published chunk %d of %d", i + 1, numChunks);
-                }
+    switch (command->kind) {
+        case MQTT_COMMAND_DEVICE:
+            ret = mqtt_device_info(load);
+            break;
+        case MQTT_COMMAND_RULES:
+            ret = mqtt_rules(load);
+            break;
+        case MQTT_COMMAND_LOG_LEVEL:
+            ret = mqtt_log_level(load);
+            break;
+        default:
+            break;
+    }
 
-                if (mqtt.endPublish()) {
-                    esplogI(TAG_LIB_MQTT, "(mqtt_publish)", "MQTT message (splitted) published successfully!");
-                    ret = true;
-                } else {
-                    esplogW(TAG_LIB_MQTT, "(mqtt_publish)", "Error occured during publishing chunks!");
-                    ret = false;
-                }
+    mqtt_command_reply(command->kind, command->id, ret ? "done" : "failed", NULL, true);
+}
+
+void mqtt_command_process(TickType_t timeout) {
+    if (mqtt_command_pending == NULL) {
+        vTaskDelay(timeout);
+        return;
+    }
+
+    // the count can be ahead of the queues (a dropped acknowledge), then it is only consumed
+    if (xSemaphoreTake(mqtt_command_pending, timeout) == pdTRUE) {
+        mqtt_command_ack_t ack;
+        mqtt_command_t command;
+        if (xQueueReceive(mqtt_command_acks, &ack, 0) == pdPASS) {
+            mqtt_command_ack(&ack);
+        } else if (xQueueReceive(mqtt_command_queue, &command, 0) == pdPASS) {
+            mqtt_command_execute(&command);
+            free(command.load);
+        }
+    }
+
+    // every frame is acknowledged or failed by the zigbee task at its deadline, this covers a dropped acknowledge
+    for (size_t i = 0; i < MQTT_COMMAND_SLOTS; i++) {
+        mqtt_command_slot_t * slot = &mqtt_command_slots[i];
+        if (slot->used && millis() - slot->started >= MQTT_COMMAND_TIMEOUT_MS) {
+            mqtt_command_finish(slot, "timeout");
+        }
+    }
+}
+
+bool mqtt_attr_batch(String load, bool write) {
+    size_t frames;
+    return mqtt_attr_command(load.c_str(), load.length(), write, NULL, NULL, &frames);
+}
 
-            } else {
-                esplogW(TAG_LIB_MQTT, "(mqtt_publish)", "Failed to begin publish for the whole message!");
+bool mqtt_log_level(String load) {
+    bool ret = true;
+
+    if (load.length() > 0) {
+        JsonDocument doc;
+        DeserializationError error = deserializeJson(doc, load);
+        if (error || !doc.is<JsonObject>()) {
+            esplogW(TAG_LIB_MQTT, "(mqtt_log_level)", "Failed to parse log level command! (%s)", error.c_str());
+            return false;
+        }
+
+        for (JsonPair kv : doc.as<JsonObject>()) {
+            log_level_t level;
+            const char* level_str = kv.value().as<const char*>();
+            if (!logParseLevel(level_str, &level) || !logSetLevel(kv.key().c_str(), level)) {
+                esplogW(TAG_LIB_MQTT, "(mqtt_log_level)", "Invalid log level command! (tag: %s, level: %s)", kv.key().c_str(), level_str);
                 ret = false;
+                continue;
+            }
+            esplogI(TAG_LIB_MQTT, "(mqtt_log_level)", "Log level of '%s' set to: %s", kv.key().c_str(), logLevelName(level));
+        }
+    }
+
+    // reply with the current log levels of all tags
+    JsonDocument levels;
+    char name[16];
+    for (int i = 0; i < TAG_ID_MAX; i++) {
+        levels[logTagName(&log_tags[i], name, sizeof(name))] = logLevelName(log_tags[i].level);
+    }
+
+    String reply;
+    serializeJson(levels, reply);
+    mqtt_publish(g_config_ptr->mqtt_topic + String("/log/level/out"), reply);
+    return ret;
+}
+
+bool mqtt_rules(String load) {
+    // an empty payload reloads the rule file from the SD card
+    bool applied = false;
+    bool ret = load.length() > 0 ? zigbeeRulesUpdate(load, &applied) : zigbeeRulesLoad();
+    if (!ret && applied) {
+        esplogW(TAG_LIB_MQTT, "(mqtt_rules)", "Report rules applied, but they could not be saved to the SD card!");
+    } else if (!ret) {
+        esplogW(TAG_LIB_MQTT, "(mqtt_rules)", "Failed to apply report rules, the active rules are kept!");
+    }
+
+    String reply;
+    if (zigbeeRulesDump(&reply)) {
+        mqtt_publish(g_config_ptr->mqtt_topic + String("/rules/out"), reply);
+    }
+    return ret;
+}
+
+bool mqtt_device_info(String load) {
+    JsonDocument doc;
+    DeserializationError error = deserializeJson(doc, load);
+    if (error || !doc["ieee"].is<const char *>()) {
+        esplogW(TAG_LIB_MQTT, "(mqtt_device_info)", "Failed to parse device info request! (%s)", error.c_str());
+        return false;
+    }
+
+    esp_zb_ieee_addr_t ieee_addr;
+    const char *ieee = doc["ieee"];
+    if (sscanf(ieee, "%hhX:%hhX:%hhX:%hhX:%hhX:%hhX:%hhX:%hhX",
+               &ieee_addr[7], &ieee_addr[6], &ieee_addr[5], &ieee_addr[4],
+               &ieee_addr[3], &ieee_addr[2], &ieee_addr[1], &ieee_addr[0]) != 8) {
+        esplogW(TAG_LIB_MQTT, "(mqtt_device_info)", "Invalid IEEE address! (%s)", ieee);
+        return false;
+    }
+
+    // unknown devices are requested from the zigbee module, the metadata are published when they arrive
+    zigbee_device_t dev;
+    if (!device_registry_find_ieee(ieee_addr, &dev)) {
+        return zigbeeDeviceInfoRequest(0, ieee_addr);
+    }
+
+    String jsonStr;
+    if (!pack_device(&dev, &jsonStr)) {
+        return false;
+    }
+
+    char ieee_str[ZIGBEE_IEEE_STR_SIZE];
+    zigbee_ieee_str(ieee_addr, ieee_str);
+
+    return mqtt_publish(g_config_ptr->mqtt_topic + String("/device/") + ieee_str, jsonStr, true);
+}
+
+bool mqtt_publish_crash_report() {
+    const log_crash_t * report = logCrashGet();
+    if (report == NULL) {
+        return true;
+    }
+
+    JsonDocument doc;
+    doc["reset_reason"] = logResetReasonName(report->reset_reason);
+    JsonArray records = doc["records"].to<JsonArray>();
+
+    char name[16];
+    for (uint32_t i = 0; i < report->count; i++) {
+        const log_crash_record_t * record = &report->records[i];
+        JsonObject r = records.add<JsonObject>();
+        r["level"] = logLevelName((log_level_t)record->level);
+        r["timestamp"] = record->timestamp;
+        r["tag"] = record->tag < TAG_ID_MAX ? logTagName(&log_tags[record->tag], name, sizeof(name)) : "";
+        r["message"] = (const char*)record->message;
+    }
+
+    String load;
+    serializeJson(doc, load);
+    if (!mqtt_publish(g_config_ptr->mqtt_topic + String("/log/crash"), load)) {
+        esplogW(TAG_LIB_MQTT, "(mqtt_publish_crash_report)", "Failed to publish crash report, retrying on next connection!");
+        return false;
+    }
+
+    logCrashRelease();
+    return true;
+}
+
+// PubSubClient is not thread safe, every call to it is made with this lock held (recursive, the callback publishes
+// from mqtt.loop()), the outbox mutex is always taken before it
+static SemaphoreHandle_t mqtt_client_mutex = NULL;
+// the other tasks use the client only while it is connected, so they never wait for mqtt.connect()
+static volatile bool mqtt_client_online = false;
+
+bool mqtt_client_init() {
+    if (mqtt_client_mutex == NULL) {
+        mqtt_client_mutex = xSemaphoreCreateRecursiveMutex();
+    }
+    return mqtt_client_mutex != NULL;
+}
+
+void mqtt_client_lock() {
+    if (mqtt_client_mutex != NULL) {
+        xSemaphoreTakeRecursive(mqtt_client_mutex, portMAX_DELAY);
+    }
+}
+
+void mqtt_client_unlock() {
+    if (mqtt_client_mutex != NULL) {
+        xSemaphoreGiveRecursive(mqtt_client_mutex);
+    }
+}
+
+bool mqtt_client_connected() {
+    mqtt_client_lock();
+    bool connected = mqtt.connected();
+    mqtt_client_unlock();
+    return connected;
+}
+
+// publishes the message right away
+static bool mqtt_send(const char * topic, const uint8_t * load, size_t len, bool retained) {
+    mqtt_client_lock();
+
+    // the load is streamed to the client from the caller's buffer (not copied to the client buffer first),
+    // the client may take only a part of it per write
+    if (!mqtt.beginPublish(topic, len, retained)) {
+        mqtt_client_unlock();
+        esplogW(TAG_LIB_MQTT, "(mqtt_publish)", "Failed to begin publish for the whole message!");
+        return false;
+    }
+
+    size_t written = 0;
+    while (written < len) {
+        size_t chunk = mqtt.write(load + written, len - written);
+        if (chunk == 0) {
+            break;
+        }
+        written += chunk;
+    }
+
+    bool ended = mqtt.endPublish();
+    mqtt_client_unlock();
+
+    if (!ended || written != len) {
+        esplogW(TAG_LIB_MQTT, "(mqtt_publish)", "Error occured during publishing chunks! (written: %u of %u)", (unsigned)written, (unsigned)len);
+        return false;
+    }
+
+    esplogI(TAG_LIB_MQTT, "(mqtt_publish)", "MQTT message published successfully!");
+    return true;
+}
+
+// *********************************************************************************************************************
+
+#define MQTT_OUTBOX_RECORD_MAGIC 0xA5U      // first byte of every message in the outbox segments
+#define MQTT_OUTBOX_RECORD_HEADER 10        // magic, flags, topic length (2), load length (4), CRC16 of topic and load (2)
+#define MQTT_OUTBOX_FLAG_RETAINED 0x01U
+
+static SemaphoreHandle_t mqtt_outbox_mutex = NULL;
+static File mqtt_outbox_file;                                   // segment the messages are appended to (kept open)
+static bool mqtt_outbox_file_opened = false;
+static uint32_t mqtt_outbox_head = 0;                           // generation of the oldest segment
+static uint32_t mqtt_outbox_head_offset = 0;                    // offset of the next message in the oldest segment
+static uint32_t mqtt_outbox_tail = 0;                           // generation of the segment the messages are appended to
+static uint32_t mqtt_outbox_counts[MQTT_OUTBOX_SEGMENTS];       // messages left in the segments (by generation % MQTT_OUTBOX_SEGMENTS)
+static uint32_t mqtt_outbox_sizes[MQTT_OUTBOX_SEGMENTS];        // size of the complete messages in the segments
+static uint8_t mqtt_outbox_cache[MQTT_OUTBOX_CACHE_SIZE];       // block of the oldest segment read ahead
+static uint32_t mqtt_outbox_cache_offset = 0;
+static uint32_t mqtt_outbox_cache_len = 0;
+static uint32_t mqtt_outbox_credit = 0;                         // drain rate credit (thousandths of a message)
+static unsigned long mqtt_outbox_drain_time = 0;
+static unsigned long mqtt_outbox_head_saved = 0;
+static bool mqtt_outbox_head_dirty = false;                     // the drain position changed since it was saved
+static unsigned long mqtt_outbox_offline_since = 0;
+static bool mqtt_outbox_offline = true;                         // offline until the first connection
+static bool mqtt_outbox_report = false;                         // the statistics are published when the outage backlog is drained
+static mqtt_outbox_stats_t mqtt_outbox_stats = {};
+
+static const char* mqtt_outbox_path(uint32_t generation, char* buffer, size_t buffer_len) {
+    snprintf(buffer, buffer_len, "%s/%s%08lu%s", MQTT_OUTBOX_DIR, MQTT_OUTBOX_SEGMENT_PREFIX, (unsigned long)generation, MQTT_OUTBOX_SEGMENT_EXT);
+    return buffer;
+}
+
+static bool mqtt_outbox_parse(const char* name, uint32_t* generation) {
+    // older cores return the full path of the directory entry
+    const char* base = strrchr(name, '/');
+    base = base != NULL ? base + 1 : name;
+
+    size_t prefix_len = strlen(MQTT_OUTBOX_SEGMENT_PREFIX);
+    if (strncmp(base, MQTT_OUTBOX_SEGMENT_PREFIX, prefix_len) != 0) {
+        return false;
+    }
+
+    char* end;
+    unsigned long value = strtoul(base + prefix_len, &end, 10);
+    if (end == base + prefix_len || strcmp(end, MQTT_OUTBOX_SEGMENT_EXT) != 0) {
+        return false;
+    }
+
+    *generation = (uint32_t)value;
+    return true;
+}
+
+static void mqtt_outbox_header(uint8_t * header, const char * topic, uint16_t topic_len, const uint8_t * load, uint32_t load_len, bool retained) {
+    uint16_t crc = zigbee_crc16(0xFFFF, (const uint8_t *)topic, topic_len);
+    crc = zigbee_crc16(crc, load, load_len);
+
+    header[0] = MQTT_OUTBOX_RECORD_MAGIC;
+    header[1] = retained ? MQTT_OUTBOX_FLAG_RETAINED : 0;
+    memcpy(header + 2, &topic_len, sizeof(topic_len));
+    memcpy(header + 4, &load_len, sizeof(load_len));
+    memcpy(header + 8, &crc, sizeof(crc));
+}
+
+static bool mqtt_outbox_header_parse(const uint8_t * header, uint16_t * topic_len, uint32_t * load_len) {
+    memcpy(topic_len, header + 2, sizeof(*topic_len));
+    memcpy(load_len, header + 4, sizeof(*load_len));
+    return header[0] == MQTT_OUTBOX_RECORD_MAGIC && *topic_len > 0 && *topic_len <= MQTT_OUTBOX_TOPIC_MAX && *load_len <= MQTT_OUTBOX_LOAD_MAX;
+}
+
+static void mqtt_outbox_save_head() {
+    File file = SD.open(MQTT_OUTBOX_HEAD_FILE, FILE_WRITE);
+    if (!file) {
+        mqtt_outbox_stats.errors++;
+        return;
+    }
+
+    uint8_t buffer[2 * sizeof(uint32_t)];
+    memcpy(buffer, &mqtt_outbox_head, sizeof(uint32_t));
+    memcpy(buffer + sizeof(uint32_t), &mqtt_outbox_head_offset, sizeof(uint32_t));
+    if (file.write(buffer, sizeof(buffer)) != sizeof(buffer)) {
+        mqtt_outbox_stats.errors++;
+    }
+    file.close();
+    mqtt_outbox_head_saved = millis();
+    mqtt_outbox_head_dirty = false;
+}
+
+// the oldest segment was drained or dropped, the next one becomes the head
+static void mqtt_outbox_next_head() {
+    char path[40];
+    uint32_t index = mqtt_outbox_head % MQTT_OUTBOX_SEGMENTS;
+
+    if (mqtt_outbox_head == mqtt_outbox_tail) {
+        if (mqtt_outbox_file_opened) {
+            mqtt_outbox_file.close();
+            mqtt_outbox_file_opened = false;
+        }
+        mqtt_outbox_tail++;
+        mqtt_outbox_counts[mqtt_outbox_tail % MQTT_OUTBOX_SEGMENTS] = 0;
+        mqtt_outbox_sizes[mqtt_outbox_tail % MQTT_OUTBOX_SEGMENTS] = 0;
+    }
+
+    SD.remove(mqtt_outbox_path(mqtt_outbox_head, path, sizeof(path)));
+    mqtt_outbox_counts[index] = 0;
+    mqtt_outbox_sizes[index] = 0;
+    mqtt_outbox_head++;
+    mqtt_outbox_head_offset = 0;
+    mqtt_outbox_cache_len = 0;
+    mqtt_outbox_save_head();
+}
+
+// drops the messages left in the oldest segment
+static void mqtt_outbox_drop_head() {
+    uint32_t index = mqtt_outbox_head % MQTT_OUTBOX_SEGMENTS;
+    mqtt_outbox_stats.dropped += mqtt_outbox_counts[index];
+    mqtt_outbox_stats.pending -= mqtt_outbox_counts[index];
+    mqtt_outbox_stats.pending_bytes -= mqtt_outbox_sizes[index] - mqtt_outbox_head_offset;
+    mqtt_outbox_next_head();
+}
+
+// returns the bytes of the oldest segment from the cache, the blocks larger than the cache are read to the heap
+static const uint8_t * mqtt_outbox_fetch(uint32_t offset, size_t len, uint8_t ** heap) {
+    *heap = NULL;
+    if (offset >= mqtt_outbox_cache_offset && offset + len <= mqtt_outbox_cache_offset + mqtt_outbox_cache_len) {
+        return mqtt_outbox_cache + (offset - mqtt_outbox_cache_offset);
+    }
+
+    char path[40];
+    File file = SD.open(mqtt_outbox_path(mqtt_outbox_head, path, sizeof(path)), FILE_READ);
+    if (!file || !file.seek(offset)) {
+        if (file) {
+            file.close();
+        }
+        mqtt_outbox_stats.errors++;
+        return NULL;
+    }
+
+    const uint8_t * data = NULL;
+    if (len <= MQTT_OUTBOX_CACHE_SIZE) {
+        uint32_t available = mqtt_outbox_sizes[mqtt_outbox_head % MQTT_OUTBOX_SEGMENTS] - offset;
+        mqtt_outbox_cache_offset = offset;
+        mqtt_outbox_cache_len = file.read(mqtt_outbox_cache, available < MQTT_OUTBOX_CACHE_SIZE ? available : MQTT_OUTBOX_CACHE_SIZE);
+        data = mqtt_outbox_cache_len >= len ? mqtt_outbox_cache : NULL;
+    } else {
+        *heap = (uint8_t *)malloc(len);
+        if (*heap != NULL && file.read(*heap, len) == len) {
+            data = *heap;
+        }
+    }
+    file.close();
+
+    if (data == NULL) {
+        mqtt_outbox_stats.errors++;
+        free(*heap);
+        *heap = NULL;
+    }
+    return data;
+}
+
+// walks the messages of a segment left by the previous run, returns the size of the complete messages
+static uint32_t mqtt_outbox_scan(uint32_t generation, uint32_t offset, uint32_t * count) {
+    char path[40];
+    *count = 0;
+
+    File file = SD.open(mqtt_outbox_path(generation, path, sizeof(path)), FILE_READ);
+    if (!file) {
+        return offset;
+    }
+
+    uint32_t size = file.size();
+    uint8_t * buffer = (uint8_t *)malloc(MQTT_OUTBOX_TOPIC_MAX + MQTT_OUTBOX_LOAD_MAX);
+    while (buffer != NULL && offset + MQTT_OUTBOX_RECORD_HEADER <= size) {
+        uint8_t header[MQTT_OUTBOX_RECORD_HEADER];
+        uint16_t topic_len;
+        uint32_t load_len;
+        uint16_t crc;
+
+        // a torn or corrupted message ends the segment
+        if (!file.seek(offset) || file.read(header, sizeof(header)) != sizeof(header) || !mqtt_outbox_header_parse(header, &topic_len, &load_len) ||
+            offset + MQTT_OUTBOX_RECORD_HEADER + topic_len + load_len > size || file.read(buffer, topic_len + load_len) != topic_len + load_len) {
+            break;
+        }
+
+        memcpy(&crc, header + 8, sizeof(crc));
+        if (zigbee_crc16(0xFFFF, buffer, topic_len + load_len) != crc) {
+            break;
+        }
+
+        offset += MQTT_OUTBOX_RECORD_HEADER + topic_len + load_len;
+        (*count)++;
+    }
+
+    if (offset < size) {
+        esplogW(TAG_LIB_MQTT, "(mqtt_outbox_init)", "Outbox segment %lu is torn, it is drained up to offset %lu! (size: %lu)", (unsigned long)generation, (unsigned long)offset, (unsigned long)size);
+    }
+
+    free(buffer);
+    file.close();
+    return offset;
+}
+
+bool mqtt_outbox_init() {
+    if (mqtt_outbox_mutex == NULL) {
+        mqtt_outbox_mutex = xSemaphoreCreateMutex();
+    }
+    // initialised again (the outbox is recovered from the SD card), the new messages go to a new segment
+    if (mqtt_outbox_file_opened) {
+        mqtt_outbox_file.close();
+        mqtt_outbox_file_opened = false;
+    }
+
+    File dir = SD.open(MQTT_OUTBOX_DIR);
+    if (!dir || !dir.isDirectory()) {
+        if (!SD.mkdir(MQTT_OUTBOX_DIR)) {
+            esplogW(TAG_LIB_MQTT, "(mqtt_outbox_init)", "Failed to create outbox directory, the messages are not queued while offline!");
+            vSemaphoreDelete(mqtt_outbox_mutex);
+            mqtt_outbox_mutex = NULL;
+            return false;
+        }
+    }
+
+    bool found = false;
+    uint32_t first = 0;
+    uint32_t last = 0;
+    if (dir && dir.isDirectory()) {
+        File entry;
+        while ((entry = dir.openNextFile())) {
+            uint32_t generation;
+            if (!entry.isDirectory() && mqtt_outbox_parse(entry.name(), &generation)) {
+                if (!found || generation < first) {first = generation;}
+                if (!found || generation > last) {last = generation;}
+                found = true;
+            }
+            entry.close();
+        }
+    }
+    if (dir) {
+        dir.close();
+    }
+
+    // the drain position of the previous run, the segments before it were drained
+    uint32_t head = first;
+    uint32_t head_offset = 0;
+    File file = SD.open(MQTT_OUTBOX_HEAD_FILE, FILE_READ);
+    if (file) {
+        uint8_t buffer[2 * sizeof(uint32_t)];
+        if (file.read(buffer, sizeof(buffer)) == sizeof(buffer)) {
+            memcpy(&head, buffer, sizeof(uint32_t));
+            memcpy(&head_offset, buffer + sizeof(uint32_t), sizeof(uint32_t));
+        }
+        file.close();
+    }
+
+    char path[40];
+    if (!found || head < first || head > last) {
+        head = first;
+        head_offset = 0;
+    }
+    for (uint32_t generation = first; found && generation < head; generation++) {
+        SD.remove(mqtt_outbox_path(generation, path, sizeof(path)));
+    }
+
+    // the segments over the limit (e.g. after MQTT_OUTBOX_SEGMENTS was lowered) are dropped
+    while (found && last + 1 - head + 1 > MQTT_OUTBOX_SEGMENTS) {
+        esplogW(TAG_LIB_MQTT, "(mqtt_outbox_init)", "MQTT outbox has too many segments, segment %lu is dropped!", (unsigned long)head);
+        SD.remove(mqtt_outbox_path(head, path, sizeof(path)));
+        head++;
+        head_offset = 0;
+    }
+
+    // the new messages are appended to a new segment, so they never follow a torn message
+    mqtt_outbox_head = found ? head : 0;
+    mqtt_outbox_head_offset = found ? head_offset : 0;
+    mqtt_outbox_tail = found ? last + 1 : 0;
+    mqtt_outbox_cache_len = 0;
+    memset(mqtt_outbox_counts, 0, sizeof(mqtt_outbox_counts));
+    memset(mqtt_outbox_sizes, 0, sizeof(mqtt_outbox_sizes));
+    memset(&mqtt_outbox_stats, 0, sizeof(mqtt_outbox_stats));
+
+    for (uint32_t generation = mqtt_outbox_head; found && generation <= last; generation++) {
+        uint32_t count;
+        uint32_t offset = generation == mqtt_outbox_head ? mqtt_outbox_head_offset : 0;
+        uint32_t index = generation % MQTT_OUTBOX_SEGMENTS;
+        mqtt_outbox_sizes[index] = mqtt_outbox_scan(generation, offset, &count);
+        mqtt_outbox_counts[index] = count;
+        mqtt_outbox_stats.pending += count;
+        mqtt_outbox_stats.pending_bytes += mqtt_outbox_sizes[index] - offset;
+    }
+    mqtt_outbox_stats.max_pending = mqtt_outbox_stats.pending;
+
+    mqtt_outbox_offline = true;
+    mqtt_outbox_offline_since = millis();
+    mqtt_outbox_drain_time = millis();
+    esplogI(TAG_LIB_MQTT, "(mqtt_outbox_init)", "MQTT outbox initialised! (pending: %lu, segments: %lu)", (unsigned long)mqtt_outbox_stats.pending, (unsigned long)(mqtt_outbox_tail - mqtt_outbox_head));
+    return true;
+}
+
+// the caller holds the outbox mutex
+static bool mqtt_outbox_append(const char * topic, const uint8_t * load, size_t len, bool retained) {
+    size_t topic_len = strlen(topic);
+    if (topic_len == 0 || topic_len > MQTT_OUTBOX_TOPIC_MAX || len > MQTT_OUTBOX_LOAD_MAX) {
+        esplogW(TAG_LIB_MQTT, "(mqtt_outbox_push)", "MQTT message is too large for the outbox, it is dropped! (topic: %u, load: %u)", (unsigned)topic_len, (unsigned)len);
+        mqtt_outbox_stats.dropped++;
+        return false;
+    }
+
+    uint32_t size = MQTT_OUTBOX_RECORD_HEADER + topic_len + len;
+    uint32_t index = mqtt_outbox_tail % MQTT_OUTBOX_SEGMENTS;
+    if (mqtt_outbox_sizes[index] > 0 && mqtt_outbox_sizes[index] + size > MQTT_OUTBOX_SEGMENT_SIZE) {
+        if (mqtt_outbox_file_opened) {
+            mqtt_outbox_file.close();
+            mqtt_outbox_file_opened = false;
+        }
+        mqtt_outbox_tail++;
+        index = mqtt_outbox_tail % MQTT_OUTBOX_SEGMENTS;
+        mqtt_outbox_counts[index] = 0;
+        mqtt_outbox_sizes[index] = 0;
+    }
+
+    // the outbox is full, the oldest messages are dropped
+    while (mqtt_outbox_tail - mqtt_outbox_head + 1 > MQTT_OUTBOX_SEGMENTS) {
+        esplogW(TAG_LIB_MQTT, "(mqtt_outbox_push)", "MQTT outbox is full, the oldest segment is dropped! (messages: %lu)", (unsigned long)mqtt_outbox_counts[mqtt_outbox_head % MQTT_OUTBOX_SEGMENTS]);
+        mqtt_outbox_drop_head();
+    }
+
+    if (!mqtt_outbox_file_opened) {
+        char path[40];
+        mqtt_outbox_file = SD.open(mqtt_outbox_path(mqtt_outbox_tail, path, sizeof(path)), FILE_APPEND);
+        if (!mqtt_outbox_file) {
+            esplogW(TAG_LIB_MQTT, "(mqtt_outbox_push)", "Failed to open outbox segment! (%s)", path);
+            mqtt_outbox_stats.errors++;
+            mqtt_outbox_stats.dropped++;
+            return false;
+        }
+        mqtt_outbox_file_opened = true;
+    }
+
+    uint8_t header[MQTT_OUTBOX_RECORD_HEADER];
+    mqtt_outbox_header(header, topic, topic_len, load, len, retained);
+    size_t written = mqtt_outbox_file.write(header, sizeof(header));
+    written += mqtt_outbox_file.write((const uint8_t *)topic, topic_len);
+    written += len > 0 ? mqtt_outbox_file.write(load, len) : 0;
+    mqtt_outbox_file.flush();
+
+    // a partly written message ends the segment, the next message starts a new one
+    if (written != size) {
+        esplogW(TAG_LIB_MQTT, "(mqtt_outbox_push)", "Failed to write to outbox segment! (written: %u of %lu)", (unsigned)written, (unsigned long)size);
+        mqtt_outbox_file.close();
+        mqtt_outbox_file_opened = false;
+        mqtt_outbox_tail++;
+        mqtt_outbox_counts[mqtt_outbox_tail % MQTT_OUTBOX_SEGMENTS] = 0;
+        mqtt_outbox_sizes[mqtt_outbox_tail % MQTT_OUTBOX_SEGMENTS] = 0;
+        mqtt_outbox_stats.errors++;
+        mqtt_outbox_stats.dropped++;
+        return false;
+    }
+
+    mqtt_outbox_counts[index]++;
+    mqtt_outbox_sizes[index] += size;
+    mqtt_outbox_stats.pending++;
+    mqtt_outbox_stats.pending_bytes += size;
+    mqtt_outbox_stats.queued++;
+    if (mqtt_outbox_stats.pending > mqtt_outbox_stats.max_pending) {
+        mqtt_outbox_stats.max_pending = mqtt_outbox_stats.pending;
+    }
+    return true;
+}
+
+bool mqtt_outbox_push(const char * topic, const uint8_t * load, size_t len, bool retained) {
+    if (mqtt_outbox_mutex == NULL || topic == NULL || (load == NULL && len > 0)) {
+        return false;
+    }
+
+    xSemaphoreTake(mqtt_outbox_mutex, portMAX_DELAY);
+    bool ret = mqtt_outbox_append(topic, load, len, retained);
+    xSemaphoreGive(mqtt_outbox_mutex);
+    return ret;
+}
+
+size_t mqtt_outbox_drain() {
+    if (mqtt_outbox_mutex == NULL) {
+        return 0;
+    }
+
+    size_t sent = 0;
+    bool advanced = false;
+    bool report = false;
+    xSemaphoreTake(mqtt_outbox_mutex, portMAX_DELAY);
+
+    // the unused rate is accumulated for at most one second
+    unsigned long now = millis();
+    uint32_t elapsed = now - mqtt_outbox_drain_time < 1000 ? now - mqtt_outbox_drain_time : 1000;
+    uint32_t credit = mqtt_outbox_credit + elapsed * MQTT_OUTBOX_DRAIN_RATE;
+    mqtt_outbox_credit = credit < MQTT_OUTBOX_DRAIN_RATE * 1000 ? credit : MQTT_OUTBOX_DRAIN_RATE * 1000;
+    mqtt_outbox_drain_time = now;
+
+    while (mqtt_client_online && mqtt_client_connected() && mqtt_outbox_stats.pending > 0 && mqtt_outbox_credit >= 1000) {
+        uint32_t index = mqtt_outbox_head % MQTT_OUTBOX_SEGMENTS;
+        if (mqtt_outbox_head_offset + MQTT_OUTBOX_RECORD_HEADER > mqtt_outbox_sizes[index]) {
+            if (mqtt_outbox_head == mqtt_outbox_tail) {
+                break;
             }
+            mqtt_outbox_next_head();
+            continue;
+        }
+
+        uint8_t * heap;
+        uint16_t topic_len;
+        uint32_t load_len;
+        uint16_t crc;
+        char topic[MQTT_OUTBOX_TOPIC_MAX + 1];
+        const uint8_t * header = mqtt_outbox_fetch(mqtt_outbox_head_offset, MQTT_OUTBOX_RECORD_HEADER, &heap);
+        if (header == NULL) {
+            break;
+        }
+
+        bool valid = mqtt_outbox_header_parse(header, &topic_len, &load_len) &&
+            mqtt_outbox_head_offset + MQTT_OUTBOX_RECORD_HEADER + topic_len + load_len <= mqtt_outbox_sizes[index];
+        memcpy(&crc, header + 8, sizeof(crc));
+        bool retained = header[1] & MQTT_OUTBOX_FLAG_RETAINED;
+
+        // the segment was changed on the SD card, its remaining messages are dropped
+        const uint8_t * record = valid ? mqtt_outbox_fetch(mqtt_outbox_head_offset + MQTT_OUTBOX_RECORD_HEADER, topic_len + load_len, &heap) : NULL;
+        if (valid && record == NULL) {
+            break;
+        }
+        if (!valid || zigbee_crc16(0xFFFF, record, topic_len + load_len) != crc) {
+            esplogW(TAG_LIB_MQTT, "(mqtt_outbox_drain)", "Corrupted message in outbox segment %lu, the rest of the segment is dropped!", (unsigned long)mqtt_outbox_head);
+            free(heap);
+            mqtt_outbox_drop_head();
+            advanced = true;
+            continue;
+        }
 
+        memcpy(topic, record, topic_len);
+        topic[topic_len] = '\0';
+        bool ok = mqtt_send(topic, record + topic_len, load_len, retained);
+        free(heap);
+
+        // the message stays in the outbox if the connection was lost, a message refused by the connected client is dropped
+        if (!ok && !mqtt_client_connected()) {
+            break;
+        }
+        if (!ok) {
+            mqtt_outbox_stats.dropped++;
         } else {
-            if (mqtt.publish(topic.c_str(), load.c_str())) {
-                esplogI(TAG_LIB_MQTT, "(mqtt_publish)", "MQTT message published successfully!");
-                ret = true;
-            } else {
-                esplogW(TAG_LIB_MQTT, "(mqtt_publish)", "Failed to begin publish for whole message!");
-                ret = false;
+            mqtt_outbox_stats.sent++;
+            sent++;
+        }
+
+        uint32_t size = MQTT_OUTBOX_RECORD_HEADER + topic_len + load_len;
+        advanced = true;
+        mqtt_outbox_head_dirty = true;
+        mqtt_outbox_head_offset += size;
+        mqtt_outbox_counts[index]--;
+        mqtt_outbox_stats.pending--;
+        mqtt_outbox_stats.pending_bytes -= size;
+        mqtt_outbox_credit -= 1000;
+    }
+
+    if (advanced && mqtt_outbox_stats.pending == 0) {
+        // the drained segments are removed right away
+        while (mqtt_outbox_head != mqtt_outbox_tail || mqtt_outbox_sizes[mqtt_outbox_tail % MQTT_OUTBOX_SEGMENTS] > 0) {
+            mqtt_outbox_next_head();
+        }
+        esplogI(TAG_LIB_MQTT, "(mqtt_outbox_drain)", "MQTT outbox drained! (sent: %lu, dropped: %lu)", (unsigned long)mqtt_outbox_stats.sent, (unsigned long)mqtt_outbox_stats.dropped);
+        report = mqtt_outbox_report;
+        mqtt_outbox_report = false;
+    } else if (mqtt_outbox_head_dirty && millis() - mqtt_outbox_head_saved >= MQTT_OUTBOX_HEAD_SAVE_MS) {
+        mqtt_outbox_save_head();
+    }
+
+    xSemaphoreGive(mqtt_outbox_mutex);
+
+    if (report) {
+        String json;
+        if (mqtt_outbox_dump(&json)) {
+            mqtt_publish(g_config_ptr->mqtt_topic + String("/outbox"), json);
+        }
+    }
+
+    return sent;
+}
+
+void mqtt_outbox_link(bool connected) {
+    mqtt_client_online = connected;
+    if (mqtt_outbox_mutex == NULL) {
+        return;
+    }
+
+    xSemaphoreTake(mqtt_outbox_mutex, portMAX_DELAY);
+    if (connected && mqtt_outbox_offline) {
+        uint32_t duration = (uint32_t)(millis() - mqtt_outbox_offline_since);
+        mqtt_outbox_stats.last_offline_ms = duration;
+        mqtt_outbox_stats.total_offline_ms += duration;
+        mqtt_outbox_offline = false;
+        mqtt_outbox_report = mqtt_outbox_stats.pending > 0;
+        esplogI(TAG_LIB_MQTT, "(mqtt_outbox_link)", "MQTT connection restored after %lu ms! (pending: %lu)", (unsigned long)duration, (unsigned long)mqtt_outbox_stats.pending);
+    } else if (!connected && !mqtt_outbox_offline) {
+        // the position is saved before the outage, so a reset during it does not publish the drained messages again
+        if (mqtt_outbox_head_dirty) {
+            mqtt_outbox_save_head();
+        }
+        mqtt_outbox_offline = true;
+        mqtt_outbox_offline_since = millis();
+        mqtt_outbox_stats.outages++;
+    }
+    xSemaphoreGive(mqtt_outbox_mutex);
+}
+
+mqtt_outbox_stats_t mqtt_outbox_get_stats() {
+    mqtt_outbox_stats_t stats = {};
+    if (mqtt_outbox_mutex == NULL) {
+        return stats;
+    }
+
+    xSemaphoreTake(mqtt_outbox_mutex, portMAX_DELAY);
+    stats = mqtt_outbox_stats;
+    stats.offline_ms = mqtt_outbox_offline ? (uint32_t)(millis() - mqtt_outbox_offline_since) : 0;
+    xSemaphoreGive(mqtt_outbox_mutex);
+    return stats;
+}
+
+bool mqtt_outbox_dump(String * json) {
+    mqtt_outbox_stats_t stats = mqtt_outbox_get_stats();
+
+    JsonDocument doc;
+    doc["pending"] = stats.pending;
+    doc["pending_bytes"] = stats.pending_bytes;
+    doc["max_pending"] = stats.max_pending;
+    doc["queued"] = stats.queued;
+    doc["sent"] = stats.sent;
+    doc["dropped"] = stats.dropped;
+    doc["errors"] = stats.errors;
+    doc["outages"] = stats.outages;
+    doc["offline_ms"] = stats.offline_ms;
+    doc["last_offline_ms"] = stats.last_offline_ms;
+    doc["total_offline_ms"] = stats.total_offline_ms;
+
+    if (serializeJson(doc, *json) == 0) {
+        esplogW(TAG_LIB_MQTT, "(mqtt_outbox_dump)", "Failed serialise data!");
+        return false;
+    }
+    return true;
+}
+
+// *********************************************************************************************************************
+
+// publishes or queues the message, the caller logs it to the SD card
+static bool mqtt_publish_load(const char * topic, const uint8_t * load, size_t len, bool retained) {
+    bool ret = false;
+
+    if (mqtt_outbox_mutex != NULL) {
+        xSemaphoreTake(mqtt_outbox_mutex, portMAX_DELAY);
+    }
+
+    // while offline or while older messages wait in the outbox, the message is queued behind them (keeps the order)
+    bool queue = mqtt_outbox_mutex != NULL && (!mqtt_client_online || mqtt_outbox_stats.pending > 0);
+    if (!queue) {
+        bool connected = false;
+        if (mqtt_client_online) {
+            mqtt_client_lock();
+            connected = mqtt.connected();
+            if (connected) {
+                // a MessagePack message (map or array) starts with a byte above 0x7F, only its length is logged
+                if (len > 0 && load[0] > 0x7F) {
+                    esplogI(TAG_LIB_MQTT, "(mqtt_publish)", "Publishing: [%s] (MessagePack, %u bytes)", topic, (unsigned)len);
+                } else {
+                    esplogI(TAG_LIB_MQTT, "(mqtt_publish)", "Publishing: [%s] \n%.*s", topic, (int)len, (const char *)load);
+                }
+                ret = mqtt_send(topic, load, len, retained);
+                connected = ret || mqtt.connected();
             }
+            mqtt_client_unlock();
         }
 
-    } else {
-        esplogW(TAG_LIB_MQTT, "(mqtt_publish)", "Tried to publish MQTT message, but client is not connected!");
-        ret = false;
+        // the message stays in the outbox if the connection was lost, a message refused by the connected client is dropped
+        if (!connected && mqtt_outbox_mutex != NULL) {
+            queue = true;
+        } else if (!connected) {
+            esplogW(TAG_LIB_MQTT, "(mqtt_publish)", "Tried to publish MQTT message, but client is not connected!");
+        }
+    }
+
+    if (queue) {
+        ret = mqtt_outbox_append(topic, load, len, retained);
+        if (ret) {
+            esplogI(TAG_LIB_MQTT, "(mqtt_publish)", "MQTT message queued in the outbox! (topic: %s, pending: %lu)", topic, (unsigned long)mqtt_outbox_stats.pending);
+        }
     }
 
-    logMqttMessage(load);
+    if (mqtt_outbox_mutex != NULL) {
+        xSemaphoreGive(mqtt_outbox_mutex);
+    }
 
     return ret;
 }
 
-bool logMqttMessage(String load) {
-    time_t rawTime = g_vars_ptr->datetime;
-    struct tm * timeInfo = localtime(&rawTime);
+bool mqtt_publish(String topic, String load, bool retained) {
+    bool ret = mqtt_publish_load(topic.c_str(), (const uint8_t *)load.c_str(), load.length(), retained);
+    mqtt_log_line(load.c_str(), load.length());
+    return ret;
+}
 
-    if (rawTime <= 0) {
-        esplogW(TAG_LIB_MQTT, "(logMqttMessage)", "MQTT logging failed! Datetime is incorrect!");
+bool mqtt_publish_raw(const char * topic, const char * load, size_t len, bool retained) {
+    bool ret = mqtt_publish_load(topic, (const uint8_t *)load, len, retained);
+    // the load does not have to be null terminated (e.g. a message packed into a fixed buffer)
+    mqtt_log_line(load, len);
+    return ret;
+}
+
+bool mqtt_format_msgpack() {
+    return g_config_ptr != NULL && g_config_ptr->mqtt_format == MQTT_FORMAT_MSGPACK;
+}
+
+// the archive stays JSON, a MessagePack message is converted for it
+static bool mqtt_log_msgpack(const uint8_t * load, size_t len) {
+    JsonDocument doc;
+    DeserializationError error = deserializeMsgPack(doc, load, len);
+    if (error) {
+        esplogW(TAG_LIB_MQTT, "(mqtt_log_msgpack)", "MQTT logging failed! Invalid MessagePack message! Error: %s", error.c_str());
         return false;
     }
 
-    char bufferFolder[11];
-    char bufferFile[8];
-    strftime(bufferFolder, sizeof(bufferFolder), "%Y-%m", timeInfo);
-    strftime(bufferFile, sizeof(bufferFile), "%Y-%m-%d", timeInfo);
-    String foldername = String(MQTT_LOG_FILES_PATH) + "/" + String(bufferFolder);
-    String filename = foldername + "/" + String(bufferFile) + ".json";
+    String json;
+    serializeJson(doc, json);
+    doc.clear();
+    return mqtt_log_line(json.c_str(), json.length());
+}
+
+bool mqtt_publish_msgpack(const char * topic, const uint8_t * load, size_t len, bool retained) {
+    bool ret = mqtt_publish_load(topic, load, len, retained);
+    mqtt_log_msgpack(load, len);
+    return ret;
+}
 
-    // Create the directory path for the month
-    if (!SD.exists(foldername.c_str())) {
-        if (!SD.mkdir(foldername.c_str())) {
-            esplogW(TAG_LIB_MQTT, "(logMqttMessage)", "MQTT logging failed! Failed to create directory for log!");
-            return false;
+bool mqtt_publish_attr(const char * topic, const char * load, size_t len, bool retained) {
+    if (mqtt_format_msgpack()) {
+        return mqtt_publish_msgpack(topic, (const uint8_t *)load, len, retained);
+    }
+    return mqtt_publish_raw(topic, load, len, retained);
+}
+
+// *********************************************************************************************************************
+
+typedef struct {
+    String topic;                       // topic of the batch (kept when the batch is published, the slot is reused for it)
+    String load;                        // JSON array of the reports (without the closing bracket) or MessagePack array
+                                        // (array16, the count is written when the batch is published)
+    uint32_t count;                     // number of reports in the batch (0 = empty slot)
+    unsigned long first;                // time of the first report in the batch
+} mqtt_batch_t;
+
+// only the publishing task uses the batches, no lock is needed
+static mqtt_batch_t mqtt_batches[MQTT_BATCH_TOPICS];
+
+static uint32_t mqtt_batch_bytes() {
+    int bytes = g_config_ptr->mqtt_batch_bytes;
+    if (bytes < MQTT_BATCH_BYTES_MIN) {
+        return MQTT_BATCH_BYTES_MIN;
+    }
+    return bytes > MQTT_BATCH_BYTES_MAX ? MQTT_BATCH_BYTES_MAX : (uint32_t)bytes;
+}
+
+static bool mqtt_batch_publish(mqtt_batch_t * batch) {
+    if (batch->count == 0) {
+        return true;
+    }
+
+    bool msgpack = mqtt_format_msgpack();
+    if (msgpack) {
+        batch->load.setCharAt(1, (char)(batch->count >> 8));
+        batch->load.setCharAt(2, (char)batch->count);
+    } else {
+        batch->load += ']';
+    }
+
+    bool ret = mqtt_publish_load(batch->topic.c_str(), (const uint8_t *)batch->load.c_str(), batch->load.length(), false);
+    esplogI(TAG_LIB_MQTT, "(mqtt_batch_publish)", "Batch of %lu reports published after %lu ms. [%s] (%u bytes)",
+        (unsigned long)batch->count, (unsigned long)(millis() - batch->first), batch->topic.c_str(), batch->load.length());
+
+
+    // the buffer is kept (emptied), the next batch of the same device does not allocate
+    batch->load.remove(0);
+    batch->count = 0;
+    return ret;
+}
+
+bool mqtt_batch_enabled() {
+    return g_config_ptr != NULL && g_config_ptr->mqtt_batch_ms > 0;
+}
+
+bool mqtt_batch_add(const char * topic, const char * load, size_t len) {
+    // JSON: brackets and a comma per report, MessagePack: array16 header (3 bytes) and nothing per report
+    bool msgpack = mqtt_format_msgpack();
+    size_t header = msgpack ? 3 : 1;
+    size_t separator = msgpack ? 0 : 1;
+    size_t trailer = msgpack ? 0 : 1;
+
+    if (!mqtt_batch_enabled() || header + len + trailer > mqtt_batch_bytes()) {
+        mqtt_batch_flush(topic);
+        return mqtt_publish_attr(topic, load, len);
+    }
+
+    mqtt_batch_t * batch = NULL;
+    mqtt_batch_t * oldest = NULL;
+    for (size_t i = 0; i < MQTT_BATCH_TOPICS; i++) {
+        mqtt_batch_t * b = &mqtt_batches[i];
+        if (b->topic == topic) {
+            batch = b;
+            break;
+        }
+        // an empty slot is preferred, otherwise the oldest batch makes place for the new topic
+        if (oldest == NULL || (oldest->count > 0 && (b->count == 0 || (long)(b->first - oldest->first) < 0))) {
+            oldest = b;
+        }
+    }
+
+    if (batch == NULL) {
+        batch = oldest;
+        mqtt_batch_publish(batch);
+        batch->topic = topic;
+    }
+
+    // the opening bracket, separators and the closing bracket are counted in the budget
+    if (batch->count > 0 && (batch->load.length() + separator + len + trailer > mqtt_batch_bytes() || batch->count == UINT16_MAX)) {
+        mqtt_batch_publish(batch);
+    }
+
+    if (batch->count == 0) {
+        batch->load.reserve(mqtt_batch_bytes());
+        if (msgpack) {
+            batch->load.concat("\xDC\0\0", header);
         } else {
-            esplogI(TAG_LIB_MQTT, "(logMqttMessage)", "New folder for MQTT logging has been created successfully!");
+            batch->load += '[';
         }
+        batch->first = millis();
+    } else if (!msgpack) {
+        batch->load += ',';
     }
+    batch->load.concat(load, len);
+    batch->count++;
 
-    // Create or append to the daily log file
-    File logFile;
-    if (SD.exists(filename.c_str())) {
-        logFile = SD.open(filename.c_str(), FILE_WRITE);
-        if (!logFile) {
-            esplogW(TAG_LIB_MQTT, "(logMqttMessage)", "MQTT logging failed! Failed to open log file for appending!");
-            return false;
+    // the reports are archived one per line when they are added (the archive is buffered, see logMqttMessage())
+    if (msgpack) {
+        mqtt_log_msgpack((const uint8_t *)load, len);
+    } else {
+        mqtt_log_line(load, len);
+    }
+
+    return true;
+}
+
+bool mqtt_batch_flush(const char * topic) {
+    for (size_t i = 0; i < MQTT_BATCH_TOPICS; i++) {
+        if (mqtt_batches[i].count > 0 && mqtt_batches[i].topic == topic) {
+            return mqtt_batch_publish(&mqtt_batches[i]);
+        }
+    }
+
+    return true;
+}
+
+uint32_t mqtt_batch_poll() {
+    uint32_t wait = MQTT_BATCH_POLL_MAX_MS;
+    if (!mqtt_batch_enabled()) {
+        return wait;
+    }
+
+    uint32_t interval = (uint32_t)g_config_ptr->mqtt_batch_ms;
+    for (size_t i = 0; i < MQTT_BATCH_TOPICS; i++) {
+        mqtt_batch_t * batch = &mqtt_batches[i];
+        if (batch->count == 0) {
+            continue;
+        }
+
+        uint32_t age = millis() - batch->first;
+        if (age >= interval) {
+            mqtt_batch_publish(batch);
+        } else if (interval - age < wait) {
+            wait = interval - age;
+        }
+    }
+
+    return wait;
+}
+
+// *********************************************************************************************************************
+
+// the topic prefix is written once, per message only the path and the address are written after it and the message
+// is packed into the fixed buffer (no String and no JsonDocument per message), used by the Zigbee publishing task only
+static const char * const mqtt_zigbee_paths[ZIGBEE_PUBLISH_MAX] = {"/report/", "/read/out/", "/write/out/", "/event/", "/read/out", "/write/out", "/device/"};
+static char mqtt_zigbee_topic[MQTT_OUTBOX_TOPIC_MAX];
+static size_t mqtt_zigbee_prefix = 0;                   // 0 if the topic is too long (the jobs are consumed only)
+static bool mqtt_zigbee_msgpack = false;
+// the MessagePack message of a batched response does not fit the stack, its buffer is allocated once
+static uint8_t * mqtt_zigbee_batch_load = NULL;
+
+bool mqtt_zigbee_init() {
+    mqtt_zigbee_msgpack = mqtt_format_msgpack();
+    if (mqtt_zigbee_msgpack && mqtt_zigbee_batch_load == NULL) {
+        mqtt_zigbee_batch_load = (uint8_t *)malloc(ZIGBEE_ATTR_BATCH_MSGPACK_MAX);
+        if (mqtt_zigbee_batch_load == NULL) {
+            esplogW(TAG_LIB_MQTT, "(mqtt_zigbee_init)", "Failed to allocate memory for the batched responses, they are not published!");
         }
+    }
+
+    mqtt_zigbee_prefix = strlcpy(mqtt_zigbee_topic, g_config_ptr->mqtt_topic.c_str(), sizeof(mqtt_zigbee_topic));
+    // the topic is checked when the configuration is saved (see MQTT_TOPIC_MAX), a hand-edited config file is only reported
+    // and the jobs are consumed without publishing, so the queues do not fill up
+    if (mqtt_zigbee_prefix + strlen("/write/out/") + ZIGBEE_IEEE_STR_SIZE > sizeof(mqtt_zigbee_topic)) {
+        esplogW(TAG_LIB_MQTT, "(mqtt_zigbee_init)", "MQTT topic is too long, the Zigbee attributes are not published! (length: %u, max: %u)", g_config_ptr->mqtt_topic.length(), (unsigned)MQTT_TOPIC_MAX);
+        mqtt_zigbee_prefix = 0;
+        return false;
+    }
+
+    return true;
+}
+
+bool mqtt_zigbee_publish(const zigbee_publish_job_t * job) {
+    if (job == NULL || job->kind >= ZIGBEE_PUBLISH_MAX) {
+        return false;
+    }
+
+    char * topic = mqtt_zigbee_topic;
+    size_t prefix = mqtt_zigbee_prefix;
+    size_t path_len = strlen(mqtt_zigbee_paths[job->kind]);
+    bool published = false;
 
-        // Remove closing bracket, append the new message, and close JSON
-        logFile.seek(logFile.size() - 1); // Go to the end
-        logFile.printf(",\n%s\n]", load.c_str());
+    // <topic><path> of a batched response, its attributes are published as one message and the slot is freed
+    const iot_alarm_attr_load_t * batch = zigbee_publish_batch_get(job);
+    if (batch != NULL) {
+        memcpy(topic + prefix, mqtt_zigbee_paths[job->kind], path_len + 1);
+        if (prefix > 0 && mqtt_zigbee_msgpack) {
+            size_t batch_len = mqtt_zigbee_batch_load != NULL ? pack_attr_batch_msgpack(batch, job->count, mqtt_zigbee_batch_load, ZIGBEE_ATTR_BATCH_MSGPACK_MAX) : 0;
+            published = batch_len > 0 && mqtt_publish_msgpack(topic, mqtt_zigbee_batch_load, batch_len);
+        } else if (prefix > 0) {
+            String json;
+            published = pack_attr_batch(batch, job->count, &json) && mqtt_publish(String(topic), json);
+        }
+        zigbee_publish_batch_release(job);
+        return published;
+    }
+
+    if (prefix == 0) {
+        return false;
+    }
+
+    // <topic><path><ieee>, the address is formatted once for the topic and the message
+    memcpy(topic + prefix, mqtt_zigbee_paths[job->kind], path_len);
+    const char * ieee_str = zigbee_ieee_str(job->attr.ieee_addr, topic + prefix + path_len);
+
+    // the device metadata are taken from the registry (the newest ones if the device rejoined meanwhile)
+    if (job->kind == ZIGBEE_PUBLISH_DEVICE) {
+        zigbee_device_t dev;
+        String device;
+        return device_registry_find_ieee(job->attr.ieee_addr, &dev) && pack_device(&dev, &device) && mqtt_publish(String(topic), device, true);
+    }
+
+    char load[ZIGBEE_ATTR_JSON_MAX];
+    size_t len;
+    if (mqtt_zigbee_msgpack) {
+        len = job->kind == ZIGBEE_PUBLISH_EVENT ?
+            pack_attr_event_msgpack(&job->attr, ieee_str, job->count, job->span_ms, (uint8_t *)load, sizeof(load)) :
+            pack_attr_msgpack(&job->attr, ieee_str, (uint8_t *)load, sizeof(load));
     } else {
-        logFile = SD.open(filename.c_str(), FILE_WRITE);
-        if (!logFile) {
-            esplogW(TAG_LIB_MQTT, "(logMqttMessage)", "MQTT logging failed! Failed to create log file!");
+        len = job->kind == ZIGBEE_PUBLISH_EVENT ?
+            pack_attr_event_json(&job->attr, ieee_str, job->count, job->span_ms, load, sizeof(load)) :
+            pack_attr_json(&job->attr, ieee_str, load, sizeof(load));
+    }
+    if (len == 0) {
+        return false;
+    }
+
+    // only the telemetry is batched, the alarm-relevant reports go out right away (after the batch of the device)
+    if (job->kind == ZIGBEE_PUBLISH_REPORT && !job->critical) {
+        return mqtt_batch_add(topic, load, len);
+    }
+    mqtt_batch_flush(topic);
+    return mqtt_publish_attr(topic, load, len);
+}
+
+// *********************************************************************************************************************
+
+// the archive lines are collected here and written to the daily file (kept open) when the buffer is full, the day
+// changes or MQTT_LOG_FLUSH_MS passes (mqtt_log_flush() from the log task)
+static SemaphoreHandle_t mqtt_log_mutex = NULL;
+static char mqtt_log_buffer[MQTT_LOG_BUFFER_SIZE];
+static size_t mqtt_log_len = 0;
+static uint32_t mqtt_log_lines = 0;
+static unsigned long mqtt_log_first = 0;                // time the oldest buffered line was added
+static File mqtt_log_file;
+static bool mqtt_log_file_opened = false;
+static int mqtt_log_day = 0;                            // YYYYMMDD of the buffered lines and of the open file
+static char mqtt_log_path[sizeof(MQTT_LOG_FILES_PATH) + sizeof("/YYYY-MM/YYYY-MM-DD") + sizeof(MQTT_LOG_FILE_EXT)];
+
+// the buffered lines are written before every reboot (also the one of esplogE)
+static void mqtt_log_reboot() {
+    mqtt_log_flush(true);
+}
+
+bool mqtt_log_init() {
+    if (mqtt_log_mutex == NULL) {
+        mqtt_log_mutex = xSemaphoreCreateMutex();
+        if (mqtt_log_mutex != NULL && !rebootAddHook(mqtt_log_reboot)) {
+            esplogW(TAG_LIB_MQTT, "(mqtt_log_init)", "Failed to register the MQTT archive flush, buffered messages are lost on reboot!");
+        }
+    }
+    return mqtt_log_mutex != NULL;
+}
+
+static bool mqtt_log_open() {
+    if (mqtt_log_file_opened) {
+        return true;
+    }
+
+    // /mqtt/YYYY-MM/YYYY-MM-DD.ndjson, the folder is checked once per day (when the file is opened)
+    char foldername[sizeof(mqtt_log_path)];
+    strlcpy(foldername, mqtt_log_path, sizeof(foldername));
+    char * slash = strrchr(foldername, '/');
+    if (slash != NULL) {
+        *slash = '\0';
+    }
+
+    if (!SD.exists(foldername)) {
+        if (!SD.mkdir(foldername)) {
+            esplogW(TAG_LIB_MQTT, "(mqtt_log_open)", "MQTT logging failed! Failed to create directory for log!");
             return false;
-        } else {
-            esplogI(TAG_LIB_MQTT, "(logMqttMessage)", "New file for MQTT logging has been created successfully! (%s)", filename.c_str());
         }
+        esplogI(TAG_LIB_MQTT, "(mqtt_log_open)", "New folder for MQTT logging has been created successfully!");
+    }
 
-        // Write the new JSON array
-        logFile.printf("[\n%s\n]", load.c_str());
+    mqtt_log_file = SD.open(mqtt_log_path, FILE_APPEND);
+    if (!mqtt_log_file) {
+        esplogW(TAG_LIB_MQTT, "(mqtt_log_open)", "MQTT logging failed! Failed to open log file for appending! (%s)", mqtt_log_path);
+        return false;
     }
 
-    logFile.close();
-    esplogI(TAG_LIB_MQTT, "(logMqttMessage)", "MQTT message has been logged to SD card successfully! (%s)", filename.c_str());
+    mqtt_log_file_opened = true;
     return true;
 }
 
+static void mqtt_log_close() {
+    if (mqtt_log_file_opened) {
+        mqtt_log_file.close();
+        mqtt_log_file_opened = false;
+    }
+}
+
+// writes the buffered lines (and the extra line which does not fit the buffer), the mutex is held by the caller
+static bool mqtt_log_write(const char * extra, size_t extra_len) {
+    if (mqtt_log_len == 0 && extra_len == 0) {
+        return true;
+    }
+
+    bool ret = mqtt_log_open();
+    if (ret) {
+        // the archive is append-only, a torn write damages only the last line
+        ret = mqtt_log_file.write((const uint8_t *)mqtt_log_buffer, mqtt_log_len) == mqtt_log_len;
+        if (extra_len > 0) {
+            ret = mqtt_log_file.write((const uint8_t *)extra, extra_len) == extra_len && mqtt_log_file.write('\n') == 1 && ret;
+        }
+        mqtt_log_file.flush();
+    }
+
+    if (ret) {
+        esplogI(TAG_LIB_MQTT, "(mqtt_log_write)", "MQTT messages have been logged to SD card successfully! (%s, messages: %lu, bytes: %u)",
+            mqtt_log_path, (unsigned long)mqtt_log_lines + (extra_len > 0 ? 1 : 0), (unsigned)(mqtt_log_len + extra_len));
+    } else {
+        // the file is reopened by the next write (the card may have been removed)
+        esplogW(TAG_LIB_MQTT, "(mqtt_log_write)", "MQTT logging failed! %lu messages lost! (%s)",
+            (unsigned long)mqtt_log_lines + (extra_len > 0 ? 1 : 0), mqtt_log_path);
+        mqtt_log_close();
+    }
+
+    mqtt_log_len = 0;
+    mqtt_log_lines = 0;
+    return ret;
+}
+
+static bool mqtt_log_line(const char * load, size_t len) {
+    time_t rawTime = g_vars_ptr->datetime;
+    if (rawTime <= 0) {
+        esplogW(TAG_LIB_MQTT, "(logMqttMessage)", "MQTT logging failed! Datetime is incorrect!");
+        return false;
+    }
+
+    struct tm timeInfo;
+    localtime_r(&rawTime, &timeInfo);
+    int day = (timeInfo.tm_year + 1900) * 10000 + (timeInfo.tm_mon + 1) * 100 + timeInfo.tm_mday;
+    bool ret = true;
+
+    if (mqtt_log_mutex != NULL) {
+        xSemaphoreTake(mqtt_log_mutex, portMAX_DELAY);
+    }
+
+    // the lines of the previous day are written to its file, then the file of the new day is used
+    if (day != mqtt_log_day) {
+        ret = mqtt_log_write(NULL, 0);
+        mqtt_log_close();
+        mqtt_log_day = day;
+        strftime(mqtt_log_path, sizeof(mqtt_log_path), MQTT_LOG_FILES_PATH "/%Y-%m/%Y-%m-%d" MQTT_LOG_FILE_EXT, &timeInfo);
+    }
+
+    if (mqtt_log_len + len + 1 > sizeof(mqtt_log_buffer)) {
+        // a message larger than the buffer is written right after the buffered ones
+        if (len + 1 > sizeof(mqtt_log_buffer)) {
+            ret = mqtt_log_write(load, len);
+            len = 0;
+        } else {
+            ret = mqtt_log_write(NULL, 0);
+        }
+    }
+
+    if (len > 0) {
+        if (mqtt_log_len == 0) {
+            mqtt_log_first = millis();
+        }
+        memcpy(mqtt_log_buffer + mqtt_log_len, load, len);
+        mqtt_log_buffer[mqtt_log_len + len] = '\n';
+        mqtt_log_len += len + 1;
+        mqtt_log_lines++;
+    }
+
+    if (mqtt_log_mutex != NULL) {
+        xSemaphoreGive(mqtt_log_mutex);
+    }
+
+    return ret;
+}
+
+bool logMqttMessage(const char * load) {
+    return mqtt_log_line(load, strlen(load));
+}
+
+bool mqtt_log_flush(bool force) {
+    if (mqtt_log_mutex == NULL || xSemaphoreTake(mqtt_log_mutex, portMAX_DELAY) != pdTRUE) {
+        return false;
+    }
+
+    bool ret = true;
+    if (mqtt_log_len > 0 && (force || millis() - mqtt_log_first >= MQTT_LOG_FLUSH_MS)) {
+        ret = mqtt_log_write(NULL, 0);
+    }
+
+    xSemaphoreGive(mqtt_log_mutex);
+    return ret;
+}
+
 bool cleanOldLogs() {
     File logsDir = SD.open(MQTT_LOG_FILES_PATH);
     if (!logsDir || !logsDir.isDirectory()) {
@@ -182,7 +1597,7 @@ bool cleanOldLogs() {
 
         String monthName = String(monthDir.name());
         if (monthName < cutoffStr) { // Compare lexicographically
-            esplogI(TAG_LIB_MQTT, "(cleanOldLogs)", "Deleting old logs directory: %s\n", monthName);
+            esplogI(TAG_LIB_MQTT, "(cleanOldLogs)", "Deleting old logs directory: %s\n", monthName.c_str());
             SD.rmdir(monthName);
         }
         monthDir.close();
@@ -20,6 +20,69 @@
 
 #define MQTT_LOG_FILES_PATH "/mqtt"    // MQTT logs directory
 #define MQTT_LOG_KEEP_MONTHS 2          // number of months to retain MQTT logs
+#define MQTT_LOG_FILE_EXT ".ndjson"     // daily MQTT logs are named /mqtt/YYYY-MM/YYYY-MM-DD.ndjson (one message per line)
+#define MQTT_LOG_BUFFER_SIZE 4096       // MQTT log lines collected in RAM before they are written to the SD card
+#define MQTT_LOG_FLUSH_MS 5000          // the buffered MQTT log lines are written at the latest after this time
+#define MQTT_ATTR_BATCH_MAX 48          // maximal number of attributes in one batched read/write command
+#define MQTT_BUFFER_SIZE 6144           // MQTT client buffer (fits a batched command of MQTT_ATTR_BATCH_MAX attributes)
+
+#define MQTT_OUTBOX_DIR "/outbox"                   // outbox directory (segments and the drain position)
+#define MQTT_OUTBOX_SEGMENT_PREFIX "seg"            // outbox segments are named /outbox/segNNNNNNNN.bin (generation number)
+#define MQTT_OUTBOX_SEGMENT_EXT ".bin"              // extension of the outbox segments
+#define MQTT_OUTBOX_HEAD_FILE "/outbox/head.bin"    // drain position (generation and offset of the next message)
+#define MQTT_OUTBOX_SEGMENT_SIZE 64 * 1024          // size after which the next message is appended to a new segment
+#define MQTT_OUTBOX_SEGMENTS 32                     // maximal number of segments (the oldest one is dropped when exceeded)
+#define MQTT_OUTBOX_CACHE_SIZE 4096                 // RAM cache of the messages at the head of the outbox
+#define MQTT_OUTBOX_TOPIC_MAX 128                   // maximal length of the topic of a queued message
+#define MQTT_OUTBOX_LOAD_MAX 16 * 1024              // maximal length of the load of a queued message
+#define MQTT_OUTBOX_DRAIN_RATE 50                   // messages published from the outbox per second (also the new ones while it is not empty)
+#define MQTT_OUTBOX_HEAD_SAVE_MS 1000               // period of saving the drain position while draining
+
+#define MQTT_BATCH_TOPICS 16                        // maximal number of topics batched at once (the oldest batch is published to free a slot)
+#define MQTT_BATCH_BYTES_MIN 256                    // lower bound of the configured batch size
+#define MQTT_BATCH_BYTES_MAX MQTT_OUTBOX_LOAD_MAX   // upper bound of the configured batch size (a batch fits in the outbox)
+#define MQTT_BATCH_POLL_MAX_MS 1000                 // longest wait returned by mqtt_batch_poll()
+
+#define MQTT_COMMAND_QUEUE_SIZE 8                   // commands waiting for the command worker (further ones are answered "busy")
+#define MQTT_COMMAND_SLOTS 8                        // read/write commands waiting for the acknowledges of the Zigbee module
+#define MQTT_COMMAND_ACKS_SIZE 32                   // acknowledges of the Zigbee frames waiting for the command worker
+#define MQTT_COMMAND_ID_MAX 32                      // maximal length of the correlation id (last level of the command topic)
+#define MQTT_COMMAND_REPLY_MAX 192                  // maximal length of the command result
+#define MQTT_COMMAND_TIMEOUT_MS (ZIGBEE_COMMAND_TIMEOUT_MS + 5000)  // a read/write command is answered "timeout" after this time
+
+// longest level appended to the configured topic in the fixed topic buffers (`<topic>/command/out/<id>`, the Zigbee
+// attribute topics `<topic>/write/out/<ieee>` are shorter) and the resulting maximal length of the configured topic
+#define MQTT_TOPIC_SUFFIX_MAX (sizeof("/command/out/") - 1 + MQTT_COMMAND_ID_MAX)
+#define MQTT_TOPIC_MAX (MQTT_OUTBOX_TOPIC_MAX - MQTT_TOPIC_SUFFIX_MAX - 1)
+
+/**
+ * @brief Kinds of the MQTT commands (the index of the command topic).
+ */
+typedef enum {
+    MQTT_COMMAND_WRITE = 0,             // <topic>/write/in
+    MQTT_COMMAND_READ,                  // <topic>/read/in
+    MQTT_COMMAND_DEVICE,                // <topic>/device/in
+    MQTT_COMMAND_RULES,                 // <topic>/rules/in
+    MQTT_COMMAND_LOG_LEVEL,             // <topic>/log/level/in
+    MQTT_COMMAND_MAX,
+} mqtt_command_kind_t;
+
+/**
+ * @brief Statistics of the MQTT outbox.
+ */
+typedef struct {
+    uint32_t pending;                   // number of messages waiting in the outbox
+    uint32_t pending_bytes;             // size of the messages waiting in the outbox (including the record headers)
+    uint32_t max_pending;               // highest number of waiting messages
+    uint32_t queued;                    // number of messages queued since boot
+    uint32_t sent;                      // number of queued messages published since boot
+    uint32_t dropped;                   // number of queued messages dropped (outbox full, too large or corrupted)
+    uint32_t errors;                    // number of failed SD card operations
+    uint32_t outages;                   // number of connection losses since boot
+    uint32_t offline_ms;                // duration of the current outage (0 if connected)
+    uint32_t last_offline_ms;           // duration of the last finished outage
+    uint32_t total_offline_ms;          // sum of the durations of the finished outages
+} mqtt_outbox_stats_t;
 
 extern WiFiClient mqttwificlient;
 extern WiFiClientSecure mqttwificlientsecure;
@@ -30,77 +93,264 @@ extern NTPClient timeClient;
 /**
  * @brief Callback function to handle incoming MQTT messages.
  *
- * This function processes incoming MQTT messages based on the topic of the message.
- * It distinguishes between "write" and "read" commands, performs the appropriate action
- * (such as writing or reading Zigbee attributes), and logs the results. The message payload
- * is unpacked and processed using `unpack_attr()` and either `zigbeeAttrWrite()` or `zigbeeAttrRead()`
- * is called depending on the command.
+ * This function only classifies the topic of the message and queues a copy of the payload for the command worker
+ * (see `mqtt_command_process()`), so `mqtt.loop()` never waits for the Zigbee module, the SD card or JSON parsing
+ * and the keepalives of the connection are not delayed by the commands.
  *
- * @param topic The MQTT topic associated with the received message. This topic is used to determine
- *              if the message is a "write" or "read" command.
- * @param message The payload of the received MQTT message. This contains the data to be processed.
+ * @param topic The MQTT topic associated with the received message.
+ * @param message The payload of the received MQTT message.
  * @param length The length of the received message.
  *
  * @return None
  *
- * @details The function processes the following types of MQTT messages:
- * - If the topic starts with the configured "write" prefix, the function will unpack the payload 
- *   into an attribute structure and call `zigbeeAttrWrite()` to write the Zigbee attribute.
- * - If the topic starts with the configured "read" prefix, the function will unpack the payload 
- *   into an attribute structure and call `zigbeeAttrRead()` to read the Zigbee attribute.
- * - If the topic does not match either of these prefixes, the function logs a warning indicating 
- *   an undefined message.
+ * @details The following command topics are accepted, a further topic level is the correlation id of the command
+ * (e.g. `<topic>/write/in/42`, at most `MQTT_COMMAND_ID_MAX` characters):
+ * - `<topic>/write/in` and `<topic>/read/in` write or read a Zigbee attribute (`zigbeeAttrWrite()`, `zigbeeAttrRead()`),
+ *   a JSON array of attributes is sent at once by `zigbeeAttrWriteBatch()` or `zigbeeAttrReadBatch()`. The payload
+ *   may also be MessagePack (a map or an array, see `unpack_attr_msgpack()`), whatever `mqtt_format` is.
+ * - `<topic>/log/level/in` passes the payload to `mqtt_log_level()` to change the runtime log levels.
+ * - `<topic>/device/in` passes the payload to `mqtt_device_info()` to publish the metadata of the device.
+ * - `<topic>/rules/in` passes the payload to `mqtt_rules()` to replace or reload the Zigbee report rules.
+ * - Other topics are logged as undefined messages.
  *
- * The `unpack_attr()` function is used to unpack the MQTT payload into a `iot_alarm_attr_load_t` structure.
- * If the unpacking is successful, the corresponding Zigbee function (`zigbeeAttrWrite()` or `zigbeeAttrRead()`)
- * is called. After processing, the allocated attribute memory is freed using `destroy_attr()`.
+ * The result of every command is published to `<topic>/command/out/<id>` (`<topic>/command/out` without an id) as
+ * `{"id": "42", "command": "write", "status": "done"}`. The status is `done`, `failed`, `timeout` (the Zigbee module
+ * did not acknowledge all frames in `MQTT_COMMAND_TIMEOUT_MS`) or `busy` (the command queue or the command slots
+ * are full, the command was not executed). Read/write results add the number of `frames` sent to the Zigbee module,
+ * the number of `acked` and `failed` frames and `duration_ms`.
  *
  * @note The function assumes that the global configuration (`g_config_ptr`) contains the MQTT topic prefix
- *       which is used to match the incoming topics for "write" and "read" commands.
+ *       which is used to match the incoming topics.
  *
  * Example Usage:
  * @code
- * void mqtt_callback(char* topic, byte* message, unsigned int length) {
- *     // Handle MQTT message
- * }
+ * mqtt.setCallback(mqtt_callback);
+ * mqtt.subscribe((g_config.mqtt_topic + "/write/in/#").c_str());
  * @endcode
  */
 void mqtt_callback(char* topic, byte* message, unsigned int length);
 
+/**
+ * @brief Changes the runtime log levels of the tags according to the MQTT command.
+ *
+ * The payload is a JSON object mapping tag names to log levels, e.g. `{"ZIGBEE": "warn", "LIB-MQTT": "error"}`.
+ * The tag name `all` sets the level of all tags. After the levels are applied, the current log levels of all tags
+ * are published to the `<topic>/log/level/out` topic in the same format (an empty payload only publishes them).
+ *
+ * @param load The payload of the received MQTT message.
+ *
+ * @return bool
+ * - `true` if all levels were set successfully.
+ * - `false` if the payload could not be parsed or it contained an invalid tag or level.
+ *
+ * Example Usage:
+ * @code
+ * mqtt_log_level("{\"all\": \"warn\", \"ZIGBEE\": \"info\"}");
+ * @endcode
+ */
+bool mqtt_log_level(String load);
+
+/**
+ * @brief Creates the queues of the MQTT command worker.
+ *
+ * Must be called before the MQTT client is connected, the commands received before are dropped.
+ *
+ * @return bool
+ * - `true` if the queues were created (or already existed).
+ * - `false` if there is not enough memory.
+ *
+ * Example Usage:
+ * @code
+ * if (!mqtt_command_init()) {
+ *     esplogW(TAG_RTOS_MQTT, NULL, "Failed to create the MQTT command queues!");
+ * }
+ * @endcode
+ */
+bool mqtt_command_init();
+
+/**
+ * @brief Executes one queued MQTT command or handles one acknowledge of the Zigbee module.
+ *
+ * Waits at most `timeout` ticks for a command queued by `mqtt_callback()` or an acknowledge of a Zigbee frame sent
+ * by a read/write command. A command is executed right away, a read/write command then waits in one of
+ * `MQTT_COMMAND_SLOTS` slots until all its frames are acknowledged (or `MQTT_COMMAND_TIMEOUT_MS` expires) and its
+ * result is published (see `mqtt_callback()`). The function must be called repeatedly by a single task.
+ *
+ * @param timeout Maximal wait for a command or an acknowledge (in ticks).
+ *
+ * @return None
+ *
+ * Example Usage:
+ * @code
+ * for (;;) {
+ *     mqtt_command_process(1000 / portTICK_PERIOD_MS);
+ * }
+ * @endcode
+ */
+void mqtt_command_process(TickType_t timeout);
+
+/**
+ * @brief Sends a batched read or write attribute command according to the MQTT command.
+ *
+ * The payload is a JSON array of the attribute objects accepted by `unpack_attr()` (at most `MQTT_ATTR_BATCH_MAX`),
+ * or the same array in MessagePack.
+ * The attributes are sent to the Zigbee module in as few frames as possible and the module answers with one
+ * batched notification, which is published as one aggregated message to `<topic>/read/out` or `<topic>/write/out`.
+ *
+ * @param load The payload of the received MQTT message.
+ * @param write `true` for the write command, `false` for the read command.
+ *
+ * @return bool
+ * - `true` if the command was sent.
+ * - `false` if the payload could not be parsed or the command could not be sent.
+ *
+ * Example Usage:
+ * @code
+ * mqtt_attr_batch("[{\"device\": {\"ieee\": \"00:11:22:33:44:55:66:77\"}, \"ep_id\": 1, \"cluster_id\": 1026, \"attr_id\": 0, \"value_type\": 41, \"value\": 0}]", false);
+ * @endcode
+ */
+bool mqtt_attr_batch(String load, bool write);
+
+/**
+ * @brief Publishes the metadata of a device according to the MQTT request.
+ *
+ * The attribute messages carry only the device addresses and IDs, the manufacturer, name and type are published
+ * (retained) to the `<topic>/device/<ieee>` topic once per device. The payload is `{"ieee": "00:11:22:33:44:55:66:77"}`.
+ * If the device is not in the device registry yet, its metadata are requested from the Zigbee module and published
+ * when the module sends them.
+ *
+ * @param load The payload of the received MQTT message.
+ *
+ * @return bool
+ * - `true` if the metadata were published or requested.
+ * - `false` if the payload could not be parsed or the publishing failed.
+ *
+ * Example Usage:
+ * @code
+ * mqtt_device_info("{\"ieee\": \"00:11:22:33:44:55:66:77\"}");
+ * @endcode
+ */
+bool mqtt_device_info(String load);
+
+/**
+ * @brief Replaces or reloads the Zigbee report rules according to the MQTT command.
+ *
+ * The payload is a rule table in the format of the rule file (see `zigbeeRulesLoad()`), it is applied at once and
+ * stored on the SD card. An empty payload reloads the rule file. The active rules are then published to the
+ * `<topic>/rules/out` topic (if the payload is invalid, the previous rules stay active).
+ *
+ * @param load The payload of the received MQTT message.
+ *
+ * @return bool
+ * - `true` if the rules were applied.
+ * - `false` if the rules are invalid or they could not be saved.
+ *
+ * @note The payload is limited by the MQTT client buffer (`MQTT_BUFFER_SIZE`), larger rule tables are uploaded over HTTP
+ *       (`POST /zigbee/rules`).
+ *
+ * Example Usage:
+ * @code
+ * mqtt_rules("{\"rules\": [{\"type_id\": \"0x0500000D\", \"cluster\": \"0x0500\", \"attr\": 2, \"op\": \"eq\", \"value\": 1, \"action\": \"intrusion\"}]}");
+ * @endcode
+ */
+bool mqtt_rules(String load);
+
+/**
+ * @brief Initialises the lock of the MQTT client.
+ *
+ * PubSubClient and its network client are not thread safe, they are used by the mqtt task (`mqtt.connect()`,
+ * `mqtt.subscribe()`, `mqtt.loop()`) and published to by the other tasks. Every call to the client is made with
+ * the lock held (`mqtt_client_lock()`). The publishing functions take it themselves and use the client only while
+ * it is connected (see `mqtt_outbox_link()`), so they never wait for a reconnect.
+ *
+ * @return bool
+ * - `true` if the lock was created.
+ * - `false` if there is not enough memory (the client is not locked).
+ *
+ * @note The lock is recursive, the commands rejected by `mqtt_callback()` are answered from `mqtt.loop()`.
+ *       The outbox is always locked before the client, so the client lock must not be held while calling
+ *       the publishing functions or `mqtt_outbox_link()` and `mqtt_outbox_drain()`.
+ *
+ * Example Usage:
+ * @code
+ * mqtt_client_init();
+ * ...
+ * mqtt_client_lock();
+ * mqtt.loop();
+ * mqtt_client_unlock();
+ * @endcode
+ */
+bool mqtt_client_init();
+
+/**
+ * @brief Takes the lock of the MQTT client (see `mqtt_client_init()`).
+ */
+void mqtt_client_lock();
+
+/**
+ * @brief Gives the lock of the MQTT client back.
+ */
+void mqtt_client_unlock();
+
+/**
+ * @brief Returns whether the MQTT client is connected (with the client locked).
+ *
+ * @return bool `true` if the client is connected to the broker.
+ */
+bool mqtt_client_connected();
+
+/**
+ * @brief Publishes the crash report recovered from RTC memory during boot.
+ *
+ * The report holds the reset reason and the last log records of the previous run (see `logCrashGet()`).
+ * It is published to the `<topic>/log/crash` topic as JSON, e.g.
+ * `{"reset_reason": "PANIC", "records": [{"level": "warn", "timestamp": 1234, "tag": "ZIGBEE", "message": "..."}]}`.
+ * The report is released after it was published successfully, so it is published only once per boot.
+ *
+ * @return bool
+ * - `true` if the report was published or there is no report to publish.
+ * - `false` if publishing failed (the report is kept for the next attempt).
+ *
+ * Example Usage:
+ * @code
+ * if (mqtt.connect(id, username, password)) {
+ *     mqtt_publish_crash_report();
+ * }
+ * @endcode
+ */
+bool mqtt_publish_crash_report();
+
 /**
  * @brief Publishes an MQTT message to a specified topic.
  *
- * This function attempts to publish an MQTT message to the given topic. If the message exceeds the
- * maximum allowed size, it will be split into smaller chunks and sent sequentially. The function
- * ensures that each chunk is published successfully before proceeding to the next. Once the message
- * or chunks are published, it logs the success or failure of the operation.
+ * This function attempts to publish an MQTT message to the given topic. The message is streamed to the client
+ * as it is written to the socket. Once the message is published, it logs the success or failure of the operation.
  *
  * @param topic The MQTT topic to which the message will be published. This is a string that identifies
  *              the destination of the message.
  * @param load The payload to be published. This is a string containing the data to be sent over MQTT.
+ * @param retained Whether the broker keeps the message for the future subscribers of the topic.
  *
- * @return True if the message was successfully published (either as a single message or in chunks),
- *         False if there was an error in publishing.
+ * @return True if the message was successfully published or queued
+ *         in the outbox, False if there was an error in publishing.
  *
  * @details
- * The function first checks if the MQTT client is connected. If the connection is active, it proceeds
+ * The function first checks if the MQTT client is connected. If the client is offline or older messages still
+ * wait in the outbox, the message is appended to the outbox (see `mqtt_outbox_init()`) behind them, so the messages
+ * reach the broker in the order they were published. If the connection is active and the outbox is empty, it proceeds
  * to publish the message:
- * - If the message size exceeds the predefined maximum size (`maxMessageSize`), the message will be split
- *   into smaller chunks and published one by one. Each chunk is sent in sequence, and if all chunks are
- *   successfully published, the function returns `true`. If any chunk fails, the function returns `false`.
- * - If the message is small enough to fit within the allowed size, it will be published as a single message.
+ * - If the connection is lost during publishing, the message is appended to the outbox.
+ * - The message is streamed to the client from the load buffer (it is not copied to the client buffer first),
+ *   the client takes as much of it per write as the socket accepts. If the whole message is written, the function
+ *   returns `true`, otherwise it returns `false`.
  *
- * The function uses `mqtt.beginPublish()` to initiate the message publication, `mqtt.print()` to send
- * each chunk (if necessary), and `mqtt.endPublish()` to finalize the message sending. It logs the status
+ * The function uses `mqtt.beginPublish()` to initiate the message publication, `mqtt.write()` to send
+ * the payload, and `mqtt.endPublish()` to finalize the message sending. It logs the status
  * of the operation using `esplogI()` and `esplogW()` for success and failure messages respectively.
  * 
  * After the publishing attempt (whether successful or not), the payload message is logged using the 
  * `logMqttMessage()` function.
  *
- * @note The maximum allowed message size (`maxMessageSize`) is set to 200 bytes. If the payload exceeds
- *       this size, the message is split into chunks. This can be adjusted by changing the `maxMessageSize`
- *       value.
- * 
  * Example Usage:
  * @code
  * String topic = "home/temperature";
@@ -112,44 +362,301 @@ void mqtt_callback(char* topic, byte* message, unsigned int length);
  * }
  * @endcode
  */
-bool mqtt_publish(String topic, String load);
+bool mqtt_publish(String topic, String load, bool retained = false);
 
 /**
- * @brief Logs an MQTT message to a daily log file on the SD card.
+ * @brief Publishes an MQTT message from caller's buffers (no heap allocation).
  *
- * This function logs the received MQTT message to a JSON file on the SD card. The log file is organized
- * by month and day, creating directories and files as needed. If the log file for the current day exists,
- * the message is appended to the file. If not, a new file is created. The function also ensures that the
- * folder structure (year/month) is created if it doesn't exist.
+ * Same as `mqtt_publish()` (including the outbox and the SD card log), but the topic and the load are not copied into
+ * `String` objects. Used by the publishing task of the Zigbee reports, which builds both in fixed buffers (see
+ * `pack_attr_json()`).
  *
- * @param load The MQTT message payload to be logged. This is a string containing the message to be written
- *             to the log file in JSON format.
+ * @param topic The MQTT topic (null terminated).
+ * @param load The payload (it does not have to be null terminated, `len` bytes are logged to the SD card).
+ * @param len The length of the payload.
+ * @param retained Whether the broker keeps the message for the future subscribers of the topic.
  *
- * @return True if the MQTT message was successfully logged to the SD card, False if any error occurs
- *         during the logging process (e.g., incorrect datetime, failed file creation, or write failure).
+ * @return `true` if the message was published or queued in the outbox, `false` otherwise.
+ */
+bool mqtt_publish_raw(const char * topic, const char * load, size_t len, bool retained = false);
+
+/**
+ * @brief Checks if the attribute messages are encoded in MessagePack (`mqtt_format` in the configuration is
+ *        `MQTT_FORMAT_MSGPACK`).
  *
- * @details
- * The function uses the system's datetime (retrieved from `g_vars_ptr->datetime`) to create a folder structure
- * based on the year and month (e.g., `/2024-12`). It then creates or appends to a daily log file (e.g., `2024-12-17.json`)
- * within that folder. The MQTT message is written in JSON format and is properly enclosed in a JSON array. If the file
- * already exists, the function appends the new message, ensuring that the array format remains valid by adding a comma
- * between messages. If the file doesn't exist, it creates the file and starts the JSON array.
+ * @return `true` for MessagePack, `false` for JSON.
+ */
+bool mqtt_format_msgpack();
+
+/**
+ * @brief Publishes a MessagePack message from caller's buffers.
+ *
+ * Same as `mqtt_publish_raw()`, but the payload is binary. The SD card log stays JSON, the message is converted for
+ * it (the conversion is the only allocation).
+ *
+ * @param topic The MQTT topic (null terminated).
+ * @param load The MessagePack payload.
+ * @param len The length of the payload.
+ * @param retained Whether the broker keeps the message for the future subscribers of the topic.
+ *
+ * @return `true` if the message was published or queued in the outbox, `false` otherwise.
+ */
+bool mqtt_publish_msgpack(const char * topic, const uint8_t * load, size_t len, bool retained = false);
+
+/**
+ * @brief Publishes an attribute message packed in the configured format.
+ *
+ * Calls `mqtt_publish_msgpack()` if `mqtt_format_msgpack()`, otherwise `mqtt_publish_raw()`. The message has to be
+ * packed by `pack_attr_msgpack()` or `pack_attr_json()` (and their variants) accordingly.
+ *
+ * @param topic The MQTT topic (null terminated).
+ * @param load The payload.
+ * @param len The length of the payload.
+ * @param retained Whether the broker keeps the message for the future subscribers of the topic.
+ *
+ * @return `true` if the message was published or queued in the outbox, `false` otherwise.
+ */
+bool mqtt_publish_attr(const char * topic, const char * load, size_t len, bool retained = false);
+
+/**
+ * @brief Checks if the telemetry batching is enabled (`mqtt_batch_ms` in the configuration is not 0).
+ *
+ * @return `true` if the reports passed to `mqtt_batch_add()` are batched.
+ */
+bool mqtt_batch_enabled();
+
+/**
+ * @brief Adds a telemetry message to the batch of its topic.
+ *
+ * The messages of one topic (one device) are collected into an array (JSON or MessagePack, see `mqtt_format_msgpack()`),
+ * which is published as a single message `mqtt_batch_ms` after the first message of the batch, or earlier when the
+ * array would exceed `mqtt_batch_bytes`
+ * (see `mqtt_batch_poll()`). At most `MQTT_BATCH_TOPICS` topics are batched at once, when another topic is added the
+ * oldest batch is published. The messages of a batch are logged to the SD card as separate items of the daily log.
+ *
+ * @param topic The MQTT topic of the message.
+ * @param load The payload of the message in the configured format (an item of the published array).
+ * @param len The length of the payload.
+ *
+ * @return bool
+ * - `true` if the message was added to the batch (or published, see below).
+ * - `false` if the batching is disabled or the message is larger than the batch size, and publishing it failed
+ *   (such a message is published right away by `mqtt_publish_attr()`, after the batch of its topic).
+ *
+ * @note The batches are not locked, call it from one task only (the Zigbee publishing task). The alarm-relevant
+ *       messages are not batched, publish them by `mqtt_publish_attr()` after `mqtt_batch_flush()` of their topic.
+ *
+ * Example Usage:
+ * @code
+ * if (critical) {
+ *     mqtt_batch_flush(topic);
+ *     mqtt_publish_attr(topic, load, len);
+ * } else {
+ *     mqtt_batch_add(topic, load, len);
+ * }
+ * @endcode
+ */
+bool mqtt_batch_add(const char * topic, const char * load, size_t len);
+
+/**
+ * @brief Publishes the batch of a topic right away (keeps the order with a message published directly to it).
+ *
+ * @param topic The MQTT topic of the batch.
+ *
+ * @return `false` if the batch was not empty and publishing it failed, `true` otherwise.
+ */
+bool mqtt_batch_flush(const char * topic);
+
+/**
+ * @brief Publishes the batches which are older than `mqtt_batch_ms`.
+ *
+ * @return uint32_t Time (in ms) until the next batch is due, at most `MQTT_BATCH_POLL_MAX_MS` (the publishing task
+ *         waits for the next message at most this long).
+ */
+uint32_t mqtt_batch_poll();
+
+/**
+ * @brief Prepares the publishing of the Zigbee publish jobs (see `mqtt_zigbee_publish()`).
+ *
+ * Writes the configured topic as the prefix of the published topics and takes the configured format
+ * (see `mqtt_format_msgpack()`), the buffer of the batched MessagePack responses is allocated once. Call it when
+ * the publishing task starts.
+ *
+ * @return `false` if the configured topic is too long, the jobs are then consumed without publishing (so the queues
+ *         do not fill up), `true` otherwise.
+ */
+bool mqtt_zigbee_init();
+
+/**
+ * @brief Publishes a Zigbee publish job (the body of `rtosZigbeePublish`).
+ *
+ * The topic is `<topic><path><ieee>` (`/report/`, `/read/out/`, `/write/out/`, `/event/` or `/device/`) or
+ * `<topic><path>` of a batched response (`/read/out`, `/write/out`). The attributes are packed into a fixed buffer
+ * in the configured format, the telemetry is added to the batch of its topic (`mqtt_batch_add()`), the alarm-relevant
+ * reports, events and responses are published right away after the batch of the topic. The slot of a batched response
+ * is freed (`zigbee_publish_batch_release()`), the device metadata are taken from the registry and published retained.
+ *
+ * @param job The job taken by `zigbee_publish_dequeue()`.
+ *
+ * @return `true` if the message was published, queued in the outbox or added to a batch, `false` otherwise.
+ *
+ * @note The topic buffer is not locked, call it from one task only (the Zigbee publishing task), after `mqtt_zigbee_init()`.
+ *
+ * Example Usage:
+ * @code
+ * mqtt_zigbee_init();
+ * for (;;) {
+ *     uint32_t wait_ms = mqtt_batch_poll();
+ *     if (zigbee_publish_dequeue(&job, wait_ms / portTICK_PERIOD_MS)) {
+ *         mqtt_zigbee_publish(&job);
+ *     }
+ * }
+ * @endcode
+ */
+bool mqtt_zigbee_publish(const zigbee_publish_job_t * job);
+
+/**
+ * @brief Initialises the store-and-forward outbox of the MQTT messages.
+ *
+ * The messages published while the client is offline are appended to segment files on the SD card
+ * (`/outbox/segNNNNNNNN.bin`), so they survive a broker or WiFi outage and a reboot. After reconnect they are
+ * published in order by `mqtt_outbox_drain()`. A segment is closed when it reaches `MQTT_OUTBOX_SEGMENT_SIZE` and
+ * removed when it was drained. The outbox is bounded to `MQTT_OUTBOX_SEGMENTS` segments, the oldest segment is dropped
+ * when it is exceeded.
+ *
+ * During boot the segments left by the previous run are scanned from the saved drain position (`MQTT_OUTBOX_HEAD_FILE`),
+ * a segment with a torn or corrupted message is drained only up to it and the new messages are always appended to a new
+ * segment.
+ *
+ * @return bool
+ * - `true` if the outbox was initialised.
+ * - `false` if the outbox directory could not be created (the messages are not queued).
  *
- * The log file and folder paths are created dynamically based on the current date and time. If any issue occurs during
- * folder or file creation, or if the SD card cannot be accessed, the function logs an appropriate warning and returns `false`.
- * If everything is successful, the function returns `true`.
+ * @note The drain position is saved every `MQTT_OUTBOX_HEAD_SAVE_MS` while draining, so the messages published
+ *       shortly before a reset may be published again after it (at-least-once delivery).
+ *
+ * Example Usage:
+ * @code
+ * SD.begin(SD_CS_PIN);
+ * mqtt_outbox_init();
+ * @endcode
+ */
+bool mqtt_outbox_init();
+
+/**
+ * @brief Appends a message to the outbox.
+ *
+ * The message is written to the current segment with a header holding its lengths, the retained flag and the CRC
+ * of the topic and load.
+ *
+ * @param topic The MQTT topic of the message (at most `MQTT_OUTBOX_TOPIC_MAX` characters).
+ * @param load The payload of the message.
+ * @param len The length of the payload (at most `MQTT_OUTBOX_LOAD_MAX` bytes).
+ * @param retained Whether the broker keeps the message for the future subscribers of the topic.
+ *
+ * @return bool
+ * - `true` if the message was queued.
+ * - `false` if the outbox is not initialised, the message is too large or it could not be written.
+ */
+bool mqtt_outbox_push(const char * topic, const uint8_t * load, size_t len, bool retained);
+
+/**
+ * @brief Publishes the queued messages in order while the client is connected.
+ *
+ * The messages are published at most at `MQTT_OUTBOX_DRAIN_RATE` messages per second (the unused rate is accumulated
+ * for at most one second), so the broker and the other tasks are not flooded after a long outage. The messages are read
+ * from the SD card in blocks of `MQTT_OUTBOX_CACHE_SIZE` bytes. When the outbox was drained after an outage, its
+ * statistics are published to the `<topic>/outbox` topic.
+ *
+ * @return size_t Number of published messages.
+ *
+ * @note Called periodically by the MQTT task.
+ */
+size_t mqtt_outbox_drain();
+
+/**
+ * @brief Records the state of the connection to the broker for the outage statistics.
+ *
+ * The other tasks publish right away only while the connection is recorded as up, otherwise the messages are queued
+ * (see `mqtt_publish()`).
+ *
+ * @param connected `true` when the client connected, `false` when the connection was lost.
+ */
+void mqtt_outbox_link(bool connected);
+
+/**
+ * @brief Returns the statistics of the outbox.
+ *
+ * @return mqtt_outbox_stats_t Copy of the outbox statistics.
+ */
+mqtt_outbox_stats_t mqtt_outbox_get_stats();
+
+/**
+ * @brief Serialises the statistics of the outbox to JSON.
+ *
+ * @param json Pointer to the string where the JSON object is stored, e.g.
+ *             `{"pending": 12, "pending_bytes": 3104, "max_pending": 240, "queued": 240, "sent": 228, "dropped": 0,
+ *             "errors": 0, "outages": 1, "offline_ms": 0, "last_offline_ms": 95012, "total_offline_ms": 95012}`.
+ *
+ * @return bool
+ * - `true` if the statistics were serialised.
+ * - `false` if the serialisation failed.
+ */
+bool mqtt_outbox_dump(String * json);
+
+/**
+ * @brief Initialises the lock of the MQTT message archive (the daily log files on the SD card).
+ *
+ * Must be called before the messages are published from several tasks. The buffered lines are also written by
+ * `rebootESP()` (see `rebootAddHook()`).
+ *
+ * @return `true` if the lock was created (or already existed), `false` if there is not enough memory.
+ */
+bool mqtt_log_init();
+
+/**
+ * @brief Logs an MQTT message to the daily log file on the SD card.
+ *
+ * The archive is newline-delimited JSON: each message is one line of the file `/mqtt/YYYY-MM/YYYY-MM-DD.ndjson`
+ * (`MQTT_LOG_FILES_PATH`, `MQTT_LOG_FILE_EXT`), the file is only appended to, so a write interrupted by a reset damages
+ * at most its last line. The lines are collected in a RAM buffer (`MQTT_LOG_BUFFER_SIZE`) and written to the file,
+ * which is kept open, when the buffer is full, when the day changes or by `mqtt_log_flush()` after `MQTT_LOG_FLUSH_MS`.
+ * A message larger than the buffer is written right away. The month folder is checked once per day.
+ *
+ * @param load The MQTT message payload to be logged. This is a null terminated string containing compact JSON
+ *             (it must not contain a newline).
+ *
+ * @return bool
+ * - `true` if the message was buffered (and the buffered messages written, if it was needed).
+ * - `false` if the datetime is not set yet or writing the buffered messages to the SD card failed (they are dropped).
  *
  * Example Usage:
  * @code
  * String message = "{\"topic\": \"home/temperature\", \"value\": 22.5}";
- * if (logMqttMessage(message)) {
+ * if (logMqttMessage(message.c_str())) {
  *     Serial.println("Message successfully logged.");
  * } else {
  *     Serial.println("Failed to log message.");
  * }
  * @endcode
  */
-bool logMqttMessage(const String mqttMessage);
+bool logMqttMessage(const char * load);
+
+/**
+ * @brief Writes the buffered MQTT log lines to the SD card.
+ *
+ * Called periodically by the log task, the lines are written once the oldest of them is `MQTT_LOG_FLUSH_MS` old.
+ *
+ * @param force Write the buffered lines right away (e.g. before a restart).
+ *
+ * @return `false` if writing the lines failed or the archive is not initialised, `true` otherwise.
+ *
+ * Example Usage:
+ * @code
+ * mqtt_log_flush(false);
+ * @endcode
+ */
+bool mqtt_log_flush(bool force);
 
 /**
  * @brief Cleans up old MQTT log directories from the SD card.
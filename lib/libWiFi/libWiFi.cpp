@@ -1,6 +1,7 @@
 #include "libWiFi.h"
 
 AsyncWebServer server(80);
+AsyncEventSource log_events("/log/events");
 
 extern g_vars_t * g_vars_ptr;
 extern g_config_t * g_config_ptr;
@@ -71,6 +72,108 @@ void startWifiSetupMode() {
     server.begin();
 }
 
+// streams the new log records to the connected event source clients, called by the log writer
+static void logEventsSink(uint32_t seq, log_level_t level, const char* line) {
+    if (log_events.count() > 0) {
+        log_events.send(line, "log", seq);
+    }
+}
+
+// parses the http range header "bytes=first-last", "bytes=first-" or "bytes=-suffix"
+static bool parseRange(const String& range, size_t size, size_t* offset, size_t* length) {
+    if (!range.startsWith("bytes=") || size == 0) {
+        return false;
+    }
+
+    const char* spec = range.c_str() + 6;
+    const char* dash = strchr(spec, '-');
+    if (dash == NULL || strchr(spec, ',') != NULL) {
+        return false;
+    }
+
+    char* end;
+    if (dash == spec) {
+        unsigned long suffix = strtoul(dash + 1, &end, 10);
+        if (end == dash + 1 || suffix == 0) {
+            return false;
+        }
+        *length = suffix < size ? suffix : size;
+        *offset = size - *length;
+        return true;
+    }
+
+    unsigned long first = strtoul(spec, &end, 10);
+    if (end != dash || first >= size) {
+        return false;
+    }
+    unsigned long last = size - 1;
+    if (*(dash + 1) != '\0') {
+        last = strtoul(dash + 1, &end, 10);
+        if (*end != '\0' || last < first) {
+            return false;
+        }
+        last = last < size - 1 ? last : size - 1;
+    }
+
+    *offset = first;
+    *length = last - first + 1;
+    return true;
+}
+
+// sends the log file (or its part) in chunks, so the whole file is never loaded to RAM
+static void sendLogFile(AsyncWebServerRequest *request, const char* path) {
+    File file = SD.open(path, FILE_READ);
+    if (!file) {
+        request->send(404, "text/plain", "File not found!");
+        return;
+    }
+
+    size_t size = file.size();
+    size_t offset = 0;
+    size_t length = size;
+    bool partial = false;
+
+    if (request->hasHeader("Range")) {
+        if (!parseRange(request->header("Range"), size, &offset, &length)) {
+            file.close();
+            AsyncWebServerResponse *response = request->beginResponse(416, "text/plain", "Invalid range!\n");
+            response->addHeader("Content-Range", "bytes */" + String(size));
+            request->send(response);
+            return;
+        }
+        partial = true;
+    } else if (request->hasParam("offset") || request->hasParam("length")) {
+        offset = request->hasParam("offset") ? strtoul(request->getParam("offset")->value().c_str(), NULL, 10) : 0;
+        offset = offset < size ? offset : size;
+        length = request->hasParam("length") ? strtoul(request->getParam("length")->value().c_str(), NULL, 10) : size - offset;
+        length = length < size - offset ? length : size - offset;
+        partial = true;
+    }
+
+    if (!file.seek(offset)) {
+        file.close();
+        request->send(500, "text/plain", "Failed to read the file!\n");
+        return;
+    }
+
+    AsyncWebServerResponse *response = request->beginResponse(LOG_FILE_MIME, length, [file, length](uint8_t *buffer, size_t max_len, size_t index) mutable -> size_t {
+        if (index >= length) {
+            file.close();
+            return 0;
+        }
+        size_t chunk = length - index < max_len ? length - index : max_len;
+        int read = file.read(buffer, chunk);
+        return read > 0 ? (size_t)read : 0;
+    });
+
+    response->addHeader("Accept-Ranges", "bytes");
+    if (partial) {
+        response->setCode(206);
+        response->addHeader("Content-Range", "bytes " + String(offset) + "-" + String(offset + length - 1) + "/" + String(size));
+    }
+    request->send(response);
+}
+
 void startWiFiServerMode() {
     WiFi.mode(WIFI_MODE_STA);
     g_vars_ptr->wifi_mode = WIFI_MODE_STA;
@@ -143,6 +246,9 @@ void startWiFiServerMode() {
                 if (p->name() == "mqtt_tpc" && p->value().length() > 0) {c.mqtt_topic = p->value();}
                 if (p->name() == "mqtt_usrnm" && p->value().length() > 0) {c.mqtt_username = p->value();}
                 if (p->name() == "mqtt_pswd") {c.mqtt_password = p->value();}
+                if (p->name() == "mqtt_batch_ms" && p->value().length() > 0) {c.mqtt_batch_ms = p->value().toInt();}
+                if (p->name() == "mqtt_batch_b" && p->value().length() > 0) {c.mqtt_batch_bytes = p->value().toInt();}
+                if (p->name() == "mqtt_format" && p->value().length() > 0) {c.mqtt_format = p->value().toInt() == MQTT_FORMAT_MSGPACK ? MQTT_FORMAT_MSGPACK : MQTT_FORMAT_JSON;}
 
                 if (p->name() == "countdown" && p->value().length() > 0) {c.alarm_countdown_s = p->value().toInt();}
                 if (p->name() == "countdown_e" && p->value().length() > 0) {c.alarm_e_countdown_s = p->value().toInt();}
@@ -152,6 +258,13 @@ void startWiFiServerMode() {
             }
         }
 
+        // the topics are built in fixed buffers, a longer topic would leave the Zigbee attributes unpublished
+        if (c.mqtt_topic.length() > MQTT_TOPIC_MAX) {
+            esplogW(TAG_SERVER, "(startWiFiServerMode)", "MQTT topic is too long, configuration rejected! (length: %u, max: %u)", c.mqtt_topic.length(), (unsigned)MQTT_TOPIC_MAX);
+            request->send(400, "text/plain", "MQTT topic is too long, the configuration was not saved!\n");
+            return;
+        }
+
         esplogI(TAG_SERVER, "(startWiFiServerMode)", "Received configuration:\n -> mqtt:\n   - tls: %d\n   - broker: %s\n   - port: %d\n   - id: %s\n   - topic: %s\n   - username: %s\n   - password: %s\n -> alarm:\n   - cnt (c): %d\n   - cnt (e): %d\n,   - thr (w): %d\n   - thr (e): %d\n   - tel: %s\n",
             c.mqtt_tls, c.mqtt_broker.c_str(), c.mqtt_port, c.mqtt_id.c_str(), c.mqtt_topic.c_str(), c.mqtt_username.c_str(), c.mqtt_password.c_str(),
             c.alarm_countdown_s, c.alarm_e_countdown_s, c.alarm_w_threshold, c.alarm_e_threshold, c.alarm_telephone.c_str());
@@ -175,22 +288,205 @@ void startWiFiServerMode() {
 
         displayRestart();
         delay(3000);
+        mqtt_log_flush(true);
         ESP.restart();
     });
 
     // server.onNotFound();
 
+    // ------------------------------------------------------- LOG ------------------------------------------------------
+
+    server.on("/log/level", HTTP_GET, [](AsyncWebServerRequest *request){
+        if (!request->authenticate(http_username, http_password)) {
+            return request->requestAuthentication();
+        }
+        String response;
+        char name[16];
+        for (int i = 0; i < TAG_ID_MAX; i++) {
+            response += String(logTagName(&log_tags[i], name, sizeof(name))) + ": " + logLevelName(log_tags[i].level) + "\n";
+        }
+        request->send(200, "text/plain", response);
+    });
+
+    server.on("/log/level", HTTP_POST, [](AsyncWebServerRequest *request){
+        if (!request->authenticate(http_username, http_password)) {
+            return request->requestAuthentication();
+        }
+        if (!request->hasParam("tag", true) || !request->hasParam("level", true)) {
+            request->send(400, "text/plain", "Missing 'tag' or 'level' parameter!\n");
+            return;
+        }
+
+        String tag = request->getParam("tag", true)->value();
+        String level_str = request->getParam("level", true)->value();
+        log_level_t level;
+        if (!logParseLevel(level_str.c_str(), &level) || !logSetLevel(tag.c_str(), level)) {
+            esplogW(TAG_SERVER, "(startWiFiServerMode)", "Invalid log level request! (tag: %s, level: %s)", tag.c_str(), level_str.c_str());
+            request->send(400, "text/plain", "Invalid tag or log level!\n");
+            return;
+        }
+
+        esplogI(TAG_SERVER, "(startWiFiServerMode)", "Log level of '%s' set to: %s", tag.c_str(), logLevelName(level));
+        request->send(200, "text/plain", "Log level set successfully!\n");
+    });
+
+    server.on("/log/tail", HTTP_GET, [](AsyncWebServerRequest *request){
+        if (!request->authenticate(http_username, http_password)) {
+            return request->requestAuthentication();
+        }
+
+        uint32_t first, next;
+        logHistoryRange(&first, &next);
+
+        uint32_t since = request->hasParam("since") ? strtoul(request->getParam("since")->value().c_str(), NULL, 10) : first;
+        uint32_t limit = request->hasParam("limit") ? strtoul(request->getParam("limit")->value().c_str(), NULL, 10) : LOG_HISTORY_RECORDS;
+        since = since > first ? since : first;
+
+        String response;
+        char line[LOG_HISTORY_LINE_MAX];
+        uint32_t seq = since;
+        for (; seq < next && seq - since < limit; seq++) {
+            if (logHistoryGet(seq, line, sizeof(line))) {
+                response += String(line) + "\n";
+            }
+        }
+
+        AsyncWebServerResponse *tail = request->beginResponse(200, "text/plain", response);
+        tail->addHeader("X-Log-First", String(first));
+        tail->addHeader("X-Log-Next", String(seq));
+        request->send(tail);
+    });
+
+    server.on("/log/segments", HTTP_GET, [](AsyncWebServerRequest *request){
+        if (!request->authenticate(http_username, http_password)) {
+            return request->requestAuthentication();
+        }
+
+        uint32_t first, next;
+        if (!logGetSegments(&first, &next)) {
+            request->send(500, "text/plain", "Log is not initialised!\n");
+            return;
+        }
+
+        String response;
+        char path[48];
+        for (uint32_t gen = first; gen < next; gen++) {
+            File file = SD.open(logSegmentPath(gen, path, sizeof(path)), FILE_READ);
+            if (file) {
+                response += String(gen) + " " + String(file.size()) + " " + path + "\n";
+                file.close();
+            }
+        }
+        File file = SD.open(LOG_FILE, FILE_READ);
+        response += "active " + String(file ? file.size() : 0) + " " + LOG_FILE + "\n";
+        if (file) {
+            file.close();
+        }
+
+        request->send(200, "text/plain", response);
+    });
+
+    log_events.setAuthentication(http_username, http_password);
+    log_events.onConnect([](AsyncEventSourceClient *client){
+        uint32_t first, next;
+        logHistoryRange(&first, &next);
+
+        // a reconnected client continues after the last received record, a new one gets all records kept in RAM
+        uint32_t seq = client->lastId() + 1;
+        seq = seq > first ? seq : first;
+
+        char line[LOG_HISTORY_LINE_MAX];
+        for (; seq < next; seq++) {
+            if (logHistoryGet(seq, line, sizeof(line))) {
+                client->send(line, "log", seq);
+            }
+        }
+    });
+    server.addHandler(&log_events);
+    logSetSink(logEventsSink);
+
+    // ----------------------------------------------------- ZIGBEE -----------------------------------------------------
+
+    server.on("/zigbee/rules", HTTP_GET, [](AsyncWebServerRequest *request){
+        if (!request->authenticate(http_username, http_password)) {
+            return request->requestAuthentication();
+        }
+        String response;
+        if (!zigbeeRulesDump(&response)) {
+            request->send(500, "text/plain", "Failed to serialise report rules!\n");
+            return;
+        }
+        request->send(200, "application/json", response);
+    });
+
+    server.on("/zigbee/rules", HTTP_POST, [](AsyncWebServerRequest *request){
+        if (!request->authenticate(http_username, http_password)) {
+            return request->requestAuthentication();
+        }
+
+        // without the 'rules' parameter the rule file is reloaded from the SD card
+        bool ok;
+        bool applied = false;
+        if (request->hasParam("rules", true)) {
+            ok = zigbeeRulesUpdate(request->getParam("rules", true)->value(), &applied);
+        } else {
+            ok = zigbeeRulesLoad();
+        }
+
+        if (!ok && applied) {
+            esplogW(TAG_SERVER, "(startWiFiServerMode)", "Failed to save report rules!");
+            request->send(500, "text/plain", "Report rules applied, but they could not be saved to the SD card!\n");
+            return;
+        }
+
+        if (!ok) {
+            esplogW(TAG_SERVER, "(startWiFiServerMode)", "Failed to apply report rules!");
+            request->send(400, "text/plain", "Invalid report rules, the active rules are kept!\n");
+            return;
+        }
+
+        esplogI(TAG_SERVER, "(startWiFiServerMode)", "Report rules applied!");
+        request->send(200, "text/plain", "Report rules applied successfully!\n");
+    });
+
+    // ------------------------------------------------------ MQTT ------------------------------------------------------
+
+    server.on("/mqtt/outbox", HTTP_GET, [](AsyncWebServerRequest *request){
+        if (!request->authenticate(http_username, http_password)) {
+            return request->requestAuthentication();
+        }
+        String response;
+        if (!mqtt_outbox_dump(&response)) {
+            request->send(500, "text/plain", "Failed to serialise outbox statistics!\n");
+            return;
+        }
+        request->send(200, "application/json", response);
+    });
+
     // ---------------------------------------------------- DOWNOLAD ----------------------------------------------------
 
     server.on("/download/log", HTTP_GET, [](AsyncWebServerRequest *request){
         if (!request->authenticate(http_username, http_password)) {
             return request->requestAuthentication();
         }
-        if (SD.exists(LOG_FILE)) {
-            request->send(SD, LOG_FILE, "text/plain");
-        } else {
-            request->send(200, "text/plain", "File not found!");
+
+        // the buffered records are written first, so the downloaded file is up to date
+        logFlush(true);
+
+        if (!request->hasParam("segment")) {
+            sendLogFile(request, LOG_FILE);
+            return;
         }
+
+        uint32_t first, next;
+        uint32_t gen = strtoul(request->getParam("segment")->value().c_str(), NULL, 10);
+        if (!logGetSegments(&first, &next) || gen < first || gen >= next) {
+            request->send(404, "text/plain", "Segment not found!\n");
+            return;
+        }
+
+        char path[48];
+        sendLogFile(request, logSegmentPath(gen, path, sizeof(path)));
     });
 
     server.on("/download/password", HTTP_GET, [](AsyncWebServerRequest *request){
@@ -16,6 +16,8 @@
 #include "mainAppDefinitions.h"
 #include "libJson.h"
 #include "libAuth.h"
+#include "libZigbee.h"
+#include "libMqtt.h"
 #include "utils.h"
 
 #ifdef EINK
@@ -76,7 +78,14 @@ void startWifiSetupMode();
  *    - `/` serves the main page, requiring authentication.
  *    - `/login` and `/logout` handle login/logout actions.
  *    - `/setup` serves a setup page and handles POST requests to update the configuration.
- *    - `/download/*` allows downloading various files (logs, password, RFID, configuration).
+ *    - `/log/level` lists the runtime log levels of all tags (GET) and sets the level of a tag (POST, params `tag` and `level`).
+ *    - `/log/tail` returns the last log records kept in RAM (params `since` and `limit`, headers `X-Log-First` and `X-Log-Next`).
+ *    - `/log/events` streams the new log records as server-sent events (event `log`, the id is the record sequence number,
+ *      so a reconnected client continues after the last received record).
+ *    - `/log/segments` lists the rotated log segments (generation, size, path) and the active log file.
+ *    - `/mqtt/outbox` returns the statistics of the MQTT outbox as JSON (backlog, outage durations, see `mqtt_outbox_dump()`).
+ *    - `/download/*` allows downloading various files (logs, password, RFID, configuration). The log download accepts
+ *      param `segment` (generation of a rotated segment), params `offset` and `length` or a http `Range` header.
  *    - `/upload/config` accepts a configuration file and writes it to the SD card, then restarts the device.
  * 4. On successful configuration update, the system saves the configuration and restarts to apply the changes.
  *
@@ -1,109 +1,91 @@
 #include "libZigbee.h"
 
-HardwareSerial SerialZigbee(2);
-
 extern TaskHandle_t handleTaskZigbee;
 extern g_vars_t * g_vars_ptr;
 extern g_config_t * g_config_ptr;
 
-void updateSerialZigbee() {
-    while (Serial.available()) {
-        SerialZigbee.write(Serial.read());
-    }
-
-    while (SerialZigbee.available()) {
-        Serial.write(SerialZigbee.read());
-    }
-}
-
-/**
- * @brief Sends a message to the Zigbee module and waits for the correct acknowledgment response.
- *
- * This function sends a message over the Zigbee UART interface and waits for a corresponding acknowledgment
- * within a specified timeout period. It temporarily suspends the Zigbee task to ensure exclusive access to
- * the UART interface. The function checks if the received message matches the expected response type and ID.
- *
- * @param[in] sendMsg Pointer to the message to be sent.
- * @param[out] receivedMsg Double pointer to store the received acknowledgment message.
- * @param[in] timeout Optional timeout in milliseconds to wait for a response (default is 5000 ms).
- * @return The number of bytes sent on success, or -1 if the operation times out or fails.
- *
- * @note The function suspends `handleTaskZigbee` during the operation to avoid UART conflicts.
- *
- * @warning If `sendMsg` or `receivedMsg` is `NULL`, the function logs a warning and returns `false`.
- *
- * @details The function operates as follows:
- *  1. Clears any pending data in the Zigbee UART buffer.
- *  2. Suspends `handleTaskZigbee` if it's not the current task.
- *  3. Sends the message using `send_message()`.
- *  4. Waits for an acknowledgment response by calling `receive_message()`.
- *  5. Verifies the response direction, ID, and status.
- *  6. Resumes `handleTaskZigbee` after completion.
- *
- * Example Usage:
- * @code
- * iot_alarm_message_t sendMsg = {...};
- * iot_alarm_message_t *receivedMsg = NULL;
- * int result = waitForCorrectResponseZigbee(&sendMsg, &receivedMsg);
- * if (result > 0) {
- *     // Success handling
- * } else {
- *     // Error handling
- * }
- * @endcode
- */
-int waitForCorrectResponseZigbee(iot_alarm_message_t * sendMsg, iot_alarm_message_t ** receivedMsg, unsigned long timeout = 5000) {
-    if (sendMsg == NULL || receivedMsg == NULL) {
-        esplogW(TAG_LIB_ZIGBEE, "(waitForCorrectResponseZigbee)", "Message to be sent or received is nullptr!");
-        return false;
-    }
-
-    while (SerialZigbee.available()) {
-        SerialZigbee.read();
-    }
-
-
-    if (xTaskGetCurrentTaskHandle() != handleTaskZigbee && handleTaskZigbee != NULL) {
-        vTaskSuspend(handleTaskZigbee);
-    }
-
-    unsigned long startTime = millis();
-    int tx_bytes = 0;
-    int rx_bytes;
-    bool ret = false;
-    while (millis() - startTime < timeout) {
-        // send command
-        tx_bytes = send_message(UART, tx_buffer, sendMsg);
+static QueueHandle_t zigbee_uart_queue = NULL;
 
-        vTaskDelay(550 / portTICK_PERIOD_MS);
+typedef enum {
+    ZIGBEE_COMMAND_FREE,                // slot is not used
+    ZIGBEE_COMMAND_PENDING,             // command waits for the acknowledge
+    ZIGBEE_COMMAND_DONE,                // command of a waiting task finished, the task frees the slot
+} zigbee_command_state_t;
 
-        // receive command
-        rx_bytes = receive_message(UART, rx_buffer, receivedMsg, RX_BUF_SIZE-1);
+typedef struct {
+    zigbee_command_state_t state;
+    bool waiting;                       // a task waits for the command (notified by the semaphore instead of the callback)
+    bool success;
+    uint8_t seq;
+    message_type_t id;
+    message_direction_t ack_dir;        // direction of the expected acknowledge
+    TickType_t deadline;                // tick count after which the command fails
+    TickType_t resend;                  // tick count after which the frame is sent again
+    zigbee_command_cb_t cb;
+    void* ctx;
+    SemaphoreHandle_t done;
+    size_t frame_len;
+    uint8_t frame[ZIGBEE_COMMAND_FRAME_MAX];
+} zigbee_command_t;
+
+// in-flight command table, the frames are kept in the slots so they can be sent again
+static zigbee_command_t zigbee_commands[ZIGBEE_COMMAND_SLOTS];
+static SemaphoreHandle_t zigbee_command_mutex = NULL;
+static uint8_t zigbee_command_seq = 0;
+
+static bool zigbee_command_init();
+static bool zigbee_rules_init();
+static bool device_registry_init();
+static bool zigbee_publish_init();
+static bool zigbee_rules_evaluate(const iot_alarm_attr_load_t * attr);
+static void serialize_attr_command(iot_alarm_attr_load_t * attr, char * buffer, size_t * bytes);
+static void fill_attr(iot_alarm_attr_load_t * attr, const char * manuf, const char * name, const char * type, uint32_t type_id, esp_zb_ieee_addr_t ieee_addr, uint16_t short_addr, uint8_t device_id, uint8_t endpoint_id, uint16_t cluster_id, uint16_t attr_id, esp_zb_zcl_attr_type_t value_type, uint32_t value);
+
+#ifdef ZIGBEE_LATENCY_PROBE
+static volatile int64_t zigbee_probe_sent = 0;
+static volatile int64_t zigbee_probe_latency = -1;
+#endif
 
-        // check if acknowledge is received
-        if (((sendMsg->dir == IOT_ALARM_MSGDIR_COMMAND && (*receivedMsg)->dir == IOT_ALARM_MSGDIR_COMMAND_ACK) ||
-                (sendMsg->dir == IOT_ALARM_MSGDIR_NOTIFICATION && (*receivedMsg)->dir == IOT_ALARM_MSGDIR_NOTIFICATION_ACK)) &&
-                sendMsg->id == (*receivedMsg)->id && (*receivedMsg)->st == IOT_ALARM_MSGSTATUS_SUCCESS) {
-            ret = true;
-            break;
-        }
-    }
+void updateSerialZigbee() {
+    uint8_t buffer[64];
+    size_t available = 0;
 
-    if (xTaskGetCurrentTaskHandle() != handleTaskZigbee && handleTaskZigbee != NULL) {
-        vTaskResume(handleTaskZigbee);
+    while (Serial.available()) {
+        uint8_t byte = Serial.read();
+        uart_write_bytes(UART, (const char *)&byte, 1);
     }
 
-    if (ret == false) {
-        esplogW(TAG_LIB_ZIGBEE, "(waitForCorrectResponseZigbee)", "Zigbee module didnt responded in time!");
-        tx_bytes = -1;
+    uart_get_buffered_data_len(UART, &available);
+    while (available > 0) {
+        int read = uart_read_bytes(UART, buffer, available < sizeof(buffer) ? available : sizeof(buffer), 0);
+        if (read <= 0) {
+            break;
+        }
+        Serial.write(buffer, read);
+        uart_get_buffered_data_len(UART, &available);
     }
-    
-    return tx_bytes;
 }
 
 bool initSerialZigbee() {
-    SerialZigbee.begin(ZIGBEE_BAUDRATE, SERIAL_8N1, ZIGBEE_RX_PIN, ZIGBEE_TX_PIN);
-    SerialZigbee.setTimeout(ZIGBEE_TIMEOUT);
+    uart_config_t uart_config = {
+        .baud_rate = ZIGBEE_BAUDRATE,
+        .data_bits = UART_DATA_8_BITS,
+        .parity = UART_PARITY_DISABLE,
+        .stop_bits = UART_STOP_BITS_1,
+        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+        .rx_flow_ctrl_thresh = 0,
+    };
+
+    // the driver posts an event when the RX FIFO reaches the threshold or the line is idle after received bytes
+    if (uart_driver_install(UART, RX_BUF_SIZE * 2, TX_BUF_SIZE * 2, ZIGBEE_UART_QUEUE_SIZE, &zigbee_uart_queue, 0) != ESP_OK ||
+        uart_param_config(UART, &uart_config) != ESP_OK ||
+        uart_set_pin(UART, TXD_PIN, RXD_PIN, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE) != ESP_OK) {
+        esplogW(TAG_LIB_ZIGBEE, "(initSerialZigbee)", "Failed to install zigbee UART driver!");
+        return false;
+    }
+
+    uart_set_rx_timeout(UART, ZIGBEE_RX_IDLE_SYMBOLS);
+    uart_set_rx_full_threshold(UART, ZIGBEE_RX_FULL_THRESHOLD);
 
     #ifdef ZIGBEE_EN_PIN
     pinMode(ZIGBEE_EN_PIN, OUTPUT);
@@ -112,14 +94,17 @@ bool initSerialZigbee() {
     digitalWrite(ZIGBEE_EN_PIN, HIGH);
     #endif
 
+    if (!zigbee_command_init() || !device_registry_init() || !zigbee_rules_init() || !zigbee_publish_init()) {
+        esplogW(TAG_LIB_ZIGBEE, "(initSerialZigbee)", "Failed to create zigbee command table!");
+        return false;
+    }
+
     iot_alarm_message_t * msg = create_message(IOT_ALARM_MSGDIR_COMMAND, IOT_ALARM_MSGSTATUS_SUCCESS, IOT_ALARM_MSGTYPE_ECHO, 1, "\0");
-    iot_alarm_message_t * ack = create_message(IOT_ALARM_MSGDIR_MAX, IOT_ALARM_MSGSTATUS_MAX, IOT_ALARM_MSGTYPE_MAX, 1, "\0");
     int ret = true;
 
     esplogI(TAG_LIB_ZIGBEE, "(initSerialZigbee)", "ZIGBEE INITIALISATION!");
 
-    int tx_bytes = waitForCorrectResponseZigbee(msg, &ack, 10000);
-    if (!ret || tx_bytes <= 0) {
+    if (msg == NULL || !zigbee_command_wait(msg, ZIGBEE_COMMAND_TIMEOUT_MS)) {
         esplogW(TAG_LIB_ZIGBEE, "(initSerialZigbee)", "Failed finding zigbee module!");
         ret = false;
     } else {
@@ -127,18 +112,91 @@ bool initSerialZigbee() {
     }
 
     destroy_message(&msg);
-    destroy_message(&ack);
 
     return ret;
 }
 
+#ifdef ZIGBEE_LATENCY_PROBE
+bool zigbeeLatencyProbe(uint8_t samples) {
+    esp_zb_ieee_addr_t ieee_addr = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    int64_t latency_min = INT64_MAX;
+    int64_t latency_max = 0;
+    int64_t latency_sum = 0;
+    uint8_t handled = 0;
+    size_t length;
+
+    if (handleTaskZigbee == NULL) {
+        esplogW(TAG_LIB_ZIGBEE, "(zigbeeLatencyProbe)", "Zigbee task is not running!");
+        return false;
+    }
+
+    // own TX buffer, the global one is used by the zigbee task for acknowledges
+    uint8_t * probe_buffer = (uint8_t*)malloc(TX_BUF_SIZE + 1);
+    if (probe_buffer == NULL) {
+        esplogW(TAG_LIB_ZIGBEE, "(zigbeeLatencyProbe)", "Failed to allocate memory for probe buffer!");
+        return false;
+    }
+
+    uart_wait_tx_done(UART, pdMS_TO_TICKS(100));
+    uart_set_loop_back(UART, true);
+
+    for (uint8_t i = 0; i < samples; i++) {
+        // the value differs for every sample, so the report is not dropped as a duplicate
+        char load[256];
+        iot_alarm_attr_load_t * attr = create_attr("probe", "probe", "probe", 0, ieee_addr, 0xFFFF, 0, 1, 0, 0, ESP_ZB_ZCL_ATTR_TYPE_U32, 100 + i);
+        if (attr == NULL) {
+            break;
+        }
+        serialize_attr(attr, load, &length);
+        destroy_attr(&attr);
+
+        iot_alarm_message_t msg = {
+            .dir = IOT_ALARM_MSGDIR_NOTIFICATION,
+            .st = IOT_ALARM_MSGSTATUS_SUCCESS,
+            .id = IOT_ALARM_MSGTYPE_ZB_DATA_REPORT,
+            .length = (uint32_t)length,
+            .load = load,
+            .size = 0,
+        };
+
+        zigbee_probe_latency = -1;
+        zigbee_probe_sent = esp_timer_get_time();
+        send_message(UART, probe_buffer, &msg);
+
+        unsigned long startTime = millis();
+        while (zigbee_probe_latency < 0 && millis() - startTime < 1000) {
+            vTaskDelay(1);
+        }
+
+        if (zigbee_probe_latency >= 0) {
+            latency_min = zigbee_probe_latency < latency_min ? zigbee_probe_latency : latency_min;
+            latency_max = zigbee_probe_latency > latency_max ? zigbee_probe_latency : latency_max;
+            latency_sum += zigbee_probe_latency;
+            handled++;
+        }
+        zigbee_probe_sent = 0;
+    }
+
+    uart_wait_tx_done(UART, pdMS_TO_TICKS(100));
+    uart_set_loop_back(UART, false);
+    free(probe_buffer);
+
+    if (handled == 0) {
+        esplogW(TAG_LIB_ZIGBEE, "(zigbeeLatencyProbe)", "No synthetic report has been handled!");
+        return false;
+    }
+
+    esplogI(TAG_LIB_ZIGBEE, "(zigbeeLatencyProbe)", "Report latency (%d/%d samples): min %lld us, avg %lld us, max %lld us",
+        handled, samples, latency_min, latency_sum / handled, latency_max);
+    return handled == samples;
+}
+#endif
+
 bool zigbeeReset() {
     int ret = true;
     iot_alarm_message_t * msg = create_message(IOT_ALARM_MSGDIR_COMMAND, IOT_ALARM_MSGSTATUS_SUCCESS, IOT_ALARM_MSGTYPE_CTL_RESTART, 1, "\0");
-    iot_alarm_message_t * ack = create_message(IOT_ALARM_MSGDIR_MAX, IOT_ALARM_MSGSTATUS_MAX, IOT_ALARM_MSGTYPE_MAX, 1, "\0");
 
-    int tx_bytes = waitForCorrectResponseZigbee(msg, &ack, 10000);
-    if (tx_bytes <= 0) {
+    if (msg == NULL || !zigbee_command_wait(msg, ZIGBEE_COMMAND_TIMEOUT_MS)) {
         esplogW(TAG_LIB_ZIGBEE, "(zigbeeReset)", "Failed sending message to zigbee module!");
         ret = false;
     } else {
@@ -146,17 +204,14 @@ bool zigbeeReset() {
     }
 
     destroy_message(&msg);
-    destroy_message(&ack);
     return ret;
 }
 
 bool zigbeeFactory() {
     int ret = true;
     iot_alarm_message_t * msg = create_message(IOT_ALARM_MSGDIR_COMMAND, IOT_ALARM_MSGSTATUS_SUCCESS, IOT_ALARM_MSGTYPE_CTL_FACTORY, 1, "\0");
-    iot_alarm_message_t * ack = create_message(IOT_ALARM_MSGDIR_MAX, IOT_ALARM_MSGSTATUS_MAX, IOT_ALARM_MSGTYPE_MAX, 1, "\0");
 
-    int tx_bytes = waitForCorrectResponseZigbee(msg, &ack, 10000);
-    if (tx_bytes <= 0) {
+    if (msg == NULL || !zigbee_command_wait(msg, ZIGBEE_COMMAND_TIMEOUT_MS)) {
         esplogW(TAG_LIB_ZIGBEE, "(zigbeeFactory)", "Failed sending message to zigbee module!");
         ret = false;
     } else {
@@ -164,7 +219,6 @@ bool zigbeeFactory() {
     }
 
     destroy_message(&msg);
-    destroy_message(&ack);
     return ret;
 }
 
@@ -172,11 +226,9 @@ bool zigbeeFactory() {
 bool zigbeeCount() {
     int ret = true;
     iot_alarm_message_t * msg = create_message(IOT_ALARM_MSGDIR_COMMAND, IOT_ALARM_MSGSTATUS_SUCCESS, IOT_ALARM_MSGTYPE_DEV_COUNT, 1, "\0");
-    iot_alarm_message_t * ack = create_message(IOT_ALARM_MSGDIR_MAX, IOT_ALARM_MSGSTATUS_MAX, IOT_ALARM_MSGTYPE_MAX, 1, "\0");
 
     // sending the message
-    int tx_bytes = waitForCorrectResponseZigbee(msg, &ack, 10000);
-    if (tx_bytes <= 0) {
+    if (msg == NULL || !zigbee_command_wait(msg, ZIGBEE_COMMAND_TIMEOUT_MS)) {
         esplogW(TAG_LIB_ZIGBEE, "(zigbeeCount)", "Failed sending message to zigbee module!");
         ret = false;
     } else {
@@ -184,7 +236,6 @@ bool zigbeeCount() {
     }
 
     destroy_message(&msg);
-    destroy_message(&ack);
     return ret;
 }
 
@@ -193,11 +244,9 @@ bool zigbeeOpen(uint8_t duration) {
     char load[12];
     sprintf(load, "%d", duration);
     iot_alarm_message_t * msg = create_message(IOT_ALARM_MSGDIR_COMMAND, IOT_ALARM_MSGSTATUS_SUCCESS, IOT_ALARM_MSGTYPE_ZB_DEV_UNLOCK, 4, load);
-    iot_alarm_message_t * ack = create_message(IOT_ALARM_MSGDIR_MAX, IOT_ALARM_MSGSTATUS_MAX, IOT_ALARM_MSGTYPE_MAX, 1, "\0");
 
     // sending the message
-    int tx_bytes = waitForCorrectResponseZigbee(msg, &ack, 10000);
-    if (tx_bytes <= 0) {
+    if (msg == NULL || !zigbee_command_wait(msg, ZIGBEE_COMMAND_TIMEOUT_MS)) {
         esplogW(TAG_LIB_ZIGBEE, "(zigbeeOpen)", "Failed sending message to zigbee module!");
         ret = false;
     } else {
@@ -205,18 +254,15 @@ bool zigbeeOpen(uint8_t duration) {
     }
 
     destroy_message(&msg);
-    destroy_message(&ack);
     return ret;
 }
 
 bool zigbeeClose() {
     int ret = true;
     iot_alarm_message_t * msg = create_message(IOT_ALARM_MSGDIR_COMMAND, IOT_ALARM_MSGSTATUS_SUCCESS, IOT_ALARM_MSGTYPE_ZB_DEV_LOCK, 1, "\0");
-    iot_alarm_message_t * ack = create_message(IOT_ALARM_MSGDIR_MAX, IOT_ALARM_MSGSTATUS_MAX, IOT_ALARM_MSGTYPE_MAX, 1, "\0");
 
     // sending the message
-    int tx_bytes = waitForCorrectResponseZigbee(msg, &ack, 10000);
-    if (tx_bytes <= 0) {
+    if (msg == NULL || !zigbee_command_wait(msg, ZIGBEE_COMMAND_TIMEOUT_MS)) {
         esplogW(TAG_LIB_ZIGBEE, "(zigbeeClose)", "Failed sending message to zigbee module!");
         ret = false;
     } else {
@@ -224,18 +270,15 @@ bool zigbeeClose() {
     }
 
     destroy_message(&msg);
-    destroy_message(&ack);
     return ret;
 }
 
 bool zigbeeClear() {
     int ret = true;
     iot_alarm_message_t * msg = create_message(IOT_ALARM_MSGDIR_COMMAND, IOT_ALARM_MSGSTATUS_SUCCESS, IOT_ALARM_MSGTYPE_ZB_DEV_CLEAR, 1, "\0");
-    iot_alarm_message_t * ack = create_message(IOT_ALARM_MSGDIR_MAX, IOT_ALARM_MSGSTATUS_MAX, IOT_ALARM_MSGTYPE_MAX, 1, "\0");
 
     // sending the message
-    int tx_bytes = waitForCorrectResponseZigbee(msg, &ack, 10000);
-    if (tx_bytes <= 0) {
+    if (msg == NULL || !zigbee_command_wait(msg, ZIGBEE_COMMAND_TIMEOUT_MS)) {
         esplogW(TAG_LIB_ZIGBEE, "(zigbeeClear)", "Failed sending message to zigbee module!");
         ret = false;
     } else {
@@ -244,119 +287,171 @@ bool zigbeeClear() {
     }
 
     destroy_message(&msg);
-    destroy_message(&ack);
     return ret;
 }
 
-bool zigbeeAttrRead(iot_alarm_attr_load_t * attr) {
-    int ret = true;
+static void zigbeeAttrCommandDone(uint8_t seq, message_type_t id, bool success, void* ctx) {
+    const char * command = id == IOT_ALARM_MSGTYPE_ZB_DATA_WRITE || id == IOT_ALARM_MSGTYPE_ZB_DATA_WRITE_BATCH ? "Write" : "Read";
+    if (success) {
+        esplogI(TAG_LIB_ZIGBEE, "(zigbeeAttrCommandDone)", "%s attribute command (seq: %d) acknowledged by zigbee module!", command, seq);
+    } else {
+        esplogW(TAG_LIB_ZIGBEE, "(zigbeeAttrCommandDone)", "%s attribute command (seq: %d) was not acknowledged by zigbee module!", command, seq);
+    }
+}
+
+bool zigbeeAttrRead(iot_alarm_attr_load_t * attr, zigbee_command_cb_t cb, void* ctx) {
     size_t length;
 
     char serialized_load[1024];
     memset(serialized_load, 0, sizeof(serialized_load));
-    serialize_attr(attr, serialized_load, &length);
+    serialize_attr_command(attr, serialized_load, &length);
 
-    iot_alarm_message_t * msg = create_message(IOT_ALARM_MSGDIR_COMMAND, IOT_ALARM_MSGSTATUS_SUCCESS, IOT_ALARM_MSGTYPE_ZB_DATA_READ, (uint32_t)length, serialized_load);
-    iot_alarm_message_t * ack = create_message(IOT_ALARM_MSGDIR_MAX, IOT_ALARM_MSGSTATUS_MAX, IOT_ALARM_MSGTYPE_MAX, 1, "\0");
+    iot_alarm_message_t msg = {
+        .dir = IOT_ALARM_MSGDIR_COMMAND,
+        .st = IOT_ALARM_MSGSTATUS_SUCCESS,
+        .id = IOT_ALARM_MSGTYPE_ZB_DATA_READ,
+        .length = (uint32_t)length,
+        .load = serialized_load,
+        .size = 0,
+    };
 
-    // sending the message
-    int tx_bytes = waitForCorrectResponseZigbee(msg, &ack, 10000);
-    if (tx_bytes <= 0) {
+    // the acknowledge is handled by the zigbee task, so more commands may be outstanding at once
+    uint8_t seq = zigbee_command_send(&msg, ZIGBEE_COMMAND_TIMEOUT_MS, cb != NULL ? cb : zigbeeAttrCommandDone, ctx);
+    if (seq == 0) {
         esplogW(TAG_LIB_ZIGBEE, "(zigbeeAttrRead)", "Failed sending message to zigbee module!");
-        ret = false;
-    } else {
-        esplogI(TAG_LIB_ZIGBEE, "(zigbeeAttrRead)", "Read attribute command sent to zigbee module!");
+        return false;
     }
 
-    destroy_message(&msg);
-    destroy_message(&ack);
-    return ret;
+    esplogI(TAG_LIB_ZIGBEE, "(zigbeeAttrRead)", "Read attribute command (seq: %d) sent to zigbee module!", seq);
+    return true;
 }
 
-bool zigbeeAttrWrite(iot_alarm_attr_load_t * attr) {
-    int ret = true;
+bool zigbeeAttrWrite(iot_alarm_attr_load_t * attr, zigbee_command_cb_t cb, void* ctx) {
     size_t length;
-    
+
     char serialized_load[1024];
     memset(serialized_load, 0, sizeof(serialized_load));
-    serialize_attr(attr, serialized_load, &length);
+    serialize_attr_command(attr, serialized_load, &length);
 
-    iot_alarm_message_t * msg = create_message(IOT_ALARM_MSGDIR_COMMAND, IOT_ALARM_MSGSTATUS_SUCCESS, IOT_ALARM_MSGTYPE_ZB_DATA_WRITE, (uint32_t)length, serialized_load);
-    iot_alarm_message_t * ack = create_message(IOT_ALARM_MSGDIR_MAX, IOT_ALARM_MSGSTATUS_MAX, IOT_ALARM_MSGTYPE_MAX, 1, "\0");
+    iot_alarm_message_t msg = {
+        .dir = IOT_ALARM_MSGDIR_COMMAND,
+        .st = IOT_ALARM_MSGSTATUS_SUCCESS,
+        .id = IOT_ALARM_MSGTYPE_ZB_DATA_WRITE,
+        .length = (uint32_t)length,
+        .load = serialized_load,
+        .size = 0,
+    };
 
-    // sending the message
-    int tx_bytes = waitForCorrectResponseZigbee(msg, &ack, 10000);
-    if (tx_bytes <= 0) {
+    // the attribute is owned by the caller, only the serialized copy is kept in the command slot
+    uint8_t seq = zigbee_command_send(&msg, ZIGBEE_COMMAND_TIMEOUT_MS, cb != NULL ? cb : zigbeeAttrCommandDone, ctx);
+    if (seq == 0) {
         esplogW(TAG_LIB_ZIGBEE, "(zigbeeAttrWrite)", "Failed sending message to zigbee module!");
-        ret = false;
-    } else {
-        esplogI(TAG_LIB_ZIGBEE, "(zigbeeAttrWrite)", "Write attribute command sent to zigbee module!");
+        return false;
+    }
+
+    esplogI(TAG_LIB_ZIGBEE, "(zigbeeAttrWrite)", "Write attribute command (seq: %d) sent to zigbee module!", seq);
+    return true;
+}
+
+static bool zigbeeAttrBatchSend(message_type_t id, const iot_alarm_attr_load_t * attrs, size_t count, zigbee_command_cb_t cb, void* ctx, size_t * frames) {
+    char serialized_load[1 + ZIGBEE_ATTR_BATCH_MAX * ZIGBEE_ATTR_BATCH_ITEM_SIZE];
+    bool ret = true;
+
+    if (frames != NULL) {
+        *frames = 0;
+    }
+
+    // the frames are pipelined, each of them is acknowledged separately
+    for (size_t first = 0; first < count; first += ZIGBEE_ATTR_BATCH_MAX) {
+        size_t chunk = count - first < ZIGBEE_ATTR_BATCH_MAX ? count - first : ZIGBEE_ATTR_BATCH_MAX;
+        size_t length;
+        serialize_attr_batch(attrs + first, chunk, serialized_load, sizeof(serialized_load), &length);
+
+        iot_alarm_message_t msg = {
+            .dir = IOT_ALARM_MSGDIR_COMMAND,
+            .st = IOT_ALARM_MSGSTATUS_SUCCESS,
+            .id = id,
+            .length = (uint32_t)length,
+            .load = serialized_load,
+            .size = 0,
+        };
+
+        uint8_t seq = zigbee_command_send(&msg, ZIGBEE_COMMAND_TIMEOUT_MS, cb != NULL ? cb : zigbeeAttrCommandDone, ctx);
+        if (seq == 0) {
+            esplogW(TAG_LIB_ZIGBEE, "(zigbeeAttrBatchSend)", "Failed sending message to zigbee module! (attributes: %u-%u)", (unsigned)first, (unsigned)(first + chunk - 1));
+            ret = false;
+            continue;
+        }
+
+        if (frames != NULL) {
+            (*frames)++;
+        }
+
+        esplogI(TAG_LIB_ZIGBEE, "(zigbeeAttrBatchSend)", "Batched attribute command (seq: %d, attributes: %u) sent to zigbee module!", seq, (unsigned)chunk);
     }
 
-    destroy_message(&msg);
-    destroy_message(&ack);
-    destroy_attr(&attr);
     return ret;
 }
 
+bool zigbeeAttrReadBatch(const iot_alarm_attr_load_t * attrs, size_t count, zigbee_command_cb_t cb, void* ctx, size_t * frames) {
+    return zigbeeAttrBatchSend(IOT_ALARM_MSGTYPE_ZB_DATA_READ_BATCH, attrs, count, cb, ctx, frames);
+}
+
+bool zigbeeAttrWriteBatch(const iot_alarm_attr_load_t * attrs, size_t count, zigbee_command_cb_t cb, void* ctx, size_t * frames) {
+    return zigbeeAttrBatchSend(IOT_ALARM_MSGTYPE_ZB_DATA_WRITE_BATCH, attrs, count, cb, ctx, frames);
+}
+
+bool zigbeeDeviceInfoRequest(uint16_t handle, const esp_zb_ieee_addr_t ieee_addr) {
+    char load[sizeof(esp_zb_ieee_addr_t)];
+    uint32_t length;
+
+    if (ieee_addr != NULL) {
+        memcpy(load, ieee_addr, sizeof(esp_zb_ieee_addr_t));
+        length = sizeof(esp_zb_ieee_addr_t);
+    } else {
+        memcpy(load, &handle, sizeof(handle));
+        length = sizeof(handle);
+    }
+
+    iot_alarm_message_t msg = {
+        .dir = IOT_ALARM_MSGDIR_COMMAND,
+        .st = IOT_ALARM_MSGSTATUS_SUCCESS,
+        .id = IOT_ALARM_MSGTYPE_ZB_DEV_INFO,
+        .length = length,
+        .load = load,
+        .size = 0,
+    };
+
+    if (zigbee_command_send(&msg, ZIGBEE_COMMAND_TIMEOUT_MS) == 0) {
+        esplogW(TAG_LIB_ZIGBEE, "(zigbeeDeviceInfoRequest)", "Failed sending message to zigbee module!");
+        return false;
+    }
+
+    return true;
+}
+
 // TODO
 bool zigbeeAttrReadWriteHandler(iot_alarm_attr_load_t * attr) {return true;}
 
-bool zigbeeAttrReportHandler(iot_alarm_attr_load_t * attr) {
+bool zigbeeAttrReportHandler(iot_alarm_attr_load_t * attr, bool * coalesced) {
     bool ret = false;
 
+#ifdef ZIGBEE_LATENCY_PROBE
+    if (zigbee_probe_sent != 0) {
+        zigbee_probe_latency = esp_timer_get_time() - zigbee_probe_sent;
+        zigbee_probe_sent = 0;
+    }
+#endif
+
     if (attr != NULL) {
         // esplogI(TAG_LIB_DEBUG, "(zigbeeAttrReportHandler)", "Device data: %s - %s [%s (%lu)]", attr->manuf, attr->name, attr->type, attr->type_id);
         // esplogI(TAG_LIB_DEBUG, "(zigbeeAttrReportHandler)", "Attribute data: short: %04hx/%d, cluster: %04hx, attribute: %04hx, type: %d, value: %lu",
         //     attr->short_addr, attr->endpoint_id, attr->cluster_id, attr->attr_id, attr->value_type, attr->value);
 
         // local application handeling
-        switch (attr->type_id) {
-            // handle IAS zone reports, occupacy reports
-            case 0x0500000DU:
-            case 0x05000015U:
-            case 0x0500002DU:
-            case 0x05000225U:
-                if (attr->attr_id == 0x0002 && attr->value == 1) {
-                    esplogW(TAG_RTOS_ZIGBEE, "(zigbeeAttrReportHandler)", "Alarm event triggered! [ZONESTATUS = 1 at 0x%04hx/%d]", attr->short_addr, attr->endpoint_id);
-                    displayNotification(NOTIFICATION_ZIGBEE_ATTR_REPORT);
-                    if (g_vars_ptr->state == STATE_ALARM_OK || g_vars_ptr->state == STATE_ALARM_W) {
-                        g_vars_ptr->alarm.alarm_events++;
-                    }
-                }
-                break;
-
-            case 0x04060000U:
-            case 0x04060001U:
-            case 0x04060002U:
-                if (attr->attr_id == 0x0000 && attr->value == 1) {
-                    esplogW(TAG_RTOS_ZIGBEE, "(zigbeeAttrReportHandler)", "Alarm event triggered! [OCCUPANCY = 1 at 0x%04hx/%d]", attr->short_addr, attr->endpoint_id);
-                    displayNotification(NOTIFICATION_ZIGBEE_ATTR_REPORT);
-                    if (g_vars_ptr->state == STATE_ALARM_OK || g_vars_ptr->state == STATE_ALARM_W) {
-                        g_vars_ptr->alarm.alarm_events++;
-                    }
-                }
-                break;
-
-            // handle fire sensor reports
-            case 0x05000028U:
-            case 0x0500002BU:
-                if (attr->attr_id == 0x0002) {
-                    if (attr->value == 1) {esplogW(TAG_RTOS_ZIGBEE, "(zigbeeAttrReportHandler)", "Fire alarm triggered! [ZONESTATUS = 1 at 0x%04hx/%d]", attr->short_addr, attr->endpoint_id);}
-                    g_vars_ptr->alarm.alarm_fire = attr->value > 0;
-                }
-                break;
-
-            // handle water sensor reports
-            case 0x0500002AU:
-                if (attr->attr_id == 0x0002) {
-                    if (attr->value == 1) {esplogW(TAG_RTOS_ZIGBEE, "(zigbeeAttrReportHandler)", "Water-leakage alarm triggered! [ZONESTATUS = 1 at 0x%04hx/%d]", attr->short_addr, attr->endpoint_id);}
-                    g_vars_ptr->alarm.alarm_water = attr->value > 0;
-                }
-                break;
-
-            default:
-                break;
+        bool debounced = zigbee_rules_evaluate(attr);
+        if (coalesced != NULL) {
+            *coalesced = debounced;
         }
         ret = true;
     }
@@ -367,609 +462,2680 @@ bool zigbeeAttrReportHandler(iot_alarm_attr_load_t * attr) {
 
 // *********************************************************************************************************************
 
-const int RX_BUF_SIZE = 1024;
-const int TX_BUF_SIZE = 1024;
+// compiled rule table, the rules with the same key are adjacent and the bucket points to the first of them
+typedef struct {
+    zigbee_rule_t rules[ZIGBEE_RULES_MAX];
+    size_t count;
+    int16_t buckets[ZIGBEE_RULES_BUCKETS];
+} zigbee_rule_table_t;
+
+// the active table is read by the zigbee task, the other one is compiled by the reload and then swapped
+static zigbee_rule_table_t zigbee_rule_tables[2];
+static zigbee_rule_table_t * zigbee_rules_active = NULL;
+static SemaphoreHandle_t zigbee_rules_mutex = NULL;
+static SemaphoreHandle_t zigbee_rules_reload_mutex = NULL;
+
+static const zigbee_rule_t zigbee_rules_default[] = {
+    // IAS zone reports
+    {0x0500000DU, 0x0500, 0x0002, ZIGBEE_RULE_OP_EQ, 1, ZIGBEE_RULE_ACTION_INTRUSION, ZIGBEE_RULE_DEBOUNCE_MS},
+    {0x05000015U, 0x0500, 0x0002, ZIGBEE_RULE_OP_EQ, 1, ZIGBEE_RULE_ACTION_INTRUSION, ZIGBEE_RULE_DEBOUNCE_MS},
+    {0x0500002DU, 0x0500, 0x0002, ZIGBEE_RULE_OP_EQ, 1, ZIGBEE_RULE_ACTION_INTRUSION, ZIGBEE_RULE_DEBOUNCE_MS},
+    {0x05000225U, 0x0500, 0x0002, ZIGBEE_RULE_OP_EQ, 1, ZIGBEE_RULE_ACTION_INTRUSION, ZIGBEE_RULE_DEBOUNCE_MS},
+    // occupancy reports
+    {0x04060000U, 0x0406, 0x0000, ZIGBEE_RULE_OP_EQ, 1, ZIGBEE_RULE_ACTION_INTRUSION, ZIGBEE_RULE_DEBOUNCE_MS},
+    {0x04060001U, 0x0406, 0x0000, ZIGBEE_RULE_OP_EQ, 1, ZIGBEE_RULE_ACTION_INTRUSION, ZIGBEE_RULE_DEBOUNCE_MS},
+    {0x04060002U, 0x0406, 0x0000, ZIGBEE_RULE_OP_EQ, 1, ZIGBEE_RULE_ACTION_INTRUSION, ZIGBEE_RULE_DEBOUNCE_MS},
+    // fire sensor reports
+    {0x05000028U, 0x0500, 0x0002, ZIGBEE_RULE_OP_GT, 0, ZIGBEE_RULE_ACTION_FIRE, 0},
+    {0x0500002BU, 0x0500, 0x0002, ZIGBEE_RULE_OP_GT, 0, ZIGBEE_RULE_ACTION_FIRE, 0},
+    // water sensor reports
+    {0x0500002AU, 0x0500, 0x0002, ZIGBEE_RULE_OP_GT, 0, ZIGBEE_RULE_ACTION_WATER, 0},
+};
+
+static const char * zigbee_rule_op_names[ZIGBEE_RULE_OP_MAX] = {"any", "eq", "ne", "gt", "lt", "mask"};
+static const char * zigbee_rule_action_names[ZIGBEE_RULE_ACTION_MAX] = {"intrusion", "fire", "water"};
+
+static uint32_t zigbee_rule_hash(uint32_t type_id, uint16_t cluster_id, uint16_t attr_id) {
+    uint32_t hash = type_id * 0x9E3779B1U;
+    hash ^= (((uint32_t)cluster_id << 16) | attr_id) * 0x85EBCA6BU;
+    return hash ^ (hash >> 15);
+}
 
-uint8_t* tx_buffer = NULL;
-uint8_t* rx_buffer = NULL;
+static bool zigbee_rule_key_equal(const zigbee_rule_t * a, uint32_t type_id, uint16_t cluster_id, uint16_t attr_id) {
+    return a->type_id == type_id && a->cluster_id == cluster_id && a->attr_id == attr_id;
+}
 
-void serialize_message(iot_alarm_message_t *msg, uint8_t *buffer, size_t *bytes) {
-    
-    if (msg == NULL) {
-        esplogW(TAG_LIB_ZIGBEE, "(serialize_message)", "Error: Message is nullptr!");
-        return;
+static bool zigbee_rule_less(const zigbee_rule_t * a, const zigbee_rule_t * b) {
+    if (a->type_id != b->type_id) {
+        return a->type_id < b->type_id;
     }
-    
-    if (buffer == NULL) {
-        esplogW(TAG_LIB_ZIGBEE, "(serialize_message)", "Error: Buffer is nullptr!");
-        return;
+    if (a->cluster_id != b->cluster_id) {
+        return a->cluster_id < b->cluster_id;
     }
+    return a->attr_id < b->attr_id;
+}
 
-    int offset = 0;
-
-    // Copy the struct fields into the buffer
-    memcpy(buffer + offset, &msg->dir, sizeof(msg->dir));
-    offset += sizeof(msg->dir);
-
-    memcpy(buffer + offset, &msg->st, sizeof(msg->st));
-    offset += sizeof(msg->st);
-
-    memcpy(buffer + offset, &msg->id, sizeof(msg->id));
-    offset += sizeof(msg->id);
-
-    memcpy(buffer + offset, &msg->length, sizeof(msg->length));
-    offset += sizeof(msg->length);
+static bool zigbee_rules_compile(zigbee_rule_table_t * table, const zigbee_rule_t * rules, size_t count) {
+    if (count > ZIGBEE_RULES_MAX) {
+        esplogW(TAG_LIB_ZIGBEE, "(zigbee_rules_compile)", "Too many report rules! (count: %u, max: %d)", (unsigned)count, ZIGBEE_RULES_MAX);
+        return false;
+    }
 
-    // If there is a load, copy it (i want to copy the "\0" too if there is no load)
-    if (msg->length > 0) {
-        memcpy(buffer + offset, msg->load, msg->length);
-        offset += msg->length;
+    // stable insertion sort keeps the rules with the same key in the file order
+    for (size_t i = 0; i < count; i++) {
+        zigbee_rule_t rule = rules[i];
+        size_t j = i;
+        while (j > 0 && zigbee_rule_less(&rule, &table->rules[j - 1])) {
+            table->rules[j] = table->rules[j - 1];
+            j--;
+        }
+        table->rules[j] = rule;
     }
+    table->count = count;
 
-    buffer[offset] = '\0';
-    *bytes = offset;
-}
+    for (int i = 0; i < ZIGBEE_RULES_BUCKETS; i++) {
+        table->buckets[i] = -1;
+    }
 
-void deserialize_message(iot_alarm_message_t **msg, uint8_t *buffer, size_t buffer_len) {
+    // only the first rule of each key is hashed, the buckets are never full (at least twice the rules)
+    for (size_t i = 0; i < count; i++) {
+        const zigbee_rule_t * rule = &table->rules[i];
+        if (i > 0 && zigbee_rule_key_equal(&table->rules[i - 1], rule->type_id, rule->cluster_id, rule->attr_id)) {
+            continue;
+        }
 
-    if (msg == NULL) {
-        esplogW(TAG_LIB_ZIGBEE, "(deserialize_message)", "Error: Message is nullptr!");
-        return;
+        uint32_t slot = zigbee_rule_hash(rule->type_id, rule->cluster_id, rule->attr_id) & (ZIGBEE_RULES_BUCKETS - 1);
+        while (table->buckets[slot] >= 0) {
+            slot = (slot + 1) & (ZIGBEE_RULES_BUCKETS - 1);
+        }
+        table->buckets[slot] = (int16_t)i;
     }
 
-    if (*msg == NULL) {
-        esplogW(TAG_LIB_ZIGBEE, "(deserialize_message)", "Error: Message is nullptr!");
-        return;
-    }
+    return true;
+}
 
-    if (buffer == NULL) {
-        esplogW(TAG_LIB_ZIGBEE, "(deserialize_message)", "Error: Buffer is nullptr!");
-        return;
+static bool zigbee_rule_predicate(const zigbee_rule_t * rule, uint32_t value) {
+    switch (rule->op) {
+        case ZIGBEE_RULE_OP_ANY:
+            return true;
+        case ZIGBEE_RULE_OP_EQ:
+            return value == rule->operand;
+        case ZIGBEE_RULE_OP_NE:
+            return value != rule->operand;
+        case ZIGBEE_RULE_OP_GT:
+            return value > rule->operand;
+        case ZIGBEE_RULE_OP_LT:
+            return value < rule->operand;
+        case ZIGBEE_RULE_OP_MASK:
+            return (value & rule->operand) != 0;
+        default:
+            return false;
     }
+}
 
-    int offset = 0;
+static void zigbee_rule_apply(const zigbee_rule_t * rule, const iot_alarm_attr_load_t * attr) {
+    bool holds = zigbee_rule_predicate(rule, attr->value);
 
-    message_direction_t dir;
-    message_status_t st;
-    message_type_t id;
-    uint32_t length;
+    switch (rule->action) {
+        case ZIGBEE_RULE_ACTION_INTRUSION:
+            if (holds) {
+                esplogW(TAG_RTOS_ZIGBEE, "(zigbeeAttrReportHandler)", "Alarm event triggered! [%04hx/%04hx = %lu at 0x%04hx/%d]", attr->cluster_id, attr->attr_id, attr->value, attr->short_addr, attr->endpoint_id);
+                displayNotification(NOTIFICATION_ZIGBEE_ATTR_REPORT);
+                if (g_vars_ptr->state == STATE_ALARM_OK || g_vars_ptr->state == STATE_ALARM_W) {
+                    g_vars_ptr->alarm.alarm_events++;
+                }
+            }
+            break;
 
-    // Extract message direction
-    if (offset + sizeof(dir) <= buffer_len) {
-        memcpy(&dir, buffer + offset, sizeof(dir));
-        offset += sizeof(dir);
-    } else {
-        esplogW(TAG_LIB_ZIGBEE, "(deserialize_message)", "The buffer length is too small to deserialise all data!");
-    }
+        case ZIGBEE_RULE_ACTION_FIRE:
+            if (holds) {esplogW(TAG_RTOS_ZIGBEE, "(zigbeeAttrReportHandler)", "Fire alarm triggered! [%04hx/%04hx = %lu at 0x%04hx/%d]", attr->cluster_id, attr->attr_id, attr->value, attr->short_addr, attr->endpoint_id);}
+            g_vars_ptr->alarm.alarm_fire = holds;
+            break;
 
-    // Extract message status
-    if (offset + sizeof(st) <= buffer_len) {
-        memcpy(&st, buffer + offset, sizeof(st));
-        offset += sizeof(st);
-    } else {
-        esplogW(TAG_LIB_ZIGBEE, "(deserialize_message)", "The buffer length is too small to deserialise all data!");
-    }
+        case ZIGBEE_RULE_ACTION_WATER:
+            if (holds) {esplogW(TAG_RTOS_ZIGBEE, "(zigbeeAttrReportHandler)", "Water-leakage alarm triggered! [%04hx/%04hx = %lu at 0x%04hx/%d]", attr->cluster_id, attr->attr_id, attr->value, attr->short_addr, attr->endpoint_id);}
+            g_vars_ptr->alarm.alarm_water = holds;
+            break;
 
-    // Extract message ID
-    if (offset + sizeof(id) <= buffer_len) {
-        memcpy(&id, buffer + offset, sizeof(id));
-        offset += sizeof(id);
-    } else {
-        esplogW(TAG_LIB_ZIGBEE, "(deserialize_message)", "The buffer length is too small to deserialise all data!");
+        default:
+            break;
     }
+}
 
-    // Extract length of load
-    if (offset + sizeof(length) <= buffer_len) {
-        memcpy(&length, buffer + offset, sizeof(length));
-        offset += sizeof(length);
-    } else {
-        esplogW(TAG_LIB_ZIGBEE, "(deserialize_message)", "The buffer length is too small to deserialise all data!");
+// returns the index of the first rule with the key of the attribute, or -1 if there is none
+static int zigbee_rules_find(const zigbee_rule_table_t * table, const iot_alarm_attr_load_t * attr) {
+    uint32_t slot = zigbee_rule_hash(attr->type_id, attr->cluster_id, attr->attr_id) & (ZIGBEE_RULES_BUCKETS - 1);
+    while (table->buckets[slot] >= 0) {
+        int first = table->buckets[slot];
+        if (zigbee_rule_key_equal(&table->rules[first], attr->type_id, attr->cluster_id, attr->attr_id)) {
+            return first;
+        }
+        slot = (slot + 1) & (ZIGBEE_RULES_BUCKETS - 1);
     }
 
-    // Extract load itself
-    char* load = (char *)malloc(length + 1);
-    if (load == NULL) {
-        esplogW(TAG_LIB_ZIGBEE, "(deserialize_message)", "Failed to allocate memory for message load!");
-        return;
-    }
+    return -1;
+}
 
-    if (length > 0 && offset + length <= buffer_len) {
-        memcpy(load, buffer + offset, length);
-    } else {
-        esplogW(TAG_LIB_ZIGBEE, "(deserialize_message)", "The buffer length is too small to deserialise all data!");
-    }
+// open debounce windows, used only by the zigbee task
+typedef struct {
+    bool used;                          // slot holds an open window
+    esp_zb_ieee_addr_t ieee_addr;       // IEEE address of the sensor (key)
+    uint8_t endpoint_id;                // ZCL Endpoint ID (key)
+    uint16_t cluster_id;                // ZCL Cluster ID (key)
+    uint16_t attr_id;                   // ZCL Attribute ID (key)
+    zigbee_rule_action_t action;        // action of the rule (key)
+    uint32_t debounce_ms;               // window length
+    unsigned long first;                // time of the report which opened the window (ms since boot)
+    unsigned long last;                 // time of the last coalesced report (ms since boot)
+    uint32_t count;                     // number of reports in the window (including the first one)
+    iot_alarm_attr_load_t attr;         // last coalesced report
+} zigbee_debounce_t;
+
+static zigbee_debounce_t zigbee_debounces[ZIGBEE_DEBOUNCE_SLOTS];
+
+// closes the window, repeated reports are summarised by one event
+static void zigbee_debounce_close(zigbee_debounce_t * window) {
+    if (window->count > 1) {
+        zigbee_publish_event(&window->attr, window->count, (uint32_t)(window->last - window->first));
+    }
+    window->used = false;
+}
 
-    load[length] = '\0';
+// returns true if the report falls into the open window of the sensor (it is counted and not acted upon)
+static bool zigbee_debounce(const zigbee_rule_t * rule, const iot_alarm_attr_load_t * attr) {
+    unsigned long now = millis();
+    zigbee_debounce_t * free_slot = NULL;
 
-    destroy_message(msg);
-    *msg = (iot_alarm_message_t *)malloc(sizeof(iot_alarm_message_t));
-    if (msg == NULL) {
-        esplogW(TAG_LIB_ZIGBEE, "(create_message)", "Failed to allocate memory for message!");
-        free(load);
-        load = NULL;
-        return;
-    }
+    for (int i = 0; i < ZIGBEE_DEBOUNCE_SLOTS; i++) {
+        zigbee_debounce_t * window = &zigbee_debounces[i];
+        if (!window->used) {
+            free_slot = free_slot == NULL ? window : free_slot;
+            continue;
+        }
 
-    (*msg)->dir = dir;
-    (*msg)->id = id;
-    (*msg)->st = st;
-    (*msg)->length = length;
-    (*msg)->load = load;
-}
+        if (window->action != rule->action || window->endpoint_id != attr->endpoint_id || window->cluster_id != attr->cluster_id ||
+            window->attr_id != attr->attr_id || memcmp(window->ieee_addr, attr->ieee_addr, sizeof(window->ieee_addr)) != 0) {
+            continue;
+        }
 
-iot_alarm_message_t * create_message(message_direction_t dir, message_status_t st, message_type_t id, uint32_t length, const char* load) {
+        if (now - window->first < window->debounce_ms) {
+            window->count++;
+            window->last = now;
+            window->attr = *attr;
+            return true;
+        }
 
-    iot_alarm_message_t *msg = (iot_alarm_message_t *)malloc(sizeof(iot_alarm_message_t));
-    if (msg == NULL) {
-        esplogW(TAG_LIB_ZIGBEE, "(create_message)", "Failed to allocate memory for message!");
-        return NULL;
+        // the window expired before zigbee_debounce_poll() closed it, the report opens a new one
+        zigbee_debounce_close(window);
+        free_slot = window;
+        break;
     }
 
-    msg->dir = dir;
-    msg->id = id;
-    msg->st = st;
-    msg->length = length;
-    msg->load = (char *)malloc(length + 1);
-    if (msg->load == NULL) {
-        esplogW(TAG_LIB_ZIGBEE, "(create_message)", "Failed to allocate memory for message load!");
-        free(msg);
-        msg = NULL;
-        return NULL;
+    // without a free slot the report is not debounced
+    if (free_slot != NULL) {
+        memcpy(free_slot->ieee_addr, attr->ieee_addr, sizeof(free_slot->ieee_addr));
+        free_slot->endpoint_id = attr->endpoint_id;
+        free_slot->cluster_id = attr->cluster_id;
+        free_slot->attr_id = attr->attr_id;
+        free_slot->action = rule->action;
+        free_slot->debounce_ms = rule->debounce_ms;
+        free_slot->first = now;
+        free_slot->last = now;
+        free_slot->count = 1;
+        free_slot->attr = *attr;
+        free_slot->used = true;
     }
-    memcpy(msg->load, load, length);
-    msg->load[length] = '\0';
 
-    return msg;
+    return false;
 }
 
-void destroy_message(iot_alarm_message_t **msg) {
-    if (*msg != NULL) {
-        if ((*msg)->load != NULL) {
-            free((*msg)->load);
-            (*msg)->load = NULL;
-        }
+void zigbee_debounce_poll() {
+    unsigned long now = millis();
 
-        free(*msg);
-        *msg = NULL;
+    for (int i = 0; i < ZIGBEE_DEBOUNCE_SLOTS; i++) {
+        zigbee_debounce_t * window = &zigbee_debounces[i];
+        if (window->used && now - window->first >= window->debounce_ms) {
+            zigbee_debounce_close(window);
+        }
     }
 }
 
-// *********************************************************************************************************************
+// returns true if all rules which hold for the report were debounced
+static bool zigbee_rules_evaluate(const iot_alarm_attr_load_t * attr) {
+    if (zigbee_rules_mutex == NULL) {
+        return false;
+    }
 
-int read_uart(uart_port_t uart, uint8_t* rx_buffer, size_t max_len) {
-    size_t available = 0;
-    size_t read = 0;
-    int bytes_read = 0;
+    zigbee_rule_t matched[ZIGBEE_RULES_MAX];
+    size_t matched_count = 0;
 
-    vTaskDelay(100 / portTICK_PERIOD_MS);
-    uart_get_buffered_data_len(uart, &available);
-    while (available > 0 && bytes_read < max_len) {
-        bytes_read = uart_read_bytes(uart, rx_buffer+bytes_read, available, pdMS_TO_TICKS(500));
-        if (bytes_read > 0) {
-            read += bytes_read;
-        }
+    xSemaphoreTake(zigbee_rules_mutex, portMAX_DELAY);
+    const zigbee_rule_table_t * table = zigbee_rules_active;
+    int first = zigbee_rules_find(table, attr);
+    for (size_t i = first < 0 ? table->count : (size_t)first; i < table->count && zigbee_rule_key_equal(&table->rules[i], attr->type_id, attr->cluster_id, attr->attr_id); i++) {
+        matched[matched_count++] = table->rules[i];
+    }
+    xSemaphoreGive(zigbee_rules_mutex);
 
-        uart_get_buffered_data_len(uart, &available);
+    // the actions (display, logs) are taken without blocking the reload
+    size_t held = 0;
+    size_t coalesced = 0;
+    for (size_t i = 0; i < matched_count; i++) {
+        // the repeated reports of a burst are one physical event, only the predicates which hold are debounced
+        if (matched[i].debounce_ms > 0 && zigbee_rule_predicate(&matched[i], attr->value)) {
+            held++;
+            if (zigbee_debounce(&matched[i], attr)) {
+                coalesced++;
+                continue;
+            }
+        }
+        zigbee_rule_apply(&matched[i], attr);
     }
 
-    return read;
+    return held > 0 && coalesced == held;
 }
 
-int send_message(uart_port_t uart, uint8_t* tx_buffer, iot_alarm_message_t *msg) {
-    size_t length;
+static bool zigbee_rules_init() {
+    if (zigbee_rules_mutex != NULL) {
+        return true;
+    }
 
-    serialize_message(msg, tx_buffer, &length);
-    int tx_bytes = uart_write_bytes(uart, (const char *)tx_buffer, length);
-    if (tx_bytes == length) {
-        // esplogI(TAG_LIB_ZIGBEE, "(send_message)", "Message (length: %d) was sent successfully!", tx_bytes);
-    } else {
+    zigbee_rules_mutex = xSemaphoreCreateMutex();
+    zigbee_rules_reload_mutex = xSemaphoreCreateMutex();
+    if (zigbee_rules_mutex == NULL || zigbee_rules_reload_mutex == NULL) {
+        return false;
+    }
+
+    zigbee_rules_compile(&zigbee_rule_tables[0], zigbee_rules_default, sizeof(zigbee_rules_default) / sizeof(zigbee_rules_default[0]));
+    zigbee_rules_active = &zigbee_rule_tables[0];
+
+    // the built-in rules stay active if the rule file is invalid
+    zigbeeRulesLoad(ZIGBEE_RULES_FILE);
+    return true;
+}
+
+// compiles the rules into the inactive table and swaps it with the active one, the caller holds the reload mutex
+static bool zigbee_rules_install(const zigbee_rule_t * rules, size_t count) {
+    // only the zigbee task may read the active table now, the inactive one is not used by anybody
+    zigbee_rule_table_t * table = zigbee_rules_active == &zigbee_rule_tables[0] ? &zigbee_rule_tables[1] : &zigbee_rule_tables[0];
+    if (!zigbee_rules_compile(table, rules, count)) {
+        return false;
+    }
+
+    xSemaphoreTake(zigbee_rules_mutex, portMAX_DELAY);
+    zigbee_rules_active = table;
+    xSemaphoreGive(zigbee_rules_mutex);
+
+    esplogI(TAG_LIB_ZIGBEE, "(zigbee_rules_install)", "Report rules applied! (count: %u)", (unsigned)count);
+    return true;
+}
+
+// accepts numbers and (hex) strings
+static bool zigbee_rule_number(JsonVariantConst value, uint32_t max, uint32_t * number) {
+    if (value.is<uint32_t>()) {
+        *number = value.as<uint32_t>();
+    } else if (value.is<const char *>()) {
+        char * end = NULL;
+        const char * str = value.as<const char *>();
+        *number = strtoul(str, &end, 0);
+        if (end == str || *end != '\0') {
+            return false;
+        }
+    } else {
+        return false;
+    }
+
+    return *number <= max;
+}
+
+static int zigbee_rule_name(const char * name, const char ** names, int count) {
+    for (int i = 0; name != NULL && i < count; i++) {
+        if (strcmp(name, names[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static bool zigbee_rules_apply_json(JsonDocument * doc) {
+    static zigbee_rule_t rules[ZIGBEE_RULES_MAX];
+
+    JsonArrayConst array = (*doc)["rules"].as<JsonArrayConst>();
+    if (array.isNull()) {
+        esplogW(TAG_LIB_ZIGBEE, "(zigbee_rules_apply_json)", "Missing 'rules' array!");
+        return false;
+    }
+
+    if (array.size() > ZIGBEE_RULES_MAX) {
+        esplogW(TAG_LIB_ZIGBEE, "(zigbee_rules_apply_json)", "Too many report rules! (count: %u, max: %d)", (unsigned)array.size(), ZIGBEE_RULES_MAX);
+        return false;
+    }
+
+    size_t count = 0;
+    for (JsonObjectConst item : array) {
+        uint32_t type_id, cluster_id, attr_id, operand = 0, debounce_ms = 0;
+        int op = item["op"].is<const char *>() ? zigbee_rule_name(item["op"], zigbee_rule_op_names, ZIGBEE_RULE_OP_MAX) : ZIGBEE_RULE_OP_ANY;
+        int action = zigbee_rule_name(item["action"], zigbee_rule_action_names, ZIGBEE_RULE_ACTION_MAX);
+
+        if (!zigbee_rule_number(item["type_id"], UINT32_MAX, &type_id) ||
+            !zigbee_rule_number(item["cluster"], UINT16_MAX, &cluster_id) ||
+            !zigbee_rule_number(item["attr"], UINT16_MAX, &attr_id) ||
+            (op != ZIGBEE_RULE_OP_ANY && !zigbee_rule_number(item["value"], UINT32_MAX, &operand)) ||
+            (!item["debounce"].isNull() && !zigbee_rule_number(item["debounce"], UINT32_MAX, &debounce_ms)) ||
+            op < 0 || action < 0) {
+            esplogW(TAG_LIB_ZIGBEE, "(zigbee_rules_apply_json)", "Invalid report rule! (index: %u)", (unsigned)count);
+            return false;
+        }
+
+        rules[count].type_id = type_id;
+        rules[count].cluster_id = (uint16_t)cluster_id;
+        rules[count].attr_id = (uint16_t)attr_id;
+        rules[count].op = (zigbee_rule_op_t)op;
+        rules[count].operand = operand;
+        rules[count].action = (zigbee_rule_action_t)action;
+        rules[count].debounce_ms = debounce_ms;
+        count++;
+    }
+
+    return zigbee_rules_install(rules, count);
+}
+
+bool zigbeeRulesLoad(const char * filepath) {
+    if (zigbee_rules_reload_mutex == NULL) {
+        esplogW(TAG_LIB_ZIGBEE, "(zigbeeRulesLoad)", "Report rules are not initialised!");
+        return false;
+    }
+
+    xSemaphoreTake(zigbee_rules_reload_mutex, portMAX_DELAY);
+
+    if (!SD.exists(filepath)) {
+        esplogI(TAG_LIB_ZIGBEE, "(zigbeeRulesLoad)", "Rule file '%s' not found, using built-in report rules!", filepath);
+        bool ret = zigbee_rules_install(zigbee_rules_default, sizeof(zigbee_rules_default) / sizeof(zigbee_rules_default[0]));
+        xSemaphoreGive(zigbee_rules_reload_mutex);
+        return ret;
+    }
+
+    File file = SD.open(filepath, FILE_READ);
+    if (!file) {
+        esplogW(TAG_LIB_ZIGBEE, "(zigbeeRulesLoad)", "Failed to open rule file: %s!", filepath);
+        xSemaphoreGive(zigbee_rules_reload_mutex);
+        return false;
+    }
+
+    JsonDocument doc;
+    DeserializationError error = deserializeJson(doc, file);
+    file.close();
+
+    bool ret = false;
+    if (error) {
+        esplogW(TAG_LIB_ZIGBEE, "(zigbeeRulesLoad)", "Failed to parse rule file %s! Keeping the active rules. Error: %s", filepath, error.c_str());
+    } else {
+        ret = zigbee_rules_apply_json(&doc);
+    }
+
+    doc.clear();
+    xSemaphoreGive(zigbee_rules_reload_mutex);
+    return ret;
+}
+
+bool zigbeeRulesUpdate(String json, bool * applied) {
+    if (applied != NULL) {
+        *applied = false;
+    }
+
+    if (zigbee_rules_reload_mutex == NULL) {
+        esplogW(TAG_LIB_ZIGBEE, "(zigbeeRulesUpdate)", "Report rules are not initialised!");
+        return false;
+    }
+
+    JsonDocument doc;
+    DeserializationError error = deserializeJson(doc, json);
+    if (error) {
+        esplogW(TAG_LIB_ZIGBEE, "(zigbeeRulesUpdate)", "Failed to parse report rules! Error: %s", error.c_str());
+        return false;
+    }
+
+    xSemaphoreTake(zigbee_rules_reload_mutex, portMAX_DELAY);
+    bool ret = zigbee_rules_apply_json(&doc);
+    xSemaphoreGive(zigbee_rules_reload_mutex);
+    doc.clear();
+
+    if (!ret) {
+        return false;
+    }
+    if (applied != NULL) {
+        *applied = true;
+    }
+
+    // the applied rules are kept for the next boot (they stay active if the file can not be written)
+    File file = SD.open(ZIGBEE_RULES_FILE, FILE_WRITE);
+    if (!file) {
+        esplogW(TAG_LIB_ZIGBEE, "(zigbeeRulesUpdate)", "Failed to open rule file: %s! The rules are active until reboot.", ZIGBEE_RULES_FILE);
+        return false;
+    }
+
+    bool written = file.print(json) == json.length();
+    file.close();
+    if (!written) {
+        esplogW(TAG_LIB_ZIGBEE, "(zigbeeRulesUpdate)", "Failed to save rule file: %s! The rules are active until reboot.", ZIGBEE_RULES_FILE);
+    }
+
+    return written;
+}
+
+bool zigbeeRulesDump(String * json) {
+    if (zigbee_rules_mutex == NULL || json == NULL) {
+        return false;
+    }
+
+    JsonDocument doc;
+    JsonArray array = doc["rules"].to<JsonArray>();
+    char hex[11];
+
+    xSemaphoreTake(zigbee_rules_mutex, portMAX_DELAY);
+    const zigbee_rule_table_t * table = zigbee_rules_active;
+    for (size_t i = 0; i < table->count; i++) {
+        const zigbee_rule_t * rule = &table->rules[i];
+        JsonObject item = array.add<JsonObject>();
+        sprintf(hex, "0x%08lX", (unsigned long)rule->type_id);
+        item["type_id"] = hex;
+        sprintf(hex, "0x%04X", rule->cluster_id);
+        item["cluster"] = hex;
+        sprintf(hex, "0x%04X", rule->attr_id);
+        item["attr"] = hex;
+        item["op"] = zigbee_rule_op_names[rule->op];
+        item["value"] = rule->operand;
+        item["action"] = zigbee_rule_action_names[rule->action];
+        item["debounce"] = rule->debounce_ms;
+    }
+    xSemaphoreGive(zigbee_rules_mutex);
+
+    bool ret = serializeJson(doc, *json) > 0;
+    doc.clear();
+    return ret;
+}
+
+bool zigbeeAttrIsCritical(const iot_alarm_attr_load_t * attr) {
+    if (attr == NULL || zigbee_rules_mutex == NULL) {
+        return false;
+    }
+
+    xSemaphoreTake(zigbee_rules_mutex, portMAX_DELAY);
+    bool critical = zigbee_rules_find(zigbee_rules_active, attr) >= 0;
+    xSemaphoreGive(zigbee_rules_mutex);
+
+    return critical;
+}
+
+
+// *********************************************************************************************************************
+
+// publish jobs, filled by the zigbee task and emptied by the publishing task (high priority queue first)
+static QueueHandle_t zigbee_publish_high = NULL;
+static QueueHandle_t zigbee_publish_low = NULL;
+// counts the queued jobs, so the publishing task can wait for both queues at once
+static SemaphoreHandle_t zigbee_publish_pending = NULL;
+static uint32_t zigbee_publish_dropped = 0;
+// attributes of the batched responses, the free slots are passed back by the publishing task through the queue
+static iot_alarm_attr_load_t zigbee_publish_batches[ZIGBEE_PUBLISH_BATCH_SLOTS][ZIGBEE_ATTR_BATCH_MAX];
+static QueueHandle_t zigbee_publish_batch_free = NULL;
+
+static bool zigbee_publish_init() {
+    if (zigbee_publish_pending != NULL) {
+        return true;
+    }
+
+    zigbee_publish_high = xQueueCreate(ZIGBEE_PUBLISH_HIGH_SIZE, sizeof(zigbee_publish_job_t));
+    zigbee_publish_low = xQueueCreate(ZIGBEE_PUBLISH_LOW_SIZE, sizeof(zigbee_publish_job_t));
+    zigbee_publish_pending = xSemaphoreCreateCounting(ZIGBEE_PUBLISH_HIGH_SIZE + ZIGBEE_PUBLISH_LOW_SIZE, 0);
+    zigbee_publish_batch_free = xQueueCreate(ZIGBEE_PUBLISH_BATCH_SLOTS, sizeof(int8_t));
+    for (int8_t slot = 0; zigbee_publish_batch_free != NULL && slot < ZIGBEE_PUBLISH_BATCH_SLOTS; slot++) {
+        xQueueSend(zigbee_publish_batch_free, &slot, 0);
+    }
+
+    return zigbee_publish_high != NULL && zigbee_publish_low != NULL && zigbee_publish_pending != NULL && zigbee_publish_batch_free != NULL;
+}
+
+static void zigbee_publish_drop(const zigbee_publish_job_t * job) {
+    // logged on the powers of two only, a flood of telemetry would flood the log as well
+    zigbee_publish_dropped++;
+    if ((zigbee_publish_dropped & (zigbee_publish_dropped - 1)) == 0) {
+        esplogW(TAG_LIB_ZIGBEE, "(zigbee_publish_enqueue)", "Publish queue is full, attribute dropped! [%04hx/%04hx at 0x%04hx/%d] (dropped: %lu)",
+            job->attr.cluster_id, job->attr.attr_id, job->attr.short_addr, job->attr.endpoint_id, (unsigned long)zigbee_publish_dropped);
+    }
+}
+
+bool zigbee_publish_enqueue(zigbee_publish_kind_t kind, const iot_alarm_attr_load_t * attr, bool critical) {
+    if (attr == NULL || zigbee_publish_pending == NULL) {
+        return false;
+    }
+
+    zigbee_publish_job_t job;
+    job.kind = kind;
+    job.critical = critical;
+    job.attr = *attr;
+    job.count = 1;
+    job.span_ms = 0;
+    job.slot = -1;
+
+    if (critical) {
+        if (xQueueSend(zigbee_publish_high, &job, pdMS_TO_TICKS(ZIGBEE_PUBLISH_HIGH_WAIT_MS)) != pdPASS) {
+            zigbee_publish_drop(&job);
+            return false;
+        }
+    } else if (xQueueSend(zigbee_publish_low, &job, 0) != pdPASS) {
+        // the oldest telemetry is replaced, its place in the pending count is taken by the new job
+        zigbee_publish_job_t oldest;
+        bool replaced = xQueueReceive(zigbee_publish_low, &oldest, 0) == pdPASS;
+        if (replaced) {
+            zigbee_publish_drop(&oldest);
+        }
+        if (xQueueSend(zigbee_publish_low, &job, 0) != pdPASS) {
+            zigbee_publish_drop(&job);
+            return false;
+        }
+        if (replaced) {
+            return true;
+        }
+    }
+
+    xSemaphoreGive(zigbee_publish_pending);
+    return true;
+}
+
+bool zigbee_publish_event(const iot_alarm_attr_load_t * attr, uint32_t count, uint32_t span_ms) {
+    if (attr == NULL || zigbee_publish_pending == NULL) {
+        return false;
+    }
+
+    zigbee_publish_job_t job;
+    job.kind = ZIGBEE_PUBLISH_EVENT;
+    job.critical = true;
+    job.attr = *attr;
+    job.count = count;
+    job.span_ms = span_ms;
+    job.slot = -1;
+
+    if (xQueueSend(zigbee_publish_high, &job, pdMS_TO_TICKS(ZIGBEE_PUBLISH_HIGH_WAIT_MS)) != pdPASS) {
+        zigbee_publish_drop(&job);
+        return false;
+    }
+
+    xSemaphoreGive(zigbee_publish_pending);
+    return true;
+}
+
+bool zigbee_publish_batch(zigbee_publish_kind_t kind, const iot_alarm_attr_load_t * attrs, size_t count) {
+    if (attrs == NULL || count == 0 || count > ZIGBEE_ATTR_BATCH_MAX || zigbee_publish_pending == NULL) {
+        return false;
+    }
+
+    zigbee_publish_job_t job;
+    job.kind = kind;
+    job.critical = true;
+    job.attr = attrs[0];
+    job.count = count;
+    job.span_ms = 0;
+
+    // both slots wait for the publishing task only when the responses come faster than they are published
+    if (xQueueReceive(zigbee_publish_batch_free, &job.slot, pdMS_TO_TICKS(ZIGBEE_PUBLISH_HIGH_WAIT_MS)) != pdPASS) {
+        zigbee_publish_drop(&job);
+        return false;
+    }
+    memcpy(zigbee_publish_batches[job.slot], attrs, count * sizeof(iot_alarm_attr_load_t));
+
+    if (xQueueSend(zigbee_publish_high, &job, pdMS_TO_TICKS(ZIGBEE_PUBLISH_HIGH_WAIT_MS)) != pdPASS) {
+        xQueueSend(zigbee_publish_batch_free, &job.slot, 0);
+        zigbee_publish_drop(&job);
+        return false;
+    }
+
+    xSemaphoreGive(zigbee_publish_pending);
+    return true;
+}
+
+bool zigbee_publish_device(const zigbee_device_t * dev) {
+    if (dev == NULL || zigbee_publish_pending == NULL) {
+        return false;
+    }
+
+    zigbee_publish_job_t job;
+    memset(&job, 0, sizeof(job));
+    job.kind = ZIGBEE_PUBLISH_DEVICE;
+    job.critical = true;
+    memcpy(job.attr.ieee_addr, dev->ieee_addr, sizeof(job.attr.ieee_addr));
+    job.attr.short_addr = dev->short_addr;
+    job.attr.device_id = dev->device_id;
+    job.count = 1;
+    job.slot = -1;
+
+    if (xQueueSend(zigbee_publish_high, &job, pdMS_TO_TICKS(ZIGBEE_PUBLISH_HIGH_WAIT_MS)) != pdPASS) {
+        zigbee_publish_drop(&job);
+        return false;
+    }
+
+    xSemaphoreGive(zigbee_publish_pending);
+    return true;
+}
+
+const iot_alarm_attr_load_t * zigbee_publish_batch_get(const zigbee_publish_job_t * job) {
+    if (job == NULL || job->slot < 0 || job->slot >= ZIGBEE_PUBLISH_BATCH_SLOTS) {
+        return NULL;
+    }
+    return zigbee_publish_batches[job->slot];
+}
+
+void zigbee_publish_batch_release(const zigbee_publish_job_t * job) {
+    if (zigbee_publish_batch_get(job) != NULL) {
+        xQueueSend(zigbee_publish_batch_free, &job->slot, 0);
+    }
+}
+
+bool zigbee_publish_dequeue(zigbee_publish_job_t * job, TickType_t timeout) {
+    if (job == NULL || zigbee_publish_pending == NULL) {
+        return false;
+    }
+
+    // the count can be ahead of the queues (a dropped job), then the next job is waited for again
+    while (xSemaphoreTake(zigbee_publish_pending, timeout) == pdTRUE) {
+        if (xQueueReceive(zigbee_publish_high, job, 0) == pdPASS || xQueueReceive(zigbee_publish_low, job, 0) == pdPASS) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+// *********************************************************************************************************************
+
+const int RX_BUF_SIZE = 1024;
+const int TX_BUF_SIZE = 1024;
+
+uint8_t* tx_buffer = NULL;
+uint8_t* rx_buffer = NULL;
+
+// frame parser state and the bytes read from the UART but not fed to the parser yet
+static zigbee_frame_parser_t zigbee_rx_parser = {ZIGBEE_FRAME_STATE_SYNC, NULL, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+static uint8_t zigbee_rx_chunk[ZIGBEE_RX_CHUNK_SIZE];
+static size_t zigbee_rx_chunk_pos = 0;
+static size_t zigbee_rx_chunk_len = 0;
+
+void serialize_message(iot_alarm_message_t *msg, uint8_t *buffer, size_t *bytes) {
+    
+    if (msg == NULL) {
+        esplogW(TAG_LIB_ZIGBEE, "(serialize_message)", "Error: Message is nullptr!");
+        return;
+    }
+    
+    if (buffer == NULL) {
+        esplogW(TAG_LIB_ZIGBEE, "(serialize_message)", "Error: Buffer is nullptr!");
+        return;
+    }
+
+    int offset = 0;
+
+    // Copy the struct fields into the buffer
+    memcpy(buffer + offset, &msg->dir, sizeof(msg->dir));
+    offset += sizeof(msg->dir);
+
+    memcpy(buffer + offset, &msg->st, sizeof(msg->st));
+    offset += sizeof(msg->st);
+
+    memcpy(buffer + offset, &msg->id, sizeof(msg->id));
+    offset += sizeof(msg->id);
+
+    memcpy(buffer + offset, &msg->length, sizeof(msg->length));
+    offset += sizeof(msg->length);
+
+    // If there is a load, copy it (i want to copy the "\0" too if there is no load)
+    if (msg->length > 0) {
+        memcpy(buffer + offset, msg->load, msg->length);
+        offset += msg->length;
+    }
+
+    buffer[offset] = '\0';
+    *bytes = offset;
+}
+
+bool deserialize_message(iot_alarm_message_t **msg, uint8_t *buffer, size_t buffer_len) {
+
+    if (msg == NULL) {
+        esplogW(TAG_LIB_ZIGBEE, "(deserialize_message)", "Error: Message is nullptr!");
+        return false;
+    }
+
+    if (*msg == NULL) {
+        esplogW(TAG_LIB_ZIGBEE, "(deserialize_message)", "Error: Message is nullptr!");
+        return false;
+    }
+
+    if (buffer == NULL) {
+        esplogW(TAG_LIB_ZIGBEE, "(deserialize_message)", "Error: Buffer is nullptr!");
+        return false;
+    }
+
+    size_t offset = 0;
+
+    // the enum fields are read as integers, so the values out of range never end up in an enum
+    uint32_t dir;
+    uint32_t st;
+    uint32_t id;
+    uint32_t length;
+
+    if (buffer_len < sizeof(dir) + sizeof(st) + sizeof(id) + sizeof(length)) {
+        esplogW(TAG_LIB_ZIGBEE, "(deserialize_message)", "The buffer length is too small to deserialise all data!");
+        return false;
+    }
+
+    // Extract message direction, status, ID and length of load
+    memcpy(&dir, buffer + offset, sizeof(dir));
+    offset += sizeof(dir);
+    memcpy(&st, buffer + offset, sizeof(st));
+    offset += sizeof(st);
+    memcpy(&id, buffer + offset, sizeof(id));
+    offset += sizeof(id);
+    memcpy(&length, buffer + offset, sizeof(length));
+    offset += sizeof(length);
+
+    if (dir >= IOT_ALARM_MSGDIR_MAX || st >= IOT_ALARM_MSGSTATUS_MAX || id >= IOT_ALARM_MSGTYPE_MAX) {
+        esplogW(TAG_LIB_ZIGBEE, "(deserialize_message)", "Message header is invalid! (dir: %lu, status: %lu, id: %lu)", (unsigned long)dir, (unsigned long)st, (unsigned long)id);
+        return false;
+    }
+
+    // the load has to fill the rest of the frame exactly
+    if (length != buffer_len - offset) {
+        esplogW(TAG_LIB_ZIGBEE, "(deserialize_message)", "Message load length does not match the buffer length! (load: %lu, buffer: %u)", (unsigned long)length, (unsigned)(buffer_len - offset));
+        return false;
+    }
+
+    // the message and its load buffer are reused, the load buffer grows only if the load does not fit
+    if ((*msg)->load == NULL || (*msg)->size < length + 1) {
+        size_t size = length + 1 > ZIGBEE_LOAD_SIZE_MIN ? length + 1 : ZIGBEE_LOAD_SIZE_MIN;
+        char* load = (char *)realloc((*msg)->load, size);
+        if (load == NULL) {
+            esplogW(TAG_LIB_ZIGBEE, "(deserialize_message)", "Failed to allocate memory for message load!");
+            return false;
+        }
+        (*msg)->load = load;
+        (*msg)->size = size;
+    }
+
+    memcpy((*msg)->load, buffer + offset, length);
+    (*msg)->load[length] = '\0';
+
+    (*msg)->dir = (message_direction_t)dir;
+    (*msg)->id = (message_type_t)id;
+    (*msg)->st = (message_status_t)st;
+    (*msg)->length = length;
+    return true;
+}
+
+iot_alarm_message_t * create_message(message_direction_t dir, message_status_t st, message_type_t id, uint32_t length, const char* load) {
+
+    iot_alarm_message_t *msg = (iot_alarm_message_t *)malloc(sizeof(iot_alarm_message_t));
+    if (msg == NULL) {
+        esplogW(TAG_LIB_ZIGBEE, "(create_message)", "Failed to allocate memory for message!");
+        return NULL;
+    }
+
+    msg->dir = dir;
+    msg->id = id;
+    msg->st = st;
+    msg->length = length;
+    msg->size = length + 1;
+    msg->seq = 0;
+    msg->load = (char *)malloc(length + 1);
+    if (msg->load == NULL) {
+        esplogW(TAG_LIB_ZIGBEE, "(create_message)", "Failed to allocate memory for message load!");
+        free(msg);
+        msg = NULL;
+        return NULL;
+    }
+    memcpy(msg->load, load, length);
+    msg->load[length] = '\0';
+
+    return msg;
+}
+
+void destroy_message(iot_alarm_message_t **msg) {
+    if (*msg != NULL) {
+        if ((*msg)->load != NULL) {
+            free((*msg)->load);
+            (*msg)->load = NULL;
+        }
+
+        free(*msg);
+        *msg = NULL;
+    }
+}
+
+// *********************************************************************************************************************
+
+uint16_t zigbee_crc16(uint16_t crc, const uint8_t* data, size_t len) {
+    // CRC16-CCITT computed per byte without a lookup table
+    for (size_t i = 0; i < len; i++) {
+        uint8_t x = (uint8_t)(crc >> 8) ^ data[i];
+        x ^= x >> 4;
+        crc = (uint16_t)((crc << 8) ^ ((uint16_t)x << 12) ^ ((uint16_t)x << 5) ^ x);
+    }
+
+    return crc;
+}
+
+size_t encode_frame(uint8_t seq, const uint8_t* payload, size_t len, uint8_t* frame, size_t frame_size) {
+    if (frame == NULL || (payload == NULL && len > 0) || len == 0 || len > UINT16_MAX || len + ZIGBEE_FRAME_OVERHEAD > frame_size) {
+        return 0;
+    }
+
+    // the payload may be already serialized in place behind the header
+    if (payload != frame + ZIGBEE_FRAME_HEADER_SIZE) {
+        memmove(frame + ZIGBEE_FRAME_HEADER_SIZE, payload, len);
+    }
+
+    frame[0] = ZIGBEE_FRAME_SOF;
+    frame[1] = (uint8_t)(len & 0xFF);
+    frame[2] = (uint8_t)(len >> 8);
+    frame[3] = seq;
+
+    uint16_t crc = zigbee_crc16(0xFFFF, frame + 1, len + ZIGBEE_FRAME_HEADER_SIZE - 1);
+    frame[ZIGBEE_FRAME_HEADER_SIZE + len] = (uint8_t)(crc & 0xFF);
+    frame[ZIGBEE_FRAME_HEADER_SIZE + len + 1] = (uint8_t)(crc >> 8);
+
+    return len + ZIGBEE_FRAME_OVERHEAD;
+}
+
+void frame_parser_init(zigbee_frame_parser_t* parser, uint8_t* buffer, size_t buffer_size) {
+    memset(parser, 0, sizeof(zigbee_frame_parser_t));
+    parser->state = ZIGBEE_FRAME_STATE_SYNC;
+    parser->buffer = buffer;
+    parser->buffer_size = buffer_size;
+}
+
+void frame_parser_reset(zigbee_frame_parser_t* parser) {
+    parser->state = ZIGBEE_FRAME_STATE_SYNC;
+    parser->length = 0;
+    parser->index = 0;
+}
+
+int frame_parser_feed(zigbee_frame_parser_t* parser, uint8_t byte) {
+    switch (parser->state) {
+        case ZIGBEE_FRAME_STATE_SYNC:
+            if (byte == ZIGBEE_FRAME_SOF) {
+                parser->crc = 0xFFFF;
+                parser->state = ZIGBEE_FRAME_STATE_LEN_LO;
+            }
+            break;
+
+        case ZIGBEE_FRAME_STATE_LEN_LO:
+            parser->length = byte;
+            parser->crc = zigbee_crc16(parser->crc, &byte, 1);
+            parser->state = ZIGBEE_FRAME_STATE_LEN_HI;
+            break;
+
+        case ZIGBEE_FRAME_STATE_LEN_HI:
+            parser->length |= (uint16_t)byte << 8;
+            parser->crc = zigbee_crc16(parser->crc, &byte, 1);
+            if (parser->length == 0 || parser->length > parser->buffer_size || parser->buffer == NULL) {
+                parser->length_errors++;
+                parser->state = ZIGBEE_FRAME_STATE_SYNC;
+            } else {
+                parser->state = ZIGBEE_FRAME_STATE_SEQ;
+            }
+            break;
+
+        case ZIGBEE_FRAME_STATE_SEQ:
+            parser->seq = byte;
+            parser->crc = zigbee_crc16(parser->crc, &byte, 1);
+            parser->index = 0;
+            parser->state = ZIGBEE_FRAME_STATE_PAYLOAD;
+            break;
+
+        case ZIGBEE_FRAME_STATE_PAYLOAD:
+            parser->buffer[parser->index++] = byte;
+            parser->crc = zigbee_crc16(parser->crc, &byte, 1);
+            if (parser->index == parser->length) {
+                parser->state = ZIGBEE_FRAME_STATE_CRC_LO;
+            }
+            break;
+
+        case ZIGBEE_FRAME_STATE_CRC_LO:
+            parser->crc_rx = byte;
+            parser->state = ZIGBEE_FRAME_STATE_CRC_HI;
+            break;
+
+        case ZIGBEE_FRAME_STATE_CRC_HI:
+            parser->crc_rx |= (uint16_t)byte << 8;
+            parser->state = ZIGBEE_FRAME_STATE_SYNC;
+            if (parser->crc_rx == parser->crc) {
+                parser->frames++;
+                return parser->length;
+            }
+            parser->crc_errors++;
+            break;
+
+        default:
+            parser->state = ZIGBEE_FRAME_STATE_SYNC;
+            break;
+    }
+
+    return 0;
+}
+
+int read_uart(uart_port_t uart, uint8_t* rx_buffer, size_t max_len, TickType_t timeout) {
+    size_t available = 0;
+    uart_event_t event;
+    TickType_t start = xTaskGetTickCount();
+
+    if (max_len == 0) {
+        return 0;
+    }
+
+    if (zigbee_uart_queue == NULL) {
+        esplogW(TAG_LIB_ZIGBEE, "(read_uart)", "Zigbee UART driver is not installed!");
+        vTaskDelay(timeout);
+        return 0;
+    }
+
+    // block on the driver events until some bytes are buffered, the buffered bytes are read without waiting
+    uart_get_buffered_data_len(uart, &available);
+    while (available == 0) {
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        if (elapsed >= timeout || xQueueReceive(zigbee_uart_queue, &event, timeout - elapsed) != pdTRUE) {
+            return 0;
+        }
+
+        switch (event.type) {
+            case UART_FIFO_OVF:
+            case UART_BUFFER_FULL:
+                // the buffered data are not complete anymore, the parser resynchronises on the next frame
+                esplogW(TAG_LIB_ZIGBEE, "(read_uart)", "Zigbee UART RX overflow! Received data have been dropped.");
+                uart_flush_input(uart);
+                xQueueReset(zigbee_uart_queue);
+                frame_parser_reset(&zigbee_rx_parser);
+                break;
+
+            default:
+                break;
+        }
+
+        uart_get_buffered_data_len(uart, &available);
+    }
+
+    int read = uart_read_bytes(uart, rx_buffer, available < max_len ? available : max_len, 0);
+    return read > 0 ? read : 0;
+}
+
+static size_t frame_message(iot_alarm_message_t *msg, uint8_t seq, uint8_t* frame, size_t frame_size) {
+    size_t length;
+
+    // serialize_message terminates the load, so one more byte is needed
+    if (sizeof(msg->dir) + sizeof(msg->st) + sizeof(msg->id) + sizeof(msg->length) + msg->length + ZIGBEE_FRAME_OVERHEAD + 1 > frame_size) {
+        return 0;
+    }
+
+    // the message is serialized behind the frame header, so it is not copied again
+    serialize_message(msg, frame + ZIGBEE_FRAME_HEADER_SIZE, &length);
+    return encode_frame(seq, frame + ZIGBEE_FRAME_HEADER_SIZE, length, frame, frame_size);
+}
+
+int send_message(uart_port_t uart, uint8_t* tx_buffer, iot_alarm_message_t *msg) {
+    if (msg == NULL || tx_buffer == NULL) {
+        esplogW(TAG_LIB_ZIGBEE, "(send_message)", "Error: Message or buffer is nullptr!");
+        return -1;
+    }
+
+    size_t length = frame_message(msg, msg->seq, tx_buffer, TX_BUF_SIZE);
+    if (length == 0) {
+        esplogW(TAG_LIB_ZIGBEE, "(send_message)", "Message (load length: %lu) does not fit into the TX buffer!", (unsigned long)msg->length);
+        return -1;
+    }
+
+    int tx_bytes = uart_write_bytes(uart, (const char *)tx_buffer, length);
+    if (tx_bytes == (int)length) {
+        // esplogI(TAG_LIB_ZIGBEE, "(send_message)", "Message (length: %d) was sent successfully!", tx_bytes);
+    } else {
         esplogW(TAG_LIB_ZIGBEE, "(send_message)", "Failed to send message!");
     }
 
-    return tx_bytes;
+    return tx_bytes;
+}
+
+int receive_message(uart_port_t uart, uint8_t* rx_buffer, iot_alarm_message_t **msg, size_t max_len, TickType_t timeout) {
+    if (msg == NULL || *msg == NULL) {
+        esplogW(TAG_LIB_ZIGBEE, "(receive_message)", "Error: Message is nullptr!");
+        return 0;
+    }
+
+    if (rx_buffer == NULL) {
+        esplogW(TAG_LIB_ZIGBEE, "(receive_message)", "Error: Buffer is nullptr!");
+        return 0;
+    }
+
+    if (zigbee_rx_parser.buffer != rx_buffer || zigbee_rx_parser.buffer_size != max_len) {
+        frame_parser_init(&zigbee_rx_parser, rx_buffer, max_len);
+    }
+
+    TickType_t start = xTaskGetTickCount();
+    for (;;) {
+        // the bytes behind a completed frame are kept for the next call
+        while (zigbee_rx_chunk_pos < zigbee_rx_chunk_len) {
+            uint32_t crc_errors = zigbee_rx_parser.crc_errors;
+            int rx_bytes = frame_parser_feed(&zigbee_rx_parser, zigbee_rx_chunk[zigbee_rx_chunk_pos++]);
+
+            /* char hex_string[rx_bytes * 3 + 1];
+            for (size_t i = 0; i < rx_bytes; i++) {
+                snprintf(&hex_string[i * 3], 4, "%02X ", rx_buffer[i]);
+            }
+            esplogI(TAG_LIB_DEBUG, "(receive_message)", "Frame (length %d): %s", rx_bytes, hex_string); // */
+
+            if (rx_bytes > 0 && deserialize_message(msg, rx_buffer, rx_bytes)) {
+                (*msg)->seq = zigbee_rx_parser.seq;
+                return rx_bytes;
+            }
+            if (zigbee_rx_parser.crc_errors != crc_errors) {
+                esplogW(TAG_LIB_ZIGBEE, "(receive_message)", "Frame with invalid CRC has been dropped! (dropped: %lu)", (unsigned long)zigbee_rx_parser.crc_errors);
+            }
+        }
+
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        int read = read_uart(uart, zigbee_rx_chunk, sizeof(zigbee_rx_chunk), elapsed < timeout ? timeout - elapsed : 0);
+        if (read <= 0) {
+            return 0;
+        }
+
+        zigbee_rx_chunk_pos = 0;
+        zigbee_rx_chunk_len = (size_t)read;
+    }
+}
+
+// *********************************************************************************************************************
+
+static bool zigbee_command_init() {
+    if (zigbee_command_mutex != NULL) {
+        return true;
+    }
+
+    zigbee_command_mutex = xSemaphoreCreateMutex();
+    if (zigbee_command_mutex == NULL) {
+        return false;
+    }
+
+    for (int i = 0; i < ZIGBEE_COMMAND_SLOTS; i++) {
+        zigbee_commands[i].state = ZIGBEE_COMMAND_FREE;
+        zigbee_commands[i].done = xSemaphoreCreateBinary();
+        if (zigbee_commands[i].done == NULL) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool zigbee_ticks_reached(TickType_t now, TickType_t ticks) {
+    // works across the tick counter overflow
+    return (int32_t)(now - ticks) >= 0;
+}
+
+// the sequence number is returned through `seq` (optional), the slot of an asynchronous command may be reused
+// by the zigbee task as soon as the mutex is released
+static int zigbee_command_start(iot_alarm_message_t *msg, uint32_t timeout_ms, zigbee_command_cb_t cb, void* ctx, bool waiting, uint8_t *seq) {
+    if (msg == NULL) {
+        esplogW(TAG_LIB_ZIGBEE, "(zigbee_command_start)", "Error: Message is nullptr!");
+        return -1;
+    }
+
+    if (zigbee_command_mutex == NULL) {
+        esplogW(TAG_LIB_ZIGBEE, "(zigbee_command_start)", "Zigbee command table is not initialised!");
+        return -1;
+    }
+
+    xSemaphoreTake(zigbee_command_mutex, portMAX_DELAY);
+
+    int slot = -1;
+    for (int i = 0; i < ZIGBEE_COMMAND_SLOTS; i++) {
+        if (zigbee_commands[i].state == ZIGBEE_COMMAND_FREE) {
+            slot = i;
+            break;
+        }
+    }
+
+    if (slot < 0) {
+        xSemaphoreGive(zigbee_command_mutex);
+        esplogW(TAG_LIB_ZIGBEE, "(zigbee_command_start)", "Too many zigbee commands in flight! (max: %d)", ZIGBEE_COMMAND_SLOTS);
+        return -1;
+    }
+
+    // sequence number 0 is used for the frames which are not acknowledged
+    zigbee_command_seq = zigbee_command_seq == UINT8_MAX ? 1 : zigbee_command_seq + 1;
+
+    zigbee_command_t * command = &zigbee_commands[slot];
+    command->frame_len = frame_message(msg, zigbee_command_seq, command->frame, sizeof(command->frame));
+    if (command->frame_len == 0) {
+        xSemaphoreGive(zigbee_command_mutex);
+        esplogW(TAG_LIB_ZIGBEE, "(zigbee_command_start)", "Message (load length: %lu) does not fit into the command slot!", (unsigned long)msg->length);
+        return -1;
+    }
+
+    TickType_t now = xTaskGetTickCount();
+    command->state = ZIGBEE_COMMAND_PENDING;
+    command->waiting = waiting;
+    command->success = false;
+    command->seq = zigbee_command_seq;
+    command->id = msg->id;
+    command->ack_dir = msg->dir == IOT_ALARM_MSGDIR_NOTIFICATION ? IOT_ALARM_MSGDIR_NOTIFICATION_ACK : IOT_ALARM_MSGDIR_COMMAND_ACK;
+    command->deadline = now + pdMS_TO_TICKS(timeout_ms);
+    command->resend = now + pdMS_TO_TICKS(ZIGBEE_ACK_TIMEOUT_MS);
+    command->cb = cb;
+    command->ctx = ctx;
+
+    // the semaphore may be given by a late completion of the previous command in the slot
+    xSemaphoreTake(command->done, 0);
+
+    if (uart_write_bytes(UART, (const char *)command->frame, command->frame_len) != (int)command->frame_len) {
+        esplogW(TAG_LIB_ZIGBEE, "(zigbee_command_start)", "Failed to send message! (seq: %d)", command->seq);
+    }
+
+    if (seq != NULL) {
+        *seq = command->seq;
+    }
+    xSemaphoreGive(zigbee_command_mutex);
+    return slot;
+}
+
+// finishes the command, the caller holds the mutex and invokes the returned callback after releasing it
+static zigbee_command_cb_t zigbee_command_finish(zigbee_command_t * command, bool success) {
+    command->success = success;
+
+    if (command->waiting) {
+        command->state = ZIGBEE_COMMAND_DONE;
+        xSemaphoreGive(command->done);
+        return NULL;
+    }
+
+    command->state = ZIGBEE_COMMAND_FREE;
+    return command->cb;
+}
+
+uint8_t zigbee_command_send(iot_alarm_message_t *msg, uint32_t timeout_ms, zigbee_command_cb_t cb, void* ctx) {
+    uint8_t seq = 0;
+    int slot = zigbee_command_start(msg, timeout_ms, cb, ctx, false, &seq);
+    return slot < 0 ? 0 : seq;
+}
+
+bool zigbee_command_wait(iot_alarm_message_t *msg, uint32_t timeout_ms) {
+    static iot_alarm_message_t * rx_msg = NULL;
+
+    int slot = zigbee_command_start(msg, timeout_ms, NULL, NULL, true, NULL);
+    if (slot < 0) {
+        return false;
+    }
+
+    zigbee_command_t * command = &zigbee_commands[slot];
+
+    if (handleTaskZigbee == NULL || xTaskGetCurrentTaskHandle() == handleTaskZigbee) {
+        // nobody else receives the frames, so the acknowledges are received here
+        if (rx_msg == NULL) {
+            rx_msg = create_message(IOT_ALARM_MSGDIR_MAX, IOT_ALARM_MSGSTATUS_MAX, IOT_ALARM_MSGTYPE_MAX, 1, "\0");
+        }
+
+        while (command->state == ZIGBEE_COMMAND_PENDING) {
+            TickType_t timeout = zigbee_command_poll();
+            if (rx_msg != NULL && receive_message(UART, rx_buffer, &rx_msg, RX_BUF_SIZE-1, timeout) > 0 &&
+                (rx_msg->dir == IOT_ALARM_MSGDIR_COMMAND_ACK || rx_msg->dir == IOT_ALARM_MSGDIR_NOTIFICATION_ACK)) {
+                zigbee_command_ack(rx_msg);
+            } else if (rx_msg == NULL) {
+                vTaskDelay(timeout);
+            }
+        }
+    } else {
+        // the zigbee task fails the command at its deadline, the margin covers a late poll
+        xSemaphoreTake(command->done, pdMS_TO_TICKS(timeout_ms + ZIGBEE_ACK_TIMEOUT_MS));
+    }
+
+    xSemaphoreTake(zigbee_command_mutex, portMAX_DELAY);
+    bool success = command->state == ZIGBEE_COMMAND_DONE && command->success;
+    uint8_t seq = command->seq;
+    command->state = ZIGBEE_COMMAND_FREE;
+    xSemaphoreGive(zigbee_command_mutex);
+
+    if (!success) {
+        esplogW(TAG_LIB_ZIGBEE, "(zigbee_command_wait)", "Zigbee module didnt responded in time! (seq: %d, id: %d)", seq, msg->id);
+    }
+
+    return success;
+}
+
+bool zigbee_command_ack(const iot_alarm_message_t *ack) {
+    if (ack == NULL || zigbee_command_mutex == NULL) {
+        return false;
+    }
+
+    zigbee_command_cb_t cb = NULL;
+    bool matched = false;
+    bool success = false;
+    void* ctx = NULL;
+
+    xSemaphoreTake(zigbee_command_mutex, portMAX_DELAY);
+    for (int i = 0; i < ZIGBEE_COMMAND_SLOTS; i++) {
+        zigbee_command_t * command = &zigbee_commands[i];
+        if (command->state == ZIGBEE_COMMAND_PENDING && command->seq == ack->seq && command->ack_dir == ack->dir && command->id == ack->id) {
+            success = ack->st == IOT_ALARM_MSGSTATUS_SUCCESS;
+            ctx = command->ctx;
+            cb = zigbee_command_finish(command, success);
+            matched = true;
+            break;
+        }
+    }
+    xSemaphoreGive(zigbee_command_mutex);
+
+    if (cb != NULL) {
+        cb(ack->seq, ack->id, success, ctx);
+    }
+
+    return matched;
+}
+
+TickType_t zigbee_command_poll() {
+    TickType_t next = pdMS_TO_TICKS(ZIGBEE_RX_TIMEOUT_MS);
+
+    if (zigbee_command_mutex == NULL) {
+        return next;
+    }
+
+    struct {
+        zigbee_command_cb_t cb;
+        uint8_t seq;
+        message_type_t id;
+        void* ctx;
+    } expired[ZIGBEE_COMMAND_SLOTS];
+    int expired_count = 0;
+
+    xSemaphoreTake(zigbee_command_mutex, portMAX_DELAY);
+    TickType_t now = xTaskGetTickCount();
+    for (int i = 0; i < ZIGBEE_COMMAND_SLOTS; i++) {
+        zigbee_command_t * command = &zigbee_commands[i];
+        if (command->state != ZIGBEE_COMMAND_PENDING) {
+            continue;
+        }
+
+        if (zigbee_ticks_reached(now, command->deadline)) {
+            zigbee_command_cb_t cb = zigbee_command_finish(command, false);
+            if (cb != NULL) {
+                expired[expired_count].cb = cb;
+                expired[expired_count].seq = command->seq;
+                expired[expired_count].id = command->id;
+                expired[expired_count].ctx = command->ctx;
+                expired_count++;
+            }
+            continue;
+        }
+
+        // the command or its acknowledge got lost, so the same frame (with the same sequence number) is sent again
+        if (zigbee_ticks_reached(now, command->resend)) {
+            uart_write_bytes(UART, (const char *)command->frame, command->frame_len);
+            command->resend = now + pdMS_TO_TICKS(ZIGBEE_ACK_TIMEOUT_MS);
+        }
+
+        TickType_t event = zigbee_ticks_reached(command->resend, command->deadline) ? command->deadline : command->resend;
+        if (event - now < next) {
+            next = event - now;
+        }
+    }
+    xSemaphoreGive(zigbee_command_mutex);
+
+    for (int i = 0; i < expired_count; i++) {
+        esplogW(TAG_LIB_ZIGBEE, "(zigbee_command_poll)", "Zigbee command timed out! (seq: %d, id: %d)", expired[i].seq, expired[i].id);
+        expired[i].cb(expired[i].seq, expired[i].id, false, expired[i].ctx);
+    }
+
+    return next;
+}
+
+// the attributes of the frame being dispatched (only the zigbee task dispatches the frames)
+static iot_alarm_attr_load_t zigbee_dispatch_attrs[ZIGBEE_ATTR_BATCH_MAX];
+
+bool zigbee_message_dispatch(const iot_alarm_message_t *msg, int rx_bytes) {
+    // handeling of unusable messages
+    if (msg == NULL ||
+        msg->dir >= IOT_ALARM_MSGDIR_MAX || msg->dir < 0 ||
+        msg->id >= IOT_ALARM_MSGTYPE_MAX || msg->id <= 0 ||
+        msg->st >= IOT_ALARM_MSGSTATUS_MAX || msg->st < 0) {
+        esplogW(TAG_RTOS_ZIGBEE, NULL, "Invalid message has been received!");
+        return false;
+    }
+
+    // handeling of acknowladges (completes the outstanding command with the same sequence number)
+    if (msg->dir == IOT_ALARM_MSGDIR_COMMAND_ACK || msg->dir == IOT_ALARM_MSGDIR_NOTIFICATION_ACK) {
+        if (!zigbee_command_ack(msg)) {
+            esplogI(TAG_RTOS_ZIGBEE, NULL, "Acknowledgement message without outstanding command has been received! (seq: %d, id: %d)", msg->seq, msg->id);
+        }
+        return true;
+    }
+
+    // send acknowledge (the load is not owned by the acknowledge)
+    char ack_load[1] = {'\0'};
+    iot_alarm_message_t msg_ack = {IOT_ALARM_MSGDIR_MAX, IOT_ALARM_MSGSTATUS_SUCCESS, msg->id, 1, ack_load, 0, msg->seq};
+    if (msg->dir == IOT_ALARM_MSGDIR_NOTIFICATION) {
+        msg_ack.dir = IOT_ALARM_MSGDIR_NOTIFICATION_ACK;
+        send_message(UART, tx_buffer, &msg_ack);
+    } else if (msg->dir == IOT_ALARM_MSGDIR_COMMAND) {
+        msg_ack.dir = IOT_ALARM_MSGDIR_COMMAND_ACK;
+        send_message(UART, tx_buffer, &msg_ack);
+    }
+
+    // handle received messages
+    esplogI(TAG_RTOS_ZIGBEE, NULL, "Message (length: %d) received: DIR: %d, ID: %d, STATUS: %d, LEN: %d, LOAD: %s", rx_bytes, msg->dir, msg->id, msg->st, msg->length, msg->load);
+    iot_alarm_attr_load_t * msg_load = &zigbee_dispatch_attrs[0];
+    size_t msg_batch_count = 0;
+    zigbee_device_t dev;
+    bool coalesced = false;
+    bool critical;
+
+    switch (msg->id) {
+        case IOT_ALARM_MSGTYPE_DEV_COUNT:
+            if (msg->load != NULL) {
+                displayNotification(NOTIFICATION_ZIGBEE_DEV_COUNT, (uint8_t)atoi(msg->load));
+            }
+            break;
+
+        case IOT_ALARM_MSGTYPE_ZB_DATA_READ:
+        case IOT_ALARM_MSGTYPE_ZB_DATA_WRITE:
+            if (msg->load == NULL || !deserialize_attr(&msg_load, (uint8_t*)msg->load, msg->length)) {
+                return false;
+            }
+            // the requested value is published even if it did not change, the cache is only kept up to date
+            attr_cache_update(msg_load);
+
+            zigbeeAttrReadWriteHandler(msg_load);
+
+            // push to mqtt (the requested responses are not dropped in favour of the telemetry)
+            zigbee_publish_enqueue(msg->id == IOT_ALARM_MSGTYPE_ZB_DATA_READ ? ZIGBEE_PUBLISH_READ : ZIGBEE_PUBLISH_WRITE, msg_load, true);
+            break;
+
+        case IOT_ALARM_MSGTYPE_ZB_DATA_REPORT:
+            if (msg->load == NULL || !deserialize_attr(&msg_load, (uint8_t*)msg->load, msg->length)) {
+                return false;
+            }
+            // the repeated values count as well (the device is alive)
+            device_registry_seen(msg_load);
+            // only the unchanged telemetry is dropped, a repeated alarm value still goes through the rules
+            // (they coalesce the repeats of a sensor in its debounce window)
+            critical = zigbeeAttrIsCritical(msg_load);
+            if (!attr_cache_update(msg_load) && !critical) {
+                break;
+            }
+
+            esplogI(TAG_RTOS_ZIGBEE, NULL, "Attr report obtained: short: %04hx, ieee: %02X:%02X:%02X:%02X:%02X:%02X:%02X:%02X, dev_id: %d, ep_id: %d, cluster_id: %04hx, attr_id: %04hx, value: %lu",
+                msg_load->short_addr,
+                msg_load->ieee_addr[7], msg_load->ieee_addr[6], msg_load->ieee_addr[5], msg_load->ieee_addr[4],
+                msg_load->ieee_addr[3], msg_load->ieee_addr[2], msg_load->ieee_addr[1], msg_load->ieee_addr[0],
+                msg_load->device_id, msg_load->endpoint_id, msg_load->cluster_id, msg_load->attr_id, msg_load->value);
+
+            // the alarm rules are evaluated right away, publishing and logging are left to the publishing task
+            zigbeeAttrReportHandler(msg_load, &coalesced);
+
+            // push to mqtt (the alarm-relevant reports first, the oldest telemetry is dropped under a flood),
+            // the reports coalesced by a debounce window are published as one event when it closes
+            if (!coalesced) {
+                zigbee_publish_enqueue(ZIGBEE_PUBLISH_REPORT, msg_load, critical);
+            }
+            break;
+
+        case IOT_ALARM_MSGTYPE_ZB_DATA_READ_BATCH:
+        case IOT_ALARM_MSGTYPE_ZB_DATA_WRITE_BATCH:
+            if (msg->load == NULL ||
+                !deserialize_attr_batch(zigbee_dispatch_attrs, ZIGBEE_ATTR_BATCH_MAX, &msg_batch_count, (uint8_t*)msg->load, msg->length)) {
+                return false;
+            }
+
+            // the requested values are published even if they did not change, the cache is only kept up to date
+            for (size_t i = 0; i < msg_batch_count; i++) {
+                attr_cache_update(&zigbee_dispatch_attrs[i]);
+                zigbeeAttrReadWriteHandler(&zigbee_dispatch_attrs[i]);
+            }
+
+            // push to mqtt (one aggregated message, packed and published by the publishing task)
+            zigbee_publish_batch(msg->id == IOT_ALARM_MSGTYPE_ZB_DATA_READ_BATCH ? ZIGBEE_PUBLISH_READ_BATCH : ZIGBEE_PUBLISH_WRITE_BATCH,
+                zigbee_dispatch_attrs, msg_batch_count);
+            break;
+
+        case IOT_ALARM_MSGTYPE_ZB_DEV_INFO:
+            // the metadata are interned once per device, the attribute frames refer to the device by its handle
+            if (msg->load == NULL || !device_registry_update((uint8_t*)msg->load, msg->length, &dev)) {
+                return false;
+            }
+
+            // push to mqtt (retained, so the subscribers get the metadata of all devices), the metadata come
+            // on every rejoin and in bursts after boot, so they are packed and published by the publishing task
+            zigbee_publish_device(&dev);
+            break;
+
+        case IOT_ALARM_MSGTYPE_ZB_DEV_LOCK:
+            displayNotification(NOTIFICATION_ZIGBEE_NET_CLOSE);
+            break;
+
+        case IOT_ALARM_MSGTYPE_ZB_DEV_UNLOCK:
+            displayNotification(NOTIFICATION_ZIGBEE_NET_OPEN, msg->load != NULL ? (uint8_t)atoi(msg->load) : 0);
+            break;
+
+        case IOT_ALARM_MSGTYPE_ZB_DEV_NEW:
+            displayNotification(NOTIFICATION_ZIGBEE_DEV_ANNCE);
+            break;
+
+        case IOT_ALARM_MSGTYPE_ZB_DEV_LEAVE:
+            displayNotification(NOTIFICATION_ZIGBEE_DEV_LEAVE);
+            break;
+
+        default:
+            break;
+    }
+
+    return true;
+}
+
+int send_attr(uart_port_t uart, uint8_t* tx_buffer, iot_alarm_attr_load_t * load, message_type_t id) {
+    message_direction_t dir;
+    size_t length;
+    char serialized_load[1000];
+    serialize_attr(load, serialized_load, &length);
+
+    switch (id) {
+        case IOT_ALARM_MSGTYPE_ZB_DATA_READ:
+        case IOT_ALARM_MSGTYPE_ZB_DATA_WRITE:
+        case IOT_ALARM_MSGTYPE_ZB_DATA_REPORT:
+            dir = IOT_ALARM_MSGDIR_NOTIFICATION;
+            break;
+        
+        default:
+            dir = IOT_ALARM_MSGDIR_MAX;
+            break;
+    }
+
+    iot_alarm_message_t msg = {
+        .dir = dir,
+        .st = IOT_ALARM_MSGSTATUS_SUCCESS,
+        .id = id,
+        .length = (uint16_t)length,
+        .load = serialized_load,
+        .size = 0,
+    };
+
+    if (!zigbee_command_wait(&msg, ZIGBEE_COMMAND_TIMEOUT_MS)) {
+        esplogW(TAG_LIB_ZIGBEE, "(send_attr)", "Failed to get acknowlede for sending attribute data!");
+        return -1;
+    }
+
+    return (int)length;
+}
+
+/* int send_dev(uart_port_t uart, uint8_t* tx_buffer, iot_alarm_dev_load_t * load, message_type_t id) {
+    // convert iot_alarm_dev_load_t to char*
+    // compute the length of char* load
+    // from load structure & id compute the dir
+
+    iot_alarm_message_t msg = {
+        .dir = ,
+        .id = id,
+        .st = IOT_ALARM_MSGSTATUS_SUCCESS,
+        .length = ,
+        .load = ,
+    };
+
+    int tx_bytes = send_message(uart, tx_buffer, &msg);
+    return tx_bytes;
+} */
+
+// ----------------------------------------------------------------------------------------------------------------------------------------------------
+
+void serialize_attr(iot_alarm_attr_load_t *attr, char *buffer, size_t *bytes) {
+    if (attr == NULL) {
+        esplogW(TAG_LIB_ZIGBEE, "(serialize_attr)", "Error: Message is nullptr!");
+        return;
+    }
+    
+    if (buffer == NULL) {
+        esplogW(TAG_LIB_ZIGBEE, "(serialize_attr)", "Error: Buffer is nullptr!");
+        return;
+    }
+
+    int offset = 0;
+
+    memcpy(buffer + offset, &attr->ieee_addr, sizeof(attr->ieee_addr));
+    offset += sizeof(attr->ieee_addr);
+    memcpy(buffer + offset, &attr->short_addr, sizeof(attr->short_addr));
+    offset += sizeof(attr->short_addr);
+
+    memcpy(buffer + offset, &attr->device_id, sizeof(attr->device_id));
+    offset += sizeof(attr->device_id);
+    memcpy(buffer + offset, &attr->endpoint_id, sizeof(attr->endpoint_id));
+    offset += sizeof(attr->endpoint_id);
+    memcpy(buffer + offset, &attr->cluster_id, sizeof(attr->cluster_id));
+    offset += sizeof(attr->cluster_id);
+    memcpy(buffer + offset, &attr->attr_id, sizeof(attr->attr_id));
+    offset += sizeof(attr->attr_id);
+
+    memcpy(buffer + offset, &attr->value_type, sizeof(attr->value_type));
+    offset += sizeof(attr->value_type);
+
+    uint16_t length;
+    switch (attr->value_type) {
+        case ESP_ZB_ZCL_ATTR_TYPE_8BIT:
+        case ESP_ZB_ZCL_ATTR_TYPE_8BITMAP:
+        case ESP_ZB_ZCL_ATTR_TYPE_8BIT_ENUM:
+        case ESP_ZB_ZCL_ATTR_TYPE_U8:
+
+        case ESP_ZB_ZCL_ATTR_TYPE_16BIT:
+        case ESP_ZB_ZCL_ATTR_TYPE_16BITMAP:
+        case ESP_ZB_ZCL_ATTR_TYPE_16BIT_ENUM:
+        case ESP_ZB_ZCL_ATTR_TYPE_U16:
+
+        case ESP_ZB_ZCL_ATTR_TYPE_32BIT:
+        case ESP_ZB_ZCL_ATTR_TYPE_32BITMAP:
+        case ESP_ZB_ZCL_ATTR_TYPE_U32:
+            memcpy(buffer + offset, &attr->value, sizeof(attr->value));
+            offset += sizeof(attr->value);
+            break;
+
+        default:
+            break;
+    }
+
+    memcpy(buffer + offset, &attr->type_id, sizeof(attr->type_id));
+    offset += sizeof(attr->type_id);
+    memcpy(buffer + offset, &attr->type, sizeof(attr->type));
+    offset += sizeof(attr->type);
+    buffer[offset-1] = '\0';
+    memcpy(buffer + offset, &attr->manuf, sizeof(attr->manuf));
+    offset += sizeof(attr->manuf);
+    buffer[offset-1] = '\0';
+    memcpy(buffer + offset, &attr->name, sizeof(attr->name));
+    offset += sizeof(attr->name);
+    buffer[offset-1] = '\0';
+
+    buffer[offset] = '\0';
+    *bytes = offset;
+}
+
+void serialize_attr_compact(const iot_alarm_attr_load_t *attr, uint16_t handle, char *buffer, size_t *bytes) {
+    if (attr == NULL || buffer == NULL) {
+        esplogW(TAG_LIB_ZIGBEE, "(serialize_attr_compact)", "Error: Attr or buffer is nullptr!");
+        return;
+    }
+
+    uint8_t value_type = (uint8_t)attr->value_type;
+    int offset = 0;
+
+    buffer[offset++] = (char)ZIGBEE_ATTR_COMPACT_TAG;
+    memcpy(buffer + offset, &handle, sizeof(handle));
+    offset += sizeof(handle);
+    memcpy(buffer + offset, &attr->endpoint_id, sizeof(attr->endpoint_id));
+    offset += sizeof(attr->endpoint_id);
+    memcpy(buffer + offset, &attr->cluster_id, sizeof(attr->cluster_id));
+    offset += sizeof(attr->cluster_id);
+    memcpy(buffer + offset, &attr->attr_id, sizeof(attr->attr_id));
+    offset += sizeof(attr->attr_id);
+    memcpy(buffer + offset, &value_type, sizeof(value_type));
+    offset += sizeof(value_type);
+    memcpy(buffer + offset, &attr->value, sizeof(attr->value));
+    offset += sizeof(attr->value);
+
+    *bytes = offset;
+}
+
+// the attributes of the registered devices are sent to the zigbee module in the compact form
+static void serialize_attr_command(iot_alarm_attr_load_t * attr, char * buffer, size_t * bytes) {
+    zigbee_device_t dev;
+    if (device_registry_find_ieee(attr->ieee_addr, &dev)) {
+        serialize_attr_compact(attr, dev.handle, buffer, bytes);
+    } else {
+        serialize_attr(attr, buffer, bytes);
+    }
+}
+
+bool serialize_attr_batch(const iot_alarm_attr_load_t *attrs, size_t count, char *buffer, size_t buffer_size, size_t *bytes) {
+    if ((attrs == NULL && count > 0) || buffer == NULL || bytes == NULL) {
+        esplogW(TAG_LIB_ZIGBEE, "(serialize_attr_batch)", "Error: Attrs or buffer is nullptr!");
+        return false;
+    }
+
+    if (count > ZIGBEE_ATTR_BATCH_MAX || buffer_size < 1 + count * ZIGBEE_ATTR_BATCH_ITEM_SIZE) {
+        esplogW(TAG_LIB_ZIGBEE, "(serialize_attr_batch)", "Batch (attributes: %u) does not fit into the buffer!", (unsigned)count);
+        return false;
+    }
+
+    size_t offset = 0;
+    buffer[offset++] = (char)count;
+
+    for (size_t i = 0; i < count; i++) {
+        const iot_alarm_attr_load_t * attr = &attrs[i];
+        uint8_t value_type = (uint8_t)attr->value_type;
+
+        memcpy(buffer + offset, &attr->ieee_addr, sizeof(attr->ieee_addr));
+        offset += sizeof(attr->ieee_addr);
+        memcpy(buffer + offset, &attr->endpoint_id, sizeof(attr->endpoint_id));
+        offset += sizeof(attr->endpoint_id);
+        memcpy(buffer + offset, &attr->cluster_id, sizeof(attr->cluster_id));
+        offset += sizeof(attr->cluster_id);
+        memcpy(buffer + offset, &attr->attr_id, sizeof(attr->attr_id));
+        offset += sizeof(attr->attr_id);
+        memcpy(buffer + offset, &value_type, sizeof(value_type));
+        offset += sizeof(value_type);
+        memcpy(buffer + offset, &attr->value, sizeof(attr->value));
+        offset += sizeof(attr->value);
+    }
+
+    *bytes = offset;
+    return true;
+}
+
+bool deserialize_attr_batch(iot_alarm_attr_load_t *attrs, size_t max, size_t *count, const uint8_t *buffer, size_t buffer_len) {
+    if (attrs == NULL || count == NULL || buffer == NULL || buffer_len < 1) {
+        esplogW(TAG_LIB_ZIGBEE, "(deserialize_attr_batch)", "Error: Attrs or buffer is nullptr!");
+        return false;
+    }
+
+    size_t n = buffer[0];
+    if (buffer_len != 1 + n * ZIGBEE_ATTR_BATCH_ITEM_SIZE || n > max) {
+        esplogW(TAG_LIB_ZIGBEE, "(deserialize_attr_batch)", "Invalid batch! (attributes: %u, length: %u)", (unsigned)n, (unsigned)buffer_len);
+        return false;
+    }
+
+    size_t offset = 1;
+    for (size_t i = 0; i < n; i++) {
+        esp_zb_ieee_addr_t ieee_addr;
+        uint8_t endpoint_id;
+        uint16_t cluster_id;
+        uint16_t attr_id;
+        uint8_t value_type;
+        uint32_t value;
+
+        memcpy(&ieee_addr, buffer + offset, sizeof(ieee_addr));
+        offset += sizeof(ieee_addr);
+        memcpy(&endpoint_id, buffer + offset, sizeof(endpoint_id));
+        offset += sizeof(endpoint_id);
+        memcpy(&cluster_id, buffer + offset, sizeof(cluster_id));
+        offset += sizeof(cluster_id);
+        memcpy(&attr_id, buffer + offset, sizeof(attr_id));
+        offset += sizeof(attr_id);
+        memcpy(&value_type, buffer + offset, sizeof(value_type));
+        offset += sizeof(value_type);
+        memcpy(&value, buffer + offset, sizeof(value));
+        offset += sizeof(value);
+
+        // the metadata are not part of the batch, the registered devices get them from the registry
+        zigbee_device_t dev;
+        if (!device_registry_find_ieee(ieee_addr, &dev)) {
+            memset(&dev, 0, sizeof(dev));
+        }
+
+        fill_attr(&attrs[i], dev.manuf, dev.name, dev.type, dev.type_id, ieee_addr, dev.short_addr, dev.device_id, endpoint_id, cluster_id, attr_id, (esp_zb_zcl_attr_type_t)value_type, value);
+    }
+
+    *count = n;
+    return true;
+}
+
+static bool deserialize_attr_compact(iot_alarm_attr_load_t *attr, const uint8_t *buffer) {
+    static uint16_t requested_handle = 0;
+    static uint32_t requested_time = 0;
+
+    uint16_t handle;
+    uint8_t endpoint_id;
+    uint16_t cluster_id;
+    uint16_t attr_id;
+    uint8_t value_type;
+    uint32_t value;
+    size_t offset = 1;
+
+    memcpy(&handle, buffer + offset, sizeof(handle));
+    offset += sizeof(handle);
+    memcpy(&endpoint_id, buffer + offset, sizeof(endpoint_id));
+    offset += sizeof(endpoint_id);
+    memcpy(&cluster_id, buffer + offset, sizeof(cluster_id));
+    offset += sizeof(cluster_id);
+    memcpy(&attr_id, buffer + offset, sizeof(attr_id));
+    offset += sizeof(attr_id);
+    memcpy(&value_type, buffer + offset, sizeof(value_type));
+    offset += sizeof(value_type);
+    memcpy(&value, buffer + offset, sizeof(value));
+    offset += sizeof(value);
+
+    zigbee_device_t dev;
+    if (!device_registry_find(handle, &dev)) {
+        // the metadata are requested once per command timeout, the reports are dropped until they arrive
+        if (handle != requested_handle || millis() - requested_time > ZIGBEE_COMMAND_TIMEOUT_MS) {
+            esplogW(TAG_LIB_ZIGBEE, "(deserialize_attr)", "Unknown device handle %d! Requesting device info...", handle);
+            requested_handle = handle;
+            requested_time = millis();
+            zigbeeDeviceInfoRequest(handle);
+        }
+        return false;
+    }
+
+    fill_attr(attr, dev.manuf, dev.name, dev.type, dev.type_id, dev.ieee_addr, dev.short_addr, dev.device_id, endpoint_id, cluster_id, attr_id, (esp_zb_zcl_attr_type_t)value_type, value);
+    return true;
+}
+
+bool deserialize_attr(iot_alarm_attr_load_t **attr, uint8_t *buffer, size_t buffer_len) {
+    if (attr == NULL) {
+        esplogW(TAG_LIB_ZIGBEE, "(deserialize_attr)", "Error: Message is nullptr!");
+        return false;
+    }
+
+    if (*attr == NULL) {
+        esplogW(TAG_LIB_ZIGBEE, "(deserialize_attr)", "Error: Message is nullptr!");
+        return false;
+    }
+
+    if (buffer == NULL) {
+        esplogW(TAG_LIB_ZIGBEE, "(deserialize_attr)", "Error: Buffer is nullptr!");
+        return false;
+    }
+
+    // the full form is never as short as the compact form
+    if (buffer_len == ZIGBEE_ATTR_COMPACT_SIZE && buffer[0] == ZIGBEE_ATTR_COMPACT_TAG) {
+        return deserialize_attr_compact(*attr, buffer);
+    }
+
+    size_t offset = 0;
+
+    char manuf[50];
+    char name[50];
+    char type[50];
+    uint32_t type_id;
+    esp_zb_ieee_addr_t ieee_addr;
+    uint16_t short_addr;
+    uint8_t device_id;
+    uint8_t endpoint_id;
+    uint16_t cluster_id;
+    uint16_t attr_id;
+    uint32_t value_type;
+    uint32_t value = 0;
+
+    // the size of the attribute depends on its value type, so the buffer length is checked in two steps
+    size_t required = sizeof(ieee_addr) + sizeof(short_addr) + sizeof(device_id) + sizeof(endpoint_id) + sizeof(cluster_id) + sizeof(attr_id) + sizeof(value_type);
+    if (buffer_len < required) {
+        esplogW(TAG_LIB_ZIGBEE, "(deserialize_attr)", "The buffer length is too small to deserialise all data!");
+        return false;
+    }
+
+    memcpy(&ieee_addr, buffer + offset, sizeof(ieee_addr));
+    offset += sizeof(ieee_addr);
+    memcpy(&short_addr, buffer + offset, sizeof(short_addr));
+    offset += sizeof(short_addr);
+    memcpy(&device_id, buffer + offset, sizeof(device_id));
+    offset += sizeof(device_id);
+    memcpy(&endpoint_id, buffer + offset, sizeof(endpoint_id));
+    offset += sizeof(endpoint_id);
+    memcpy(&cluster_id, buffer + offset, sizeof(cluster_id));
+    offset += sizeof(cluster_id);
+    memcpy(&attr_id, buffer + offset, sizeof(attr_id));
+    offset += sizeof(attr_id);
+    memcpy(&value_type, buffer + offset, sizeof(value_type));
+    offset += sizeof(value_type);
+
+    // the ZCL data types are one byte, the rest of the field has to be empty
+    if (value_type > ESP_ZB_ZCL_ATTR_TYPE_INVALID) {
+        esplogW(TAG_LIB_ZIGBEE, "(deserialize_attr)", "Invalid value type %lu!", (unsigned long)value_type);
+        return false;
+    }
+
+    bool has_value;
+    switch (value_type) {
+        case ESP_ZB_ZCL_ATTR_TYPE_8BIT:
+        case ESP_ZB_ZCL_ATTR_TYPE_8BITMAP:
+        case ESP_ZB_ZCL_ATTR_TYPE_8BIT_ENUM:
+        case ESP_ZB_ZCL_ATTR_TYPE_U8:
+
+        case ESP_ZB_ZCL_ATTR_TYPE_16BIT:
+        case ESP_ZB_ZCL_ATTR_TYPE_16BITMAP:
+        case ESP_ZB_ZCL_ATTR_TYPE_16BIT_ENUM:
+        case ESP_ZB_ZCL_ATTR_TYPE_U16:
+
+        case ESP_ZB_ZCL_ATTR_TYPE_32BIT:
+        case ESP_ZB_ZCL_ATTR_TYPE_32BITMAP:
+        case ESP_ZB_ZCL_ATTR_TYPE_U32:
+            has_value = true;
+            break;
+
+        default:
+            has_value = false;
+            break;
+    }
+
+    required += (has_value ? sizeof(value) : 0) + sizeof(type_id) + sizeof(type) + sizeof(manuf) + sizeof(name);
+    if (buffer_len < required) {
+        esplogW(TAG_LIB_ZIGBEE, "(deserialize_attr)", "The buffer length is too small to deserialise all data!");
+        return false;
+    }
+
+    if (has_value) {
+        memcpy(&value, buffer + offset, sizeof(value));
+        offset += sizeof(value);
+    }
+
+    memcpy(&type_id, buffer + offset, sizeof(type_id));
+    offset += sizeof(type_id);
+    memcpy(&type, buffer + offset, sizeof(type));
+    offset += sizeof(type);
+    memcpy(&manuf, buffer + offset, sizeof(manuf));
+    offset += sizeof(manuf);
+    memcpy(&name, buffer + offset, sizeof(name));
+    offset += sizeof(name);
+
+    /* char hex_string[offset * 3 + 1];
+    for (size_t i = 0; i < offset; i++) {
+        snprintf(&hex_string[i * 3], 4, "%02X ", buffer[i]);
+    }
+    esplogI(TAG_LIB_DEBUG, "(deserialize_attr)", "Buffer (length %d): %s", offset, hex_string); // */
+
+    // the strings are not terminated if the sender filled the whole field
+    manuf[sizeof(manuf) - 1] = '\0';
+    name[sizeof(name) - 1] = '\0';
+    type[sizeof(type) - 1] = '\0';
+
+    // the attribute is filled in place, so no memory is allocated
+    fill_attr(*attr, manuf, name, type, type_id, ieee_addr, short_addr, device_id, endpoint_id, cluster_id, attr_id, (esp_zb_zcl_attr_type_t)value_type, value);
+    return true;
+}
+
+static void fill_attr(iot_alarm_attr_load_t * attr, const char * manuf, const char * name, const char * type, uint32_t type_id, esp_zb_ieee_addr_t ieee_addr, uint16_t short_addr, uint8_t device_id, uint8_t endpoint_id, uint16_t cluster_id, uint16_t attr_id, esp_zb_zcl_attr_type_t value_type, uint32_t value) {
+    // strncpy instead of snprintf, the formatting took most of the time spent deserialising an attribute
+    if (manuf != NULL) {
+        strncpy(attr->manuf, manuf, sizeof(attr->manuf) - 1);
+        attr->manuf[sizeof(attr->manuf) - 1] = '\0';
+    }
+
+    if (name != NULL) {
+        strncpy(attr->name, name, sizeof(attr->name) - 1);
+        attr->name[sizeof(attr->name) - 1] = '\0';
+    }
+
+    if (type != NULL) {
+        strncpy(attr->type, type, sizeof(attr->type) - 1);
+        attr->type[sizeof(attr->type) - 1] = '\0';
+    }
+
+    attr->type_id = type_id;
+    memcpy(attr->ieee_addr, ieee_addr, sizeof(attr->ieee_addr));
+    attr->short_addr = short_addr;
+    attr->device_id = device_id;
+    attr->endpoint_id = endpoint_id;
+    attr->cluster_id = cluster_id;
+    attr->attr_id = attr_id;
+    attr->value_type = value_type;
+
+    switch (value_type) {
+        case ESP_ZB_ZCL_ATTR_TYPE_8BIT:
+        case ESP_ZB_ZCL_ATTR_TYPE_8BITMAP:
+        case ESP_ZB_ZCL_ATTR_TYPE_8BIT_ENUM:
+        case ESP_ZB_ZCL_ATTR_TYPE_U8:
+
+        case ESP_ZB_ZCL_ATTR_TYPE_16BIT:
+        case ESP_ZB_ZCL_ATTR_TYPE_16BITMAP:
+        case ESP_ZB_ZCL_ATTR_TYPE_16BIT_ENUM:
+        case ESP_ZB_ZCL_ATTR_TYPE_U16:
+
+        case ESP_ZB_ZCL_ATTR_TYPE_32BIT:
+        case ESP_ZB_ZCL_ATTR_TYPE_32BITMAP:
+        case ESP_ZB_ZCL_ATTR_TYPE_U32:
+            memcpy(&attr->value, &value, sizeof(attr->value));
+            break;
+
+        default:
+            break;
+    }
+}
+
+iot_alarm_attr_load_t * create_attr(const char * manuf,const  char * name,const  char * type, uint32_t type_id, esp_zb_ieee_addr_t ieee_addr, uint16_t short_addr, uint8_t device_id, uint8_t endpoint_id, uint16_t cluster_id, uint16_t attr_id, esp_zb_zcl_attr_type_t value_type, uint32_t value) {
+
+    iot_alarm_attr_load_t *attr = (iot_alarm_attr_load_t *)malloc(sizeof(iot_alarm_attr_load_t));
+    if (attr == NULL) {
+        esplogW(TAG_LIB_ZIGBEE, "(create_attr)", "Failed to allocate memory for attr!");
+        return NULL;
+    }
+
+    fill_attr(attr, manuf, name, type, type_id, ieee_addr, short_addr, device_id, endpoint_id, cluster_id, attr_id, value_type, value);
+    return attr;
+}
+
+void destroy_attr(iot_alarm_attr_load_t **attr) {
+    if (*attr != NULL) {
+        free(*attr);
+        *attr = NULL;
+    }
+}
+
+/* bool compare_attr(iot_alarm_attr_load_t attr1, iot_alarm_attr_load_t attr2) {
+    return (attr1.manuf == attr2.manuf && attr1.name == attr2.name && attr1.type == attr2.type && attr1.type_id == attr2.type_id && 
+        attr1.device_id == attr2.device_id && attr1.endpoint_id == attr2.endpoint_id && attr1.cluster_id == attr2.cluster_id && attr1.attr_id == attr2.attr_id && 
+        attr1.value_type == attr2.value_type && attr1.value == attr2.value && attr1.short_addr == attr2.short_addr && attr1.ieee_addr == attr2.ieee_addr);
+} */
+
+bool compare_attr(iot_alarm_attr_load_t attr1, iot_alarm_attr_load_t attr2) {
+    return (strcmp(attr1.manuf, attr2.manuf) == 0 &&   // Compare manuf strings
+            strcmp(attr1.name, attr2.name) == 0 &&     // Compare name strings
+            strcmp(attr1.type, attr2.type) == 0 &&     // Compare type strings
+            attr1.type_id == attr2.type_id &&
+            attr1.device_id == attr2.device_id &&
+            attr1.endpoint_id == attr2.endpoint_id &&
+            attr1.cluster_id == attr2.cluster_id &&
+            attr1.attr_id == attr2.attr_id &&
+            attr1.value_type == attr2.value_type &&
+            attr1.value == attr2.value &&
+            attr1.short_addr == attr2.short_addr &&
+            memcmp(attr1.ieee_addr, attr2.ieee_addr, sizeof(attr1.ieee_addr)) == 0);  // Compare ieee_addr
+}
+
+void copy_attr(iot_alarm_attr_load_t * src, iot_alarm_attr_load_t * dst) {
+    if (src != NULL && dst != NULL) {
+        memcpy(dst->manuf, src->manuf, sizeof(dst->manuf));
+        memcpy(dst->name, src->name, sizeof(dst->name));
+        memcpy(dst->type, src->type, sizeof(dst->type));
+        dst->type_id = src->type_id;
+        dst->short_addr = src->short_addr;
+        memcpy(dst->ieee_addr, src->ieee_addr, sizeof(dst->ieee_addr));
+        dst->device_id = src->device_id;
+        dst->endpoint_id = src->endpoint_id;
+        dst->cluster_id = src->cluster_id;
+        dst->attr_id = src->attr_id;
+        dst->value_type = src->value_type;
+        dst->value = src->value;
+    }
+}
+
+// last-value cache of the received attributes, only the zigbee task accesses it
+static zigbee_attr_cache_entry_t zigbee_attr_cache[ZIGBEE_ATTR_CACHE_SIZE];
+
+static uint32_t attr_cache_hash(const esp_zb_ieee_addr_t ieee_addr, uint8_t endpoint_id, uint16_t cluster_id, uint16_t attr_id) {
+    // FNV-1a over the key
+    uint8_t key[sizeof(esp_zb_ieee_addr_t) + 5];
+    memcpy(key, ieee_addr, sizeof(esp_zb_ieee_addr_t));
+    key[8] = endpoint_id;
+    key[9] = (uint8_t)(cluster_id & 0xFF);
+    key[10] = (uint8_t)(cluster_id >> 8);
+    key[11] = (uint8_t)(attr_id & 0xFF);
+    key[12] = (uint8_t)(attr_id >> 8);
+
+    uint32_t hash = 2166136261U;
+    for (size_t i = 0; i < sizeof(key); i++) {
+        hash = (hash ^ key[i]) * 16777619U;
+    }
+
+    return hash;
+}
+
+static bool attr_cache_match(const zigbee_attr_cache_entry_t * entry, const esp_zb_ieee_addr_t ieee_addr, uint8_t endpoint_id, uint16_t cluster_id, uint16_t attr_id) {
+    return entry->used && entry->endpoint_id == endpoint_id && entry->cluster_id == cluster_id && entry->attr_id == attr_id &&
+        memcmp(entry->ieee_addr, ieee_addr, sizeof(entry->ieee_addr)) == 0;
+}
+
+const zigbee_attr_cache_entry_t * attr_cache_find(const esp_zb_ieee_addr_t ieee_addr, uint8_t endpoint_id, uint16_t cluster_id, uint16_t attr_id) {
+    uint32_t hash = attr_cache_hash(ieee_addr, endpoint_id, cluster_id, attr_id);
+
+    for (uint32_t i = 0; i < ZIGBEE_ATTR_CACHE_PROBES; i++) {
+        const zigbee_attr_cache_entry_t * entry = &zigbee_attr_cache[(hash + i) & (ZIGBEE_ATTR_CACHE_SIZE - 1)];
+        if (!entry->used) {
+            return NULL;
+        }
+        if (attr_cache_match(entry, ieee_addr, endpoint_id, cluster_id, attr_id)) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+bool attr_cache_update(const iot_alarm_attr_load_t * attr) {
+    if (attr == NULL) {
+        return false;
+    }
+
+    uint32_t hash = attr_cache_hash(attr->ieee_addr, attr->endpoint_id, attr->cluster_id, attr->attr_id);
+    uint32_t now = millis();
+    zigbee_attr_cache_entry_t * victim = NULL;
+
+    for (uint32_t i = 0; i < ZIGBEE_ATTR_CACHE_PROBES; i++) {
+        zigbee_attr_cache_entry_t * entry = &zigbee_attr_cache[(hash + i) & (ZIGBEE_ATTR_CACHE_SIZE - 1)];
+
+        if (attr_cache_match(entry, attr->ieee_addr, attr->endpoint_id, attr->cluster_id, attr->attr_id)) {
+            entry->last_seen = now;
+            if (entry->value == attr->value && entry->value_type == attr->value_type) {
+                return false;
+            }
+
+            entry->value = attr->value;
+            entry->value_type = attr->value_type;
+            entry->changes++;
+            return true;
+        }
+
+        if (!entry->used) {
+            victim = entry;
+            break;
+        }
+
+        // the least recently seen attribute is replaced if all probed slots are used
+        if (victim == NULL || (int32_t)(entry->last_seen - victim->last_seen) < 0) {
+            victim = entry;
+        }
+    }
+
+    memcpy(victim->ieee_addr, attr->ieee_addr, sizeof(victim->ieee_addr));
+    victim->endpoint_id = attr->endpoint_id;
+    victim->cluster_id = attr->cluster_id;
+    victim->attr_id = attr->attr_id;
+    victim->value_type = attr->value_type;
+    victim->value = attr->value;
+    victim->last_seen = now;
+    victim->changes = 0;
+    victim->used = true;
+    return true;
+}
+
+// device registry, written by the zigbee task and read by the tasks sending commands
+static zigbee_device_t zigbee_devices[ZIGBEE_DEVICE_SLOTS];
+static SemaphoreHandle_t zigbee_device_mutex = NULL;
+// changes not saved to the device database yet
+static bool zigbee_device_dirty = false;
+static bool zigbee_device_seen_dirty = false;
+static unsigned long zigbee_device_saved_at = 0;
+
+// largest encoded endpoint list and device record of the device database
+#define ZIGBEE_DEVICE_ENDPOINTS_SIZE (1 + ZIGBEE_DEVICE_ENDPOINTS * (8 + 2 * ZIGBEE_ENDPOINT_CLUSTERS))
+#define ZIGBEE_DEVICE_RECORD_SIZE (2 + 8 + 2 + 1 + 4 + 4 + 3 * 50 + ZIGBEE_DEVICE_ENDPOINTS_SIZE)
+
+static bool device_registry_init() {
+    if (zigbee_device_mutex != NULL) {
+        return true;
+    }
+
+    zigbee_device_mutex = xSemaphoreCreateMutex();
+    if (zigbee_device_mutex == NULL) {
+        return false;
+    }
+
+    // the registry stays empty if the database is invalid, the devices are learned again
+    device_registry_load(ZIGBEE_DEVICE_DB_FILE);
+    return true;
 }
 
-int receive_message(uart_port_t uart, uint8_t* rx_buffer, iot_alarm_message_t **msg, size_t max_len) {
-    if (msg == NULL || *msg == NULL) {
-        esplogW(TAG_LIB_ZIGBEE, "(receive_message)", "Error: Message is nullptr!");
-    }
+// decodes the endpoint list, the endpoints and clusters over the capacity are skipped, returns the consumed bytes (0 if invalid)
+static size_t device_endpoints_decode(const uint8_t *buffer, size_t buffer_len, zigbee_device_t *dev) {
+    size_t offset = 0;
 
-    if (rx_buffer == NULL) {
-        esplogW(TAG_LIB_ZIGBEE, "(receive_message)", "Error: Buffer is nullptr!");
+    if (buffer_len < 1) {
+        return 0;
     }
 
-    memset(rx_buffer, 0, max_len);
-    int rx_bytes = read_uart(uart, rx_buffer, max_len);
+    uint8_t count = buffer[offset++];
+    dev->endpoint_count = 0;
 
-    /* char hex_string[rx_bytes * 3 + 1];
-    for (size_t i = 0; i < rx_bytes; i++) {
-        snprintf(&hex_string[i * 3], 4, "%02X ", rx_buffer[i]);
-    }
-    esplogI(TAG_LIB_DEBUG, "(receive_message)", "Buffer (length %d): %s", rx_bytes, hex_string); // */
+    for (uint8_t i = 0; i < count; i++) {
+        if (offset + 8 > buffer_len) {
+            return 0;
+        }
 
-    if (rx_bytes < max_len) {
-        rx_buffer[rx_bytes] = 0;
-    } else {
-        rx_buffer[max_len - 1] = 0;
-        esplogW(TAG_LIB_ZIGBEE, "(receive_message)", "RX buffer overflow. Data may be truncated.");
+        zigbee_endpoint_t endpoint;
+        memset(&endpoint, 0, sizeof(endpoint));
+        endpoint.endpoint_id = buffer[offset];
+        memcpy(&endpoint.app_profile_id, buffer + offset + 1, sizeof(endpoint.app_profile_id));
+        memcpy(&endpoint.app_device_id, buffer + offset + 3, sizeof(endpoint.app_device_id));
+        endpoint.app_device_version = buffer[offset + 5];
+        uint8_t input_count = buffer[offset + 6];
+        uint8_t output_count = buffer[offset + 7];
+        offset += 8;
+
+        if (offset + 2 * ((size_t)input_count + output_count) > buffer_len) {
+            return 0;
+        }
+
+        // the input clusters are kept rather than the output ones
+        endpoint.input_cluster_count = input_count < ZIGBEE_ENDPOINT_CLUSTERS ? input_count : ZIGBEE_ENDPOINT_CLUSTERS;
+        endpoint.output_cluster_count = output_count < ZIGBEE_ENDPOINT_CLUSTERS - endpoint.input_cluster_count ? output_count : ZIGBEE_ENDPOINT_CLUSTERS - endpoint.input_cluster_count;
+        memcpy(endpoint.clusters, buffer + offset, 2 * endpoint.input_cluster_count);
+        memcpy(endpoint.clusters + endpoint.input_cluster_count, buffer + offset + 2 * input_count, 2 * endpoint.output_cluster_count);
+        offset += 2 * ((size_t)input_count + output_count);
+
+        if (dev->endpoint_count < ZIGBEE_DEVICE_ENDPOINTS) {
+            dev->endpoints[dev->endpoint_count++] = endpoint;
+        }
     }
-    
-    if (rx_bytes > 0) {
-        deserialize_message(msg, rx_buffer, rx_bytes);
+
+    return offset;
+}
+
+// encodes the endpoint list, the buffer has at least ZIGBEE_DEVICE_ENDPOINTS_SIZE bytes
+static size_t device_endpoints_encode(const zigbee_device_t *dev, uint8_t *buffer) {
+    size_t offset = 0;
+
+    buffer[offset++] = dev->endpoint_count;
+    for (uint8_t i = 0; i < dev->endpoint_count; i++) {
+        const zigbee_endpoint_t * endpoint = &dev->endpoints[i];
+        buffer[offset] = endpoint->endpoint_id;
+        memcpy(buffer + offset + 1, &endpoint->app_profile_id, sizeof(endpoint->app_profile_id));
+        memcpy(buffer + offset + 3, &endpoint->app_device_id, sizeof(endpoint->app_device_id));
+        buffer[offset + 5] = endpoint->app_device_version;
+        buffer[offset + 6] = endpoint->input_cluster_count;
+        buffer[offset + 7] = endpoint->output_cluster_count;
+        offset += 8;
+
+        size_t clusters = (size_t)endpoint->input_cluster_count + endpoint->output_cluster_count;
+        memcpy(buffer + offset, endpoint->clusters, 2 * clusters);
+        offset += 2 * clusters;
     }
 
-    return rx_bytes;
+    return offset;
 }
 
-int send_attr(uart_port_t uart, uint8_t* tx_buffer, iot_alarm_attr_load_t * load, message_type_t id) {
-    message_direction_t dir;
-    size_t length;
-    char serialized_load[1000];
-    serialize_attr(load, serialized_load, &length);
+bool device_registry_update(const uint8_t *buffer, size_t buffer_len, zigbee_device_t *dev) {
+    zigbee_device_t device;
+    size_t offset = 0;
 
-    switch (id) {
-        case IOT_ALARM_MSGTYPE_ZB_DATA_READ:
-        case IOT_ALARM_MSGTYPE_ZB_DATA_WRITE:
-        case IOT_ALARM_MSGTYPE_ZB_DATA_REPORT:
-            dir = IOT_ALARM_MSGDIR_NOTIFICATION;
-            break;
-        
-        default:
-            dir = IOT_ALARM_MSGDIR_MAX;
-            break;
+    // the unused endpoints are compared too, when the metadata are checked for changes
+    memset(&device, 0, sizeof(device));
+
+    if (buffer == NULL || buffer_len < ZIGBEE_DEV_INFO_SIZE || zigbee_device_mutex == NULL) {
+        esplogW(TAG_LIB_ZIGBEE, "(device_registry_update)", "Invalid device info! (length: %u)", (unsigned)buffer_len);
+        return false;
     }
 
-    iot_alarm_message_t * ack = create_message(IOT_ALARM_MSGDIR_MAX, IOT_ALARM_MSGSTATUS_MAX, IOT_ALARM_MSGTYPE_MAX, 1, "\0");
-    iot_alarm_message_t msg = {
-        .dir = dir,
-        .st = IOT_ALARM_MSGSTATUS_SUCCESS,
-        .id = id,
-        .length = (uint16_t)length,
-        .load = serialized_load,
-    };
+    memcpy(&device.handle, buffer + offset, sizeof(device.handle));
+    offset += sizeof(device.handle);
+    memcpy(&device.ieee_addr, buffer + offset, sizeof(device.ieee_addr));
+    offset += sizeof(device.ieee_addr);
+    memcpy(&device.short_addr, buffer + offset, sizeof(device.short_addr));
+    offset += sizeof(device.short_addr);
+    memcpy(&device.device_id, buffer + offset, sizeof(device.device_id));
+    offset += sizeof(device.device_id);
+    memcpy(&device.type_id, buffer + offset, sizeof(device.type_id));
+    offset += sizeof(device.type_id);
+    memcpy(&device.type, buffer + offset, sizeof(device.type));
+    offset += sizeof(device.type);
+    memcpy(&device.manuf, buffer + offset, sizeof(device.manuf));
+    offset += sizeof(device.manuf);
+    memcpy(&device.name, buffer + offset, sizeof(device.name));
+    offset += sizeof(device.name);
+
+    device.type[sizeof(device.type) - 1] = '\0';
+    device.manuf[sizeof(device.manuf) - 1] = '\0';
+    device.name[sizeof(device.name) - 1] = '\0';
+    device.used = true;
+    device.last_seen = 0;
+    device.endpoint_count = 0;
+
+    bool interviewed = buffer_len > ZIGBEE_DEV_INFO_SIZE;
+    if (interviewed && device_endpoints_decode(buffer + offset, buffer_len - offset, &device) != buffer_len - offset) {
+        esplogW(TAG_LIB_ZIGBEE, "(device_registry_update)", "Invalid endpoint list in device info! (length: %u)", (unsigned)buffer_len);
+        return false;
+    }
 
-    int tx_bytes = waitForCorrectResponseZigbee(&msg, &ack, 10000);
-    if (tx_bytes <= 0) {
-        esplogW(TAG_LIB_ZIGBEE, "(send_attr)", "Failed to get acknowlede for sending attribute data!");
+    xSemaphoreTake(zigbee_device_mutex, portMAX_DELAY);
+
+    // the device keeps its slot if it rejoined with a new handle
+    int slot = -1;
+    for (int i = 0; i < ZIGBEE_DEVICE_SLOTS; i++) {
+        if (zigbee_devices[i].used && (zigbee_devices[i].handle == device.handle ||
+            memcmp(zigbee_devices[i].ieee_addr, device.ieee_addr, sizeof(device.ieee_addr)) == 0)) {
+            slot = i;
+            break;
+        }
+        if (slot < 0 && !zigbee_devices[i].used) {
+            slot = i;
+        }
     }
 
-    destroy_message(&ack);
+    if (slot >= 0) {
+        zigbee_device_t * current = &zigbee_devices[slot];
+        bool same = current->used && memcmp(current->ieee_addr, device.ieee_addr, sizeof(device.ieee_addr)) == 0;
 
-    return tx_bytes;
-}
+        // the interview result and the last-seen time are kept, if the module sent only the metadata
+        if (same) {
+            device.last_seen = current->last_seen;
+            if (!interviewed) {
+                device.endpoint_count = current->endpoint_count;
+                memcpy(device.endpoints, current->endpoints, sizeof(device.endpoints));
+            }
+        }
 
-/* int send_dev(uart_port_t uart, uint8_t* tx_buffer, iot_alarm_dev_load_t * load, message_type_t id) {
-    // convert iot_alarm_dev_load_t to char*
-    // compute the length of char* load
-    // from load structure & id compute the dir
+        // the other slot with the same handle or IEEE address (two devices swapped their handles) is dropped
+        for (int i = slot + 1; i < ZIGBEE_DEVICE_SLOTS; i++) {
+            if (zigbee_devices[i].used && (zigbee_devices[i].handle == device.handle ||
+                memcmp(zigbee_devices[i].ieee_addr, device.ieee_addr, sizeof(device.ieee_addr)) == 0)) {
+                zigbee_devices[i].used = false;
+                zigbee_device_dirty = true;
+            }
+        }
 
-    iot_alarm_message_t msg = {
-        .dir = ,
-        .id = id,
-        .st = IOT_ALARM_MSGSTATUS_SUCCESS,
-        .length = ,
-        .load = ,
-    };
+        // the metadata of a known device are sent again on every rejoin, the database is written only if they changed
+        if (!same || current->handle != device.handle || current->short_addr != device.short_addr ||
+            current->device_id != device.device_id || current->type_id != device.type_id ||
+            strcmp(current->type, device.type) != 0 || strcmp(current->manuf, device.manuf) != 0 || strcmp(current->name, device.name) != 0 ||
+            current->endpoint_count != device.endpoint_count || memcmp(current->endpoints, device.endpoints, sizeof(device.endpoints)) != 0) {
+            zigbee_device_dirty = true;
+        }
 
-    int tx_bytes = send_message(uart, tx_buffer, &msg);
-    return tx_bytes;
-} */
+        *current = device;
+    }
 
-// ----------------------------------------------------------------------------------------------------------------------------------------------------
+    xSemaphoreGive(zigbee_device_mutex);
 
-void serialize_attr(iot_alarm_attr_load_t *attr, char *buffer, size_t *bytes) {
-    if (attr == NULL) {
-        esplogW(TAG_LIB_ZIGBEE, "(serialize_attr)", "Error: Message is nullptr!");
-        return;
+    if (slot < 0) {
+        esplogW(TAG_LIB_ZIGBEE, "(device_registry_update)", "Device registry is full! (max: %d)", ZIGBEE_DEVICE_SLOTS);
+        return false;
     }
-    
-    if (buffer == NULL) {
-        esplogW(TAG_LIB_ZIGBEE, "(serialize_attr)", "Error: Buffer is nullptr!");
-        return;
+
+    if (dev != NULL) {
+        *dev = device;
     }
 
-    int offset = 0;
+    return true;
+}
 
-    memcpy(buffer + offset, &attr->ieee_addr, sizeof(attr->ieee_addr));
-    offset += sizeof(attr->ieee_addr);
-    memcpy(buffer + offset, &attr->short_addr, sizeof(attr->short_addr));
-    offset += sizeof(attr->short_addr);
+bool device_registry_find(uint16_t handle, zigbee_device_t *dev) {
+    bool found = false;
 
-    memcpy(buffer + offset, &attr->device_id, sizeof(attr->device_id));
-    offset += sizeof(attr->device_id);
-    memcpy(buffer + offset, &attr->endpoint_id, sizeof(attr->endpoint_id));
-    offset += sizeof(attr->endpoint_id);
-    memcpy(buffer + offset, &attr->cluster_id, sizeof(attr->cluster_id));
-    offset += sizeof(attr->cluster_id);
-    memcpy(buffer + offset, &attr->attr_id, sizeof(attr->attr_id));
-    offset += sizeof(attr->attr_id);
+    if (dev == NULL || zigbee_device_mutex == NULL) {
+        return false;
+    }
 
-    memcpy(buffer + offset, &attr->value_type, sizeof(attr->value_type));
-    offset += sizeof(attr->value_type);
+    xSemaphoreTake(zigbee_device_mutex, portMAX_DELAY);
+    for (int i = 0; i < ZIGBEE_DEVICE_SLOTS; i++) {
+        if (zigbee_devices[i].used && zigbee_devices[i].handle == handle) {
+            *dev = zigbee_devices[i];
+            found = true;
+            break;
+        }
+    }
+    xSemaphoreGive(zigbee_device_mutex);
 
-    uint16_t length;
-    switch (attr->value_type) {
-        case ESP_ZB_ZCL_ATTR_TYPE_8BIT:
-        case ESP_ZB_ZCL_ATTR_TYPE_8BITMAP:
-        case ESP_ZB_ZCL_ATTR_TYPE_8BIT_ENUM:
-        case ESP_ZB_ZCL_ATTR_TYPE_U8:
+    return found;
+}
 
-        case ESP_ZB_ZCL_ATTR_TYPE_16BIT:
-        case ESP_ZB_ZCL_ATTR_TYPE_16BITMAP:
-        case ESP_ZB_ZCL_ATTR_TYPE_16BIT_ENUM:
-        case ESP_ZB_ZCL_ATTR_TYPE_U16:
+bool device_registry_find_ieee(const esp_zb_ieee_addr_t ieee_addr, zigbee_device_t *dev) {
+    bool found = false;
 
-        case ESP_ZB_ZCL_ATTR_TYPE_32BIT:
-        case ESP_ZB_ZCL_ATTR_TYPE_32BITMAP:
-        case ESP_ZB_ZCL_ATTR_TYPE_U32:
-            memcpy(buffer + offset, &attr->value, sizeof(attr->value));
-            offset += sizeof(attr->value);
-            break;
+    if (dev == NULL || zigbee_device_mutex == NULL) {
+        return false;
+    }
 
-        default:
+    xSemaphoreTake(zigbee_device_mutex, portMAX_DELAY);
+    for (int i = 0; i < ZIGBEE_DEVICE_SLOTS; i++) {
+        if (zigbee_devices[i].used && memcmp(zigbee_devices[i].ieee_addr, ieee_addr, sizeof(zigbee_devices[i].ieee_addr)) == 0) {
+            *dev = zigbee_devices[i];
+            found = true;
             break;
+        }
     }
+    xSemaphoreGive(zigbee_device_mutex);
 
-    memcpy(buffer + offset, &attr->type_id, sizeof(attr->type_id));
-    offset += sizeof(attr->type_id);
-    memcpy(buffer + offset, &attr->type, sizeof(attr->type));
-    offset += sizeof(attr->type);
-    buffer[offset-1] = '\0';
-    memcpy(buffer + offset, &attr->manuf, sizeof(attr->manuf));
-    offset += sizeof(attr->manuf);
-    buffer[offset-1] = '\0';
-    memcpy(buffer + offset, &attr->name, sizeof(attr->name));
-    offset += sizeof(attr->name);
-    buffer[offset-1] = '\0';
-
-    buffer[offset] = '\0';
-    *bytes = offset;
+    return found;
 }
 
-void deserialize_attr(iot_alarm_attr_load_t **attr, uint8_t *buffer, size_t buffer_len) {
-    if (attr == NULL) {
-        esplogW(TAG_LIB_ZIGBEE, "(deserialize_attr)", "Error: Message is nullptr!");
-        return;
-    }
+bool device_registry_seen(const iot_alarm_attr_load_t *attr) {
+    bool found = false;
 
-    if (*attr == NULL) {
-        esplogW(TAG_LIB_ZIGBEE, "(deserialize_attr)", "Error: Message is nullptr!");
-        return;
+    if (attr == NULL || zigbee_device_mutex == NULL) {
+        return false;
     }
 
-    if (buffer == NULL) {
-        esplogW(TAG_LIB_ZIGBEE, "(deserialize_attr)", "Error: Buffer is nullptr!");
-        return;
-    }
+    xSemaphoreTake(zigbee_device_mutex, portMAX_DELAY);
+    for (int i = 0; i < ZIGBEE_DEVICE_SLOTS; i++) {
+        zigbee_device_t * device = &zigbee_devices[i];
+        if (!device->used || memcmp(device->ieee_addr, attr->ieee_addr, sizeof(device->ieee_addr)) != 0) {
+            continue;
+        }
 
-    int offset = 0;
+        found = true;
+        if (g_vars_ptr->datetime > 0 && device->last_seen != (uint32_t)g_vars_ptr->datetime) {
+            device->last_seen = (uint32_t)g_vars_ptr->datetime;
+            zigbee_device_seen_dirty = true;
+        }
 
-    char manuf[50];
-    char name[50];
-    char type[50];
-    uint32_t type_id;
-    esp_zb_ieee_addr_t ieee_addr;
-    uint16_t short_addr;
-    uint8_t device_id;
-    uint8_t endpoint_id;
-    uint16_t cluster_id;
-    uint16_t attr_id;
-    esp_zb_zcl_attr_type_t value_type;
-    uint32_t value;
+        zigbee_endpoint_t * endpoint = NULL;
+        for (uint8_t j = 0; j < device->endpoint_count; j++) {
+            if (device->endpoints[j].endpoint_id == attr->endpoint_id) {
+                endpoint = &device->endpoints[j];
+                break;
+            }
+        }
 
-    if (offset + sizeof(ieee_addr) <= buffer_len) {
-        memcpy(&ieee_addr, buffer + offset, sizeof(ieee_addr));
-        offset += sizeof(ieee_addr);
-    } else {
-        esplogW(TAG_LIB_ZIGBEE, "(deserialize_attr)", "The buffer length is too small to deserialise all data!");
-    }
+        if (endpoint == NULL && device->endpoint_count < ZIGBEE_DEVICE_ENDPOINTS) {
+            endpoint = &device->endpoints[device->endpoint_count++];
+            memset(endpoint, 0, sizeof(*endpoint));
+            endpoint->endpoint_id = attr->endpoint_id;
+            zigbee_device_dirty = true;
+        }
 
-    if (offset + sizeof(short_addr) <= buffer_len) {
-        memcpy(&short_addr, buffer + offset, sizeof(short_addr));
-        offset += sizeof(short_addr);
-    } else {
-        esplogW(TAG_LIB_ZIGBEE, "(deserialize_attr)", "The buffer length is too small to deserialise all data!");
+        if (endpoint != NULL) {
+            bool known = false;
+            for (uint8_t j = 0; j < endpoint->input_cluster_count + endpoint->output_cluster_count; j++) {
+                known = known || endpoint->clusters[j] == attr->cluster_id;
+            }
+
+            // the reported cluster is an input (server) cluster, it is inserted in front of the output ones
+            if (!known && endpoint->input_cluster_count + endpoint->output_cluster_count < ZIGBEE_ENDPOINT_CLUSTERS) {
+                memmove(endpoint->clusters + endpoint->input_cluster_count + 1, endpoint->clusters + endpoint->input_cluster_count,
+                    2 * endpoint->output_cluster_count);
+                endpoint->clusters[endpoint->input_cluster_count++] = attr->cluster_id;
+                zigbee_device_dirty = true;
+            }
+        }
+        break;
     }
+    xSemaphoreGive(zigbee_device_mutex);
 
-    if (offset + sizeof(device_id) <= buffer_len) {
-        memcpy(&device_id, buffer + offset, sizeof(device_id));
-        offset += sizeof(device_id);
-    } else {
-        esplogW(TAG_LIB_ZIGBEE, "(deserialize_attr)", "The buffer length is too small to deserialise all data!");
+    return found;
+}
+
+static void device_record_string(const char *string, uint8_t *buffer, size_t *offset) {
+    size_t length = strnlen(string, 49);
+    buffer[(*offset)++] = (uint8_t)length;
+    memcpy(buffer + *offset, string, length);
+    *offset += length;
+}
+
+static bool device_record_string_decode(char *string, const uint8_t *buffer, size_t buffer_len, size_t *offset) {
+    if (*offset >= buffer_len || buffer[*offset] > 49 || *offset + 1 + buffer[*offset] > buffer_len) {
+        return false;
     }
 
-    if (offset + sizeof(endpoint_id) <= buffer_len) {
-        memcpy(&endpoint_id, buffer + offset, sizeof(endpoint_id));
-        offset += sizeof(endpoint_id);
-    } else {
-        esplogW(TAG_LIB_ZIGBEE, "(deserialize_attr)", "The buffer length is too small to deserialise all data!");
+    size_t length = buffer[(*offset)++];
+    memcpy(string, buffer + *offset, length);
+    string[length] = '\0';
+    *offset += length;
+    return true;
+}
+
+bool device_registry_load(const char * filepath) {
+    if (zigbee_device_mutex == NULL) {
+        return false;
     }
 
-    if (offset + sizeof(cluster_id) <= buffer_len) {
-        memcpy(&cluster_id, buffer + offset, sizeof(cluster_id));
-        offset += sizeof(cluster_id);
-    } else {
-        esplogW(TAG_LIB_ZIGBEE, "(deserialize_attr)", "The buffer length is too small to deserialise all data!");
+    if (!SD.exists(filepath)) {
+        esplogI(TAG_LIB_ZIGBEE, "(device_registry_load)", "Device database '%s' not found, starting with an empty registry!", filepath);
+        return true;
     }
 
-    if (offset + sizeof(attr_id) <= buffer_len) {
-        memcpy(&attr_id, buffer + offset, sizeof(attr_id));
-        offset += sizeof(attr_id);
-    } else {
-        esplogW(TAG_LIB_ZIGBEE, "(deserialize_attr)", "The buffer length is too small to deserialise all data!");
+    File file = SD.open(filepath, FILE_READ);
+    if (!file) {
+        esplogW(TAG_LIB_ZIGBEE, "(device_registry_load)", "Failed to open device database: %s!", filepath);
+        return false;
     }
 
-    if (offset + sizeof(value_type) <= buffer_len) {
-        memcpy(&value_type, buffer + offset, sizeof(value_type));
-        offset += sizeof(value_type);
-    } else {
-        esplogW(TAG_LIB_ZIGBEE, "(deserialize_attr)", "The buffer length is too small to deserialise all data!");
+    size_t length = file.size();
+    uint8_t * buffer = length <= 6 + ZIGBEE_DEVICE_SLOTS * ZIGBEE_DEVICE_RECORD_SIZE + 2 ? (uint8_t *)malloc(length) : NULL;
+    bool read = buffer != NULL && file.read(buffer, length) == length;
+    file.close();
+
+    uint32_t magic = 0;
+    uint16_t count = 0;
+    uint16_t crc = 0;
+    if (read && length >= 8) {
+        memcpy(&magic, buffer, sizeof(magic));
+        memcpy(&count, buffer + 4, sizeof(count));
+        memcpy(&crc, buffer + length - 2, sizeof(crc));
     }
 
-    switch (value_type) {
-        case ESP_ZB_ZCL_ATTR_TYPE_8BIT:
-        case ESP_ZB_ZCL_ATTR_TYPE_8BITMAP:
-        case ESP_ZB_ZCL_ATTR_TYPE_8BIT_ENUM:
-        case ESP_ZB_ZCL_ATTR_TYPE_U8:
+    if (!read || length < 8 || magic != ZIGBEE_DEVICE_DB_MAGIC || count > ZIGBEE_DEVICE_SLOTS || zigbee_crc16(0xFFFF, buffer, length - 2) != crc) {
+        esplogW(TAG_LIB_ZIGBEE, "(device_registry_load)", "Device database %s is invalid! (length: %u)", filepath, (unsigned)length);
+        free(buffer);
+        return false;
+    }
 
-        case ESP_ZB_ZCL_ATTR_TYPE_16BIT:
-        case ESP_ZB_ZCL_ATTR_TYPE_16BITMAP:
-        case ESP_ZB_ZCL_ATTR_TYPE_16BIT_ENUM:
-        case ESP_ZB_ZCL_ATTR_TYPE_U16:
+    // the records are decoded into a copy, so an invalid database does not leave a half-loaded registry
+    zigbee_device_t * devices = (zigbee_device_t *)calloc(ZIGBEE_DEVICE_SLOTS, sizeof(zigbee_device_t));
+    size_t offset = 6;
+    size_t end = length - 2;
+    bool valid = devices != NULL;
 
-        case ESP_ZB_ZCL_ATTR_TYPE_32BIT:
-        case ESP_ZB_ZCL_ATTR_TYPE_32BITMAP:
-        case ESP_ZB_ZCL_ATTR_TYPE_U32:
-            if (offset + sizeof(value) <= buffer_len) {
-                memcpy(&value, buffer + offset, sizeof(value));
-                offset += sizeof(value);
-            } else {
-                esplogW(TAG_LIB_ZIGBEE, "(deserialize_attr)", "The buffer length is too small to deserialise all data!");
-            }
+    for (uint16_t i = 0; valid && i < count; i++) {
+        zigbee_device_t * device = &devices[i];
+        if (offset + 21 > end) {
+            valid = false;
             break;
+        }
 
-        default:
+        memcpy(&device->handle, buffer + offset, sizeof(device->handle));
+        memcpy(&device->ieee_addr, buffer + offset + 2, sizeof(device->ieee_addr));
+        memcpy(&device->short_addr, buffer + offset + 10, sizeof(device->short_addr));
+        device->device_id = buffer[offset + 12];
+        memcpy(&device->type_id, buffer + offset + 13, sizeof(device->type_id));
+        memcpy(&device->last_seen, buffer + offset + 17, sizeof(device->last_seen));
+        offset += 21;
+
+        valid = device_record_string_decode(device->type, buffer, end, &offset) &&
+                device_record_string_decode(device->manuf, buffer, end, &offset) &&
+                device_record_string_decode(device->name, buffer, end, &offset);
+        if (!valid) {
             break;
-    }
+        }
 
-    if (offset + sizeof(type_id) <= buffer_len) {
-        memcpy(&type_id, buffer + offset, sizeof(type_id));
-        offset += sizeof(type_id);
-    } else {
-        esplogW(TAG_LIB_ZIGBEE, "(deserialize_attr)", "The buffer length is too small to deserialise all data!");
+        size_t used = device_endpoints_decode(buffer + offset, end - offset, device);
+        valid = used > 0;
+        offset += used;
+        device->used = true;
     }
 
-    if (offset + sizeof(type) <= buffer_len) {
-        memcpy(&type, buffer + offset, sizeof(type));
-        offset += sizeof(type);
-    } else {
-        esplogW(TAG_LIB_ZIGBEE, "(deserialize_attr)", "The buffer length is too small to deserialise all data!");
-    }
-    
-    if (offset + sizeof(manuf) <= buffer_len) {
-        memcpy(&manuf, buffer + offset, sizeof(manuf));
-        offset += sizeof(manuf);
-    } else {
-        esplogW(TAG_LIB_ZIGBEE, "(deserialize_attr)", "The buffer length is too small to deserialise all data!");
+    free(buffer);
+
+    if (!valid || offset != end) {
+        esplogW(TAG_LIB_ZIGBEE, "(device_registry_load)", "Device database %s is corrupted!", filepath);
+        free(devices);
+        return false;
     }
-    
-    if (offset + sizeof(name) <= buffer_len) {
-        memcpy(&name, buffer + offset, sizeof(name));
-        offset += sizeof(name);
-    } else {
-        esplogW(TAG_LIB_ZIGBEE, "(deserialize_attr)", "The buffer length is too small to deserialise all data!");
+
+    xSemaphoreTake(zigbee_device_mutex, portMAX_DELAY);
+    memcpy(zigbee_devices, devices, sizeof(zigbee_devices));
+    zigbee_device_dirty = false;
+    zigbee_device_seen_dirty = false;
+    zigbee_device_saved_at = millis();
+    xSemaphoreGive(zigbee_device_mutex);
+
+    free(devices);
+    esplogI(TAG_LIB_ZIGBEE, "(device_registry_load)", "Device database loaded! (devices: %u)", (unsigned)count);
+    return true;
+}
+
+bool device_registry_save(bool force) {
+    if (zigbee_device_mutex == NULL) {
+        return false;
     }
 
-    /* char hex_string[offset * 3 + 1];
-    for (size_t i = 0; i < offset; i++) {
-        snprintf(&hex_string[i * 3], 4, "%02X ", buffer[i]);
+    uint8_t * buffer = NULL;
+    size_t offset = 0;
+    uint16_t count = 0;
+
+    xSemaphoreTake(zigbee_device_mutex, portMAX_DELAY);
+    bool due = zigbee_device_dirty || (zigbee_device_seen_dirty && (force || millis() - zigbee_device_saved_at >= ZIGBEE_DEVICE_DB_SAVE_MS));
+    if (due) {
+        buffer = (uint8_t *)malloc(6 + ZIGBEE_DEVICE_SLOTS * ZIGBEE_DEVICE_RECORD_SIZE + 2);
     }
-    esplogI(TAG_LIB_DEBUG, "(deserialize_attr)", "Buffer (length %d): %s", offset, hex_string); // */
 
-    destroy_attr(attr);
-    *attr = create_attr(manuf, name, type, type_id, ieee_addr, short_addr, device_id, endpoint_id, cluster_id, attr_id, value_type, value);
-}
+    // the records are encoded under the mutex, the slow SD card write is done without it
+    if (buffer != NULL) {
+        offset = 6;
+        for (int i = 0; i < ZIGBEE_DEVICE_SLOTS; i++) {
+            const zigbee_device_t * device = &zigbee_devices[i];
+            if (!device->used) {
+                continue;
+            }
 
-iot_alarm_attr_load_t * create_attr(const char * manuf,const  char * name,const  char * type, uint32_t type_id, esp_zb_ieee_addr_t ieee_addr, uint16_t short_addr, uint8_t device_id, uint8_t endpoint_id, uint16_t cluster_id, uint16_t attr_id, esp_zb_zcl_attr_type_t value_type, uint32_t value) {
+            memcpy(buffer + offset, &device->handle, sizeof(device->handle));
+            memcpy(buffer + offset + 2, &device->ieee_addr, sizeof(device->ieee_addr));
+            memcpy(buffer + offset + 10, &device->short_addr, sizeof(device->short_addr));
+            buffer[offset + 12] = device->device_id;
+            memcpy(buffer + offset + 13, &device->type_id, sizeof(device->type_id));
+            memcpy(buffer + offset + 17, &device->last_seen, sizeof(device->last_seen));
+            offset += 21;
+
+            device_record_string(device->type, buffer, &offset);
+            device_record_string(device->manuf, buffer, &offset);
+            device_record_string(device->name, buffer, &offset);
+            offset += device_endpoints_encode(device, buffer + offset);
+            count++;
+        }
 
-    iot_alarm_attr_load_t *attr = (iot_alarm_attr_load_t *)malloc(sizeof(iot_alarm_attr_load_t));
-    if (attr == NULL) {
-        esplogW(TAG_LIB_ZIGBEE, "(create_attr)", "Failed to allocate memory for attr!");
-        return NULL;
+        zigbee_device_dirty = false;
+        zigbee_device_seen_dirty = false;
+        zigbee_device_saved_at = millis();
     }
+    xSemaphoreGive(zigbee_device_mutex);
 
-    if (manuf != NULL) {
-        snprintf(attr->manuf, sizeof(attr->manuf), "%s", manuf);
-        attr->manuf[50] = '\0';
+    if (!due) {
+        return true;
     }
 
-    if (name != NULL) {
-        snprintf(attr->name, sizeof(attr->name), "%s", name);
-        attr->name[50] = '\0';
+    bool written = false;
+    if (buffer != NULL) {
+        uint32_t magic = ZIGBEE_DEVICE_DB_MAGIC;
+        memcpy(buffer, &magic, sizeof(magic));
+        memcpy(buffer + 4, &count, sizeof(count));
+        uint16_t crc = zigbee_crc16(0xFFFF, buffer, offset);
+        memcpy(buffer + offset, &crc, sizeof(crc));
+        offset += sizeof(crc);
+
+        // written under a temporary name, a reset during the write keeps the previous database
+        String temp = String(ZIGBEE_DEVICE_DB_FILE) + ".tmp";
+        File file = SD.open(temp.c_str(), FILE_WRITE);
+        if (file) {
+            written = file.write(buffer, offset) == offset;
+            file.close();
+        }
+
+        if (written) {
+            SD.remove(ZIGBEE_DEVICE_DB_FILE);
+            written = SD.rename(temp.c_str(), ZIGBEE_DEVICE_DB_FILE);
+        }
+
+        free(buffer);
     }
 
-    if (type != NULL) {
-        snprintf(attr->type, sizeof(attr->type), "%s", type);
-        attr->type[50] = '\0';
+    if (!written) {
+        esplogW(TAG_LIB_ZIGBEE, "(device_registry_save)", "Failed to save device database: %s!", ZIGBEE_DEVICE_DB_FILE);
+        // written again on the next call
+        xSemaphoreTake(zigbee_device_mutex, portMAX_DELAY);
+        zigbee_device_dirty = true;
+        xSemaphoreGive(zigbee_device_mutex);
+        return false;
     }
 
-    attr->type_id = type_id;
-    memcpy(attr->ieee_addr, ieee_addr, sizeof(attr->ieee_addr));
-    attr->short_addr = short_addr;
-    attr->device_id = device_id;
-    attr->endpoint_id = endpoint_id;
-    attr->cluster_id = cluster_id;
-    attr->attr_id = attr_id;
-    attr->value_type = value_type;
+    esplogI(TAG_LIB_ZIGBEE, "(device_registry_save)", "Device database saved! (devices: %u, %u B)", (unsigned)count, (unsigned)offset);
+    return true;
+}
 
-    uint16_t length;
-    switch (value_type) {
-        case ESP_ZB_ZCL_ATTR_TYPE_8BIT:
-        case ESP_ZB_ZCL_ATTR_TYPE_8BITMAP:
-        case ESP_ZB_ZCL_ATTR_TYPE_8BIT_ENUM:
-        case ESP_ZB_ZCL_ATTR_TYPE_U8:
+bool pack_device(const zigbee_device_t *dev, String *jsonStr) {
+    if (dev == NULL) {
+        esplogW(TAG_LIB_ZIGBEE, "(pack_device)", "Error: Device struct is nullptr!");
+        return false;
+    }
 
-        case ESP_ZB_ZCL_ATTR_TYPE_16BIT:
-        case ESP_ZB_ZCL_ATTR_TYPE_16BITMAP:
-        case ESP_ZB_ZCL_ATTR_TYPE_16BIT_ENUM:
-        case ESP_ZB_ZCL_ATTR_TYPE_U16:
+    JsonDocument doc;
 
-        case ESP_ZB_ZCL_ATTR_TYPE_32BIT:
-        case ESP_ZB_ZCL_ATTR_TYPE_32BITMAP:
-        case ESP_ZB_ZCL_ATTR_TYPE_U32:
-            memcpy(&attr->value, &value, sizeof(attr->value));
-            break;
+    char ieee_str[ZIGBEE_IEEE_STR_SIZE];
+    zigbee_ieee_str(dev->ieee_addr, ieee_str);
+
+    doc["handle"] = dev->handle;
+    doc["short"] = dev->short_addr;
+    doc["ieee"] = ieee_str;
+    doc["id"] = dev->device_id;
+    doc["manufacturer"] = dev->manuf;
+    doc["name"] = dev->name;
+    doc["type"] = dev->type;
+    doc["type_id"] = dev->type_id;
+    doc["last_seen"] = dev->last_seen;
+
+    JsonArray endpoints = doc["endpoints"].to<JsonArray>();
+    for (uint8_t i = 0; i < dev->endpoint_count && i < ZIGBEE_DEVICE_ENDPOINTS; i++) {
+        const zigbee_endpoint_t * endpoint = &dev->endpoints[i];
+        JsonObject obj = endpoints.add<JsonObject>();
+        obj["ep"] = endpoint->endpoint_id;
+        obj["profile"] = endpoint->app_profile_id;
+        obj["device"] = endpoint->app_device_id;
+        obj["version"] = endpoint->app_device_version;
+        JsonArray in = obj["in"].to<JsonArray>();
+        JsonArray out = obj["out"].to<JsonArray>();
+        for (uint8_t j = 0; j < endpoint->input_cluster_count + endpoint->output_cluster_count && j < ZIGBEE_ENDPOINT_CLUSTERS; j++) {
+            (j < endpoint->input_cluster_count ? in : out).add(endpoint->clusters[j]);
+        }
+    }
 
-        default:
-            break;
+    if (serializeJson(doc, *jsonStr) == 0) {
+        esplogE(TAG_LIB_ZIGBEE, "(pack_device)", "Failed serialise data!");
+        doc.clear();
+        return false;
     }
 
-    return attr;
+    doc.clear();
+    return true;
 }
 
-void destroy_attr(iot_alarm_attr_load_t **attr) {
-    if (*attr != NULL) {
-        free(*attr);
-        *attr = NULL;
-    }
-}
+static void pack_attr_object(const iot_alarm_attr_load_t * attr, JsonObject obj) {
+    JsonObject device = obj["device"].to<JsonObject>();
 
-/* bool compare_attr(iot_alarm_attr_load_t attr1, iot_alarm_attr_load_t attr2) {
-    return (attr1.manuf == attr2.manuf && attr1.name == attr2.name && attr1.type == attr2.type && attr1.type_id == attr2.type_id && 
-        attr1.device_id == attr2.device_id && attr1.endpoint_id == attr2.endpoint_id && attr1.cluster_id == attr2.cluster_id && attr1.attr_id == attr2.attr_id && 
-        attr1.value_type == attr2.value_type && attr1.value == attr2.value && attr1.short_addr == attr2.short_addr && attr1.ieee_addr == attr2.ieee_addr);
-} */
+    // Populate the JSON document
+    device["short"] = attr->short_addr;
+    char ieee_str[ZIGBEE_IEEE_STR_SIZE]; // For converting ieee_addr to string
+    device["ieee"] = zigbee_ieee_str(attr->ieee_addr, ieee_str);
+    device["id"] = attr->device_id;
+    device["type_id"] = attr->type_id;
 
-bool compare_attr(iot_alarm_attr_load_t attr1, iot_alarm_attr_load_t attr2) {
-    return (strcmp(attr1.manuf, attr2.manuf) == 0 &&   // Compare manuf strings
-            strcmp(attr1.name, attr2.name) == 0 &&     // Compare name strings
-            strcmp(attr1.type, attr2.type) == 0 &&     // Compare type strings
-            attr1.type_id == attr2.type_id &&
-            attr1.device_id == attr2.device_id &&
-            attr1.endpoint_id == attr2.endpoint_id &&
-            attr1.cluster_id == attr2.cluster_id &&
-            attr1.attr_id == attr2.attr_id &&
-            attr1.value_type == attr2.value_type &&
-            attr1.value == attr2.value &&
-            attr1.short_addr == attr2.short_addr &&
-            memcmp(attr1.ieee_addr, attr2.ieee_addr, sizeof(attr1.ieee_addr)) == 0);  // Compare ieee_addr
+    obj["ep_id"] = attr->endpoint_id;
+    obj["cluster_id"] = attr->cluster_id;
+    obj["attr_id"] = attr->attr_id;
+    obj["value_type"] = attr->value_type;
+    obj["value"] = attr->value;
 }
 
-void copy_attr(iot_alarm_attr_load_t * src, iot_alarm_attr_load_t * dst) {
-    if (src != NULL && dst != NULL) {
-        memcpy(dst->manuf, src->manuf, sizeof(dst->manuf));
-        memcpy(dst->name, src->name, sizeof(dst->name));
-        memcpy(dst->type, src->type, sizeof(dst->type));
-        dst->type_id = src->type_id;
-        dst->short_addr = src->short_addr;
-        memcpy(dst->ieee_addr, src->ieee_addr, sizeof(dst->ieee_addr));
-        dst->device_id = src->device_id;
-        dst->endpoint_id = src->endpoint_id;
-        dst->cluster_id = src->cluster_id;
-        dst->attr_id = src->attr_id;
-        dst->value_type = src->value_type;
-        dst->value = src->value;
+static bool unpack_attr_object(iot_alarm_attr_load_t * attr, JsonObjectConst obj) {
+    if (!obj["device"].is<JsonObjectConst>()) {
+        esplogW(TAG_LIB_ZIGBEE, "(unpack_attr)", "MQTT message is missing device field! Ignoring...");
+        return false;
+    }
+
+    JsonObjectConst device = obj["device"];
+
+    // validate the JSON data (checking for required fields)
+    if (!device["ieee"].is<const char *>() ||
+        !obj["ep_id"].is<uint8_t>() ||
+        !obj["cluster_id"].is<uint16_t>() ||
+        !obj["attr_id"].is<uint16_t>() ||
+        !obj["value_type"].is<uint8_t>() ||
+        !obj["value"].is<uint32_t>()) {
+            
+        esplogW(TAG_LIB_ZIGBEE, "(unpack_attr)", "MQTT message is missing some required fields! Ignoring...");
+        return false;
+    }
+
+    // Parse JSON into the structure
+    if (device["short"].is<uint16_t>()) {
+        attr->short_addr = device["short"];
+    } else {
+        attr->short_addr = 0;
+    }
+    // a malformed address would leave a part of the old one in the attribute
+    const char *ieee = device["ieee"];
+    if (sscanf(ieee, "%hhX:%hhX:%hhX:%hhX:%hhX:%hhX:%hhX:%hhX",
+           &attr->ieee_addr[7], &attr->ieee_addr[6], &attr->ieee_addr[5], &attr->ieee_addr[4],
+           &attr->ieee_addr[3], &attr->ieee_addr[2], &attr->ieee_addr[1], &attr->ieee_addr[0]) != 8) {
+        esplogW(TAG_LIB_ZIGBEE, "(unpack_attr)", "MQTT message has an invalid IEEE address! Ignoring...");
+        return false;
     }
+
+    attr->endpoint_id = obj["ep_id"];
+    attr->cluster_id = obj["cluster_id"];
+    attr->attr_id = obj["attr_id"];
+    attr->value_type = obj["value_type"];
+    attr->value = obj["value"];
+
+    memset(attr->manuf, 0, sizeof(attr->manuf));
+    memset(attr->name, 0, sizeof(attr->name));
+    memset(attr->type, 0, sizeof(attr->type));
+    attr->type_id = 0;
+    attr->device_id = 0;
+
+    return true;
 }
 
 bool pack_attr(iot_alarm_attr_load_t * attr, String * jsonStr) {
@@ -986,26 +3152,7 @@ bool pack_attr(iot_alarm_attr_load_t * attr, String * jsonStr) {
 
     // Create a JSON document
     JsonDocument doc;
-    JsonObject device = doc["device"].to<JsonObject>();
-
-    // Populate the JSON document
-    device["short"] = attr->short_addr;
-    char ieee_str[41]; // For converting ieee_addr to string
-    sprintf(ieee_str, "%02X:%02X:%02X:%02X:%02X:%02X:%02X:%02X",
-            attr->ieee_addr[7], attr->ieee_addr[6], attr->ieee_addr[5], attr->ieee_addr[4],
-            attr->ieee_addr[3], attr->ieee_addr[2], attr->ieee_addr[1], attr->ieee_addr[0]);
-    device["ieee"] = ieee_str;
-    device["id"] = attr->device_id;
-    device["manufacturer"] = attr->manuf;
-    device["name"] = attr->name;
-    device["type"] = attr->type;
-    device["type_id"] = attr->type_id;
-
-    doc["ep_id"] = attr->endpoint_id;
-    doc["cluster_id"] = attr->cluster_id;
-    doc["attr_id"] = attr->attr_id;
-    doc["value_type"] = attr->value_type;
-    doc["value"] = attr->value;
+    pack_attr_object(attr, doc.to<JsonObject>());
     doc["timestamp"] = g_vars_ptr->datetime;
 
     // Serialize JSON to String
@@ -1037,55 +3184,333 @@ bool unpack_attr(iot_alarm_attr_load_t * attr, String jsonStr) {
         return false;
     }
 
-    if (!doc["device"].is<JsonObject>()) {
-        esplogW(TAG_LIB_ZIGBEE, "(unpack_attr)", "MQTT message is missing device field! Ignoring...");
+    bool ret = unpack_attr_object(attr, doc.as<JsonObjectConst>());
+    doc.clear();
+    return ret;
+}
+
+bool unpack_attr_msgpack(iot_alarm_attr_load_t * attr, const uint8_t * load, size_t len) {
+    if (attr == NULL || load == NULL) {
+        esplogW(TAG_LIB_ZIGBEE, "(unpack_attr)", "Error: Attr struct is nullptr!");
+        return false;
+    }
+
+    JsonDocument doc;
+    DeserializationError error = deserializeMsgPack(doc, load, len);
+    if (error) {
+        esplogW(TAG_LIB_ZIGBEE, "(unpack_attr)", "Failed to parse MessagePack! Error: %s", error.c_str());
         doc.clear();
         return false;
     }
 
-    JsonObject device = doc["device"];
+    bool ret = unpack_attr_object(attr, doc.as<JsonObjectConst>());
+    doc.clear();
+    return ret;
+}
+
+static void pack_attr_batch_doc(const iot_alarm_attr_load_t * attrs, size_t count, JsonDocument & doc) {
+    doc["timestamp"] = g_vars_ptr->datetime;
+    JsonArray array = doc["attrs"].to<JsonArray>();
+    for (size_t i = 0; i < count; i++) {
+        pack_attr_object(&attrs[i], array.add<JsonObject>());
+    }
+}
+
+bool pack_attr_batch(const iot_alarm_attr_load_t * attrs, size_t count, String * jsonStr) {
+    if (attrs == NULL && count > 0) {
+        esplogW(TAG_LIB_ZIGBEE, "(pack_attr_batch)", "Error: Attr array is nullptr!");
+        return false;
+    }
+
+    JsonDocument doc;
+    pack_attr_batch_doc(attrs, count, doc);
 
-    // validate the JSON data (checking for required fields)
-    if (!doc["device"]["ieee"].is<const char *>() ||
-        !doc["ep_id"].is<uint8_t>() ||
-        !doc["cluster_id"].is<uint16_t>() ||
-        !doc["attr_id"].is<uint16_t>() ||
-        !doc["value_type"].is<uint8_t>() ||
-        !doc["value"].is<uint32_t>()) {
-            
-        esplogW(TAG_LIB_ZIGBEE, "(unpack_attr)", "MQTT message is missing some required fields! Ignoring...");
-        device.clear();
+    if (serializeJson(doc, *jsonStr) == 0) {
+        esplogE(TAG_LIB_ZIGBEE, "(pack_attr_batch)", "Failed serialise data!");
         doc.clear();
         return false;
     }
 
-    // Parse JSON into the structure
-    if (doc["device"]["short"].is<uint16_t>()) {
-        attr->short_addr = device["short"];
-    } else {
-        attr->short_addr = 0;
+    doc.clear();
+    return true;
+}
+
+size_t pack_attr_batch_msgpack(const iot_alarm_attr_load_t * attrs, size_t count, uint8_t * buf, size_t size) {
+    if ((attrs == NULL && count > 0) || buf == NULL) {
+        esplogW(TAG_LIB_ZIGBEE, "(pack_attr_batch_msgpack)", "Error: Attr array is nullptr!");
+        return 0;
     }
-    const char *ieee = device["ieee"];
-    sscanf(ieee, "%hhX:%hhX:%hhX:%hhX:%hhX:%hhX:%hhX:%hhX",
-           &attr->ieee_addr[7], &attr->ieee_addr[6], &attr->ieee_addr[5], &attr->ieee_addr[4],
-           &attr->ieee_addr[3], &attr->ieee_addr[2], &attr->ieee_addr[1], &attr->ieee_addr[0]);
 
-    attr->endpoint_id = doc["ep_id"];
-    attr->cluster_id = doc["cluster_id"];
-    attr->attr_id = doc["attr_id"];
-    attr->value_type = doc["value_type"];
-    attr->value = doc["value"];
+    JsonDocument doc;
+    pack_attr_batch_doc(attrs, count, doc);
 
-    memset(attr->manuf, 0, sizeof(attr->manuf));
-    memset(attr->name, 0, sizeof(attr->manuf));
-    memset(attr->type, 0, sizeof(attr->manuf));
-    attr->type_id = 0;
-    attr->device_id = 0;
+    // serializeMsgPack() cuts the message at the end of the buffer, the size is checked before
+    size_t len = measureMsgPack(doc);
+    if (len > size) {
+        esplogW(TAG_LIB_ZIGBEE, "(pack_attr_batch_msgpack)", "MessagePack buffer is too small, the batch is not packed! (needed: %u, size: %u)", (unsigned)len, (unsigned)size);
+        doc.clear();
+        return 0;
+    }
+
+    len = serializeMsgPack(doc, buf, size);
+    doc.clear();
+    return len;
+}
+
+bool pack_attr_event(const iot_alarm_attr_load_t * attr, uint32_t count, uint32_t span_ms, String * jsonStr) {
+    if (attr == NULL) {
+        esplogW(TAG_LIB_ZIGBEE, "(pack_attr_event)", "Error: Attr struct is nullptr!");
+        return false;
+    }
+
+    JsonDocument doc;
+    pack_attr_object(attr, doc.to<JsonObject>());
+    doc["timestamp"] = g_vars_ptr->datetime;
+    doc["count"] = count;
+    doc["span_ms"] = span_ms;
+
+    if (serializeJson(doc, *jsonStr) == 0) {
+        esplogE(TAG_LIB_ZIGBEE, "(pack_attr_event)", "Failed serialise data!");
+        doc.clear();
+        return false;
+    }
 
     doc.clear();
     return true;
 }
 
+const char * zigbee_ieee_str(const esp_zb_ieee_addr_t ieee_addr, char * str) {
+    static const char hex[] = "0123456789ABCDEF";
+
+    char * p = str;
+    for (int i = 7; i >= 0; i--) {
+        *p++ = hex[ieee_addr[i] >> 4];
+        *p++ = hex[ieee_addr[i] & 0x0F];
+        *p++ = i > 0 ? ':' : '\0';
+    }
+
+    return str;
+}
+
+// message written straight to a fixed buffer, the length keeps counting past the end so an overflow is detected once
+typedef struct {
+    char * buf;
+    size_t size;
+    size_t len;
+} zigbee_writer_t;
+
+static void zigbee_write_raw(zigbee_writer_t * w, const char * str, size_t len) {
+    if (w->len + len < w->size) {
+        memcpy(w->buf + w->len, str, len);
+    }
+    w->len += len;
+}
+
+// the key is a literal with the quotes and the colon, e.g. zigbee_json_uint(w, ",\"value\":", value)
+static void zigbee_json_uint(zigbee_writer_t * w, const char * key, uint32_t value) {
+    char digits[10];
+    size_t n = 0;
+    do {
+        digits[sizeof(digits) - ++n] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+
+    zigbee_write_raw(w, key, strlen(key));
+    zigbee_write_raw(w, digits + sizeof(digits) - n, n);
+}
+
+static size_t zigbee_json_attr(const iot_alarm_attr_load_t * attr, const char * ieee_str, const uint32_t * event, char * buf, size_t size) {
+    if (attr == NULL || ieee_str == NULL || buf == NULL || size == 0) {
+        return 0;
+    }
+
+    // the same fields in the same order as pack_attr_object() and pack_attr() / pack_attr_event()
+    zigbee_writer_t w = {buf, size, 0};
+    zigbee_json_uint(&w, "{\"device\":{\"short\":", attr->short_addr);
+    zigbee_write_raw(&w, ",\"ieee\":\"", 9);
+    zigbee_write_raw(&w, ieee_str, strlen(ieee_str));
+    zigbee_json_uint(&w, "\",\"id\":", attr->device_id);
+    zigbee_json_uint(&w, ",\"type_id\":", attr->type_id);
+    zigbee_json_uint(&w, "},\"ep_id\":", attr->endpoint_id);
+    zigbee_json_uint(&w, ",\"cluster_id\":", attr->cluster_id);
+    zigbee_json_uint(&w, ",\"attr_id\":", attr->attr_id);
+    zigbee_json_uint(&w, ",\"value_type\":", (uint32_t)attr->value_type);
+    zigbee_json_uint(&w, ",\"value\":", attr->value);
+    zigbee_json_uint(&w, ",\"timestamp\":", (uint32_t)g_vars_ptr->datetime);
+    if (event != NULL) {
+        zigbee_json_uint(&w, ",\"count\":", event[0]);
+        zigbee_json_uint(&w, ",\"span_ms\":", event[1]);
+    }
+    zigbee_write_raw(&w, "}", 1);
+
+    if (w.len >= size) {
+        esplogW(TAG_LIB_ZIGBEE, "(pack_attr_json)", "JSON buffer is too small! (needed: %u, size: %u)", (unsigned)w.len + 1, (unsigned)size);
+        buf[0] = '\0';
+        return 0;
+    }
+
+    buf[w.len] = '\0';
+    return w.len;
+}
+
+size_t pack_attr_json(const iot_alarm_attr_load_t * attr, const char * ieee_str, char * buf, size_t size) {
+    return zigbee_json_attr(attr, ieee_str, NULL, buf, size);
+}
+
+size_t pack_attr_event_json(const iot_alarm_attr_load_t * attr, const char * ieee_str, uint32_t count, uint32_t span_ms, char * buf, size_t size) {
+    const uint32_t event[2] = {count, span_ms};
+    return zigbee_json_attr(attr, ieee_str, event, buf, size);
+}
+
+// MessagePack fixstr (at most 31 characters), used for the keys and the IEEE address
+static void zigbee_msgpack_str(zigbee_writer_t * w, const char * str) {
+    size_t len = strlen(str);
+    char head = (char)(0xA0 | len);
+    zigbee_write_raw(w, &head, 1);
+    zigbee_write_raw(w, str, len);
+}
+
+// the value is written in its shortest form (as ArduinoJson does)
+static void zigbee_msgpack_uint(zigbee_writer_t * w, const char * key, uint32_t value) {
+    char head[5];
+    size_t n;
+    zigbee_msgpack_str(w, key);
+
+    if (value <= 0x7F) {
+        head[0] = (char)value;
+        n = 1;
+    } else if (value <= 0xFF) {
+        head[0] = (char)0xCC;
+        head[1] = (char)value;
+        n = 2;
+    } else if (value <= 0xFFFF) {
+        head[0] = (char)0xCD;
+        head[1] = (char)(value >> 8);
+        head[2] = (char)value;
+        n = 3;
+    } else {
+        head[0] = (char)0xCE;
+        head[1] = (char)(value >> 24);
+        head[2] = (char)(value >> 16);
+        head[3] = (char)(value >> 8);
+        head[4] = (char)value;
+        n = 5;
+    }
+    zigbee_write_raw(w, head, n);
+}
+
+// fixmap header (at most 15 fields), the key of a nested map is written before it
+static void zigbee_msgpack_map(zigbee_writer_t * w, const char * key, uint8_t fields) {
+    char head = (char)(0x80 | fields);
+    if (key != NULL) {
+        zigbee_msgpack_str(w, key);
+    }
+    zigbee_write_raw(w, &head, 1);
+}
+
+static size_t zigbee_msgpack_attr(const iot_alarm_attr_load_t * attr, const char * ieee_str, const uint32_t * event, uint8_t * buf, size_t size) {
+    if (attr == NULL || ieee_str == NULL || buf == NULL || size == 0) {
+        return 0;
+    }
+
+    // the same keys in the same order as zigbee_json_attr(), so both formats decode into the same document
+    zigbee_writer_t w = {(char *)buf, size, 0};
+    zigbee_msgpack_map(&w, NULL, event != NULL ? 9 : 7);
+    zigbee_msgpack_map(&w, "device", 4);
+    zigbee_msgpack_uint(&w, "short", attr->short_addr);
+    zigbee_msgpack_str(&w, "ieee");
+    zigbee_msgpack_str(&w, ieee_str);
+    zigbee_msgpack_uint(&w, "id", attr->device_id);
+    zigbee_msgpack_uint(&w, "type_id", attr->type_id);
+    zigbee_msgpack_uint(&w, "ep_id", attr->endpoint_id);
+    zigbee_msgpack_uint(&w, "cluster_id", attr->cluster_id);
+    zigbee_msgpack_uint(&w, "attr_id", attr->attr_id);
+    zigbee_msgpack_uint(&w, "value_type", (uint32_t)attr->value_type);
+    zigbee_msgpack_uint(&w, "value", attr->value);
+    zigbee_msgpack_uint(&w, "timestamp", (uint32_t)g_vars_ptr->datetime);
+    if (event != NULL) {
+        zigbee_msgpack_uint(&w, "count", event[0]);
+        zigbee_msgpack_uint(&w, "span_ms", event[1]);
+    }
+
+    if (w.len >= size) {
+        esplogW(TAG_LIB_ZIGBEE, "(pack_attr_msgpack)", "MessagePack buffer is too small! (needed: %u, size: %u)", (unsigned)w.len + 1, (unsigned)size);
+        return 0;
+    }
+
+    return w.len;
+}
+
+size_t pack_attr_msgpack(const iot_alarm_attr_load_t * attr, const char * ieee_str, uint8_t * buf, size_t size) {
+    return zigbee_msgpack_attr(attr, ieee_str, NULL, buf, size);
+}
+
+size_t pack_attr_event_msgpack(const iot_alarm_attr_load_t * attr, const char * ieee_str, uint32_t count, uint32_t span_ms, uint8_t * buf, size_t size) {
+    const uint32_t event[2] = {count, span_ms};
+    return zigbee_msgpack_attr(attr, ieee_str, event, buf, size);
+}
+
+// the array of an already parsed JSON or MessagePack command
+static bool unpack_attr_batch_doc(iot_alarm_attr_load_t * attrs, size_t max, size_t * count, JsonDocument & doc) {
+    JsonArrayConst array = doc.as<JsonArrayConst>();
+    if (array.size() > max) {
+        esplogW(TAG_LIB_ZIGBEE, "(unpack_attr_batch)", "Too many attributes in the batch! (count: %u, max: %u)", (unsigned)array.size(), (unsigned)max);
+        return false;
+    }
+
+    for (JsonVariantConst item : array) {
+        if (!item.is<JsonObjectConst>() || !unpack_attr_object(&attrs[*count], item.as<JsonObjectConst>())) {
+            esplogW(TAG_LIB_ZIGBEE, "(unpack_attr_batch)", "Invalid attribute in the batch! (index: %u)", (unsigned)*count);
+            return false;
+        }
+        (*count)++;
+    }
+
+    return true;
+}
+
+bool unpack_attr_batch(iot_alarm_attr_load_t * attrs, size_t max, size_t * count, String jsonStr) {
+    if (attrs == NULL || count == NULL) {
+        esplogW(TAG_LIB_ZIGBEE, "(unpack_attr_batch)", "Error: Attr array is nullptr!");
+        return false;
+    }
+
+    *count = 0;
+
+    JsonDocument doc;
+    DeserializationError error = deserializeJson(doc, jsonStr);
+    if (error || !doc.is<JsonArrayConst>()) {
+        esplogW(TAG_LIB_ZIGBEE, "(unpack_attr_batch)", "Failed to parse JSON array! Error: %s", error.c_str());
+        doc.clear();
+        return false;
+    }
+
+    bool ret = unpack_attr_batch_doc(attrs, max, count, doc);
+    doc.clear();
+    return ret;
+}
+
+bool unpack_attr_batch_msgpack(iot_alarm_attr_load_t * attrs, size_t max, size_t * count, const uint8_t * load, size_t len) {
+    if (attrs == NULL || count == NULL || load == NULL) {
+        esplogW(TAG_LIB_ZIGBEE, "(unpack_attr_batch)", "Error: Attr array is nullptr!");
+        return false;
+    }
+
+    *count = 0;
+
+    JsonDocument doc;
+    DeserializationError error = deserializeMsgPack(doc, load, len);
+    if (error || !doc.is<JsonArrayConst>()) {
+        esplogW(TAG_LIB_ZIGBEE, "(unpack_attr_batch)", "Failed to parse MessagePack array! Error: %s", error.c_str());
+        doc.clear();
+        return false;
+    }
+
+    bool ret = unpack_attr_batch_doc(attrs, max, count, doc);
+    doc.clear();
+    return ret;
+}
+
 // ----------------------------------------------------------------------------------------------------------------------------------------------------
 
 /* void serialize_dev(iot_alarm_dev_load_t *dev, uint8_t *buffer, size_t *bytes) {
@@ -11,6 +11,7 @@
 #include <Arduino.h>
 #include <ArduinoJson.h>
 #include <HardwareSerial.h>
+#include <SD.h>
 
 #include "utils.h"
 #include "mainAppDefinitions.h"
@@ -26,21 +27,64 @@
 #include "string.h"
 #include "driver/gpio.h"
 #include "driver/uart.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
 
 #define ZIGBEE_RX_PIN 25
 #define ZIGBEE_TX_PIN 26
 // #define ZIGBEE_EN_PIN 13 // <- will be at pcf8574
 #define ZIGBEE_BAUDRATE 115200
-#define ZIGBEE_TIMEOUT 1000
+#define ZIGBEE_UART_QUEUE_SIZE 20           // number of UART driver events
+#define ZIGBEE_RX_IDLE_SYMBOLS 3            // idle line time (in symbols) after which the received bytes are reported
+#define ZIGBEE_RX_FULL_THRESHOLD 64         // number of bytes in RX FIFO after which the received bytes are reported
+
+#define ZIGBEE_FRAME_SOF 0x7E              // start of frame byte
+#define ZIGBEE_FRAME_HEADER_SIZE 4          // start of frame byte + payload length (uint16_t, little endian) + sequence number
+#define ZIGBEE_FRAME_CRC_SIZE 2             // CRC16 of the payload length, sequence number and payload (uint16_t, little endian)
+#define ZIGBEE_FRAME_OVERHEAD (ZIGBEE_FRAME_HEADER_SIZE + ZIGBEE_FRAME_CRC_SIZE)
+#define ZIGBEE_RX_CHUNK_SIZE 64             // number of bytes read from the UART driver at once
+#define ZIGBEE_RX_TIMEOUT_MS 200            // default time to wait for a complete frame
+#define ZIGBEE_LOAD_SIZE_MIN 256            // minimal size of the load buffer of the received messages (fits attribute reports)
+#define ZIGBEE_ACK_TIMEOUT_MS 550           // time to wait for an acknowledge before the message is sent again
+#define ZIGBEE_COMMAND_SLOTS 8              // maximal number of commands waiting for an acknowledge at once
+#define ZIGBEE_COMMAND_FRAME_MAX 512        // maximal frame length of a command (fits batched attribute reads and writes)
+#define ZIGBEE_COMMAND_TIMEOUT_MS 10000     // default time after which a not acknowledged command fails
+#define ZIGBEE_ATTR_CACHE_SIZE 128          // number of slots of the attribute last-value cache (power of two)
+#define ZIGBEE_ATTR_CACHE_PROBES 8          // maximal number of slots probed for an attribute (the oldest one is replaced if all are used)
+#define ZIGBEE_DEVICE_SLOTS 64              // number of devices in the device registry
+#define ZIGBEE_ATTR_COMPACT_TAG 0xC7        // first byte of the attribute load in compact form
+#define ZIGBEE_ATTR_COMPACT_SIZE 13         // tag + device handle + endpoint + cluster + attribute + value type (uint8_t) + value
+#define ZIGBEE_DEV_INFO_SIZE 167            // device handle + IEEE + short address + device ID + type ID + type + manufacturer + name (+ endpoints)
+#define ZIGBEE_DEVICE_ENDPOINTS 4           // number of endpoints stored per device
+#define ZIGBEE_ENDPOINT_CLUSTERS 10         // number of cluster IDs stored per endpoint (input clusters first, then the output ones)
+#define ZIGBEE_DEVICE_DB_FILE "/config/zigbee_devices.bin"  // persistent device database loaded at boot
+#define ZIGBEE_DEVICE_DB_MAGIC 0x3142445AU  // "ZDB1", first bytes of the device database
+#define ZIGBEE_DEVICE_DB_SAVE_MS 600000     // period of saving the last-seen times (the changed metadata are saved right away)
+#define ZIGBEE_ATTR_BATCH_MAX 24            // maximal number of attributes in one batched read/write frame
+#define ZIGBEE_ATTR_BATCH_ITEM_SIZE 18      // IEEE + endpoint + cluster + attribute + value type (uint8_t) + value
+#define ZIGBEE_RULES_FILE "/config/zigbee_rules.json"   // report rule table loaded at boot
+#define ZIGBEE_RULES_MAX 64                 // maximal number of report rules
+#define ZIGBEE_RULES_BUCKETS 128            // number of slots of the rule lookup table (power of two, at least twice the rules)
+#define ZIGBEE_RULE_DEBOUNCE_MS 5000        // debounce window of the built-in intrusion rules (motion and contact sensors)
+#define ZIGBEE_DEBOUNCE_SLOTS 32            // number of debounce windows open at once
+#define ZIGBEE_PUBLISH_HIGH_SIZE 8          // publish jobs of the alarm-relevant reports and the read/write responses
+#define ZIGBEE_PUBLISH_LOW_SIZE 32          // publish jobs of the other reports (the oldest one is dropped if full)
+#define ZIGBEE_PUBLISH_HIGH_WAIT_MS 10      // time to wait for a free slot in the high priority queue
+#define ZIGBEE_PUBLISH_BATCH_SLOTS 2        // batched read/write responses waiting to be published at once
+#define ZIGBEE_IEEE_STR_SIZE 24             // IEEE address as text (XX:XX:XX:XX:XX:XX:XX:XX) with the terminating null
+#define ZIGBEE_ATTR_JSON_MAX 256            // buffer which fits the JSON message of any attribute report or event
+                                            // (the MessagePack message of the same report is always shorter)
+#define ZIGBEE_ATTR_BATCH_MSGPACK_MAX 4096  // buffer which fits the MessagePack message of a batched read/write response
+
+// #define ZIGBEE_LATENCY_PROBE 10          // number of samples of the latency probe run during setup (build flag)
 
 #define TXD_PIN ZIGBEE_TX_PIN
 #define RXD_PIN ZIGBEE_RX_PIN
 #define UART UART_NUM_2
 
-extern HardwareSerial SerialZigbee;
-
 extern const int RX_BUF_SIZE;
 extern const int TX_BUF_SIZE;
 
@@ -142,8 +186,11 @@ typedef enum {
     IOT_ALARM_MSGTYPE_ZB_DATA_READ          = 0x0aU,        // command (read attribute on zigbee device)
     IOT_ALARM_MSGTYPE_ZB_DATA_WRITE         = 0x0bU,        // command (set attribute on zigbee device)
     IOT_ALARM_MSGTYPE_ZB_DATA_REPORT        = 0x0cU,        // notification (attribute report)
+    IOT_ALARM_MSGTYPE_ZB_DEV_INFO           = 0x0dU,        // command (request device metadata) / notification (device metadata)
+    IOT_ALARM_MSGTYPE_ZB_DATA_READ_BATCH    = 0x0eU,        // command (read attributes) / notification (read results)
+    IOT_ALARM_MSGTYPE_ZB_DATA_WRITE_BATCH   = 0x0fU,        // command (write attributes) / notification (write results)
 
-    IOT_ALARM_MSGTYPE_MAX                   = 0x0dU,
+    IOT_ALARM_MSGTYPE_MAX                   = 0x10U,
 } message_type_t;
 
 typedef struct {
@@ -152,8 +199,44 @@ typedef struct {
     message_type_t id;                  // message type ID (notification / command type ID)
     uint32_t length;                    // load length
     char* load;                         // message load (integer, string, attribute data, etc...)
+    uint32_t size;                      // allocated size of the load (0 if the load is not owned by the message)
+    uint8_t seq;                        // sequence number of the frame (acknowledges carry the number of the acknowledged frame)
 } iot_alarm_message_t;
 
+/**
+ * @brief Callback invoked when an asynchronous command (see `zigbee_command_send()`) is acknowledged or fails.
+ *
+ * @param seq Sequence number of the command.
+ * @param id Message type ID of the command.
+ * @param success `true` if the command was acknowledged with success status, `false` if it failed or timed out.
+ * @param ctx User context passed to `zigbee_command_send()`.
+ */
+typedef void (*zigbee_command_cb_t)(uint8_t seq, message_type_t id, bool success, void* ctx);
+
+typedef enum {
+    ZIGBEE_FRAME_STATE_SYNC                 = 0x00U,        // waiting for the start of frame byte
+    ZIGBEE_FRAME_STATE_LEN_LO               = 0x01U,        // waiting for the low byte of the payload length
+    ZIGBEE_FRAME_STATE_LEN_HI               = 0x02U,        // waiting for the high byte of the payload length
+    ZIGBEE_FRAME_STATE_SEQ                  = 0x03U,        // waiting for the sequence number
+    ZIGBEE_FRAME_STATE_PAYLOAD              = 0x04U,        // receiving the payload
+    ZIGBEE_FRAME_STATE_CRC_LO               = 0x05U,        // waiting for the low byte of the CRC
+    ZIGBEE_FRAME_STATE_CRC_HI               = 0x06U,        // waiting for the high byte of the CRC
+} zigbee_frame_state_t;
+
+typedef struct {
+    zigbee_frame_state_t state;         // parser state
+    uint8_t* buffer;                    // buffer where the payload of the frame is stored
+    size_t buffer_size;                 // size of the payload buffer
+    uint16_t length;                    // payload length of the current frame
+    uint8_t seq;                        // sequence number of the current frame
+    uint16_t index;                     // number of the received payload bytes of the current frame
+    uint16_t crc;                       // CRC computed from the received bytes
+    uint16_t crc_rx;                    // CRC received in the frame
+    uint32_t frames;                    // number of valid frames
+    uint32_t crc_errors;                // number of frames dropped due to CRC mismatch
+    uint32_t length_errors;             // number of frames dropped due to invalid payload length
+} zigbee_frame_parser_t;
+
 typedef uint8_t esp_zb_64bit_addr_t[8];
 typedef esp_zb_64bit_addr_t esp_zb_ieee_addr_t;
 
@@ -204,6 +287,91 @@ typedef struct {
     uint32_t value;                     // value data
 } iot_alarm_attr_load_t;
 
+typedef struct {
+    esp_zb_ieee_addr_t ieee_addr;       // IEEE address of the device (key)
+    uint8_t endpoint_id;                // ZCL Endpoint ID (key)
+    bool used;                          // slot holds an attribute
+    uint16_t cluster_id;                // ZCL Cluster ID (key)
+    uint16_t attr_id;                   // ZCL Attribute ID (key)
+    esp_zb_zcl_attr_type_t value_type;  // value type ID of the last value
+    uint32_t value;                     // last value
+    uint32_t last_seen;                 // time of the last report (ms since boot)
+    uint32_t changes;                   // number of value changes since the attribute was cached
+} zigbee_attr_cache_entry_t;
+
+typedef struct {
+    uint8_t endpoint_id;                // Endpoint ID
+    uint16_t app_profile_id;            // Application Profile ID
+    uint16_t app_device_id;             // Application Device ID
+    uint8_t app_device_version;         // Application Device Version
+    uint8_t input_cluster_count;        // Number of input clusters
+    uint8_t output_cluster_count;       // Number of output clusters
+    uint16_t clusters[ZIGBEE_ENDPOINT_CLUSTERS];  // input cluster IDs followed by the output cluster IDs
+} zigbee_endpoint_t;
+
+typedef struct {
+    bool used;                          // slot holds a device
+    uint16_t handle;                    // device handle assigned by the Zigbee module (used by the compact attribute form)
+    esp_zb_ieee_addr_t ieee_addr;       // IEEE address of the device
+    uint16_t short_addr;                // short address of the device
+    uint8_t device_id;                  // zigbee network device ID
+    uint32_t type_id;                   // device type ID
+    char type[50];                      // device type
+    char manuf[50];                     // manufacturer name
+    char name[50];                      // device model name
+    uint32_t last_seen;                 // time of the last report (seconds after time epoch, 0 if unknown)
+    uint8_t endpoint_count;             // number of known endpoints
+    zigbee_endpoint_t endpoints[ZIGBEE_DEVICE_ENDPOINTS];  // endpoints with their clusters
+} zigbee_device_t;
+
+typedef enum {
+    ZIGBEE_RULE_OP_ANY,                 // any value
+    ZIGBEE_RULE_OP_EQ,                  // value == operand
+    ZIGBEE_RULE_OP_NE,                  // value != operand
+    ZIGBEE_RULE_OP_GT,                  // value > operand
+    ZIGBEE_RULE_OP_LT,                  // value < operand
+    ZIGBEE_RULE_OP_MASK,                // (value & operand) != 0
+    ZIGBEE_RULE_OP_MAX,
+} zigbee_rule_op_t;
+
+typedef enum {
+    ZIGBEE_RULE_ACTION_INTRUSION,       // alarm event when the predicate holds
+    ZIGBEE_RULE_ACTION_FIRE,            // fire alarm follows the predicate
+    ZIGBEE_RULE_ACTION_WATER,           // water-leakage alarm follows the predicate
+    ZIGBEE_RULE_ACTION_MAX,
+} zigbee_rule_action_t;
+
+typedef struct {
+    uint32_t type_id;                   // device type ID
+    uint16_t cluster_id;                // ZCL cluster ID
+    uint16_t attr_id;                   // ZCL attribute ID
+    zigbee_rule_op_t op;                // predicate applied to the reported value
+    uint32_t operand;                   // operand of the predicate
+    zigbee_rule_action_t action;        // action taken on the report
+    uint32_t debounce_ms;               // repeated reports of the sensor for which the predicate holds are coalesced in this window (0 = off)
+} zigbee_rule_t;
+
+typedef enum {
+    ZIGBEE_PUBLISH_REPORT,              // attribute report (published to `/report/<ieee>`)
+    ZIGBEE_PUBLISH_READ,                // read attribute response (published to `/read/out/<ieee>`)
+    ZIGBEE_PUBLISH_WRITE,               // write attribute response (published to `/write/out/<ieee>`)
+    ZIGBEE_PUBLISH_EVENT,               // summary of the reports coalesced by a debounce window (published to `/event/<ieee>`)
+    ZIGBEE_PUBLISH_READ_BATCH,          // batched read attribute response (published to `/read/out`)
+    ZIGBEE_PUBLISH_WRITE_BATCH,         // batched write attribute response (published to `/write/out`)
+    ZIGBEE_PUBLISH_DEVICE,              // device metadata (published retained to `/device/<ieee>`)
+    ZIGBEE_PUBLISH_MAX,
+} zigbee_publish_kind_t;
+
+typedef struct {
+    zigbee_publish_kind_t kind;         // what the attribute is
+    bool critical;                      // taken from the high priority queue (published right away, never batched)
+    iot_alarm_attr_load_t attr;         // copy of the received attribute (the last one of the window for the events,
+                                        // only the addresses of the device for the device metadata)
+    uint32_t count;                     // number of coalesced reports (events) or of the attributes (batches)
+    uint32_t span_ms;                   // time from the first to the last coalesced report (events only)
+    int8_t slot;                        // slot holding the attributes (batches only, see `zigbee_publish_batch()`)
+} zigbee_publish_job_t;
+
 /* typedef struct {
     uint8_t device_id;
     uint8_t devices_len;
@@ -213,8 +381,8 @@ typedef struct {
 /**
  * @brief Updates the serial communication between the ESP32's primary serial interface and the Zigbee serial interface.
  *
- * This function facilitates bidirectional data transfer between the main serial interface (`Serial`) and a secondary Zigbee serial interface (`SerialZigbee`).
- * It reads incoming data from `Serial` (the primary serial) and writes it to `SerialZigbee` (the Zigbee serial interface), and also reads incoming data from `SerialZigbee` and writes it to `Serial` for monitoring.
+ * This function facilitates bidirectional data transfer between the main serial interface (`Serial`) and the Zigbee UART (`UART`).
+ * It reads incoming data from `Serial` (the primary serial) and writes it to the Zigbee UART, and also reads incoming data from the Zigbee UART and writes it to `Serial` for monitoring.
  * This allows data received from the Zigbee network to be visible via the main serial monitor, and data sent to the main serial interface to be transmitted over the Zigbee network.
  *
  * @return None.
@@ -222,9 +390,11 @@ typedef struct {
  * @details
  * The function performs the following tasks:
  * 1. It continuously checks if there is data available in the main serial input buffer (`Serial.available()`).
- *    - If data is available, it is read from `Serial` and written to the Zigbee serial interface (`SerialZigbee`).
- * 2. It then checks if there is any data available in the Zigbee serial interface (`SerialZigbee.available()`).
- *    - If data is available, it is read from `SerialZigbee` and written to the main serial output (`Serial`).
+ *    - If data is available, it is read from `Serial` and written to the Zigbee UART (`uart_write_bytes()`).
+ * 2. It then checks if there is any data buffered by the Zigbee UART driver (`uart_get_buffered_data_len()`).
+ *    - If data is available, it is read from the Zigbee UART and written to the main serial output (`Serial`).
+ *
+ * @warning The bytes are read from the UART driver directly, so the function must not be used while `rtosZigbee` is running.
  * 
  * This loop ensures that the ESP32 can relay messages both from and to the Zigbee network while interacting with the user via the main serial port.
  * This function could be useful in situations where a Zigbee network device is being controlled or monitored using a serial interface.
@@ -245,11 +415,13 @@ void updateSerialZigbee();
  * @return `true` if the Zigbee module initializes successfully; otherwise, `false`.
  *
  * @details The function performs the following steps:
- *  1. Configures the UART interface with `SerialZigbee.begin()`.
- *  2. Sets a timeout for UART communication using `SerialZigbee.setTimeout()`.
+ *  1. Installs the ESP-IDF UART driver with an event queue and configures the UART interface and pins.
+ *  2. Sets the RX idle line timeout and the RX FIFO threshold, so the received bytes are reported right after a frame
+ *     (or a burst of frames) ends and the receiving task wakes up immediately (see `read_uart()`).
  *  3. Toggles the enable pin (`ZIGBEE_EN_PIN`) if defined, to reset the Zigbee module.
- *  4. Sends an echo command using `waitForCorrectResponseZigbee()` to ensure the module is responsive.
- *  5. Cleans up dynamically allocated messages using `destroy_message()`.
+ *  4. Prepares the in-flight command table (see `zigbee_command_send()`).
+ *  5. Sends an echo command using `zigbee_command_wait()` to ensure the module is responsive.
+ *  6. Cleans up dynamically allocated messages using `destroy_message()`.
  *
  * @note The function logs information and warnings during the initialization process.
  *
@@ -266,6 +438,26 @@ void updateSerialZigbee();
  */
 bool initSerialZigbee();
 
+/**
+ * @brief Measures the latency from a frame arriving at the UART to the `zigbeeAttrReportHandler()` call.
+ *
+ * The function switches the Zigbee UART to the internal loop back mode, sends synthetic attribute report frames
+ * (the frames are received by `rtosZigbee` as if they were sent by the Zigbee module) and logs the minimal, average
+ * and maximal latency. The loop back mode is switched off afterwards.
+ *
+ * @param samples Number of synthetic reports.
+ *
+ * @return `true` if all reports were handled, otherwise `false`.
+ *
+ * @note The function is compiled only with the `ZIGBEE_LATENCY_PROBE` build flag and requires running `rtosZigbee`.
+ *
+ * @warning The frames from the Zigbee module are not received while the probe runs and the synthetic reports are
+ * published to MQTT as any other report (device type 0, so no alarm is triggered).
+ */
+#ifdef ZIGBEE_LATENCY_PROBE
+bool zigbeeLatencyProbe(uint8_t samples);
+#endif
+
 /**
  * @brief Sends a reset command to the Zigbee module and verifies the response.
  *
@@ -276,12 +468,12 @@ bool initSerialZigbee();
  *
  * @details The function performs the following steps:
  *  1. Creates a command message to restart the Zigbee module.
- *  2. Sends the message and waits for the correct acknowledgment within a 10-second timeout using `waitForCorrectResponseZigbee()`.
+ *  2. Sends the message and waits for the correct acknowledgment within a 10-second timeout using `zigbee_command_wait()`.
  *  3. Logs an informational message if the reset command is sent successfully.
  *  4. Logs a warning if the reset command fails.
  *  5. Cleans up dynamically allocated messages using `destroy_message()`.
  *
- * @note The function relies on `waitForCorrectResponseZigbee()` to handle communication with the Zigbee module.
+ * @note The function relies on `zigbee_command_wait()` to handle communication with the Zigbee module.
  *
  * @warning If the communication fails or the acknowledgment is not received, the function returns `false`.
  *
@@ -305,12 +497,12 @@ bool initSerialZigbee();
  *
  * @details The function performs the following steps:
  *  1. Creates a command message to restart the Zigbee module.
- *  2. Sends the message and waits for the correct acknowledgment within a 10-second timeout using `waitForCorrectResponseZigbee()`.
+ *  2. Sends the message and waits for the correct acknowledgment within a 10-second timeout using `zigbee_command_wait()`.
  *  3. Logs an informational message if the reset command is sent successfully.
  *  4. Logs a warning if the reset command fails.
  *  5. Cleans up dynamically allocated messages using `destroy_message()`.
  *
- * @note The function relies on `waitForCorrectResponseZigbee()` to handle communication with the Zigbee module.
+ * @note The function relies on `zigbee_command_wait()` to handle communication with the Zigbee module.
  *
  * @warning If the communication fails or the acknowledgment is not received, the function returns `false`.
  *
@@ -335,12 +527,12 @@ bool zigbeeReset();
  *
  * @details The function performs the following steps:
  *  1. Creates a command message to initiate a factory reset of the Zigbee module.
- *  2. Sends the message and waits for the correct acknowledgment within a 10-second timeout using `waitForCorrectResponseZigbee()`.
+ *  2. Sends the message and waits for the correct acknowledgment within a 10-second timeout using `zigbee_command_wait()`.
  *  3. Logs an informational message if the factory reset command is sent successfully.
  *  4. Logs a warning if the factory reset command fails.
  *  5. Cleans up dynamically allocated messages using `destroy_message()`.
  *
- * @note The function relies on `waitForCorrectResponseZigbee()` to handle communication with the Zigbee module.
+ * @note The function relies on `zigbee_command_wait()` to handle communication with the Zigbee module.
  *
  * @warning Performing a factory reset will clear all configurations and settings in the Zigbee module.
  *
@@ -366,12 +558,12 @@ bool zigbeeFactory();
  *
  * @details The function performs the following steps:
  *  1. Creates a command message to request the number of connected devices from the Zigbee module.
- *  2. Sends the message and waits for the correct acknowledgment within a 10-second timeout using `waitForCorrectResponseZigbee()`.
+ *  2. Sends the message and waits for the correct acknowledgment within a 10-second timeout using `zigbee_command_wait()`.
  *  3. Logs an informational message if the device count command is sent successfully.
  *  4. Logs a warning if the device count command fails.
  *  5. Cleans up dynamically allocated messages using `destroy_message()`.
  *
- * @note The function relies on `waitForCorrectResponseZigbee()` to handle communication with the Zigbee module.
+ * @note The function relies on `zigbee_command_wait()` to handle communication with the Zigbee module.
  *
  * @warning Ensure that the Zigbee module is properly initialized before calling this function.
  *
@@ -399,7 +591,7 @@ bool zigbeeCount();
  * @details The function performs the following steps:
  *  1. Converts the `duration` to a string and loads it into the message payload.
  *  2. Creates a command message with the `IOT_ALARM_MSGTYPE_ZB_DEV_UNLOCK` type.
- *  3. Sends the message and waits for the correct acknowledgment within a 10-second timeout using `waitForCorrectResponseZigbee()`.
+ *  3. Sends the message and waits for the correct acknowledgment within a 10-second timeout using `zigbee_command_wait()`.
  *  4. Logs an informational message if the command is sent successfully.
  *  5. Logs a warning if the command fails to send or no acknowledgment is received.
  *  6. Cleans up dynamically allocated messages using `destroy_message()`.
@@ -429,7 +621,7 @@ bool zigbeeOpen(uint8_t duration = 180);
  *
  * @details The function performs the following steps:
  *  1. Creates a command message with the `IOT_ALARM_MSGTYPE_ZB_DEV_LOCK` type to lock the network.
- *  2. Sends the message and waits for the correct acknowledgment within a 10-second timeout using `waitForCorrectResponseZigbee()`.
+ *  2. Sends the message and waits for the correct acknowledgment within a 10-second timeout using `zigbee_command_wait()`.
  *  3. Logs an informational message if the command is sent successfully.
  *  4. Logs a warning if the command fails to send or no acknowledgment is received.
  *  5. Cleans up dynamically allocated messages using `destroy_message()`.
@@ -457,7 +649,7 @@ bool zigbeeClose();
  *
  * @details The function performs the following steps:
  *  1. Creates a command message with the `IOT_ALARM_MSGTYPE_ZB_DEV_CLEAR` type to clear the network.
- *  2. Sends the message and waits for the correct acknowledgment within a 10-second timeout using `waitForCorrectResponseZigbee()`.
+ *  2. Sends the message and waits for the correct acknowledgment within a 10-second timeout using `zigbee_command_wait()`.
  *  3. Logs an informational message if the command is sent successfully.
  *  4. Displays a notification (`NOTIFICATION_ZIGBEE_NET_CLEAR`) after successfully sending the clear command.
  *  5. Logs a warning if the command fails to send or no acknowledgment is received.
@@ -480,67 +672,101 @@ bool zigbeeClear();
  * @brief Reads an attribute from a Zigbee device.
  *
  * This function sends a command to the Zigbee module to read a specified attribute from a Zigbee device.
- * It serializes the attribute data, sends the command to the Zigbee module, and waits for a response. 
- * Upon successful communication, it returns `true`, otherwise, it returns `false`.
+ * It serializes the attribute data and queues the command in the in-flight command table without waiting for the
+ * acknowledgment, so several reads and writes may be outstanding at once.
  *
  * @param attr A pointer to an `iot_alarm_attr_load_t` structure that contains the attribute to be read.
+ * @param cb Called (by the zigbee task) when the command is acknowledged or fails, `NULL` only logs the result.
+ * @param ctx User context passed to `cb`.
  * 
- * @return `true` if the read command was sent successfully and the correct acknowledgment was received; otherwise, `false`.
+ * @return `true` if the read command was queued and sent; otherwise, `false` (`cb` is not called).
  *
  * @details The function performs the following steps:
  *  1. Serializes the attribute data provided in the `attr` parameter into a buffer (`serialized_load`).
- *  2. Creates a command message with the `IOT_ALARM_MSGTYPE_ZB_DATA_READ` type to request the attribute read.
- *  3. Sends the command message and waits for the correct acknowledgment within a 10-second timeout using `waitForCorrectResponseZigbee()`.
- *  4. Logs an informational message if the command is sent successfully.
- *  5. Logs a warning if the command fails to send or no acknowledgment is received.
- *  6. Cleans up dynamically allocated messages using `destroy_message()`.
+ *  2. Sends a command message with the `IOT_ALARM_MSGTYPE_ZB_DATA_READ` type using `zigbee_command_send()`, the message is
+ *     copied into the command slot, so `attr` may be destroyed right after the call.
+ *  3. The acknowledgment is matched by `rtosZigbee`, which logs whether the command succeeded or timed out (or calls `cb`).
  *
- * @note Ensure that the Zigbee module is initialized and that the attribute to be read is properly specified in the `attr` structure.
+ * @note The read value arrives later as an `IOT_ALARM_MSGTYPE_ZB_DATA_READ` message and is published by `rtosZigbee`.
  *
  * Example Usage:
  * @code
  * iot_alarm_attr_load_t my_attr = { ... }; // Initialize attribute
  * if (!zigbeeAttrRead(&my_attr)) {
- *     Serial.println("Failed to read attribute from Zigbee device.");
- * } else {
- *     Serial.println("Attribute read successfully.");
+ *     Serial.println("Failed to send read command to Zigbee module.");
  * }
  * @endcode
  */
-bool zigbeeAttrRead(iot_alarm_attr_load_t * attr);
+bool zigbeeAttrRead(iot_alarm_attr_load_t * attr, zigbee_command_cb_t cb = NULL, void* ctx = NULL);
 
 /**
  * @brief Writes an attribute to a Zigbee device.
  *
  * This function sends a command to the Zigbee module to write a specified attribute to a Zigbee device.
- * It serializes the attribute data, sends the write command to the Zigbee module, and waits for a response.
- * Upon successful communication, it returns `true`, otherwise, it returns `false`.
+ * It serializes the attribute data and queues the command in the in-flight command table without waiting for the
+ * acknowledgment, so several reads and writes may be outstanding at once.
  *
  * @param attr A pointer to an `iot_alarm_attr_load_t` structure that contains the attribute to be written.
+ * @param cb Called (by the zigbee task) when the command is acknowledged or fails, `NULL` only logs the result.
+ * @param ctx User context passed to `cb`.
  * 
- * @return `true` if the write command was sent successfully and the correct acknowledgment was received; otherwise, `false`.
+ * @return `true` if the write command was queued and sent; otherwise, `false` (`cb` is not called).
  *
  * @details The function performs the following steps:
  *  1. Serializes the attribute data provided in the `attr` parameter into a buffer (`serialized_load`).
- *  2. Creates a command message with the `IOT_ALARM_MSGTYPE_ZB_DATA_WRITE` type to request the attribute write.
- *  3. Sends the command message and waits for the correct acknowledgment within a 10-second timeout using `waitForCorrectResponseZigbee()`.
- *  4. Logs an informational message if the command is sent successfully.
- *  5. Logs a warning if the command fails to send or no acknowledgment is received.
- *  6. Cleans up dynamically allocated messages and attributes using `destroy_message()` and `destroy_attr()`.
+ *  2. Sends a command message with the `IOT_ALARM_MSGTYPE_ZB_DATA_WRITE` type using `zigbee_command_send()`, the message is
+ *     copied into the command slot, so `attr` may be destroyed right after the call.
+ *  3. The acknowledgment is matched by `rtosZigbee`, which logs whether the command succeeded or timed out (or calls `cb`).
  *
- * @note Ensure that the Zigbee module is initialized and that the attribute to be written is properly specified in the `attr` structure.
+ * @note The attribute is owned by the caller, the function does not destroy it.
  *
  * Example Usage:
  * @code
  * iot_alarm_attr_load_t my_attr = { ... }; // Initialize attribute to write
  * if (!zigbeeAttrWrite(&my_attr)) {
- *     Serial.println("Failed to write attribute to Zigbee device.");
- * } else {
- *     Serial.println("Attribute written successfully.");
+ *     Serial.println("Failed to send write command to Zigbee module.");
  * }
  * @endcode
  */
-bool zigbeeAttrWrite(iot_alarm_attr_load_t * attr);
+bool zigbeeAttrWrite(iot_alarm_attr_load_t * attr, zigbee_command_cb_t cb = NULL, void* ctx = NULL);
+
+/**
+ * @brief Sends a batched read attribute command to the Zigbee module.
+ *
+ * All attributes are sent in one frame (`IOT_ALARM_MSGTYPE_ZB_DATA_READ_BATCH`), so refreshing many attributes costs
+ * one UART exchange instead of one per attribute. More than `ZIGBEE_ATTR_BATCH_MAX` attributes are split into several
+ * frames, which are sent without waiting for each other. The Zigbee module answers with one
+ * `IOT_ALARM_MSGTYPE_ZB_DATA_READ_BATCH` notification carrying the read values.
+ *
+ * @param attrs Attributes to be read (the IEEE address, endpoint, cluster and attribute IDs are used).
+ * @param count Number of attributes.
+ * @param cb Called (by the zigbee task) when a frame is acknowledged or fails, `NULL` only logs the result.
+ * @param ctx User context passed to `cb`.
+ * @param frames Where the number of sent frames is stored (`cb` is called once for each of them), may be `NULL`.
+ *
+ * @return
+ * - `true` if all frames were sent.
+ * - `false` if a frame could not be sent (too many commands in flight).
+ */
+bool zigbeeAttrReadBatch(const iot_alarm_attr_load_t * attrs, size_t count, zigbee_command_cb_t cb = NULL, void* ctx = NULL, size_t * frames = NULL);
+
+/**
+ * @brief Sends a batched write attribute command to the Zigbee module.
+ *
+ * Works the same way as `zigbeeAttrReadBatch()` with `IOT_ALARM_MSGTYPE_ZB_DATA_WRITE_BATCH` frames, the value types
+ * and values of the attributes are written.
+ *
+ * @param attrs Attributes to be written.
+ * @param count Number of attributes.
+ * @param cb Called (by the zigbee task) when a frame is acknowledged or fails, `NULL` only logs the result.
+ * @param ctx User context passed to `cb`.
+ * @param frames Where the number of sent frames is stored, may be `NULL`.
+ *
+ * @return
+ * - `true` if all frames were sent.
+ * - `false` if a frame could not be sent (too many commands in flight).
+ */
+bool zigbeeAttrWriteBatch(const iot_alarm_attr_load_t * attrs, size_t count, zigbee_command_cb_t cb = NULL, void* ctx = NULL, size_t * frames = NULL);
 
 // TODO
 bool zigbeeAttrReadWriteHandler(iot_alarm_attr_load_t * attr);
@@ -549,21 +775,26 @@ bool zigbeeAttrReadWriteHandler(iot_alarm_attr_load_t * attr);
  * @brief Handles incoming Zigbee attribute reports and triggers actions based on attribute values.
  *
  * This function processes incoming attribute reports from Zigbee devices, such as alarms, occupancy sensors,
- * fire sensors, and water leakage sensors. It performs specific actions when certain attribute IDs and values
- * are reported, such as triggering alarm events or updating the state of the system.
+ * fire sensors, and water leakage sensors. The actions are looked up in the report rule table (see
+ * `zigbeeRulesLoad()`) by the device type ID, cluster ID and attribute ID, so a new sensor model needs only a new rule.
  * 
  * @param attr A pointer to an `iot_alarm_attr_load_t` structure containing the attribute data from the Zigbee device.
+ * @param coalesced Set to `true` if the report was coalesced into an open debounce window (optional), such a report
+ * is not published (the window is summarised by one event, see `zigbee_debounce_poll()`).
  * 
  * @return `true` if the attribute report was handled successfully; otherwise, `false`.
  *
- * @details The function checks the type of attribute report based on `attr->type_id` and processes it accordingly:
- * - For IAS zone reports (type IDs: 0x0500000D, 0x05000015, 0x0500002D, 0x05000225), if the attribute ID is 0x0002 and the value is 1, it triggers an alarm event.
- * - For occupancy sensor reports (type IDs: 0x04060000, 0x04060001, 0x04060002), if the attribute ID is 0x0000 and the value is 1, it triggers an alarm event.
- * - For fire sensor reports (type IDs: 0x05000028, 0x0500002B), if the attribute ID is 0x0002 and the value is 1, it triggers a fire alarm event.
- * - For water-leakage sensor reports (type ID: 0x0500002A), if the attribute ID is 0x0002 and the value is 1, it triggers a water leakage alarm event.
- * 
- * Additionally, the function increments the alarm event counter (`alarm.alarm_events`) and updates the states for
- * fire and water alarms (`alarm.alarm_fire` and `alarm.alarm_water`), if applicable.
+ * @details Each rule matching the report evaluates its predicate on the reported value:
+ * - `ZIGBEE_RULE_ACTION_INTRUSION` triggers an alarm event (increments `alarm.alarm_events` while the alarm is armed) if the predicate holds.
+ * - `ZIGBEE_RULE_ACTION_FIRE` and `ZIGBEE_RULE_ACTION_WATER` set `alarm.alarm_fire` and `alarm.alarm_water` to the predicate result.
+ *
+ * If the rule has a debounce window, the first report of the sensor for which the predicate holds takes the action
+ * and opens the window, the next ones within `debounce_ms` are only counted. A burst of a motion or contact sensor is
+ * then one alarm event with one display notification, instead of pushing `alarm_events` over the thresholds.
+ *
+ * The built-in rules (used if the rule file is missing) handle the IAS zone, occupancy, fire and water-leakage
+ * sensors: zone status (0x0500/0x0002) or occupancy (0x0406/0x0000) equal to 1 triggers an alarm event (debounced by
+ * `ZIGBEE_RULE_DEBOUNCE_MS`), a non-zero zone status of the fire and water sensors sets the fire and water-leakage alarms.
  *
  * The function logs warning messages when an alarm event is triggered and displays a notification.
  *
@@ -581,7 +812,175 @@ bool zigbeeAttrReadWriteHandler(iot_alarm_attr_load_t * attr);
  * }
  * @endcode
  */
-bool zigbeeAttrReportHandler(iot_alarm_attr_load_t * attr);
+bool zigbeeAttrReportHandler(iot_alarm_attr_load_t * attr, bool * coalesced = NULL);
+
+/**
+ * @brief Closes the expired debounce windows of the report rules.
+ *
+ * A window which coalesced more than one report is summarised by one event (see `zigbee_publish_event()`) with the
+ * number of the reports and the time from the first to the last one. Called by the zigbee task on every loop, the
+ * windows are not locked.
+ *
+ * @return void
+ */
+void zigbee_debounce_poll();
+
+/**
+ * @brief Loads the report rule table from the SD card and replaces the active one.
+ *
+ * The rules are compiled into a hash table keyed by the type ID, cluster ID and attribute ID, so a report is
+ * evaluated in constant time. The active table is replaced at once, so the rules can be reloaded at runtime while
+ * the reports are handled. If the file does not exist, the built-in rules are used.
+ *
+ * The file contains a JSON object with the `rules` array, the IDs and operands can be numbers or hex strings:
+ * @code
+ * {"rules": [
+ *     {"type_id": "0x0500000D", "cluster": "0x0500", "attr": "0x0002", "op": "eq", "value": 1, "action": "intrusion", "debounce": 5000},
+ *     {"type_id": "0x05000028", "cluster": "0x0500", "attr": "0x0002", "op": "gt", "value": 0, "action": "fire"}
+ * ]}
+ * @endcode
+ * Operators: `any`, `eq`, `ne`, `gt`, `lt`, `mask`. Actions: `intrusion`, `fire`, `water`. The optional `debounce`
+ * is the debounce window of the sensor class in milliseconds (see `zigbeeAttrReportHandler()`).
+ *
+ * @param filepath Path of the rule file.
+ *
+ * @return
+ * - `true` if the rules were loaded (or the built-in rules are used).
+ * - `false` if the file is invalid, the active rules are kept.
+ */
+bool zigbeeRulesLoad(const char * filepath = ZIGBEE_RULES_FILE);
+
+/**
+ * @brief Replaces the active report rules with the received ones and stores them on the SD card.
+ *
+ * @param json Rule table in the format of the rule file (see `zigbeeRulesLoad()`).
+ * @param applied Optional, set to `true` if the rules were applied (also when they could not be saved afterwards).
+ *
+ * @return
+ * - `true` if the rules were applied and saved.
+ * - `false` if the rules are invalid (the active rules are kept) or they could not be saved (the new rules are
+ *   active until reboot, see `applied`).
+ */
+bool zigbeeRulesUpdate(String json, bool * applied = NULL);
+
+/**
+ * @brief Serializes the active report rules into the format of the rule file.
+ *
+ * @param json The String object where the serialized rules will be stored.
+ *
+ * @return `true` if the serialization was successful, `false` otherwise.
+ */
+bool zigbeeRulesDump(String * json);
+
+/**
+ * @brief Checks if an attribute report is relevant for the alarm (any report rule exists for it).
+ *
+ * Used to classify the reports right after they are received: the alarm-relevant ones are published before the
+ * telemetry (see `zigbee_publish_enqueue()`). The check is a lookup in the rule table, the value is not evaluated.
+ *
+ * @param attr Received attribute (the type ID, cluster ID and attribute ID are used).
+ *
+ * @return `true` if a rule matches the type ID, cluster ID and attribute ID of the report.
+ */
+bool zigbeeAttrIsCritical(const iot_alarm_attr_load_t * attr);
+
+/**
+ * @brief Queues a received attribute to be published by the publishing task.
+ *
+ * The zigbee task only classifies the received attributes and runs the alarm rules, the MQTT publishing and SD card
+ * logging are done by a lower priority task (see `zigbee_publish_dequeue()`), so a flood of telemetry does not delay
+ * the frames behind it. There are two queues:
+ * - high priority (`ZIGBEE_PUBLISH_HIGH_SIZE`): the alarm-relevant reports and the read/write responses, if it is
+ *   full the job waits `ZIGBEE_PUBLISH_HIGH_WAIT_MS` for a free slot and then it is dropped,
+ * - low priority (`ZIGBEE_PUBLISH_LOW_SIZE`): the other reports, if it is full the oldest job is dropped (the newest
+ *   values are the useful ones).
+ *
+ * @param kind What the attribute is (report, read or write response).
+ * @param attr Received attribute (it is copied).
+ * @param critical `true` to use the high priority queue.
+ *
+ * @return
+ * - `true` if the job was queued.
+ * - `false` if the queues are not initialised or the job was dropped.
+ */
+bool zigbee_publish_enqueue(zigbee_publish_kind_t kind, const iot_alarm_attr_load_t * attr, bool critical);
+
+/**
+ * @brief Queues the summary of the reports coalesced by a debounce window (high priority).
+ *
+ * @param attr Last coalesced report.
+ * @param count Number of the reports in the window (including the first one, which was published on its own).
+ * @param span_ms Time from the first to the last report.
+ *
+ * @return `true` if the job was queued, `false` if the queues are not initialised or the job was dropped.
+ */
+bool zigbee_publish_event(const iot_alarm_attr_load_t * attr, uint32_t count, uint32_t span_ms);
+
+/**
+ * @brief Queues a batched read/write response to be published as one message (high priority).
+ *
+ * The attributes are copied to one of `ZIGBEE_PUBLISH_BATCH_SLOTS` slots, so the zigbee task does not pack and publish
+ * the up to `ZIGBEE_ATTR_BATCH_MAX` attributes itself. The publishing task takes them by `zigbee_publish_batch_get()`
+ * and frees the slot by `zigbee_publish_batch_release()`.
+ *
+ * @param kind `ZIGBEE_PUBLISH_READ_BATCH` or `ZIGBEE_PUBLISH_WRITE_BATCH`.
+ * @param attrs Received attributes (they are copied).
+ * @param count Number of attributes (at most `ZIGBEE_ATTR_BATCH_MAX`).
+ *
+ * @return `true` if the job was queued, `false` if the queues are not initialised, there is no free slot
+ *         or the job was dropped.
+ */
+bool zigbee_publish_batch(zigbee_publish_kind_t kind, const iot_alarm_attr_load_t * attrs, size_t count);
+
+/**
+ * @brief Queues the metadata of a device to be published (high priority, retained).
+ *
+ * Only the addresses are queued, the publishing task takes the metadata from the device registry by
+ * `device_registry_find_ieee()`, packs them by `pack_device()` and publishes them to `<topic>/device/<ieee>`.
+ * So the zigbee task never waits for the MQTT client or the outbox on the SD card, even for the bursts
+ * of `IOT_ALARM_MSGTYPE_ZB_DEV_INFO` notifications after boot (see `zigbeeDeviceInfoRequest()`).
+ *
+ * @param dev Device stored by `device_registry_update()`.
+ *
+ * @return `true` if the job was queued, `false` if the queues are not initialised or the job was dropped.
+ */
+bool zigbee_publish_device(const zigbee_device_t * dev);
+
+/**
+ * @brief Returns the attributes of a batch job (`job->count` of them).
+ *
+ * @param job Job taken by `zigbee_publish_dequeue()`.
+ *
+ * @return Pointer to the attributes in the slot of the job, `NULL` if the job is not a batch.
+ */
+const iot_alarm_attr_load_t * zigbee_publish_batch_get(const zigbee_publish_job_t * job);
+
+/**
+ * @brief Frees the slot of a batch job after it was published.
+ *
+ * @param job Job taken by `zigbee_publish_dequeue()` (nothing is done if it is not a batch).
+ */
+void zigbee_publish_batch_release(const zigbee_publish_job_t * job);
+
+/**
+ * @brief Takes the next job to be published, the high priority queue is always emptied first.
+ *
+ * @param job Where the job is stored.
+ * @param timeout Maximal time (in ticks) to wait for a job.
+ *
+ * @return `true` if a job was taken, `false` on timeout.
+ *
+ * Example Usage:
+ * @code
+ * zigbee_publish_job_t job;
+ * for (;;) {
+ *     if (zigbee_publish_dequeue(&job, portMAX_DELAY)) {
+ *         // pack and publish job.attr
+ *     }
+ * }
+ * @endcode
+ */
+bool zigbee_publish_dequeue(zigbee_publish_job_t * job, TickType_t timeout);
 
 // *********************************************************************************************************************
 
@@ -611,7 +1010,7 @@ bool zigbeeAttrReportHandler(iot_alarm_attr_load_t * attr);
  * - `msg->load`: The payload, if the message has one. It is copied into the buffer, even if it is empty (in which case `"\0"` will be copied).
  *
  * @note Ensure that the provided buffer is large enough to hold the serialized message, including the payload.
- * The function does not check the size of the buffer before writing to it.
+ * The function does not check the size of the buffer before writing to it (`send_message()` does).
  *
  * Example Usage:
  * @code
@@ -637,15 +1036,20 @@ void serialize_message(iot_alarm_message_t *msg, uint8_t *buffer, size_t *bytes)
  * @param buffer A pointer to the byte buffer containing the serialized message.
  * @param buffer_len The length of the buffer.
  *
- * @return void
+ * @return bool
+ * - `true` if the message was deserialized.
+ * - `false` if the buffer does not contain a complete message (the message is not modified).
+ * - `false` if the direction, status or ID is out of range (the message is not modified).
  *
  * @details This function performs the following steps:
  * - It checks if any of the pointers (`msg` or `buffer`) are `NULL` and logs a warning if so.
  * - It extracts the message direction, status, ID, and payload length from the buffer, ensuring there is enough data in the buffer at each step.
- * - If the buffer length is insufficient for any field, a warning is logged, and the function exits without modifying the message.
- * - It allocates memory for the message load (payload) based on the extracted length. If allocation fails, an error is logged.
- * - The extracted fields are assigned to a new `iot_alarm_message_t` structure, which is then returned through the `msg` pointer.
- * - If the message is successfully deserialized, the memory for the load (payload) is properly managed.
+ * - If the buffer length is insufficient for any field or the payload length does not match the buffer, a warning is logged, and the function exits without modifying the message.
+ * - The header fields are read as integers and checked against `IOT_ALARM_MSGDIR_MAX`, `IOT_ALARM_MSGSTATUS_MAX` and
+ *   `IOT_ALARM_MSGTYPE_MAX`, so a corrupted frame never stores an invalid enum value in the message.
+ * - The message structure and its load buffer are reused. The load buffer is reallocated (to at least `ZIGBEE_LOAD_SIZE_MIN`
+ *   bytes) only if the load does not fit, so receiving to the same message does not allocate memory in the steady state.
+ * - The extracted fields are assigned to the `iot_alarm_message_t` structure pointed by `msg`.
  *
  * @note The function assumes that the buffer contains a complete and correctly serialized message. If the buffer length is smaller than expected, the function will log warnings and not perform the deserialization.
  * 
@@ -653,9 +1057,8 @@ void serialize_message(iot_alarm_message_t *msg, uint8_t *buffer, size_t *bytes)
  * @code
  * uint8_t buffer[1024];
  * size_t buffer_len = 256; // Example buffer length
- * iot_alarm_message_t *msg = NULL;
- * deserialize_message(&msg, buffer, buffer_len);
- * if (msg != NULL) {
+ * iot_alarm_message_t *msg = create_message(IOT_ALARM_MSGDIR_MAX, IOT_ALARM_MSGSTATUS_MAX, IOT_ALARM_MSGTYPE_MAX, 1, "\0");
+ * if (deserialize_message(&msg, buffer, buffer_len)) {
  *     Serial.println("Message deserialized successfully!");
  *     // Process the message...
  *     free(msg->load);
@@ -663,7 +1066,7 @@ void serialize_message(iot_alarm_message_t *msg, uint8_t *buffer, size_t *bytes)
  * }
  * @endcode
  */
-void deserialize_message(iot_alarm_message_t **msg, uint8_t *buffer, size_t buffer_len);
+bool deserialize_message(iot_alarm_message_t **msg, uint8_t *buffer, size_t buffer_len);
 
 /**
  * @brief Creates a new `iot_alarm_message_t` structure and initializes it with the provided values.
@@ -730,59 +1133,133 @@ void destroy_message(iot_alarm_message_t **msg);
 // *********************************************************************************************************************
 
 /**
- * @brief Reads data from the specified UART interface into a buffer.
+ * @brief Updates the CRC16 (CCITT, polynomial 0x1021) with the given data.
  *
- * This function reads data from the specified UART interface and stores the received bytes into the provided buffer.
- * It reads until the buffer is full, or there is no more data available, or the maximum read length is reached.
+ * @param crc Current CRC value (`0xFFFF` for a new CRC).
+ * @param data Pointer to the data.
+ * @param len Length of the data.
+ *
+ * @return The updated CRC value.
+ */
+uint16_t zigbee_crc16(uint16_t crc, const uint8_t* data, size_t len);
+
+/**
+ * @brief Wraps the payload into a frame of the UART link protocol.
+ *
+ * The frame has the following layout (all numbers are little endian):
+ * - `ZIGBEE_FRAME_SOF` start of frame byte.
+ * - `uint16_t` payload length (1 - 65535 bytes).
+ * - `uint8_t` sequence number (the acknowledge of the frame carries the same number, 0 is used for frames which are
+ *   not tracked by the in-flight command table).
+ * - Payload (serialized message, see `serialize_message()`).
+ * - `uint16_t` CRC16 (see `zigbee_crc16()`) of the payload length, the sequence number and the payload.
+ *
+ * @param seq Sequence number of the frame.
+ * @param payload Pointer to the payload, it may point to `frame + ZIGBEE_FRAME_HEADER_SIZE` (the payload is then not copied).
+ * @param len Length of the payload.
+ * @param frame Pointer to the buffer where the frame is stored.
+ * @param frame_size Size of the frame buffer.
+ *
+ * @return The length of the frame (`len + ZIGBEE_FRAME_OVERHEAD`), or 0 if the frame does not fit into the buffer.
+ */
+size_t encode_frame(uint8_t seq, const uint8_t* payload, size_t len, uint8_t* frame, size_t frame_size);
+
+/**
+ * @brief Initialises the streaming parser of the UART link protocol frames.
+ *
+ * @param parser Pointer to the parser.
+ * @param buffer Buffer where the payload of the received frame is stored.
+ * @param buffer_size Size of the buffer, longer frames are dropped.
+ *
+ * @return void
+ */
+void frame_parser_init(zigbee_frame_parser_t* parser, uint8_t* buffer, size_t buffer_size);
+
+/**
+ * @brief Drops the partially received frame, so the parser waits for the next start of frame byte.
+ *
+ * @param parser Pointer to the parser.
+ *
+ * @return void
+ */
+void frame_parser_reset(zigbee_frame_parser_t* parser);
+
+/**
+ * @brief Feeds one received byte to the streaming parser of the UART link protocol frames.
+ *
+ * @param parser Pointer to the parser.
+ * @param byte Received byte.
+ *
+ * @return The payload length if the byte completed a valid frame (the payload is in the parser buffer and the sequence
+ * number in `parser->seq` until the next byte is fed), otherwise 0.
+ *
+ * @details
+ * The parser is a state machine, so the frames are recognised regardless of how the bytes are split into UART reads
+ * and a frame is handed off as soon as its last byte arrives. Frames with invalid length or CRC are dropped and the
+ * parser resynchronises on the next start of frame byte.
+ *
+ * Example Usage:
+ * @code
+ * zigbee_frame_parser_t parser;
+ * frame_parser_init(&parser, rx_buffer, RX_BUF_SIZE);
+ * for (int i = 0; i < rx_bytes; i++) {
+ *     int len = frame_parser_feed(&parser, chunk[i]);
+ *     if (len > 0) {
+ *         deserialize_message(&msg, rx_buffer, len);
+ *     }
+ * }
+ * @endcode
+ */
+int frame_parser_feed(zigbee_frame_parser_t* parser, uint8_t byte);
+
+/**
+ * @brief Reads the data available at the specified UART interface into a buffer.
+ *
+ * If no data is buffered, this function blocks on the UART driver event queue for up to `timeout` until the driver
+ * reports received data (RX FIFO threshold or idle line), then reads all buffered bytes (up to `max_len`) without
+ * waiting. RX overflows flush the UART and the frame parser, which then resynchronises on the next frame.
+ * It does not look for message boundaries, which is done by the frame parser.
  * 
  * @param uart The UART port to read from (e.g., `UART_NUM_0`, `UART_NUM_1`, etc.).
  * @param rx_buffer A pointer to the buffer where the received data will be stored.
  * @param max_len The maximum number of bytes to read from the UART interface.
+ * @param timeout Maximal time (in ticks) to wait for the first byte.
  *
  * @return The total number of bytes successfully read from the UART, or 0 if no data was read.
- *
- * @details This function performs the following:
- * - It first checks the available data in the UART's buffer using `uart_get_buffered_data_len`.
- * - It reads data in chunks into the provided `rx_buffer`, up to the specified `max_len` limit.
- * - If data is available, it reads it into the buffer using `uart_read_bytes`.
- * - The function continues reading data until one of the following conditions is met:
- *   1. The buffer is full (`bytes_read < max_len`).
- *   2. There is no more data available in the UART buffer (`available == 0`).
- *   3. The specified timeout period for reading (500ms) is reached.
- * 
- * @note The function uses `vTaskDelay` to introduce a brief delay before checking the UART buffer, which allows other tasks to run while waiting for data.
  * 
  * Example Usage:
  * @code
  * uint8_t buffer[100];
- * int bytes_read = read_uart(UART_NUM_1, buffer, sizeof(buffer));
+ * int bytes_read = read_uart(UART_NUM_1, buffer, sizeof(buffer), pdMS_TO_TICKS(100));
  * if (bytes_read > 0) {
- *     // Process the data stored in buffer
+ *     // Feed the data to the frame parser
  * } else {
  *     // Handle timeout or no data condition
  * }
  * @endcode
  */
-int read_uart(uart_port_t uart, uint8_t* rx_buffer, size_t max_len);
+int read_uart(uart_port_t uart, uint8_t* rx_buffer, size_t max_len, TickType_t timeout);
 
 /**
  * @brief Sends a serialized message over UART.
  *
- * This function serializes the provided message into a byte buffer and then sends it over the specified UART interface.
- * The function checks if the entire message was successfully sent and logs the outcome.
+ * This function serializes the provided message into a byte buffer, wraps it into a frame (see `encode_frame()`) and
+ * then sends it over the specified UART interface. The function checks if the entire frame was successfully sent and logs the outcome.
  * 
  * @param uart The UART port to send the message on (e.g., `UART_NUM_0`, `UART_NUM_1`, etc.).
- * @param tx_buffer A pointer to the buffer where the serialized message will be stored before sending.
+ * @param tx_buffer A pointer to the buffer (`TX_BUF_SIZE` bytes) where the frame will be stored before sending.
  * @param msg A pointer to the `iot_alarm_message_t` structure containing the message to be sent.
  *
- * @return The number of bytes actually sent via UART. If successful, this should be equal to the length of the message.
+ * @return The number of bytes actually sent via UART (including the frame overhead), or -1 if the message does not fit into the buffer.
  *
  * @details The function performs the following steps:
- * 1. Serializes the message using the `serialize_message` function, converting the `iot_alarm_message_t` structure into a byte array (`tx_buffer`).
- * 2. Writes the serialized message to the UART interface using `uart_write_bytes`.
- * 3. If the number of bytes written equals the length of the serialized message, the message is considered successfully sent. Otherwise, a warning message is logged indicating the failure.
+ * 1. Serializes the message using the `serialize_message` function directly behind the frame header in `tx_buffer`.
+ * 2. Adds the frame header with the sequence number of the message (`msg->seq`) and CRC using `encode_frame`.
+ * 3. Writes the frame to the UART interface using `uart_write_bytes`.
+ * 4. If the number of bytes written equals the length of the frame, the message is considered successfully sent. Otherwise, a warning message is logged indicating the failure.
  *
  * @note The function does not block the calling task indefinitely; if the message cannot be sent completely, a warning will be logged.
+ * The message is sent only once, commands which have to be acknowledged are sent using `zigbee_command_send()`.
  * 
  * Example Usage:
  * @code
@@ -799,32 +1276,33 @@ int read_uart(uart_port_t uart, uint8_t* rx_buffer, size_t max_len);
 int send_message(uart_port_t uart, uint8_t* tx_buffer, iot_alarm_message_t *msg);
 
 /**
- * @brief Receives a serialized message over UART and deserializes it.
+ * @brief Receives one framed message over UART and deserializes it.
  *
- * This function reads data from the specified UART interface, deserializes it into an `iot_alarm_message_t` structure,
- * and stores it in the provided message pointer. The function also handles buffer overflows and logs errors if any issues
- * occur during the reception or deserialization of the message.
+ * This function reads data from the specified UART interface, feeds it byte by byte to the frame parser and deserializes
+ * the first valid frame into an `iot_alarm_message_t` structure. The function returns as soon as the last byte of the frame
+ * arrives, the bytes received behind the frame are kept for the next call.
  * 
  * @param uart The UART port to receive the message from (e.g., `UART_NUM_0`, `UART_NUM_1`, etc.).
- * @param rx_buffer A pointer to the buffer where received data will be stored.
+ * @param rx_buffer A pointer to the buffer where the payload of the received frame will be stored.
  * @param msg A pointer to a pointer of the `iot_alarm_message_t` structure where the deserialized message will be stored.
- * @param max_len The maximum length of the buffer to store the received data.
+ * @param max_len The maximum length of the buffer to store the received payload.
+ * @param timeout Maximal time (in ticks) to wait for a complete frame (default `ZIGBEE_RX_TIMEOUT_MS`).
  *
- * @return The number of bytes successfully received. If no data was received, returns 0.
+ * @return The payload length of the received frame. If no valid frame was received in time, returns 0 (the message is not modified).
  *
  * @details The function performs the following steps:
- * 1. Clears the receive buffer and attempts to read up to `max_len` bytes from the UART interface using the `read_uart` function.
- * 2. If the data exceeds the buffer size, a warning is logged, and the buffer is truncated.
- * 3. If any data was successfully received, the function proceeds to deserialize the received data into the provided message structure (`msg`).
- * 4. The function logs warnings if there are issues with the buffer or the message structure.
+ * 1. Feeds the bytes left from the previous call to the frame parser (see `frame_parser_feed()`).
+ * 2. Reads the next chunk of bytes from the UART interface using `read_uart` until a frame is completed or the timeout expires.
+ * 3. Deserializes the frame payload into the provided message structure (`msg`) and stores the sequence number of the frame
+ *    in `msg->seq`, frames with invalid CRC or message are dropped.
  *
- * @note This function does not block indefinitely. If no data is available, it returns 0 bytes read.
+ * @note The state of the frame parser is shared, so the function must be called only from one task at a time.
  *
  * Example Usage:
  * @code
  * uint8_t rx_buffer[256];
  * iot_alarm_message_t *msg = NULL;
- * int result = receive_message(UART_NUM_1, rx_buffer, &msg, sizeof(rx_buffer));
+ * int result = receive_message(UART_NUM_1, rx_buffer, &msg, sizeof(rx_buffer), pdMS_TO_TICKS(500));
  * if (result > 0) {
  *     // Message received and deserialized
  * } else {
@@ -832,32 +1310,123 @@ int send_message(uart_port_t uart, uint8_t* tx_buffer, iot_alarm_message_t *msg)
  * }
  * @endcode
  */
-int receive_message(uart_port_t uart, uint8_t* rx_buffer, iot_alarm_message_t **msg, size_t max_len);
+int receive_message(uart_port_t uart, uint8_t* rx_buffer, iot_alarm_message_t **msg, size_t max_len, TickType_t timeout = pdMS_TO_TICKS(ZIGBEE_RX_TIMEOUT_MS));
+
+/**
+ * @brief Sends a command to the Zigbee module without waiting for its acknowledgment.
+ *
+ * The message gets the next sequence number and its frame is stored in a free slot of the in-flight command table,
+ * so up to `ZIGBEE_COMMAND_SLOTS` commands may be outstanding at once. The frame is sent immediately and then again
+ * every `ZIGBEE_ACK_TIMEOUT_MS` until `rtosZigbee` receives the acknowledge with the same sequence number or the
+ * command times out.
+ *
+ * @param msg Message to be sent (command or notification), it is copied, so it may be destroyed right after the call.
+ * @param timeout_ms Time after which the not acknowledged command fails.
+ * @param cb Callback invoked from `rtosZigbee` when the command is acknowledged or fails (optional).
+ * @param ctx User context passed to the callback.
+ *
+ * @return The sequence number of the command (1 - 255), or 0 if the command could not be sent (no free slot or too long message).
+ *
+ * @note The callback runs in the Zigbee task, so it must not block and must not wait for another command.
+ *
+ * Example Usage:
+ * @code
+ * void on_done(uint8_t seq, message_type_t id, bool success, void* ctx) {
+ *     esplogI(TAG_LIB_ZIGBEE, "(on_done)", "Command %d: %s", seq, success ? "OK" : "FAILED");
+ * }
+ *
+ * zigbee_command_send(msg, ZIGBEE_COMMAND_TIMEOUT_MS, on_done, NULL);
+ * @endcode
+ */
+uint8_t zigbee_command_send(iot_alarm_message_t *msg, uint32_t timeout_ms, zigbee_command_cb_t cb = NULL, void* ctx = NULL);
+
+/**
+ * @brief Sends a command to the Zigbee module and blocks the calling task until it is acknowledged or times out.
+ *
+ * The command is sent the same way as by `zigbee_command_send()`, the calling task then waits for the notification from
+ * `rtosZigbee`, which keeps receiving reports while the command is outstanding. If the Zigbee task is not running yet
+ * (initialisation) or the function is called from it, the frames are received by the calling task itself.
+ *
+ * @param msg Message to be sent.
+ * @param timeout_ms Time after which the not acknowledged command fails.
+ *
+ * @return
+ * - `true` if the command was acknowledged with success status.
+ * - `false` if it could not be sent, was rejected or timed out.
+ */
+bool zigbee_command_wait(iot_alarm_message_t *msg, uint32_t timeout_ms);
+
+/**
+ * @brief Completes the outstanding command acknowledged by the received message.
+ *
+ * The acknowledge is matched with the command by its sequence number, direction and message type ID. The waiting task
+ * is notified or the callback of the command is invoked.
+ *
+ * @param ack Received acknowledge (`IOT_ALARM_MSGDIR_COMMAND_ACK` or `IOT_ALARM_MSGDIR_NOTIFICATION_ACK`).
+ *
+ * @return
+ * - `true` if an outstanding command has been acknowledged.
+ * - `false` if no command matches the acknowledge (late or duplicate acknowledge).
+ */
+bool zigbee_command_ack(const iot_alarm_message_t *ack);
+
+/**
+ * @brief Sends the outstanding commands again and fails the expired ones.
+ *
+ * The function is called by the task which receives the frames before every `receive_message()` call.
+ *
+ * @return Time (in ticks) until the next resend or deadline, at most `ZIGBEE_RX_TIMEOUT_MS`, so it may be passed as
+ * the timeout of `receive_message()`.
+ */
+TickType_t zigbee_command_poll();
+
+/**
+ * @brief Handles a message received from the Zigbee module (the body of `rtosZigbee`).
+ *
+ * The acknowledges complete the outstanding commands (see `zigbee_command_ack()`), the notifications and commands are
+ * acknowledged. The attributes are decoded and the cache and the device registry are updated, the report rules run
+ * (`zigbeeAttrReportHandler()`) and the publish jobs are queued for the publishing task (`zigbee_publish_enqueue()`,
+ * `zigbee_publish_batch()`, `zigbee_publish_device()`). The network events are shown as display notifications.
+ *
+ * @param msg Message received by `receive_message()`.
+ * @param rx_bytes Payload length of the received frame (only logged).
+ *
+ * @return `false` if the message is invalid or its load could not be decoded, `true` otherwise.
+ *
+ * @note The decoded attributes are kept in a static buffer, call it from one task only (the task which receives the frames).
+ *
+ * Example Usage:
+ * @code
+ * int rx_bytes = receive_message(UART, rx_buffer, &msg, RX_BUF_SIZE-1, zigbee_command_poll());
+ * zigbee_debounce_poll();
+ * if (rx_bytes > 0) {
+ *     zigbee_message_dispatch(msg, rx_bytes);
+ * }
+ * @endcode
+ */
+bool zigbee_message_dispatch(const iot_alarm_message_t *msg, int rx_bytes);
 
 /**
  * @brief Sends an attribute message over UART and waits for a response.
  *
  * This function serializes an attribute load, creates a message with the appropriate direction and status, and sends it
- * over UART. The function then waits for an acknowledgment (ACK) message and returns the number of bytes sent or a failure
+ * over UART. The function then waits for an acknowledgment (ACK) message and returns the number of load bytes sent or a failure
  * code if no acknowledgment is received within the timeout.
  *
- * @param uart The UART port to send the message through (e.g., `UART_NUM_0`, `UART_NUM_1`, etc.).
- * @param tx_buffer A pointer to the buffer where the serialized message will be stored before transmission.
+ * @param uart Unused, the message is sent to the Zigbee UART (`UART`).
+ * @param tx_buffer Unused, the frame is stored in the in-flight command table.
  * @param load A pointer to the attribute load that needs to be serialized and sent.
  * @param id The message type identifier, which determines the message format and direction.
  *
- * @return The number of bytes sent on success. If no acknowledgment is received within the timeout, returns a failure code.
+ * @return The length of the serialized attribute on success. If no acknowledgment is received within the timeout, returns -1.
  *
  * @details The function performs the following steps:
  * 1. Serializes the attribute load into a buffer (`serialized_load`).
  * 2. Sets the message direction based on the message type (`id`).
- * 3. Creates an acknowledgment (ACK) message using the `create_message` function.
- * 4. Sends the message using the `send_message` function.
- * 5. Waits for a correct response (ACK) message using the `waitForCorrectResponseZigbee` function with a 10-second timeout.
- * 6. Logs a warning if no acknowledgment is received within the timeout.
- * 7. Destroys the acknowledgment message and returns the number of bytes sent.
+ * 3. Sends the message and waits for the acknowledgment using `zigbee_command_wait()` with a 10-second timeout.
+ * 4. Logs a warning if no acknowledgment is received within the timeout.
  *
- * @note This function depends on the `waitForCorrectResponseZigbee` function to wait for an acknowledgment, so the caller should
+ * @note This function depends on the `zigbee_command_wait` function to wait for an acknowledgment, so the caller should
  *       ensure that the Zigbee coordinator or device is expected to respond to the message.
  *
  * Example Usage:
@@ -936,10 +1505,15 @@ void serialize_attr(iot_alarm_attr_load_t *attr, char *buffer, size_t *bytes);
  * @param buffer A pointer to the buffer containing the raw attribute data to be deserialized.
  * @param buffer_len The length of the buffer, which is used to validate that the buffer is large enough to hold the required data.
  *
- * @return void
+ * @return bool
+ * - `true` if the attribute was deserialized.
+ * - `false` if the buffer is too small (the attribute is not modified).
+ * - `false` if the value type is not a one-byte ZCL data type (the attribute is not modified).
+ * - `false` if the load is in the compact form and the device is not registered yet (its metadata are requested).
  *
  * @details The function performs the following steps:
- * 1. Validates that the provided pointers (`attr` and `buffer`) are not `NULL`.
+ * 1. Validates that the provided pointers (`attr` and `buffer`) are not `NULL`. A load in the compact form (see
+ *    `serialize_attr_compact()`) is completed with the device metadata from the device registry.
  * 2. Reads and deserializes fields from the buffer, including:
  *    - `ieee_addr`: IEEE address of the device.
  *    - `short_addr`: Short address of the device.
@@ -953,27 +1527,22 @@ void serialize_attr(iot_alarm_attr_load_t *attr, char *buffer, size_t *bytes);
  *    - `type`: The attribute's type.
  *    - `manuf`: The manufacturer of the device.
  *    - `name`: The name of the device.
- * 3. Checks if the buffer has enough data to deserialize each field and logs warnings if there is not enough data.
- * 4. Creates a new attribute structure using `create_attr` and populates it with the deserialized data.
- * 5. Destroys any existing attribute data using `destroy_attr` to avoid memory leaks.
- * 6. Populates the provided `attr` pointer with the newly created `iot_alarm_attr_load_t` structure containing the deserialized data.
+ * 3. Checks if the buffer has enough data to deserialize all fields and logs a warning if there is not enough data.
+ * 4. Populates the existing attribute structure pointed by `attr` in place (no memory is allocated).
  *
- * @note If any buffer size limitations are encountered during deserialization, the function logs a warning and skips deserialization for the affected fields.
- * 
  * Example Usage:
  * @code
  * uint8_t buffer[256]; // Example buffer filled with raw attribute data.
- * iot_alarm_attr_load_t *attr = NULL;
+ * iot_alarm_attr_load_t *attr = create_attr("\0", "\0", "\0", 0, ieee_addr, 0, 0, 0, 0, 0, ESP_ZB_ZCL_ATTR_TYPE_U8, 0);
  * size_t buffer_len = sizeof(buffer);
- * deserialize_attr(&attr, buffer, buffer_len);
- * if (attr != NULL) {
+ * if (deserialize_attr(&attr, buffer, buffer_len)) {
  *     // Process the deserialized attribute data
  * } else {
  *     // Error in deserialization
  * }
  * @endcode
  */
-void deserialize_attr(iot_alarm_attr_load_t **attr, uint8_t *buffer, size_t buffer_len);
+bool deserialize_attr(iot_alarm_attr_load_t **attr, uint8_t *buffer, size_t buffer_len);
 
 /**
  * @brief Creates and initializes a new attribute structure.
@@ -1158,12 +1727,194 @@ bool compare_attr(iot_alarm_attr_load_t attr1, iot_alarm_attr_load_t attr2);
  */
 void copy_attr(iot_alarm_attr_load_t * src, iot_alarm_attr_load_t * dst);
 
+/**
+ * @brief Stores the attribute value in the last-value cache and checks whether it changed.
+ *
+ * The cache is an open addressing hash table keyed by the IEEE address, endpoint, cluster and attribute ID, so the
+ * reports of all devices are deduplicated independently of each other and in constant time. The last-seen time is
+ * updated for every report, the change counter only if the value differs.
+ *
+ * @param attr Received attribute.
+ *
+ * @return
+ * - `true` if the attribute was not cached yet or its value (or value type) changed.
+ * - `false` if the value is the same as the last one (the report is a duplicate).
+ *
+ * @details At most `ZIGBEE_ATTR_CACHE_PROBES` slots are probed for an attribute. If the attribute is not cached and
+ * all probed slots are used, the least recently seen attribute of them is replaced, so the cache never fills up and
+ * no slot is ever left empty in the middle of a probe sequence.
+ *
+ * @note The cache is not locked, it is updated and read only by `rtosZigbee`.
+ *
+ * Example Usage:
+ * @code
+ * if (!attr_cache_update(attr) && !zigbeeAttrIsCritical(attr)) {
+ *     return; // duplicate telemetry (the alarm-relevant repeats go to the rules)
+ * }
+ * @endcode
+ */
+bool attr_cache_update(const iot_alarm_attr_load_t * attr);
+
+/**
+ * @brief Looks up the attribute in the last-value cache.
+ *
+ * @param ieee_addr IEEE address of the device.
+ * @param endpoint_id ZCL Endpoint ID.
+ * @param cluster_id ZCL Cluster ID.
+ * @param attr_id ZCL Attribute ID.
+ *
+ * @return Pointer to the cache entry (valid until the next `attr_cache_update()` call), or `NULL` if the attribute is not cached.
+ */
+const zigbee_attr_cache_entry_t * attr_cache_find(const esp_zb_ieee_addr_t ieee_addr, uint8_t endpoint_id, uint16_t cluster_id, uint16_t attr_id);
+
+/**
+ * @brief Serializes the attribute into the compact form, which refers to the device by its handle.
+ *
+ * The compact form carries only the attribute tuple, the device metadata (addresses, type, manufacturer and name)
+ * are interned in the device registry on both sides of the UART (see `device_registry_update()`). The load is
+ * `ZIGBEE_ATTR_COMPACT_SIZE` bytes long instead of ~180 bytes of `serialize_attr()`:
+ * - `uint8_t` `ZIGBEE_ATTR_COMPACT_TAG`.
+ * - `uint16_t` device handle.
+ * - `uint8_t` endpoint ID, `uint16_t` cluster ID, `uint16_t` attribute ID.
+ * - `uint8_t` value type.
+ * - `uint32_t` value.
+ *
+ * @param attr Attribute to be serialized.
+ * @param handle Handle of the device in the device registry.
+ * @param buffer Buffer (at least `ZIGBEE_ATTR_COMPACT_SIZE` bytes) where the load is stored.
+ * @param bytes Length of the load.
+ *
+ * @return void
+ */
+void serialize_attr_compact(const iot_alarm_attr_load_t *attr, uint16_t handle, char *buffer, size_t *bytes);
+
+/**
+ * @brief Stores the device metadata received in `IOT_ALARM_MSGTYPE_ZB_DEV_INFO` notification in the device registry.
+ *
+ * The Zigbee module sends the metadata when a device joins the network or when they are requested (see
+ * `zigbeeDeviceInfoRequest()`). The load has `ZIGBEE_DEV_INFO_SIZE` bytes: `uint16_t` handle, IEEE address,
+ * `uint16_t` short address, `uint8_t` device ID, `uint32_t` type ID and the type, manufacturer and name strings (50 bytes each).
+ *
+ * The result of the device interview may follow: `uint8_t` endpoint count and for each endpoint `uint8_t` endpoint ID,
+ * `uint16_t` profile ID, `uint16_t` device ID, `uint8_t` device version, `uint8_t` input and output cluster counts and
+ * the `uint16_t` input and output cluster IDs. Up to `ZIGBEE_DEVICE_ENDPOINTS` endpoints with `ZIGBEE_ENDPOINT_CLUSTERS`
+ * clusters are stored, the rest is skipped.
+ *
+ * @param buffer Load of the message.
+ * @param buffer_len Length of the load.
+ * @param dev Where the stored device is copied (optional).
+ *
+ * @return
+ * - `true` if the device has been stored.
+ * - `false` if the load is invalid or the registry is full.
+ *
+ * @details A device which rejoined with a new handle replaces its old entry (matched by the IEEE address). Without
+ * the endpoint list the known endpoints and the last-seen time of the device are kept. Changed metadata are saved to
+ * the device database by the next `device_registry_save()`.
+ */
+bool device_registry_update(const uint8_t *buffer, size_t buffer_len, zigbee_device_t *dev = NULL);
+
+/**
+ * @brief Finds the device in the device registry by its handle.
+ *
+ * @param handle Device handle.
+ * @param dev Where the device is copied.
+ *
+ * @return `true` if the device is registered, otherwise `false`.
+ */
+bool device_registry_find(uint16_t handle, zigbee_device_t *dev);
+
+/**
+ * @brief Finds the device in the device registry by its IEEE address.
+ *
+ * @param ieee_addr IEEE address of the device.
+ * @param dev Where the device is copied.
+ *
+ * @return `true` if the device is registered, otherwise `false`.
+ */
+bool device_registry_find_ieee(const esp_zb_ieee_addr_t ieee_addr, zigbee_device_t *dev);
+
+/**
+ * @brief Notes a report of a registered device: updates its last-seen time and learns the reported endpoint and cluster.
+ *
+ * The endpoint and cluster of the report are added to the device (as an input cluster) if they are not known yet,
+ * so the endpoint list fills up even if the Zigbee module does not send the interview result.
+ *
+ * @param attr Received attribute (the IEEE address, endpoint ID and cluster ID are used).
+ *
+ * @return `true` if the device is registered, otherwise `false`.
+ */
+bool device_registry_seen(const iot_alarm_attr_load_t *attr);
+
+/**
+ * @brief Loads the device database from the SD card into the device registry.
+ *
+ * Called once when the registry is created (see `initSerialZigbee()`), so the compact attribute frames of the known
+ * devices are resolved right after boot without asking the Zigbee module for the metadata.
+ *
+ * The file is binary and little endian: `uint32_t` `ZIGBEE_DEVICE_DB_MAGIC`, `uint16_t` device count, the device
+ * records and `uint16_t` CRC16 of all the previous bytes. A record is the handle, IEEE address, short address, device ID,
+ * type ID, last-seen time, the type, manufacturer and name strings (`uint8_t` length and the characters) and the
+ * endpoint list in the format of the `IOT_ALARM_MSGTYPE_ZB_DEV_INFO` load.
+ *
+ * @param filepath Path of the device database.
+ *
+ * @return
+ * - `true` if the database was loaded (or it does not exist yet).
+ * - `false` if the file is invalid, the registry stays empty.
+ */
+bool device_registry_load(const char * filepath = ZIGBEE_DEVICE_DB_FILE);
+
+/**
+ * @brief Saves the device registry to the device database on the SD card, if it changed.
+ *
+ * The changed metadata (a new device, new endpoints, another handle) are saved on the first call, the changed
+ * last-seen times only every `ZIGBEE_DEVICE_DB_SAVE_MS` (or if `force` is set), to spare the SD card. The file is
+ * written under a temporary name and renamed, so a reset during the write keeps the previous database.
+ *
+ * @param force `true` to save the changed last-seen times right away.
+ *
+ * @return
+ * - `true` if the database is up to date.
+ * - `false` if it could not be written (it is written again on the next call).
+ */
+bool device_registry_save(bool force = false);
+
+/**
+ * @brief Asks the Zigbee module to send the metadata of a device (`IOT_ALARM_MSGTYPE_ZB_DEV_INFO` notification).
+ *
+ * The command load is the device handle (2 bytes) if `ieee_addr` is `NULL`, otherwise the IEEE address (8 bytes).
+ * The command is sent asynchronously, the metadata arrive as a notification handled by `rtosZigbee`.
+ *
+ * @param handle Device handle (used if `ieee_addr` is `NULL`).
+ * @param ieee_addr IEEE address of the device (optional).
+ *
+ * @return `true` if the command was sent, otherwise `false`.
+ */
+bool zigbeeDeviceInfoRequest(uint16_t handle, const esp_zb_ieee_addr_t ieee_addr = NULL);
+
+/**
+ * @brief Packs the device metadata into a JSON string.
+ *
+ * @param dev Device from the device registry.
+ * @param jsonStr The String object where the serialized JSON data will be stored.
+ *
+ * @return `true` if the packing was successful, `false` otherwise.
+ *
+ * @details The JSON contains `handle`, `short`, `ieee`, `id`, `manufacturer`, `name`, `type`, `type_id`, `last_seen`
+ * and `endpoints` (`ep`, `profile`, `device`, `version` and the `in` and `out` cluster lists). It is
+ * published (retained) to `<topic>/device/<ieee>` when the metadata arrive, so the attribute messages do not have to
+ * repeat the strings.
+ */
+bool pack_device(const zigbee_device_t *dev, String *jsonStr);
+
 /**
  * @brief Packs the attribute structure into a JSON string.
  *
- * This function takes an attribute structure (`iot_alarm_attr_load_t`) and converts its fields into a JSON string. 
- * It populates the JSON document with the relevant information from the structure, such as manufacturer, device ID, 
- * IEEE address, type, and value. The resulting JSON is serialized into the provided `jsonStr` string.
+ * This function takes an attribute structure (`iot_alarm_attr_load_t`) and converts its fields into a JSON string.
+ * It populates the JSON document with the relevant information from the structure, such as device ID,
+ * IEEE address, type ID, and value. The resulting JSON is serialized into the provided `jsonStr` string.
+ * The manufacturer, name and type strings are published only once per device (see `pack_device()`).
  * 
  * @param attr The attribute structure to be packed into JSON.
  * @param jsonStr The String object where the serialized JSON data will be stored.
@@ -1175,16 +1926,13 @@ void copy_attr(iot_alarm_attr_load_t * src, iot_alarm_attr_load_t * dst);
  * 1. `short_addr`: The short address of the device.
  * 2. `ieee_addr`: The IEEE address, formatted as a string (e.g., "00:11:22:33:44:55:66:77").
  * 3. `device_id`: The device ID.
- * 4. `manufacturer`: The manufacturer name.
- * 5. `name`: The name of the device.
- * 6. `type`: The type of the device.
- * 7. `type_id`: The type ID.
- * 8. `endpoint_id`: The endpoint ID.
- * 9. `cluster_id`: The cluster ID.
- * 10. `attr_id`: The attribute ID.
- * 11. `value_type`: The type of the attribute value.
- * 12. `value`: The attribute value.
- * 13. `timestamp`: A timestamp for when the attribute was captured (using the global `g_vars_ptr->datetime`).
+ * 4. `type_id`: The type ID.
+ * 5. `endpoint_id`: The endpoint ID.
+ * 6. `cluster_id`: The cluster ID.
+ * 7. `attr_id`: The attribute ID.
+ * 8. `value_type`: The type of the attribute value.
+ * 9. `value`: The attribute value.
+ * 10. `timestamp`: A timestamp for when the attribute was captured (using the global `g_vars_ptr->datetime`).
  * 
  * If the serialization fails, an error message is logged, and `false` is returned. Otherwise, `true` is returned.
  * 
@@ -1218,6 +1966,7 @@ bool pack_attr(iot_alarm_attr_load_t * attr, String * jsonStr);
  *
  * @details The function first checks the validity of the input parameters, then it parses the JSON string and validates
  * that the required fields are present. If the fields are present and valid, the function populates the structure's fields.
+ * The IEEE address has to consist of all 8 bytes, a partially parsed address is rejected.
  * If any errors occur during parsing or field validation, the function returns `false` and logs an appropriate warning.
  * 
  * Example usage:
@@ -1236,4 +1985,212 @@ bool pack_attr(iot_alarm_attr_load_t * attr, String * jsonStr);
  */
 bool unpack_attr(iot_alarm_attr_load_t * attr, String jsonStr);
 
+/**
+ * @brief Unpacks a MessagePack message into an attribute structure.
+ *
+ * The message is a map with the same keys and values as the JSON message of `unpack_attr()`, the integers may be
+ * encoded in any MessagePack integer type.
+ *
+ * @param attr A pointer to the attribute structure where the data will be unpacked.
+ * @param load The MessagePack message.
+ * @param len Length of the message.
+ *
+ * @return `true` if the unpacking was successful and the structure was populated with the parsed data, `false` otherwise.
+ */
+bool unpack_attr_msgpack(iot_alarm_attr_load_t * attr, const uint8_t * load, size_t len);
+
+/**
+ * @brief Serializes the attributes into the load of a batched read/write frame.
+ *
+ * The load starts with the number of attributes (`uint8_t`), followed by `ZIGBEE_ATTR_BATCH_ITEM_SIZE` bytes per
+ * attribute: IEEE address, `uint8_t` endpoint ID, `uint16_t` cluster ID, `uint16_t` attribute ID, `uint8_t` value type
+ * and `uint32_t` value. The device metadata are not sent (see the device registry).
+ *
+ * @param attrs Attributes to be serialized.
+ * @param count Number of attributes (at most `ZIGBEE_ATTR_BATCH_MAX`).
+ * @param buffer Buffer where the load is stored.
+ * @param buffer_size Size of the buffer.
+ * @param bytes Length of the load.
+ *
+ * @return `true` if the attributes fit into the buffer, otherwise `false`.
+ */
+bool serialize_attr_batch(const iot_alarm_attr_load_t *attrs, size_t count, char *buffer, size_t buffer_size, size_t *bytes);
+
+/**
+ * @brief Deserializes the load of a batched read/write frame into attributes.
+ *
+ * The device metadata (short address, device ID, type ID and the strings) of the registered devices are filled from
+ * the device registry, they are cleared for the unknown devices.
+ *
+ * @param attrs Array where the attributes are stored.
+ * @param max Size of the array.
+ * @param count Number of deserialized attributes.
+ * @param buffer Load of the frame.
+ * @param buffer_len Length of the load.
+ *
+ * @return
+ * - `true` if the attributes were deserialized.
+ * - `false` if the load length does not match the number of attributes or they do not fit into the array.
+ */
+bool deserialize_attr_batch(iot_alarm_attr_load_t *attrs, size_t max, size_t *count, const uint8_t *buffer, size_t buffer_len);
+
+/**
+ * @brief Packs the attributes into one aggregated JSON message.
+ *
+ * The message is `{"timestamp": ..., "attrs": [...]}`, each item has the same fields as the message of `pack_attr()`
+ * (without the timestamp).
+ *
+ * @param attrs Attributes to be packed.
+ * @param count Number of attributes.
+ * @param jsonStr The String object where the serialized JSON data will be stored.
+ *
+ * @return `true` if the packing was successful, `false` otherwise.
+ */
+bool pack_attr_batch(const iot_alarm_attr_load_t * attrs, size_t count, String * jsonStr);
+
+/**
+ * @brief Packs the attributes into one aggregated MessagePack message.
+ *
+ * The message has the same structure and keys as the JSON message of `pack_attr_batch()`.
+ *
+ * @param attrs Attributes to be packed.
+ * @param count Number of attributes.
+ * @param buf Buffer where the message is written, `ZIGBEE_ATTR_BATCH_MSGPACK_MAX` bytes fit `ZIGBEE_ATTR_BATCH_MAX`
+ *            attributes.
+ * @param size Size of the buffer.
+ *
+ * @return size_t Length of the message, 0 if the attributes are nullptr or the buffer is too small.
+ */
+size_t pack_attr_batch_msgpack(const iot_alarm_attr_load_t * attrs, size_t count, uint8_t * buf, size_t size);
+
+/**
+ * @brief Packs the summary of a debounce window into a JSON string.
+ *
+ * The message has the same fields as the message of `pack_attr()` (with the last coalesced value) and `count` (number
+ * of the reports in the window) and `span_ms` (time from the first to the last report).
+ *
+ * @param attr Last coalesced report.
+ * @param count Number of the reports in the window.
+ * @param span_ms Time from the first to the last report.
+ * @param jsonStr The String object where the serialized JSON data will be stored.
+ *
+ * @return `true` if the packing was successful, `false` otherwise.
+ */
+bool pack_attr_event(const iot_alarm_attr_load_t * attr, uint32_t count, uint32_t span_ms, String * jsonStr);
+
+/**
+ * @brief Writes an IEEE address as text (most significant byte first, e.g. `00:12:4B:00:1C:A1:B2:C3`).
+ *
+ * @param ieee_addr IEEE address (least significant byte first, as received).
+ * @param str Buffer of at least `ZIGBEE_IEEE_STR_SIZE` characters.
+ *
+ * @return const char* The `str` buffer.
+ */
+const char * zigbee_ieee_str(const esp_zb_ieee_addr_t ieee_addr, char * str);
+
+/**
+ * @brief Packs an attribute into a JSON message in a caller's buffer (no heap allocation).
+ *
+ * The message is byte for byte the same as the message of `pack_attr()`, it is written directly with the fields in
+ * the fixed order, so the publishing task needs no `JsonDocument` and no `String` per report.
+ *
+ * @param attr Attribute to be packed.
+ * @param ieee_str IEEE address of the device as text (see `zigbee_ieee_str()`), it is usually written to the topic
+ *                 as well, so it is formatted only once.
+ * @param buf Buffer where the message is written (null terminated), `ZIGBEE_ATTR_JSON_MAX` bytes fit any attribute.
+ * @param size Size of the buffer.
+ *
+ * @return size_t Length of the message, 0 if the attribute is nullptr or the buffer is too small.
+ *
+ * Example Usage:
+ * @code
+ * char ieee_str[ZIGBEE_IEEE_STR_SIZE];
+ * char json[ZIGBEE_ATTR_JSON_MAX];
+ * size_t len = pack_attr_json(&attr, zigbee_ieee_str(attr.ieee_addr, ieee_str), json, sizeof(json));
+ * if (len > 0) {
+ *     mqtt_publish_raw(topic, json, len);
+ * }
+ * @endcode
+ */
+size_t pack_attr_json(const iot_alarm_attr_load_t * attr, const char * ieee_str, char * buf, size_t size);
+
+/**
+ * @brief Packs the summary of a debounce window into a JSON message in a caller's buffer (no heap allocation).
+ *
+ * The message is the same as the message of `pack_attr_event()`, see `pack_attr_json()`.
+ *
+ * @param attr Last coalesced report.
+ * @param ieee_str IEEE address of the device as text (see `zigbee_ieee_str()`).
+ * @param count Number of the reports in the window.
+ * @param span_ms Time from the first to the last report.
+ * @param buf Buffer where the message is written (null terminated).
+ * @param size Size of the buffer.
+ *
+ * @return size_t Length of the message, 0 if the attribute is nullptr or the buffer is too small.
+ */
+size_t pack_attr_event_json(const iot_alarm_attr_load_t * attr, const char * ieee_str, uint32_t count, uint32_t span_ms, char * buf, size_t size);
+
+/**
+ * @brief Packs an attribute into a MessagePack message in a caller's buffer (no heap allocation).
+ *
+ * The message is a map with the same keys in the same order as the message of `pack_attr_json()`, the numbers are
+ * written in their shortest integer type. It decodes into the same document as the JSON message and it is about
+ * a third shorter (the keys are kept, so the subscribers need no schema).
+ *
+ * @param attr Attribute to be packed.
+ * @param ieee_str IEEE address of the device as text (see `zigbee_ieee_str()`).
+ * @param buf Buffer where the message is written (not null terminated), `ZIGBEE_ATTR_JSON_MAX` bytes fit any attribute.
+ * @param size Size of the buffer.
+ *
+ * @return size_t Length of the message, 0 if the attribute is nullptr or the buffer is too small.
+ *
+ * Example Usage:
+ * @code
+ * uint8_t msgpack[ZIGBEE_ATTR_JSON_MAX];
+ * size_t len = pack_attr_msgpack(&attr, zigbee_ieee_str(attr.ieee_addr, ieee_str), msgpack, sizeof(msgpack));
+ * @endcode
+ */
+size_t pack_attr_msgpack(const iot_alarm_attr_load_t * attr, const char * ieee_str, uint8_t * buf, size_t size);
+
+/**
+ * @brief Packs the summary of a debounce window into a MessagePack message in a caller's buffer (no heap allocation).
+ *
+ * The message has the same keys as the message of `pack_attr_event_json()`, see `pack_attr_msgpack()`.
+ *
+ * @param attr Last coalesced report.
+ * @param ieee_str IEEE address of the device as text (see `zigbee_ieee_str()`).
+ * @param count Number of the reports in the window.
+ * @param span_ms Time from the first to the last report.
+ * @param buf Buffer where the message is written.
+ * @param size Size of the buffer.
+ *
+ * @return size_t Length of the message, 0 if the attribute is nullptr or the buffer is too small.
+ */
+size_t pack_attr_event_msgpack(const iot_alarm_attr_load_t * attr, const char * ieee_str, uint32_t count, uint32_t span_ms, uint8_t * buf, size_t size);
+
+/**
+ * @brief Unpacks a JSON array of attributes (in the format of `unpack_attr()`) into attribute structures.
+ *
+ * @param attrs Array where the attributes are stored.
+ * @param max Size of the array.
+ * @param count Number of unpacked attributes.
+ * @param jsonStr The JSON array.
+ *
+ * @return `false` if the JSON is not an array, it has more than `max` items or an item is invalid, otherwise `true`.
+ */
+bool unpack_attr_batch(iot_alarm_attr_load_t * attrs, size_t max, size_t * count, String jsonStr);
+
+/**
+ * @brief Unpacks a MessagePack array of attributes (in the format of `unpack_attr_msgpack()`) into attribute structures.
+ *
+ * @param attrs Array where the attributes are stored.
+ * @param max Size of the array.
+ * @param count Number of unpacked attributes.
+ * @param load The MessagePack array.
+ * @param len Length of the array.
+ *
+ * @return `false` if the message is not an array, it has more than `max` items or an item is invalid, otherwise `true`.
+ */
+bool unpack_attr_batch_msgpack(iot_alarm_attr_load_t * attrs, size_t max, size_t * count, const uint8_t * load, size_t len);
+
 #endif
@@ -1,30 +1,58 @@
 #include "utils.h"
 
-const char *TAG_SETUP               = "\033[1;32mSETUP       ";
-const char *TAG_RTOS_MAIN           = "\033[1;32mMAIN        ";
-const char *TAG_RTOS_ALARM          = "\033[38;5;202mALARM       ";
-const char *TAG_RTOS_KEYPAD         = "\033[38;5;189mKEYPAD      ";
-const char *TAG_RTOS_WIFI           = "\033[38;5;225mWIFI        ";
-const char *TAG_RTOS_DATETIME       = "\033[38;5;117mDATETIME    ";
-const char *TAG_RTOS_RFID           = "\033[38;5;184mRFID        ";
-const char *TAG_RTOS_GSM            = "\033[38;5;51mGSM         ";
-const char *TAG_RTOS_ZIGBEE         = "\033[38;5;51mZIGBEE      ";
-const char *TAG_RTOS_MQTT           = "\033[38;5;51mMQTT        ";
-const char *TAG_RTOS_DISPLAY        = "\033[38;5;250mDISPLAY     ";
-const char *TAG_RTOS_PERIPHERALS    = "\033[38;5;250mPERIPH      ";
-
-const char *TAG_SERVER              = "\033[38;5;208mSERVER      ";
-
-const char *TAG_LIB_AUTH            = "\033[38;5;250m LIB-AUTH   ";
-const char *TAG_LIB_DISPLAY         = "\033[38;5;250m LIB-DISPLAY";
-const char *TAG_LIB_GSM             = "\033[38;5;250m LIB-GSM    ";
-const char *TAG_LIB_JSON            = "\033[38;5;250m LIB-JSON   ";
-const char *TAG_LIB_KEYPAD          = "\033[38;5;250m LIB-KEYPAD ";
-const char *TAG_LIB_MQTT            = "\033[38;5;250m LIB-MQTT   ";
-const char *TAG_LIB_WIFI            = "\033[38;5;250m LIB-WIFI   ";
-const char *TAG_LIB_ZIGBEE          = "\033[38;5;250m LIB-ZIGBEE ";
-const char *TAG_LIB_UTILS           = "\033[38;5;250m LIB-UTILS  ";
-const char *TAG_LIB_PERIPHERALS     = "\033[38;5;250m LIB-PERIPH ";
+log_tag_t log_tags[TAG_ID_MAX] = {
+    {TAG_ID_SETUP,             "SETUP       ", "\033[1;32m", LOG_LEVEL_DEFAULT},
+    {TAG_ID_RTOS_MAIN,         "MAIN        ", "\033[1;32m", LOG_LEVEL_DEFAULT},
+    {TAG_ID_RTOS_ALARM,        "ALARM       ", "\033[38;5;202m", LOG_LEVEL_DEFAULT},
+    {TAG_ID_RTOS_KEYPAD,       "KEYPAD      ", "\033[38;5;189m", LOG_LEVEL_DEFAULT},
+    {TAG_ID_RTOS_WIFI,         "WIFI        ", "\033[38;5;225m", LOG_LEVEL_DEFAULT},
+    {TAG_ID_RTOS_DATETIME,     "DATETIME    ", "\033[38;5;117m", LOG_LEVEL_DEFAULT},
+    {TAG_ID_RTOS_RFID,         "RFID        ", "\033[38;5;184m", LOG_LEVEL_DEFAULT},
+    {TAG_ID_RTOS_GSM,          "GSM         ", "\033[38;5;51m", LOG_LEVEL_DEFAULT},
+    {TAG_ID_RTOS_ZIGBEE,       "ZIGBEE      ", "\033[38;5;51m", LOG_LEVEL_DEFAULT},
+    {TAG_ID_RTOS_MQTT,         "MQTT        ", "\033[38;5;51m", LOG_LEVEL_DEFAULT},
+    {TAG_ID_RTOS_DISPLAY,      "DISPLAY     ", "\033[38;5;250m", LOG_LEVEL_DEFAULT},
+    {TAG_ID_RTOS_PERIPHERALS,  "PERIPH      ", "\033[38;5;250m", LOG_LEVEL_DEFAULT},
+
+    {TAG_ID_SERVER,            "SERVER      ", "\033[38;5;208m", LOG_LEVEL_DEFAULT},
+
+    {TAG_ID_LIB_AUTH,          " LIB-AUTH   ", "\033[38;5;250m", LOG_LEVEL_DEFAULT},
+    {TAG_ID_LIB_DISPLAY,       " LIB-DISPLAY", "\033[38;5;250m", LOG_LEVEL_DEFAULT},
+    {TAG_ID_LIB_GSM,           " LIB-GSM    ", "\033[38;5;250m", LOG_LEVEL_DEFAULT},
+    {TAG_ID_LIB_JSON,          " LIB-JSON   ", "\033[38;5;250m", LOG_LEVEL_DEFAULT},
+    {TAG_ID_LIB_KEYPAD,        " LIB-KEYPAD ", "\033[38;5;250m", LOG_LEVEL_DEFAULT},
+    {TAG_ID_LIB_MQTT,          " LIB-MQTT   ", "\033[38;5;250m", LOG_LEVEL_DEFAULT},
+    {TAG_ID_LIB_WIFI,          " LIB-WIFI   ", "\033[38;5;250m", LOG_LEVEL_DEFAULT},
+    {TAG_ID_LIB_ZIGBEE,        " LIB-ZIGBEE ", "\033[38;5;250m", LOG_LEVEL_DEFAULT},
+    {TAG_ID_LIB_UTILS,         " LIB-UTILS  ", "\033[38;5;250m", LOG_LEVEL_DEFAULT},
+    {TAG_ID_LIB_PERIPHERALS,   " LIB-PERIPH ", "\033[38;5;250m", LOG_LEVEL_DEFAULT},
+};
+
+const log_tag_t *TAG_SETUP            = &log_tags[TAG_ID_SETUP];
+const log_tag_t *TAG_RTOS_MAIN        = &log_tags[TAG_ID_RTOS_MAIN];
+const log_tag_t *TAG_RTOS_ALARM       = &log_tags[TAG_ID_RTOS_ALARM];
+const log_tag_t *TAG_RTOS_KEYPAD      = &log_tags[TAG_ID_RTOS_KEYPAD];
+const log_tag_t *TAG_RTOS_WIFI        = &log_tags[TAG_ID_RTOS_WIFI];
+const log_tag_t *TAG_RTOS_DATETIME    = &log_tags[TAG_ID_RTOS_DATETIME];
+const log_tag_t *TAG_RTOS_RFID        = &log_tags[TAG_ID_RTOS_RFID];
+const log_tag_t *TAG_RTOS_GSM         = &log_tags[TAG_ID_RTOS_GSM];
+const log_tag_t *TAG_RTOS_ZIGBEE      = &log_tags[TAG_ID_RTOS_ZIGBEE];
+const log_tag_t *TAG_RTOS_MQTT        = &log_tags[TAG_ID_RTOS_MQTT];
+const log_tag_t *TAG_RTOS_DISPLAY     = &log_tags[TAG_ID_RTOS_DISPLAY];
+const log_tag_t *TAG_RTOS_PERIPHERALS = &log_tags[TAG_ID_RTOS_PERIPHERALS];
+
+const log_tag_t *TAG_SERVER           = &log_tags[TAG_ID_SERVER];
+
+const log_tag_t *TAG_LIB_AUTH         = &log_tags[TAG_ID_LIB_AUTH];
+const log_tag_t *TAG_LIB_DISPLAY      = &log_tags[TAG_ID_LIB_DISPLAY];
+const log_tag_t *TAG_LIB_GSM          = &log_tags[TAG_ID_LIB_GSM];
+const log_tag_t *TAG_LIB_JSON         = &log_tags[TAG_ID_LIB_JSON];
+const log_tag_t *TAG_LIB_KEYPAD       = &log_tags[TAG_ID_LIB_KEYPAD];
+const log_tag_t *TAG_LIB_MQTT         = &log_tags[TAG_ID_LIB_MQTT];
+const log_tag_t *TAG_LIB_WIFI         = &log_tags[TAG_ID_LIB_WIFI];
+const log_tag_t *TAG_LIB_ZIGBEE       = &log_tags[TAG_ID_LIB_ZIGBEE];
+const log_tag_t *TAG_LIB_UTILS        = &log_tags[TAG_ID_LIB_UTILS];
+const log_tag_t *TAG_LIB_PERIPHERALS  = &log_tags[TAG_ID_LIB_PERIPHERALS];
 
 void cropSelection(int * selection, int selection_max) {
     if (selection_max == 0) {
@@ -51,160 +79,24 @@ void cycleSelection(int * selection, int selection_max) {
     }
 }
 
-void rebootESP() {
-    esplogW(TAG_LIB_UTILS, NULL, "Rebooting...");
-    delay(2000);
-    ESP.restart();
-}
+// registered during setup, before the tasks which may reboot the device are started
+static void (*reboot_hooks[REBOOT_HOOKS_MAX])();
+static size_t reboot_hooks_count = 0;
 
-bool checkLogFileSize() {
-    File logFile = SD.open(LOG_FILE, FILE_READ);
-    if (!logFile) {
-        esplogW(TAG_LIB_UTILS, NULL, "Failed to open log file for size check!");
+bool rebootAddHook(void (*hook)()) {
+    if (hook == NULL || reboot_hooks_count >= REBOOT_HOOKS_MAX) {
         return false;
     }
-
-    size_t fileSize = logFile.size();
-    logFile.close();
-    
-    if (fileSize >= LOG_FILE_MAX_SIZE) {
-        esplogI(TAG_LIB_UTILS, NULL, "Log file max size was reached! Cleaning logs!");
-        SD.rename(LOG_FILE, LOG_FILE_OLD);
-        esplogI(TAG_LIB_UTILS, NULL, "New log file was created!");
-    }
-
+    reboot_hooks[reboot_hooks_count++] = hook;
     return true;
 }
 
-bool esplogI(const char* tag, const char* fx, const char* format, ...) {
-    String log;
-    unsigned long timestamp = millis();
-    va_list args;
-
-    // Format the log message
-    char* formattedMessage;
-    va_start(args, format);
-    if (vasprintf(&formattedMessage, format, args) < 0) {
-        va_end(args);
-        return false; // Failed to format the message
-    }
-    va_end(args);
-
-    if (tag != NULL && tag[0] != '\0' && fx != NULL && fx[0] != '\0') {
-        Serial.printf("\033[1;32mI [%lu]\033[1;39m %s: %s \033[1;90m(fx: %s)\033[0m\n", timestamp, tag, formattedMessage, fx);
-    } else if (tag != NULL && tag[0] != '\0') {
-        Serial.printf("\033[1;32mI [%lu]\033[1;39m %s: %s\033[0m\n", timestamp, tag, formattedMessage);
-    } else {
-        Serial.printf("\033[1;32mI [%lu]\033[1;39m %s\033[0m\n", timestamp, formattedMessage);
-    }
-
-    File logFile = SD.open(LOG_FILE, FILE_APPEND);
-    if (!logFile) {
-        Serial.print("\033[1;31m");
-        Serial.printf(" -> failed to log info to file");
-        Serial.print("\033[1;39m\n");
-        free(formattedMessage);
-        return false;
-    }
-
-    if (tag != NULL && tag[0] != '\0' && fx != NULL && fx[0] != '\0') {
-        logFile.printf("I [%lu] %s: %s (fx: %s)", timestamp, tag, formattedMessage, fx);
-    } else if (tag != NULL && tag[0] != '\0') {
-        logFile.printf("I [%lu] %s: %s\n", timestamp, tag, formattedMessage);
-    } else {
-        logFile.printf("I [%lu] %s\n", timestamp, formattedMessage);
-    }
-
-    free(formattedMessage);
-    logFile.close();
-    return true;
-}
-
-bool esplogW(const char* tag, const char* fx, const char* format, ...) {
-    String log;
-    unsigned long timestamp = millis();
-    va_list args;
-
-    // Format the log message
-    char* formattedMessage;
-    va_start(args, format);
-    if (vasprintf(&formattedMessage, format, args) < 0) {
-        va_end(args);
-        return false; // Failed to format the message
-    }
-    va_end(args);
-
-    if (tag != NULL && tag[0] != '\0' && fx != NULL && fx[0] != '\0') {
-        Serial.printf("\033[1;33mW [%lu]\033[1;39m %s: %s \033[1;90m(fx: %s)\033[0m\n", timestamp, tag, formattedMessage, fx);
-    } else if (tag != NULL && tag[0] != '\0') {
-        Serial.printf("\033[1;33mW [%lu]\033[1;39m %s: %s\033[0m\n", timestamp, tag, formattedMessage);
-    } else {
-        Serial.printf("\033[1;33mW [%lu]\033[1;39m %s\033[0m\n", timestamp, formattedMessage);
-    }
-
-    File logFile = SD.open(LOG_FILE, FILE_APPEND);
-    if (!logFile) {
-        Serial.print("\033[1;31m");
-        Serial.printf(" -> failed to log info to file");
-        Serial.print("\033[1;39m\n");
-        free(formattedMessage);
-        return false;
-    }
-
-    if (tag != NULL && tag[0] != '\0' && fx != NULL && fx[0] != '\0') {
-        logFile.printf("W [%lu] %s: %s (fx: %s)", timestamp, tag, formattedMessage, fx);
-    } else if (tag != NULL && tag[0] != '\0') {
-        logFile.printf("W [%lu] %s: %s\n", timestamp, tag, formattedMessage);
-    } else {
-        logFile.printf("W [%lu] %s\n", timestamp, formattedMessage);
+void rebootESP() {
+    esplogW(TAG_LIB_UTILS, NULL, "Rebooting...");
+    delay(2000);
+    for (size_t i = 0; i < reboot_hooks_count; i++) {
+        reboot_hooks[i]();
     }
-
-    free(formattedMessage);
-    logFile.close();
-    return true;
+    logFlush(true);
+    ESP.restart();
 }
-
-bool esplogE(const char* tag, const char* fx, const char* format, ...) {
-    String log;
-    unsigned long timestamp = millis();
-    va_list args;
-
-    // Format the log message
-    char* formattedMessage;
-    va_start(args, format);
-    if (vasprintf(&formattedMessage, format, args) < 0) {
-        va_end(args);
-        return false; // Failed to format the message
-    }
-    va_end(args);
-
-    if (tag != NULL && tag[0] != '\0' && fx != NULL && fx[0] != '\0') {
-        Serial.printf("\033[1;31mE\033[1;39m [%lu] %s: %s (fx: %s)\033[0m\n", timestamp, tag, formattedMessage, fx);
-    } else if (tag != NULL && tag[0] != '\0') {
-        Serial.printf("\033[1;31mE\033[1;39m [%lu] %s: %s\033[0m\n", timestamp, tag, formattedMessage);
-    } else {
-        Serial.printf("\033[1;31mE\033[1;39m [%lu] %s\033[0m\n", timestamp, formattedMessage);
-    }
-
-    File logFile = SD.open(LOG_FILE, FILE_APPEND);
-    if (!logFile) {
-        Serial.print("\033[1;31m");
-        Serial.printf(" -> failed to log info to file");
-        Serial.print("\033[1;39m\n");
-        free(formattedMessage);
-        return false;
-    }
-
-    if (tag != NULL && tag[0] != '\0' && fx != NULL && fx[0] != '\0') {
-        logFile.printf("E [%lu] %s: %s (fx: %s)", timestamp, tag, formattedMessage, fx);
-    } else if (tag != NULL && tag[0] != '\0') {
-        logFile.printf("E [%lu] %s: %s\n", timestamp, tag, formattedMessage);
-    } else {
-        logFile.printf("E [%lu] %s\n", timestamp, formattedMessage);
-    }
-
-    free(formattedMessage);
-    logFile.close();
-    rebootESP();
-    return true;
-}
\ No newline at end of file
@@ -15,9 +15,12 @@ TaskHandle_t handleTaskRfid = NULL;
 TaskHandle_t handleTaskDisplay = NULL;
 TaskHandle_t handleTaskNotifications = NULL;
 TaskHandle_t handleTaskZigbee = NULL;
+TaskHandle_t handleTaskZigbeePublish = NULL;
 TaskHandle_t handleTaskMqtt = NULL;
+TaskHandle_t handleTaskMqttCommand = NULL;
 TaskHandle_t handleTaskMenuRefresh = NULL;
 TaskHandle_t handleTaskRfidRefresh = NULL;
+TaskHandle_t handleTaskLog = NULL;
 
 // QueueHandle_t queueMqtt;
 QueueHandle_t queueNotification;
@@ -109,15 +112,15 @@ void setup() {
       delay(1000);
   }
 
-  // clear esp memory from previous app run
-  SD.remove(LOG_FILE);
-  SD.remove(LOG_FILE_OLD);
   Serial.println();
+
+  // init logger (the log segments of previous runs are kept), until the log writer task is started the logs are written synchronously
+  initLog();
   esplogI(TAG_SETUP, NULL, "ESP Started");
 
   // load configuration
   loadConfig(&g_config, CONFIG_FILE);
-  esplogI(TAG_SETUP, NULL, "Config:\n - ssid: %s\n - pswd: %s\n - ip: %s\n - gtw: %s\n - sbnt: %s", g_config.wifi_ssid, g_config.wifi_pswd.c_str(), g_config.wifi_ip.c_str(), g_config.wifi_gtw.c_str(), g_config.wifi_sbnt.c_str());
+  esplogI(TAG_SETUP, NULL, "Config:\n - ssid: %s\n - pswd: %s\n - ip: %s\n - gtw: %s\n - sbnt: %s", g_config.wifi_ssid.c_str(), g_config.wifi_pswd.c_str(), g_config.wifi_ip.c_str(), g_config.wifi_gtw.c_str(), g_config.wifi_sbnt.c_str());
 
   // init display EINK
 #ifdef EINK
@@ -153,6 +156,26 @@ void setup() {
     esplogW(TAG_SETUP, NULL, "Failed to initialise Zigbee module!");
   }
 
+  // init MQTT message archive (the daily log files are written by the log task)
+  if (!mqtt_log_init()) {
+    esplogW(TAG_SETUP, NULL, "Failed to initialise MQTT message archive!");
+  }
+
+  // init MQTT outbox (the messages queued before a reset are published after the first connection)
+  if (!mqtt_outbox_init()) {
+    esplogW(TAG_SETUP, NULL, "Failed to initialise MQTT outbox!");
+  }
+
+  // init MQTT client lock (the client is shared by the mqtt task and the publishing tasks)
+  if (!mqtt_client_init()) {
+    esplogW(TAG_SETUP, NULL, "Failed to initialise MQTT client lock!");
+  }
+
+  // init MQTT command queues (the commands are executed by the mqttcmd task, not by mqtt.loop())
+  if (!mqtt_command_init()) {
+    esplogW(TAG_SETUP, NULL, "Failed to initialise MQTT command queues!");
+  }
+
   // init rfid
   mfrc522.PCD_Init(RFID_CS_PIN, RFID_RST_PIN);
   esplogI(TAG_SETUP, NULL, "RFID reader: ");
@@ -169,13 +192,18 @@ void setup() {
   // queue initialisation
   queueNotification = xQueueCreate(10, sizeof(notification_t));
 
+  // start log writer task
+  xTaskCreate(rtosLog, "log", 4096, NULL, 1, &handleTaskLog);
+
   // start support tasks
   xTaskCreate(rtosKeypad, "keypad", 8192, NULL, 3, &handleTaskKeypad);
   xTaskCreate(rtosRfid, "rfid", 4096, NULL, 3, &handleTaskRfid);
   xTaskCreate(rtosDisplay, "display", 8192, NULL, 4, &handleTaskDisplay);
   xTaskCreate(rtosNotifications, "notifications", 8192, NULL, 2, &handleTaskNotifications);
-  // xTaskCreate(rtosZigbee, "zigbee", 8192, NULL, 4, &handleTaskZigbee);
+  xTaskCreate(rtosZigbee, "zigbee", 8192, NULL, 4, &handleTaskZigbee);
+  xTaskCreate(rtosZigbeePublish, "zigbeepub", 8192, NULL, 2, &handleTaskZigbeePublish);
   xTaskCreatePinnedToCore(rtosMqtt, "mqtt", 8192, NULL, 2, &handleTaskMqtt, CONFIG_ARDUINO_RUNNING_CORE);
+  xTaskCreate(rtosMqttCommand, "mqttcmd", 8192, NULL, 2, &handleTaskMqttCommand);
   xTaskCreatePinnedToCore(rtosDatetime, "datetime", 4096, NULL, 1, &handleTaskDatetime, CONFIG_ARDUINO_RUNNING_CORE);
   xTaskCreatePinnedToCore(rtosWiFi, "wifi", 8192, NULL, 1, &handleTaskWiFi, CONFIG_ARDUINO_RUNNING_CORE);
 
@@ -186,6 +214,10 @@ void setup() {
   esplogI(TAG_SETUP, NULL, "All tasks created successfully!");
   esplogI(TAG_SETUP, NULL, "--------------------------------------------------------------------------------");
 
+#ifdef ZIGBEE_LATENCY_PROBE
+  zigbeeLatencyProbe(ZIGBEE_LATENCY_PROBE);
+#endif
+
   // start application
   vTaskDelay(2000 / portTICK_PERIOD_MS);
   xTaskCreate(rtosMenu, "menu", 16384, NULL, 5, &handleTaskMenu);
@@ -198,6 +230,20 @@ void loop() {
   vTaskDelay(100 * 60 * 1000 / portTICK_PERIOD_MS);
 }
 
+// -------------------------------------------------------------------------------------------------------------
+/* LOG WRITER */
+
+void rtosLog(void* parameters) {
+  for(;;) {
+    // wait for warning/error records or for the writer period, then write out all pending records
+    ulTaskNotifyTake(pdTRUE, LOG_WRITER_PERIOD_MS / portTICK_PERIOD_MS);
+    logFlush();
+
+    // the MQTT archive lines are written once the oldest of them is MQTT_LOG_FLUSH_MS old
+    mqtt_log_flush(false);
+  }
+}
+
 // -------------------------------------------------------------------------------------------------------------
 /* STATE AUTO REFRESHER */
 
@@ -304,7 +350,7 @@ void rtosDatetime(void* parameters) {
 
     g_vars.refresh_display.refresh_datetime = true;
     vTaskDelay(60 * 1000 / portTICK_PERIOD_MS);
-    esplogI(TAG_RTOS_DATETIME, NULL, "Time has been updated! %s %s", g_vars.date, g_vars.time);
+    esplogI(TAG_RTOS_DATETIME, NULL, "Time has been updated! %s %s", g_vars.date.c_str(), g_vars.time.c_str());
   }
 }
 
@@ -517,6 +563,7 @@ void rtosMqtt(void* parameters) {
 
   while (g_vars.wifi_status != WL_CONNECTED) {vTaskDelay(2000 / portTICK_PERIOD_MS);}
 
+  mqtt_client_lock();
   if (g_config.mqtt_tls) {
     mqttwificlientsecure.setCACert(g_config.mqtt_cert.c_str());
     mqtt.setClient(mqttwificlientsecure);
@@ -527,14 +574,17 @@ void rtosMqtt(void* parameters) {
   }
   
   mqtt.setCallback(mqtt_callback);
-  mqtt.setBufferSize(1024);
+  mqtt.setBufferSize(MQTT_BUFFER_SIZE);
+  mqtt_client_unlock();
 
   for(;;) {
-    // if disconnected, reconnect
-    while (!mqtt.connected()) {
-      if (mqtt.connect(g_config.mqtt_id.c_str(), g_config.mqtt_username.c_str(), g_config.mqtt_password.c_str())) {
+    // if disconnected, reconnect (the client is locked only around its own calls, the outbox is locked before it)
+    while (!mqtt_client_connected()) {
+      mqtt_outbox_link(false);
+      mqtt_client_lock();
+      bool connected = mqtt.connect(g_config.mqtt_id.c_str(), g_config.mqtt_username.c_str(), g_config.mqtt_password.c_str());
+      if (connected) {
         esplogI(TAG_RTOS_MQTT, NULL, "MQTT server connected!");
-        displayNotification(NOTIFICATION_MQTT_CONNECTED);
         // subscribe to topics
         if (mqtt.subscribe(String(g_config.mqtt_topic + String("/read/in/#")).c_str())) {
           esplogI(TAG_RTOS_MQTT, NULL, "Subscribed to: %s", String(g_config.mqtt_topic + String("/read/in")).c_str());
@@ -543,6 +593,27 @@ void rtosMqtt(void* parameters) {
         if (mqtt.subscribe(String(g_config.mqtt_topic + String("/write/in/#")).c_str())) {
           esplogI(TAG_RTOS_MQTT, NULL, "Subscribed to: %s", String(g_config.mqtt_topic + String("/write/in")).c_str());
         }
+
+        if (mqtt.subscribe(String(g_config.mqtt_topic + String("/log/level/in/#")).c_str())) {
+          esplogI(TAG_RTOS_MQTT, NULL, "Subscribed to: %s", String(g_config.mqtt_topic + String("/log/level/in")).c_str());
+        }
+
+        if (mqtt.subscribe(String(g_config.mqtt_topic + String("/device/in/#")).c_str())) {
+          esplogI(TAG_RTOS_MQTT, NULL, "Subscribed to: %s", String(g_config.mqtt_topic + String("/device/in")).c_str());
+        }
+
+        if (mqtt.subscribe(String(g_config.mqtt_topic + String("/rules/in/#")).c_str())) {
+          esplogI(TAG_RTOS_MQTT, NULL, "Subscribed to: %s", String(g_config.mqtt_topic + String("/rules/in")).c_str());
+        }
+      }
+      mqtt_client_unlock();
+
+      if (connected) {
+        mqtt_outbox_link(true);
+        displayNotification(NOTIFICATION_MQTT_CONNECTED);
+
+        // publish the last log records of the previous run (only once, after reset)
+        mqtt_publish_crash_report();
         
       } else {
         esplogW(TAG_RTOS_MQTT, NULL, "Failed to connect to MQTT server! (%s)", g_config.mqtt_broker.c_str());
@@ -551,167 +622,73 @@ void rtosMqtt(void* parameters) {
       }
     }
 
+    mqtt_client_lock();
     mqtt.loop();
+    mqtt_client_unlock();
+
+    // publish the messages queued during an outage (rate limited)
+    mqtt_outbox_drain();
     vTaskDelay(500 / portTICK_PERIOD_MS);
   }
 }
 
+// -------------------------------------------------------------------------------------------------------------
+/* MQTT COMMAND HANDELER */
+
+void rtosMqttCommand(void* parameters) {
+  // commands received by mqtt_callback() are executed here, the results are published to <topic>/command/out
+  for (;;) {
+    mqtt_command_process(1000 / portTICK_PERIOD_MS);
+  }
+}
+
 // -------------------------------------------------------------------------------------------------------------
 /* ZIGBEE COMMUNICATION HANDELER */
 
 void rtosZigbee(void* parameters) {
   // esplogI("[setup]: rtosZigbee task was created!\n");
-  esp_zb_ieee_addr_t ieee_addr;
   iot_alarm_message_t * msg = create_message(IOT_ALARM_MSGDIR_MAX, IOT_ALARM_MSGSTATUS_MAX, IOT_ALARM_MSGTYPE_MAX, 1, "\0");
-  iot_alarm_message_t * msg_ack = create_message(IOT_ALARM_MSGDIR_MAX, IOT_ALARM_MSGSTATUS_MAX, IOT_ALARM_MSGTYPE_MAX, 1, "\0");
 
-  iot_alarm_attr_load_t * msg_load = create_attr("\0", "\0", "\0", 0, ieee_addr, 0, 0, 0, 0, 0, ESP_ZB_ZCL_ATTR_TYPE_U8, 0);
-  iot_alarm_attr_load_t * msg_load_prev = create_attr("\0", "\0", "\0", 0, ieee_addr, 0, 0, 0, 0, 0, ESP_ZB_ZCL_ATTR_TYPE_U8, 0);
-
-  if (msg == NULL || msg_ack == NULL || msg_load == NULL || msg_load_prev == NULL) {
+  if (msg == NULL) {
     esplogE(TAG_RTOS_ZIGBEE, NULL, "Failed to allocate memory for zigbee messages! Rebooting...");
   }
   
   for(;;) {
-    if (SerialZigbee.available()) {
-      int rx_bytes = receive_message(UART, rx_buffer, &msg, RX_BUF_SIZE-1);
-
-      // handeling of unusable messages
-      if (msg->dir >= IOT_ALARM_MSGDIR_MAX || msg->dir < 0 ||
-          msg->id >= IOT_ALARM_MSGTYPE_MAX || msg->id <= 0 ||
-          msg->st >= IOT_ALARM_MSGSTATUS_MAX || msg->st < 0) {
-        esplogW(TAG_RTOS_ZIGBEE, NULL, "Invalid message has been received!");
-        continue;
-      }
-
-      // handeling of acknowladges
-      if (msg->dir == IOT_ALARM_MSGDIR_COMMAND_ACK || msg->dir == IOT_ALARM_MSGDIR_NOTIFICATION_ACK) {
-        esplogI(TAG_RTOS_ZIGBEE, NULL,"Acknowledgement message has been received!");
-        continue;
-      }
-
-      // send acknowledge
-      if (msg->dir == IOT_ALARM_MSGDIR_NOTIFICATION) {
-        msg_ack->dir = IOT_ALARM_MSGDIR_NOTIFICATION_ACK; msg_ack->id = msg->id; msg_ack->st = IOT_ALARM_MSGSTATUS_SUCCESS;
-        send_message(UART, tx_buffer, msg_ack);
-      } else if (msg->dir == IOT_ALARM_MSGDIR_COMMAND) {
-        msg_ack->dir = IOT_ALARM_MSGDIR_COMMAND_ACK; msg_ack->id = msg->id; msg_ack->st = IOT_ALARM_MSGSTATUS_SUCCESS;
-        send_message(UART, tx_buffer, msg_ack);
-      }
-
-      // handle received messages
-      if (rx_bytes > 0) {
-        esplogI(TAG_RTOS_ZIGBEE, NULL,"Message (length: %d) received: DIR: %d, ID: %d, STATUS: %d, LEN: %d, LOAD: %s", rx_bytes, msg->dir, msg->id, msg->st, msg->length, msg->load);
-        uint8_t duration;
-        uint8_t device_count;
-        switch (msg->id) {
-          case IOT_ALARM_MSGTYPE_DEV_COUNT:
-            if (msg->load != NULL) {
-              device_count = (uint8_t)atoi(msg->load);
-              displayNotification(NOTIFICATION_ZIGBEE_DEV_COUNT, (int)device_count);
-            }
-            break;
-
-          case IOT_ALARM_MSGTYPE_ZB_DATA_READ:
-            if (msg->load != NULL) {
-              deserialize_attr(&msg_load, (uint8_t*)msg->load, RX_BUF_SIZE-1);
-              if (compare_attr(*msg_load, *msg_load_prev)) {continue;}
-
-              // push to mqtt
-              String load;
-              if (pack_attr(msg_load, &load)) {
-                  char ieee_str[41];
-                  sprintf(ieee_str, "%02X:%02X:%02X:%02X:%02X:%02X:%02X:%02X",
-                      msg_load->ieee_addr[7], msg_load->ieee_addr[6], msg_load->ieee_addr[5], msg_load->ieee_addr[4],
-                      msg_load->ieee_addr[3], msg_load->ieee_addr[2], msg_load->ieee_addr[1], msg_load->ieee_addr[0]);
-                  String topic = g_config.mqtt_topic + String("/read/out/") + ieee_str;
-                  mqtt_publish(topic, load);
-              }
-
-              zigbeeAttrReadWriteHandler(msg_load);
-              copy_attr(msg_load, msg_load_prev);
-            }
-            break;
+    // returns as soon as a complete frame is received or the next outstanding command has to be sent again
+    int rx_bytes = receive_message(UART, rx_buffer, &msg, RX_BUF_SIZE-1, zigbee_command_poll());
+    zigbee_debounce_poll();
+    if (rx_bytes > 0) {
+      // acknowledges, decodes the attributes, runs the report rules and queues the publish jobs
+      zigbee_message_dispatch(msg, rx_bytes);
+    }
+  }
 
-          case IOT_ALARM_MSGTYPE_ZB_DATA_WRITE:
-            if (msg->load != NULL) {
-              deserialize_attr(&msg_load, (uint8_t*)msg->load, RX_BUF_SIZE-1);
-              if (compare_attr(*msg_load, *msg_load_prev)) {continue;}
-
-              // push to mqtt
-              String load;
-              if (pack_attr(msg_load, &load)) {
-                  char ieee_str[41];
-                  sprintf(ieee_str, "%02X:%02X:%02X:%02X:%02X:%02X:%02X:%02X",
-                      msg_load->ieee_addr[7], msg_load->ieee_addr[6], msg_load->ieee_addr[5], msg_load->ieee_addr[4],
-                      msg_load->ieee_addr[3], msg_load->ieee_addr[2], msg_load->ieee_addr[1], msg_load->ieee_addr[0]);
-                  String topic = g_config.mqtt_topic + String("/write/out/") + ieee_str;
-                  mqtt_publish(topic, load);
-              }
-
-              zigbeeAttrReadWriteHandler(msg_load);
-              copy_attr(msg_load, msg_load_prev);
-            }
-            break;
+  destroy_message(&msg);
+}
 
-          case IOT_ALARM_MSGTYPE_ZB_DATA_REPORT:
-            if (msg->load != NULL) {
-              deserialize_attr(&msg_load, (uint8_t*)msg->load, RX_BUF_SIZE-1);
-              if (compare_attr(*msg_load, *msg_load_prev)) {continue;}
-
-              esplogI(TAG_RTOS_ZIGBEE, NULL, "Attr report obtained: short: %04hx, ieee: %02X:%02X:%02X:%02X:%02X:%02X:%02X:%02X, dev_id: %d, ep_id: %d, cluster_id: %04hx, attr_id: %04hx, value: %lu",
-                  msg_load->short_addr,
-                  msg_load->ieee_addr[7], msg_load->ieee_addr[6], msg_load->ieee_addr[5], msg_load->ieee_addr[4],
-                  msg_load->ieee_addr[3], msg_load->ieee_addr[2], msg_load->ieee_addr[1], msg_load->ieee_addr[0],
-                  msg_load->device_id, msg_load->endpoint_id, msg_load->cluster_id, msg_load->attr_id, msg_load->value);
-
-              // push to mqtt
-              String load;
-              if (pack_attr(msg_load, &load)) {
-                  char ieee_str[41];
-                  sprintf(ieee_str, "%02X:%02X:%02X:%02X:%02X:%02X:%02X:%02X",
-                      msg_load->ieee_addr[7], msg_load->ieee_addr[6], msg_load->ieee_addr[5], msg_load->ieee_addr[4],
-                      msg_load->ieee_addr[3], msg_load->ieee_addr[2], msg_load->ieee_addr[1], msg_load->ieee_addr[0]);
-                  String topic = g_config.mqtt_topic + String("/report/") + ieee_str;
-                  mqtt_publish(topic, load);
-              }
-
-              zigbeeAttrReportHandler(msg_load);
-              copy_attr(msg_load, msg_load_prev);
-            }
-            break;
+// -------------------------------------------------------------------------------------------------------------
+/* ZIGBEE PUBLISH HANDELER */
 
-          case IOT_ALARM_MSGTYPE_ZB_DEV_LOCK:
-            displayNotification(NOTIFICATION_ZIGBEE_NET_CLOSE);
-            break;
+void rtosZigbeePublish(void* parameters) {
+  zigbee_publish_job_t job;
 
-          case IOT_ALARM_MSGTYPE_ZB_DEV_UNLOCK:
-            duration = (uint8_t)atoi(msg->load);
-            displayNotification(NOTIFICATION_ZIGBEE_NET_OPEN, (int)duration);
-            break;
+  // the topic prefix is written once and the messages are packed into fixed buffers (see mqtt_zigbee_publish())
+  mqtt_zigbee_init();
 
-          case IOT_ALARM_MSGTYPE_ZB_DEV_NEW:
-            displayNotification(NOTIFICATION_ZIGBEE_DEV_ANNCE);
-            break;
+  for(;;) {
+    // the device database is written here, so the SD card never delays the zigbee task
+    device_registry_save();
 
-          case IOT_ALARM_MSGTYPE_ZB_DEV_LEAVE:
-            displayNotification(NOTIFICATION_ZIGBEE_DEV_LEAVE);
-            break;
-          
-          default:
-            break;
-        }
-      }
+    // the batches which are due are published first, the wait for the next job ends when the next batch is due
+    uint32_t wait_ms = mqtt_batch_poll();
 
-    } else {
-      vTaskDelay(200 / portTICK_PERIOD_MS);
+    // the alarm-relevant reports and the responses are taken before the telemetry
+    if (!zigbee_publish_dequeue(&job, wait_ms / portTICK_PERIOD_MS)) {
+      continue;
     }
-  }
 
-  destroy_message(&msg);
-  destroy_message(&msg_ack);
-  destroy_attr(&msg_load);
-  destroy_attr(&msg_load_prev);
+    mqtt_zigbee_publish(&job);
+  }
 }
 
 // -------------------------------------------------------------------------------------------------------------
@@ -1119,8 +1096,7 @@ void rtosMenu(void* parameters) {
             esplogI(TAG_RTOS_MAIN, NULL, "Hard reseting IoT Alarm! Re-creating configuration data.");
             SD.remove(CONFIG_FILE);
             SD.remove(CONFIG_UPLOAD_FILE);
-            SD.remove(LOG_FILE);
-            SD.remove(LOG_FILE_OLD);
+            logClear();
             SD.remove(LOCK_FILE);
             SD.remove(RFID_FILE);
             displayRestart();
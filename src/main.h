@@ -73,9 +73,15 @@ void rtosNotifications(void* parameters);
 extern TaskHandle_t handleTaskZigbee;
 void rtosZigbee(void* parameters);
 
+extern TaskHandle_t handleTaskZigbeePublish;
+void rtosZigbeePublish(void* parameters);
+
 extern TaskHandle_t handleTaskMqtt;
 void rtosMqtt(void* parameters);
 
+extern TaskHandle_t handleTaskMqttCommand;
+void rtosMqttCommand(void* parameters);
+
 // REFRESH TASKS
 
 extern TaskHandle_t handleTaskMenuRefresh;
@@ -84,6 +90,11 @@ void rtosMenuRefresh(void* parameters);
 extern TaskHandle_t handleTaskRfidRefresh;
 void rtosRfidRefresh(void* parameters);
 
+// LOGGING TASKS
+
+extern TaskHandle_t handleTaskLog;
+void rtosLog(void* parameters);
+
 /**
  * @brief Initializes hardware peripherals, configurations, and FreeRTOS tasks for the application.
  *
@@ -91,7 +102,7 @@ void rtosRfidRefresh(void* parameters);
  *  - Initializes serial communication.
  *  - Sets up I2C and SPI communication buses.
  *  - Mounts the SD card and checks for availability.
- *  - Clears previous log files from the SD card.
+ *  - Initialises the logger (the log segments of the previous runs are kept on the SD card).
  *  - Loads the device configuration from the SD card.
  *  - Initializes the display (EINK or LCD).
  *  - Initializes the keypad, output devices, GSM module, Zigbee module, and RFID reader.
@@ -101,10 +112,19 @@ void rtosRfidRefresh(void* parameters);
  * @note The function halts execution in a blocking loop if critical initializations fail, such as mounting the SD card.
  *
  * Tasks Created:
+ *  - `log`: Writes the buffered log records to the serial monitor and SD card (lowest priority).
  *  - `keypad`: Handles keypad input.
  *  - `rfid`: Manages RFID reader operations.
  *  - `display`: Controls display updates.
  *  - `notifications`: Manages notifications.
+ *  - `zigbee`: Receives the frames from the Zigbee module (blocks on the UART driver events, so it wakes up as soon as a frame arrives),
+ *    matches the acknowledges with the outstanding commands and sends the not acknowledged commands again.
+ *    The received attributes are classified and the alarm rules are evaluated right away.
+ *  - `zigbeepub`: Publishes the received attributes to MQTT and logs them to the SD card (the alarm-relevant reports first,
+ *    see `zigbee_publish_enqueue()`) and keeps the device database on the SD card up to date (see `device_registry_save()`).
+ *    The telemetry reports are batched per device when `mqtt_batch_ms` is configured (see `mqtt_batch_add()`),
+ *    the batched read/write responses are packed into one message and the device metadata are published here as well
+ *    (see `zigbee_publish_batch()` and `zigbee_publish_device()`).
  *  - `mqtt`: Manages MQTT communication (pinned to the main core).
  *  - `datetime`: Manages date and time synchronization (pinned to the main core).
  *  - `wifi`: Handles Wi-Fi connectivity (pinned to the main core).
@@ -0,0 +1,138 @@
+/**
+ * @file ncp.h
+ * @brief Zigbee module stand-in shared by the native tests.
+ *
+ * The stand-in takes the frames written to the Zigbee UART and acknowledges every command with success, the same as
+ * the module does. The tests use it to bring the Zigbee stack up with `initSerialZigbee()` (UART driver, command table,
+ * device registry, rule table and publish queues) and to send notifications to the receiving code.
+ *
+ * The tests which talk to `tools/zigbee_ncp_sim.py` attach its pseudo-terminal instead (see `nativeUartAttach()`).
+ */
+
+#ifndef NCP_H_DEFINITION
+#define NCP_H_DEFINITION
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "libZigbee.h"
+#include "native.h"
+
+static std::atomic<bool> ncp_running(false);
+static std::thread ncp_thread;
+static bool ncp_ready = false;
+
+/**
+ * @brief Encodes a message into a frame of the link protocol.
+ *
+ * @return Frame bytes (empty if the load does not fit into a frame).
+ */
+static inline std::vector<uint8_t> ncpFrame(message_direction_t dir, message_status_t st, message_type_t id, uint8_t seq, const void * load, size_t len) {
+    // serialize_message() writes a null behind the load
+    std::vector<uint8_t> payload(16 + len + 1);
+    std::vector<uint8_t> frame(16 + len + ZIGBEE_FRAME_OVERHEAD);
+    size_t bytes = 0;
+
+    iot_alarm_message_t msg = {dir, st, id, (uint32_t)len, (char *)load, 0, seq};
+    serialize_message(&msg, payload.data(), &bytes);
+    frame.resize(encode_frame(seq, payload.data(), bytes, frame.data(), frame.size()));
+    return frame;
+}
+
+/**
+ * @brief Packs the load of the DEV_INFO notification the module sends when a device joins (see `device_registry_update()`).
+ *
+ * The fields are laid out as in `zigbee_device_t`, the strings are truncated to its fields (null terminated).
+ *
+ * @return `ZIGBEE_DEV_INFO_SIZE` bytes (without the endpoint list).
+ */
+static inline std::vector<uint8_t> ncpDevInfo(uint16_t handle, const iot_alarm_attr_load_t * attr) {
+    zigbee_device_t dev;
+    std::vector<uint8_t> info(ZIGBEE_DEV_INFO_SIZE, 0);
+    size_t offset = 0;
+
+    memcpy(&info[offset], &handle, sizeof(dev.handle));
+    offset += sizeof(dev.handle);
+    memcpy(&info[offset], attr->ieee_addr, sizeof(dev.ieee_addr));
+    offset += sizeof(dev.ieee_addr);
+    memcpy(&info[offset], &attr->short_addr, sizeof(dev.short_addr));
+    offset += sizeof(dev.short_addr);
+    memcpy(&info[offset], &attr->device_id, sizeof(dev.device_id));
+    offset += sizeof(dev.device_id);
+    memcpy(&info[offset], &attr->type_id, sizeof(dev.type_id));
+    offset += sizeof(dev.type_id);
+    strncpy((char *)&info[offset], attr->type, sizeof(dev.type) - 1);
+    offset += sizeof(dev.type);
+    strncpy((char *)&info[offset], attr->manuf, sizeof(dev.manuf) - 1);
+    offset += sizeof(dev.manuf);
+    strncpy((char *)&info[offset], attr->name, sizeof(dev.name) - 1);
+    return info;
+}
+
+/**
+ * @brief Sends a notification to the Zigbee UART as the module does.
+ */
+static inline void ncpNotify(message_type_t id, uint8_t seq, const void * load, size_t len) {
+    std::vector<uint8_t> frame = ncpFrame(IOT_ALARM_MSGDIR_NOTIFICATION, IOT_ALARM_MSGSTATUS_SUCCESS, id, seq, load, len);
+    nativeUartFeed(UART, frame.data(), frame.size());
+}
+
+// acknowledges the commands taken from the UART until ncpStop()
+static inline void ncp_respond() {
+    static uint8_t payload[ZIGBEE_COMMAND_FRAME_MAX];
+    zigbee_frame_parser_t parser;
+    iot_alarm_message_t * msg = create_message(IOT_ALARM_MSGDIR_MAX, IOT_ALARM_MSGSTATUS_MAX, IOT_ALARM_MSGTYPE_MAX, 1, "\0");
+
+    frame_parser_init(&parser, payload, sizeof(payload));
+    while (ncp_running) {
+        std::vector<uint8_t> taken = nativeUartTaken(UART);
+        for (uint8_t byte : taken) {
+            int length = frame_parser_feed(&parser, byte);
+            if (length > 0 && deserialize_message(&msg, payload, length) && msg->dir == IOT_ALARM_MSGDIR_COMMAND) {
+                std::vector<uint8_t> ack = ncpFrame(IOT_ALARM_MSGDIR_COMMAND_ACK, IOT_ALARM_MSGSTATUS_SUCCESS, msg->id, parser.seq, "\0", 1);
+                nativeUartFeed(UART, ack.data(), ack.size());
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    destroy_message(&msg);
+}
+
+/**
+ * @brief Starts the stand-in and initializes the Zigbee stack once (allocates the global UART buffers if needed).
+ *
+ * @return `true` if `initSerialZigbee()` succeeded.
+ */
+static inline bool ncpStart() {
+    if (tx_buffer == NULL) {
+        tx_buffer = (uint8_t*)malloc(TX_BUF_SIZE + 1);
+    }
+    if (rx_buffer == NULL) {
+        rx_buffer = (uint8_t*)malloc(RX_BUF_SIZE + 1);
+    }
+
+    if (!ncp_running) {
+        ncp_running = true;
+        ncp_thread = std::thread(ncp_respond);
+    }
+    // the UART driver is installed once
+    if (!ncp_ready) {
+        ncp_ready = initSerialZigbee();
+    }
+    return ncp_ready;
+}
+
+/**
+ * @brief Stops acknowledging the commands.
+ */
+static inline void ncpStop() {
+    ncp_running = false;
+    if (ncp_thread.joinable()) {
+        ncp_thread.join();
+    }
+}
+
+#endif
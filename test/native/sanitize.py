@@ -0,0 +1,4 @@
+# The sanitizer runtimes are linked in as well (build_flags reach only the compiler).
+Import("env")
+
+env.Append(LINKFLAGS=["-fsanitize=address,undefined"])
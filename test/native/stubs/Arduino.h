@@ -0,0 +1,218 @@
+/**
+ * @file Arduino.h
+ * @brief Host stand-in of the Arduino core used by the native tests.
+ *
+ * Only the part of the API used by the tested libraries is provided. `String` keeps its text in `std::string`,
+ * `Print` and `Stream` are the base classes of `HardwareSerial` and `File` (so ArduinoJson can read and write them)
+ * and `millis()` follows the host monotonic clock (the tests can move it forward by `nativeAdvanceMillis()`).
+ */
+
+#ifndef NATIVE_ARDUINO_H_DEFINITION
+#define NATIVE_ARDUINO_H_DEFINITION
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_attr.h"
+#include "esp_system.h"
+
+#define HIGH 0x1
+#define LOW 0x0
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+
+#define DEC 10
+#define HEX 16
+
+#define PROGMEM
+#define F(string) (string)
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+// newlib of the ESP32 has strlcpy(), glibc only since 2.38
+#if defined(__GLIBC__) && !__GLIBC_PREREQ(2, 38)
+inline size_t strlcpy(char * dst, const char * src, size_t size) {
+    size_t len = strlen(src);
+    if (size > 0) {
+        size_t n = len < size - 1 ? len : size - 1;
+        memcpy(dst, src, n);
+        dst[n] = '\0';
+    }
+    return len;
+}
+#endif
+
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+
+// *********************************************************************************************************************
+
+class String {
+    public:
+        String() {}
+        String(const char * str) : s(str != NULL ? str : "") {}
+        String(const char * str, size_t len) : s(str, len) {}
+        String(const std::string & str) : s(str) {}
+        String(const String & str) = default;
+        String(String && str) = default;
+        explicit String(char c) : s(1, c) {}
+        explicit String(int value, unsigned char base = DEC);
+        explicit String(unsigned int value, unsigned char base = DEC);
+        explicit String(long value, unsigned char base = DEC);
+        explicit String(unsigned long value, unsigned char base = DEC);
+        explicit String(long long value, unsigned char base = DEC);
+        explicit String(unsigned long long value, unsigned char base = DEC);
+        explicit String(float value, unsigned int decimals = 2);
+        explicit String(double value, unsigned int decimals = 2);
+
+        String & operator=(const String & str) = default;
+        String & operator=(String && str) = default;
+        String & operator=(const char * str) {s = str != NULL ? str : ""; return *this;}
+
+        const char * c_str() const {return s.c_str();}
+        unsigned int length() const {return s.length();}
+        bool isEmpty() const {return s.empty();}
+        bool reserve(unsigned int size) {s.reserve(size); return true;}
+        char charAt(unsigned int index) const {return index < s.length() ? s[index] : 0;}
+        char operator[](unsigned int index) const {return charAt(index);}
+        char & operator[](unsigned int index) {return s[index];}
+        void setCharAt(unsigned int index, char c) {if (index < s.length()) {s[index] = c;}}
+
+        bool concat(const String & str) {s += str.s; return true;}
+        bool concat(const char * str) {if (str != NULL) {s += str;} return str != NULL;}
+        bool concat(const char * str, unsigned int len) {if (str != NULL) {s.append(str, len);} return str != NULL;}
+        bool concat(char c) {s += c; return true;}
+        bool concat(int value) {return concat(String(value));}
+        bool concat(unsigned int value) {return concat(String(value));}
+        bool concat(long value) {return concat(String(value));}
+        bool concat(unsigned long value) {return concat(String(value));}
+        bool concat(double value) {return concat(String(value));}
+
+        String & operator+=(const String & str) {concat(str); return *this;}
+        String & operator+=(const char * str) {concat(str); return *this;}
+        String & operator+=(char c) {concat(c); return *this;}
+        String & operator+=(int value) {concat(value); return *this;}
+        String & operator+=(unsigned int value) {concat(value); return *this;}
+        String & operator+=(long value) {concat(value); return *this;}
+        String & operator+=(unsigned long value) {concat(value); return *this;}
+
+        bool equals(const String & str) const {return s == str.s;}
+        bool equals(const char * str) const {return s == (str != NULL ? str : "");}
+        bool equalsIgnoreCase(const String & str) const;
+        bool operator==(const String & str) const {return equals(str);}
+        bool operator==(const char * str) const {return equals(str);}
+        bool operator!=(const String & str) const {return !equals(str);}
+        bool operator!=(const char * str) const {return !equals(str);}
+        bool operator<(const String & str) const {return s < str.s;}
+        int compareTo(const String & str) const {return s.compare(str.s);}
+        bool startsWith(const String & prefix) const {return s.compare(0, prefix.s.length(), prefix.s) == 0;}
+        bool endsWith(const String & suffix) const {return s.length() >= suffix.s.length() && s.compare(s.length() - suffix.s.length(), suffix.s.length(), suffix.s) == 0;}
+
+        int indexOf(char c, unsigned int from = 0) const {size_t i = s.find(c, from); return i == std::string::npos ? -1 : (int)i;}
+        int indexOf(const String & str, unsigned int from = 0) const {size_t i = s.find(str.s, from); return i == std::string::npos ? -1 : (int)i;}
+        int lastIndexOf(char c) const {size_t i = s.rfind(c); return i == std::string::npos ? -1 : (int)i;}
+        String substring(unsigned int from) const {return from < s.length() ? String(s.substr(from)) : String();}
+        String substring(unsigned int from, unsigned int to) const;
+
+        void replace(const String & from, const String & to);
+        void remove(unsigned int index) {if (index < s.length()) {s.erase(index);}}
+        void remove(unsigned int index, unsigned int count) {if (index < s.length()) {s.erase(index, count);}}
+        void toLowerCase();
+        void toUpperCase();
+        void trim();
+        long toInt() const {return strtol(s.c_str(), NULL, 10);}
+        float toFloat() const {return strtof(s.c_str(), NULL);}
+        double toDouble() const {return strtod(s.c_str(), NULL);}
+
+    protected:
+        std::string s;
+};
+
+// result of the concatenation (ArduinoJson recognises it as a string as well)
+class StringSumHelper : public String {
+    public:
+        StringSumHelper(const String & str) : String(str) {}
+        StringSumHelper(const char * str) : String(str) {}
+};
+
+StringSumHelper operator+(const String & lhs, const String & rhs);
+StringSumHelper operator+(const String & lhs, const char * rhs);
+StringSumHelper operator+(const char * lhs, const String & rhs);
+StringSumHelper operator+(const String & lhs, char rhs);
+StringSumHelper operator+(const String & lhs, int rhs);
+StringSumHelper operator+(const String & lhs, unsigned int rhs);
+StringSumHelper operator+(const String & lhs, long rhs);
+StringSumHelper operator+(const String & lhs, unsigned long rhs);
+
+// *********************************************************************************************************************
+
+class Print {
+    public:
+        virtual ~Print() {}
+        virtual size_t write(uint8_t c) = 0;
+        virtual size_t write(const uint8_t * buffer, size_t size);
+        size_t write(const char * str) {return str != NULL ? write((const uint8_t *)str, strlen(str)) : 0;}
+        size_t write(const char * buffer, size_t size) {return write((const uint8_t *)buffer, size);}
+
+        size_t print(const char * str) {return write(str);}
+        size_t print(const String & str) {return write(str.c_str(), str.length());}
+        size_t print(char c) {return write((uint8_t)c);}
+        size_t print(int value, int base = DEC) {return print(String(value, base));}
+        size_t print(unsigned int value, int base = DEC) {return print(String(value, base));}
+        size_t print(long value, int base = DEC) {return print(String(value, base));}
+        size_t print(unsigned long value, int base = DEC) {return print(String(value, base));}
+        size_t print(double value, int decimals = 2) {return print(String(value, decimals));}
+        size_t println() {return write("\r\n");}
+        template <typename T> size_t println(const T & value) {size_t n = print(value); return n + println();}
+        template <typename T> size_t println(const T & value, int format) {size_t n = print(value, format); return n + println();}
+        size_t printf(const char * format, ...) __attribute__((format(printf, 2, 3)));
+        virtual void flush() {}
+};
+
+class Stream : public Print {
+    public:
+        virtual int available() = 0;
+        virtual int read() = 0;
+        virtual int peek() = 0;
+        size_t readBytes(char * buffer, size_t length);
+        size_t readBytes(uint8_t * buffer, size_t length) {return readBytes((char *)buffer, length);}
+        String readString();
+        String readStringUntil(char terminator);
+        void setTimeout(unsigned long timeout) {(void)timeout;}
+};
+
+// the serial monitor is the standard output
+class HardwareSerial : public Stream {
+    public:
+        void begin(unsigned long baud) {(void)baud;}
+        void end() {}
+        operator bool() const {return true;}
+        int available() override {return 0;}
+        int read() override {return -1;}
+        int peek() override {return -1;}
+        size_t write(uint8_t c) override;
+        size_t write(const uint8_t * buffer, size_t size) override;
+        using Print::write;
+        void flush() override;
+};
+
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,11 @@
+/**
+ * @file HardwareSerial.h
+ * @brief Host stand-in of the Arduino serial port (see `Arduino.h`).
+ */
+
+#ifndef NATIVE_HARDWARESERIAL_H_DEFINITION
+#define NATIVE_HARDWARESERIAL_H_DEFINITION
+
+#include "Arduino.h"
+
+#endif
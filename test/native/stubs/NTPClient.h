@@ -0,0 +1,27 @@
+/**
+ * @file NTPClient.h
+ * @brief Host stand-in of the NTP client, the time is taken from the host clock.
+ */
+
+#ifndef NATIVE_NTPCLIENT_H_DEFINITION
+#define NATIVE_NTPCLIENT_H_DEFINITION
+
+#include "WiFi.h"
+
+class NTPClient {
+    public:
+        explicit NTPClient(WiFiUDP & udp) {(void)udp;}
+        void begin() {}
+        void end() {}
+        void setTimeOffset(int offset) {time_offset = offset;}
+        void setUpdateInterval(unsigned long interval) {(void)interval;}
+        bool update() {return true;}
+        bool forceUpdate() {return true;}
+        bool isTimeSet() const {return true;}
+        unsigned long getEpochTime() const;
+
+    private:
+        int time_offset = 0;
+};
+
+#endif
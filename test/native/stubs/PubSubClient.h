@@ -0,0 +1,64 @@
+/**
+ * @file PubSubClient.h
+ * @brief Host stand-in of the PubSubClient MQTT client, connected to an in-process broker stand-in.
+ *
+ * The broker keeps every accepted message (see `nativeBrokerMessages()`). It can be stopped and started again
+ * (`nativeBrokerSetUp()`), the client then loses the connection the same way as on a broker or WiFi outage,
+ * and it can drop the connection in the middle of a publish (`nativeBrokerDropAfter()`). The messages injected by
+ * `nativeBrokerInject()` are delivered to the callback by `loop()`.
+ */
+
+#ifndef NATIVE_PUBSUBCLIENT_H_DEFINITION
+#define NATIVE_PUBSUBCLIENT_H_DEFINITION
+
+#include <functional>
+#include <string>
+
+#include "WiFi.h"
+
+#define MQTT_MAX_PACKET_SIZE 256
+#define MQTT_CALLBACK_SIGNATURE std::function<void(char *, uint8_t *, unsigned int)> callback
+
+#define MQTT_CONNECTION_TIMEOUT -4
+#define MQTT_CONNECTION_LOST -3
+#define MQTT_CONNECT_FAILED -2
+#define MQTT_DISCONNECTED -1
+#define MQTT_CONNECTED 0
+
+class PubSubClient {
+    public:
+        PubSubClient & setClient(WiFiClient & client) {(void)client; return *this;}
+        PubSubClient & setServer(const char * domain, uint16_t port) {(void)domain; (void)port; return *this;}
+        PubSubClient & setCallback(MQTT_CALLBACK_SIGNATURE);
+        bool setBufferSize(uint16_t size) {buffer_size = size; return true;}
+        uint16_t getBufferSize() {return buffer_size;}
+
+        bool connect(const char * id);
+        bool connect(const char * id, const char * user, const char * pass);
+        void disconnect();
+        bool connected();
+        int state();
+
+        bool subscribe(const char * topic, uint8_t qos = 0);
+        bool unsubscribe(const char * topic);
+        bool loop();
+
+        bool publish(const char * topic, const char * payload, bool retained = false);
+        bool publish(const char * topic, const uint8_t * payload, unsigned int length, bool retained = false);
+        bool beginPublish(const char * topic, unsigned int length, bool retained);
+        size_t write(uint8_t c);
+        size_t write(const uint8_t * buffer, size_t size);
+        int endPublish();
+
+    private:
+        std::function<void(char *, uint8_t *, unsigned int)> callback;
+        uint16_t buffer_size = MQTT_MAX_PACKET_SIZE;
+        uint32_t session = 0;           // broker session the client is connected to (0 = not connected)
+        std::string topic;              // message being published
+        std::string load;
+        unsigned int load_len = 0;
+        bool retained = false;
+        bool publishing = false;
+};
+
+#endif
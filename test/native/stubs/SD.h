@@ -0,0 +1,90 @@
+/**
+ * @file SD.h
+ * @brief Host stand-in of the Arduino SD card library, backed by a directory of the host file system.
+ *
+ * The card root is `nativeSdRoot()` (a directory in the temporary directory by default), so the tests can check,
+ * truncate or corrupt the written files directly. The files are opened with the same modes as on the ESP32:
+ * `FILE_READ`, `FILE_WRITE` (truncates) and `FILE_APPEND`.
+ */
+
+#ifndef NATIVE_SD_H_DEFINITION
+#define NATIVE_SD_H_DEFINITION
+
+#include <memory>
+
+#include "Arduino.h"
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+typedef enum {
+    SeekSet,
+    SeekCur,
+    SeekEnd,
+} SeekMode;
+
+struct native_file_t;
+
+class File : public Stream {
+    public:
+        File() {}
+        explicit File(std::shared_ptr<native_file_t> impl) : impl(impl) {}
+
+        operator bool() const;
+        bool isDirectory() const;
+        const char * name() const;
+        const char * path() const;
+        size_t size() const;
+        size_t position() const;
+        bool seek(uint32_t position, SeekMode mode = SeekSet);
+        File openNextFile(const char * mode = FILE_READ);
+        void close();
+
+        int available() override;
+        int read() override;
+        int peek() override;
+        size_t read(uint8_t * buffer, size_t size);
+        size_t write(uint8_t c) override;
+        size_t write(const uint8_t * buffer, size_t size) override;
+        using Print::write;
+        void flush() override;
+
+    private:
+        std::shared_ptr<native_file_t> impl;
+};
+
+typedef enum {
+    CARD_NONE,
+    CARD_MMC,
+    CARD_SD,
+    CARD_SDHC,
+    CARD_UNKNOWN,
+} sdcard_type_t;
+
+class SDClass {
+    public:
+        bool begin(uint8_t ss = 0) {(void)ss; return true;}
+        void end() {}
+        sdcard_type_t cardType() {return CARD_SDHC;}
+        uint64_t cardSize() {return 4ULL * 1024 * 1024 * 1024;}
+        uint64_t totalBytes() {return cardSize();}
+        uint64_t usedBytes();
+
+        File open(const char * path, const char * mode = FILE_READ);
+        File open(const String & path, const char * mode = FILE_READ) {return open(path.c_str(), mode);}
+        bool exists(const char * path);
+        bool exists(const String & path) {return exists(path.c_str());}
+        bool remove(const char * path);
+        bool remove(const String & path) {return remove(path.c_str());}
+        bool rename(const char * from, const char * to);
+        bool rename(const String & from, const String & to) {return rename(from.c_str(), to.c_str());}
+        bool mkdir(const char * path);
+        bool mkdir(const String & path) {return mkdir(path.c_str());}
+        bool rmdir(const char * path);
+        bool rmdir(const String & path) {return rmdir(path.c_str());}
+};
+
+extern SDClass SD;
+
+#endif
@@ -0,0 +1,36 @@
+/**
+ * @file WiFi.h
+ * @brief Host stand-in of the ESP32 WiFi library (the network is always connected on the host).
+ */
+
+#ifndef NATIVE_WIFI_H_DEFINITION
+#define NATIVE_WIFI_H_DEFINITION
+
+#include "Arduino.h"
+
+typedef enum {
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4,
+    WL_CONNECTION_LOST = 5,
+    WL_DISCONNECTED = 6,
+} wl_status_t;
+
+// the MQTT client of the tests talks to the broker stand-in (see PubSubClient.h), the network clients carry no data
+class WiFiClient {
+    public:
+        virtual ~WiFiClient() {}
+};
+
+class WiFiUDP {
+};
+
+class WiFiClass {
+    public:
+        wl_status_t status() {return WL_CONNECTED;}
+};
+
+extern WiFiClass WiFi;
+
+#endif
@@ -0,0 +1,17 @@
+/**
+ * @file WiFiClientSecure.h
+ * @brief Host stand-in of the ESP32 TLS client (see `WiFi.h`).
+ */
+
+#ifndef NATIVE_WIFICLIENTSECURE_H_DEFINITION
+#define NATIVE_WIFICLIENTSECURE_H_DEFINITION
+
+#include "WiFi.h"
+
+class WiFiClientSecure : public WiFiClient {
+    public:
+        void setCACert(const char * cert) {(void)cert;}
+        void setInsecure() {}
+};
+
+#endif
@@ -0,0 +1,43 @@
+#include <atomic>
+#include <time.h>
+
+#include "Arduino.h"
+#include "WiFi.h"
+#include "NTPClient.h"
+#include "mainAppDefinitions.h"
+#include "libDisplayEINK.h"
+#include "native.h"
+
+// the application globals defined by src/main.cpp on the device
+TaskHandle_t handleTaskZigbee = NULL;
+TaskHandle_t handleTaskLog = NULL;
+QueueHandle_t mqttQueue = NULL;
+QueueHandle_t queueNotification = NULL;
+
+WiFiClass WiFi;
+WiFiUDP ntpUDP;
+NTPClient timeClient(ntpUDP);
+
+g_config_t g_config = {};
+g_vars_t g_vars = {};
+
+g_vars_t * g_vars_ptr = &g_vars;
+g_config_t * g_config_ptr = &g_config;
+
+static std::atomic<uint32_t> native_notifications(0);
+
+// the display is not part of the tests, only the notifications are counted
+void displayNotification(notificationScreenId notification, int param, int duration) {
+    (void)notification;
+    (void)param;
+    (void)duration;
+    native_notifications++;
+}
+
+uint32_t nativeNotifications() {
+    return native_notifications;
+}
+
+unsigned long NTPClient::getEpochTime() const {
+    return (unsigned long)time(NULL) + time_offset;
+}
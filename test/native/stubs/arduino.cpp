@@ -0,0 +1,304 @@
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <algorithm>
+#include <ctype.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "esp_timer.h"
+#include "native.h"
+
+HardwareSerial Serial;
+EspClass ESP;
+
+static const std::chrono::steady_clock::time_point native_start = std::chrono::steady_clock::now();
+static std::atomic<uint64_t> native_skipped_us(0);
+static std::atomic<bool> native_serial_mute(false);
+static std::mutex native_serial_lock;
+static esp_reset_reason_t native_reset_reason = ESP_RST_POWERON;
+
+// *********************************************************************************************************************
+// clock
+
+int64_t esp_timer_get_time() {
+    auto elapsed = std::chrono::steady_clock::now() - native_start;
+    return std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count() + (int64_t)native_skipped_us.load();
+}
+
+unsigned long millis() {
+    return (unsigned long)(esp_timer_get_time() / 1000);
+}
+
+unsigned long micros() {
+    return (unsigned long)esp_timer_get_time();
+}
+
+void delay(uint32_t ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(uint32_t us) {
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+void nativeAdvanceMillis(uint32_t ms) {
+    native_skipped_us += (uint64_t)ms * 1000;
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+    (void)pin;
+    (void)mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+    (void)pin;
+    (void)value;
+}
+
+int digitalRead(uint8_t pin) {
+    (void)pin;
+    return LOW;
+}
+
+// *********************************************************************************************************************
+// system
+
+esp_reset_reason_t esp_reset_reason() {
+    return native_reset_reason;
+}
+
+void nativeSetResetReason(esp_reset_reason_t reason) {
+    native_reset_reason = reason;
+}
+
+uint32_t esp_get_free_heap_size() {
+    return 200 * 1024;
+}
+
+void EspClass::restart() {
+    Serial.flush();
+    fprintf(stderr, "ESP.restart() called, ending the test program\n");
+    _exit(3);
+}
+
+// *********************************************************************************************************************
+// String
+
+static std::string native_number(unsigned long long value, bool negative, unsigned char base) {
+    if (base < 2 || base > 36) {
+        base = DEC;
+    }
+
+    std::string out;
+    do {
+        int digit = (int)(value % base);
+        out += (char)(digit < 10 ? '0' + digit : 'a' + digit - 10);
+        value /= base;
+    } while (value > 0);
+
+    if (negative) {
+        out += '-';
+    }
+    std::reverse(out.begin(), out.end());
+    return out;
+}
+
+static std::string native_signed(long long value, unsigned char base) {
+    // the Arduino core prints the negative numbers in other bases than 10 as unsigned
+    if (value < 0 && base == DEC) {
+        return native_number(0ULL - (unsigned long long)value, true, base);
+    }
+    return native_number((unsigned long long)value, false, base);
+}
+
+String::String(int value, unsigned char base) : s(native_signed(value, base)) {}
+String::String(unsigned int value, unsigned char base) : s(native_number(value, false, base)) {}
+String::String(long value, unsigned char base) : s(native_signed(value, base)) {}
+String::String(unsigned long value, unsigned char base) : s(native_number(value, false, base)) {}
+String::String(long long value, unsigned char base) : s(native_signed(value, base)) {}
+String::String(unsigned long long value, unsigned char base) : s(native_number(value, false, base)) {}
+String::String(float value, unsigned int decimals) : String((double)value, decimals) {}
+
+String::String(double value, unsigned int decimals) {
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "%.*f", (int)decimals, value);
+    s = buffer;
+}
+
+bool String::equalsIgnoreCase(const String & str) const {
+    return s.length() == str.s.length() && strcasecmp(s.c_str(), str.s.c_str()) == 0;
+}
+
+String String::substring(unsigned int from, unsigned int to) const {
+    if (from > to) {
+        std::swap(from, to);
+    }
+    if (from >= s.length()) {
+        return String();
+    }
+    return String(s.substr(from, std::min<size_t>(to, s.length()) - from));
+}
+
+void String::replace(const String & from, const String & to) {
+    if (from.s.empty()) {
+        return;
+    }
+
+    size_t pos = 0;
+    while ((pos = s.find(from.s, pos)) != std::string::npos) {
+        s.replace(pos, from.s.length(), to.s);
+        pos += to.s.length();
+    }
+}
+
+void String::toLowerCase() {
+    for (char & c : s) {
+        c = (char)tolower((unsigned char)c);
+    }
+}
+
+void String::toUpperCase() {
+    for (char & c : s) {
+        c = (char)toupper((unsigned char)c);
+    }
+}
+
+void String::trim() {
+    size_t begin = 0;
+    while (begin < s.length() && isspace((unsigned char)s[begin])) {
+        begin++;
+    }
+
+    size_t end = s.length();
+    while (end > begin && isspace((unsigned char)s[end - 1])) {
+        end--;
+    }
+    s = s.substr(begin, end - begin);
+}
+
+StringSumHelper operator+(const String & lhs, const String & rhs) {
+    StringSumHelper out(lhs);
+    out.concat(rhs);
+    return out;
+}
+
+StringSumHelper operator+(const String & lhs, const char * rhs) {
+    StringSumHelper out(lhs);
+    out.concat(rhs);
+    return out;
+}
+
+StringSumHelper operator+(const char * lhs, const String & rhs) {
+    StringSumHelper out(lhs);
+    out.concat(rhs);
+    return out;
+}
+
+StringSumHelper operator+(const String & lhs, char rhs) {
+    StringSumHelper out(lhs);
+    out.concat(rhs);
+    return out;
+}
+
+StringSumHelper operator+(const String & lhs, int rhs) {
+    return lhs + String(rhs);
+}
+
+StringSumHelper operator+(const String & lhs, unsigned int rhs) {
+    return lhs + String(rhs);
+}
+
+StringSumHelper operator+(const String & lhs, long rhs) {
+    return lhs + String(rhs);
+}
+
+StringSumHelper operator+(const String & lhs, unsigned long rhs) {
+    return lhs + String(rhs);
+}
+
+// *********************************************************************************************************************
+// Print, Stream
+
+size_t Print::write(const uint8_t * buffer, size_t size) {
+    size_t n = 0;
+    while (n < size && write(buffer[n]) == 1) {
+        n++;
+    }
+    return n;
+}
+
+size_t Print::printf(const char * format, ...) {
+    char buffer[256];
+    va_list args;
+
+    va_start(args, format);
+    int len = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (len < 0) {
+        return 0;
+    }
+    if ((size_t)len < sizeof(buffer)) {
+        return write((const uint8_t *)buffer, len);
+    }
+
+    std::string big(len + 1, '\0');
+    va_start(args, format);
+    vsnprintf(&big[0], big.size(), format, args);
+    va_end(args);
+    return write((const uint8_t *)big.data(), len);
+}
+
+size_t Stream::readBytes(char * buffer, size_t length) {
+    size_t n = 0;
+    while (n < length) {
+        int c = read();
+        if (c < 0) {
+            break;
+        }
+        buffer[n++] = (char)c;
+    }
+    return n;
+}
+
+String Stream::readString() {
+    String out;
+    int c;
+    while ((c = read()) >= 0) {
+        out += (char)c;
+    }
+    return out;
+}
+
+String Stream::readStringUntil(char terminator) {
+    String out;
+    int c;
+    while ((c = read()) >= 0 && c != terminator) {
+        out += (char)c;
+    }
+    return out;
+}
+
+// *********************************************************************************************************************
+// serial monitor
+
+size_t HardwareSerial::write(uint8_t c) {
+    return write(&c, 1);
+}
+
+size_t HardwareSerial::write(const uint8_t * buffer, size_t size) {
+    if (!native_serial_mute) {
+        std::lock_guard<std::mutex> guard(native_serial_lock);
+        fwrite(buffer, 1, size, stdout);
+    }
+    return size;
+}
+
+void HardwareSerial::flush() {
+    fflush(stdout);
+}
+
+void nativeSerialMute(bool mute) {
+    native_serial_mute = mute;
+}
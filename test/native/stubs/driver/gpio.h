@@ -0,0 +1,11 @@
+/**
+ * @file gpio.h
+ * @brief Host stand-in of the ESP-IDF GPIO driver (the pins are only numbers on the host).
+ */
+
+#ifndef NATIVE_DRIVER_GPIO_H_DEFINITION
+#define NATIVE_DRIVER_GPIO_H_DEFINITION
+
+typedef int gpio_num_t;
+
+#endif
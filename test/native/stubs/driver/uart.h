@@ -0,0 +1,73 @@
+/**
+ * @file uart.h
+ * @brief Host stand-in of the ESP-IDF UART driver.
+ *
+ * The received bytes are buffered in RAM and a `UART_DATA` event is posted to the driver queue for every chunk,
+ * the same as the driver does on the RX timeout. The bytes come from `nativeUartFeed()` or from a host file
+ * descriptor (e.g. the pseudo-terminal of the NCP simulator) attached by `nativeUartAttach()`. The written bytes
+ * are kept for `nativeUartTaken()` and written to the attached descriptor.
+ */
+
+#ifndef NATIVE_DRIVER_UART_H_DEFINITION
+#define NATIVE_DRIVER_UART_H_DEFINITION
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "esp_system.h"
+#include "freertos/queue.h"
+
+typedef int uart_port_t;
+
+#define UART_NUM_0 0
+#define UART_NUM_1 1
+#define UART_NUM_2 2
+#define UART_NUM_MAX 3
+#define UART_PIN_NO_CHANGE (-1)
+
+typedef enum {UART_DATA_5_BITS, UART_DATA_6_BITS, UART_DATA_7_BITS, UART_DATA_8_BITS} uart_word_length_t;
+typedef enum {UART_PARITY_DISABLE, UART_PARITY_EVEN = 2, UART_PARITY_ODD = 3} uart_parity_t;
+typedef enum {UART_STOP_BITS_1 = 1, UART_STOP_BITS_1_5, UART_STOP_BITS_2} uart_stop_bits_t;
+typedef enum {UART_HW_FLOWCTRL_DISABLE, UART_HW_FLOWCTRL_RTS, UART_HW_FLOWCTRL_CTS, UART_HW_FLOWCTRL_CTS_RTS} uart_hw_flowcontrol_t;
+
+typedef struct {
+    int baud_rate;
+    uart_word_length_t data_bits;
+    uart_parity_t parity;
+    uart_stop_bits_t stop_bits;
+    uart_hw_flowcontrol_t flow_ctrl;
+    uint8_t rx_flow_ctrl_thresh;
+} uart_config_t;
+
+typedef enum {
+    UART_DATA,
+    UART_BREAK,
+    UART_BUFFER_FULL,
+    UART_FIFO_OVF,
+    UART_FRAME_ERR,
+    UART_PARITY_ERR,
+    UART_DATA_BREAK,
+    UART_PATTERN_DET,
+    UART_EVENT_MAX,
+} uart_event_type_t;
+
+typedef struct {
+    uart_event_type_t type;
+    size_t size;
+    bool timeout_flag;
+} uart_event_t;
+
+esp_err_t uart_driver_install(uart_port_t uart, int rx_buffer_size, int tx_buffer_size, int queue_size, QueueHandle_t * queue, int flags);
+esp_err_t uart_driver_delete(uart_port_t uart);
+esp_err_t uart_param_config(uart_port_t uart, const uart_config_t * config);
+esp_err_t uart_set_pin(uart_port_t uart, int tx, int rx, int rts, int cts);
+esp_err_t uart_set_rx_timeout(uart_port_t uart, uint8_t symbols);
+esp_err_t uart_set_rx_full_threshold(uart_port_t uart, int threshold);
+esp_err_t uart_set_loop_back(uart_port_t uart, bool enable);
+esp_err_t uart_wait_tx_done(uart_port_t uart, TickType_t ticks);
+esp_err_t uart_flush_input(uart_port_t uart);
+esp_err_t uart_get_buffered_data_len(uart_port_t uart, size_t * size);
+int uart_read_bytes(uart_port_t uart, void * buffer, uint32_t length, TickType_t ticks);
+int uart_write_bytes(uart_port_t uart, const void * data, size_t size);
+
+#endif
@@ -0,0 +1,14 @@
+/**
+ * @file esp_attr.h
+ * @brief Host stand-in of the ESP-IDF memory placement attributes (the host has one kind of memory).
+ */
+
+#ifndef NATIVE_ESP_ATTR_H_DEFINITION
+#define NATIVE_ESP_ATTR_H_DEFINITION
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define RTC_DATA_ATTR
+#define RTC_NOINIT_ATTR
+
+#endif
@@ -0,0 +1,42 @@
+/**
+ * @file esp_system.h
+ * @brief Host stand-in of the ESP-IDF system API (the reset reason can be set by the tests).
+ */
+
+#ifndef NATIVE_ESP_SYSTEM_H_DEFINITION
+#define NATIVE_ESP_SYSTEM_H_DEFINITION
+
+#include <stdint.h>
+
+typedef enum {
+    ESP_RST_UNKNOWN,
+    ESP_RST_POWERON,
+    ESP_RST_EXT,
+    ESP_RST_SW,
+    ESP_RST_PANIC,
+    ESP_RST_INT_WDT,
+    ESP_RST_TASK_WDT,
+    ESP_RST_WDT,
+    ESP_RST_DEEPSLEEP,
+    ESP_RST_BROWNOUT,
+    ESP_RST_SDIO,
+} esp_reset_reason_t;
+
+typedef int esp_err_t;
+
+#define ESP_OK 0
+#define ESP_FAIL -1
+
+esp_reset_reason_t esp_reset_reason();
+uint32_t esp_get_free_heap_size();
+
+// ESP.restart() ends the test program (a reboot is never expected by the tests)
+class EspClass {
+    public:
+        void restart();
+        uint32_t getFreeHeap() {return esp_get_free_heap_size();}
+};
+
+extern EspClass ESP;
+
+#endif
@@ -0,0 +1,13 @@
+/**
+ * @file esp_timer.h
+ * @brief Host stand-in of the ESP-IDF high resolution timer.
+ */
+
+#ifndef NATIVE_ESP_TIMER_H_DEFINITION
+#define NATIVE_ESP_TIMER_H_DEFINITION
+
+#include <stdint.h>
+
+int64_t esp_timer_get_time();
+
+#endif
@@ -0,0 +1,350 @@
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <string>
+
+#include "Arduino.h"
+
+typedef enum {
+    NATIVE_QUEUE,
+    NATIVE_MUTEX,
+    NATIVE_MUTEX_RECURSIVE,
+    NATIVE_SEMAPHORE,
+} native_queue_kind_t;
+
+// the items are kept in a ring allocated once, so sending and receiving never allocates (see the heap counters)
+struct native_queue_t {
+    native_queue_kind_t kind;
+    std::mutex lock;
+    std::condition_variable changed;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    std::vector<uint8_t> items;
+    UBaseType_t head = 0;
+    UBaseType_t count = 0;
+    std::thread::id owner;              // mutex holder
+    UBaseType_t recursion = 0;
+};
+
+struct native_task_t {
+    std::string name;
+    std::mutex lock;
+    std::condition_variable notified;
+    uint32_t notifications = 0;
+};
+
+// thrown by vTaskDelete(NULL) to leave the task function, caught by the thread running it
+struct native_task_exit_t {};
+
+static thread_local native_task_t * native_task_current = NULL;
+static std::recursive_mutex native_critical;
+
+// *********************************************************************************************************************
+
+// waits on the condition until `ready()` holds, `ticks` as in FreeRTOS (0 = no wait, portMAX_DELAY = forever)
+template <typename Ready>
+static bool native_wait(std::condition_variable & cv, std::unique_lock<std::mutex> & guard, TickType_t ticks, Ready ready) {
+    if (ticks == portMAX_DELAY) {
+        cv.wait(guard, ready);
+        return true;
+    }
+    return cv.wait_for(guard, std::chrono::milliseconds(ticks), ready);
+}
+
+void nativeCriticalEnter(portMUX_TYPE * mux) {
+    (void)mux;
+    native_critical.lock();
+}
+
+void nativeCriticalExit(portMUX_TYPE * mux) {
+    (void)mux;
+    native_critical.unlock();
+}
+
+// *********************************************************************************************************************
+// tasks
+
+static void native_task_run(native_task_t * task, TaskFunction_t function, void * parameters) {
+    native_task_current = task;
+    try {
+        function(parameters);
+    } catch (const native_task_exit_t &) {
+    }
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char * name, uint32_t stack_depth, void * parameters, UBaseType_t priority, TaskHandle_t * handle) {
+    (void)stack_depth;
+    (void)priority;
+
+    native_task_t * task = new native_task_t();
+    task->name = name != NULL ? name : "";
+    if (handle != NULL) {
+        *handle = task;
+    }
+
+    // the task object outlives the thread, a handle kept by the tested code must stay valid
+    std::thread(native_task_run, task, function, parameters).detach();
+    return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char * name, uint32_t stack_depth, void * parameters, UBaseType_t priority, TaskHandle_t * handle, BaseType_t core) {
+    (void)core;
+    return xTaskCreate(function, name, stack_depth, parameters, priority, handle);
+}
+
+void vTaskDelete(TaskHandle_t handle) {
+    // another thread cannot be stopped on the host, only a task can delete itself
+    if (handle == NULL || handle == native_task_current) {
+        throw native_task_exit_t();
+    }
+}
+
+void vTaskDelay(TickType_t ticks) {
+    if (ticks == 0) {
+        std::this_thread::yield();
+        return;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+TickType_t xTaskGetTickCount() {
+    return (TickType_t)millis();
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+    // the test runner thread is a task as well
+    if (native_task_current == NULL) {
+        native_task_current = new native_task_t();
+        native_task_current->name = "main";
+    }
+    return native_task_current;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t handle) {
+    (void)handle;
+    return 4096;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t handle) {
+    if (handle == NULL) {
+        return pdFAIL;
+    }
+
+    std::lock_guard<std::mutex> guard(handle->lock);
+    handle->notifications++;
+    handle->notified.notify_all();
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks) {
+    native_task_t * task = xTaskGetCurrentTaskHandle();
+    std::unique_lock<std::mutex> guard(task->lock);
+
+    native_wait(task->notified, guard, ticks, [task] {return task->notifications > 0;});
+    uint32_t value = task->notifications;
+    if (value > 0) {
+        task->notifications = clear ? 0 : value - 1;
+    }
+    return value;
+}
+
+// *********************************************************************************************************************
+// queues
+
+static native_queue_t * native_queue_create(native_queue_kind_t kind, UBaseType_t length, UBaseType_t item_size) {
+    native_queue_t * queue = new native_queue_t();
+    queue->kind = kind;
+    queue->length = length;
+    queue->item_size = item_size;
+    queue->items.resize((size_t)length * item_size);
+    return queue;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+    if (length == 0) {
+        return NULL;
+    }
+    return native_queue_create(NATIVE_QUEUE, length, item_size);
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+    delete queue;
+}
+
+static BaseType_t native_queue_send(QueueHandle_t queue, const void * item, TickType_t ticks, bool front) {
+    std::unique_lock<std::mutex> guard(queue->lock);
+
+    if (!native_wait(queue->changed, guard, ticks, [queue] {return queue->count < queue->length;})) {
+        return errQUEUE_FULL;
+    }
+
+    UBaseType_t index;
+    if (front) {
+        queue->head = (queue->head + queue->length - 1) % queue->length;
+        index = queue->head;
+    } else {
+        index = (queue->head + queue->count) % queue->length;
+    }
+    if (queue->item_size > 0) {
+        memcpy(&queue->items[(size_t)index * queue->item_size], item, queue->item_size);
+    }
+    queue->count++;
+    queue->changed.notify_all();
+    return pdPASS;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void * item, TickType_t ticks) {
+    return native_queue_send(queue, item, ticks, false);
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t queue, const void * item, TickType_t ticks) {
+    return native_queue_send(queue, item, ticks, false);
+}
+
+BaseType_t xQueueSendToFront(QueueHandle_t queue, const void * item, TickType_t ticks) {
+    return native_queue_send(queue, item, ticks, true);
+}
+
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void * item) {
+    std::lock_guard<std::mutex> guard(queue->lock);
+
+    queue->head = 0;
+    queue->count = 1;
+    memcpy(queue->items.data(), item, queue->item_size);
+    queue->changed.notify_all();
+    return pdPASS;
+}
+
+static BaseType_t native_queue_receive(QueueHandle_t queue, void * item, TickType_t ticks, bool remove) {
+    std::unique_lock<std::mutex> guard(queue->lock);
+
+    if (!native_wait(queue->changed, guard, ticks, [queue] {return queue->count > 0;})) {
+        return pdFALSE;
+    }
+
+    if (queue->item_size > 0) {
+        memcpy(item, &queue->items[(size_t)queue->head * queue->item_size], queue->item_size);
+    }
+    if (remove) {
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+        queue->changed.notify_all();
+    }
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void * item, TickType_t ticks) {
+    return native_queue_receive(queue, item, ticks, true);
+}
+
+BaseType_t xQueuePeek(QueueHandle_t queue, void * item, TickType_t ticks) {
+    return native_queue_receive(queue, item, ticks, false);
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue) {
+    std::lock_guard<std::mutex> guard(queue->lock);
+
+    queue->head = 0;
+    queue->count = 0;
+    queue->changed.notify_all();
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    std::lock_guard<std::mutex> guard(queue->lock);
+    return queue->count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue) {
+    std::lock_guard<std::mutex> guard(queue->lock);
+    return queue->length - queue->count;
+}
+
+// *********************************************************************************************************************
+// semaphores, the count of a semaphore is the count of its (empty) items
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+    native_queue_t * mutex = native_queue_create(NATIVE_MUTEX, 1, 0);
+    mutex->count = 1;
+    return mutex;
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex() {
+    native_queue_t * mutex = native_queue_create(NATIVE_MUTEX_RECURSIVE, 1, 0);
+    mutex->count = 1;
+    return mutex;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary() {
+    return native_queue_create(NATIVE_SEMAPHORE, 1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count) {
+    native_queue_t * semaphore = native_queue_create(NATIVE_SEMAPHORE, max_count, 0);
+    semaphore->count = initial_count;
+    return semaphore;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore) {
+    delete semaphore;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks) {
+    std::unique_lock<std::mutex> guard(semaphore->lock);
+
+    if (!native_wait(semaphore->changed, guard, ticks, [semaphore] {return semaphore->count > 0;})) {
+        return pdFALSE;
+    }
+    semaphore->count--;
+    semaphore->owner = std::this_thread::get_id();
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+    std::lock_guard<std::mutex> guard(semaphore->lock);
+
+    if (semaphore->count >= semaphore->length) {
+        return pdFALSE;
+    }
+    semaphore->count++;
+    semaphore->owner = std::thread::id();
+    semaphore->changed.notify_all();
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t semaphore, TickType_t ticks) {
+    std::unique_lock<std::mutex> guard(semaphore->lock);
+    std::thread::id self = std::this_thread::get_id();
+
+    if (semaphore->owner == self && semaphore->recursion > 0) {
+        semaphore->recursion++;
+        return pdTRUE;
+    }
+    if (!native_wait(semaphore->changed, guard, ticks, [semaphore] {return semaphore->count > 0;})) {
+        return pdFALSE;
+    }
+    semaphore->count = 0;
+    semaphore->owner = self;
+    semaphore->recursion = 1;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t semaphore) {
+    std::lock_guard<std::mutex> guard(semaphore->lock);
+
+    if (semaphore->owner != std::this_thread::get_id() || semaphore->recursion == 0) {
+        return pdFALSE;
+    }
+    if (--semaphore->recursion == 0) {
+        semaphore->owner = std::thread::id();
+        semaphore->count = 1;
+        semaphore->changed.notify_all();
+    }
+    return pdTRUE;
+}
+
+UBaseType_t uxSemaphoreGetCount(SemaphoreHandle_t semaphore) {
+    return uxQueueMessagesWaiting(semaphore);
+}
@@ -0,0 +1,45 @@
+/**
+ * @file FreeRTOS.h
+ * @brief Host stand-in of the FreeRTOS types and macros used by the native tests (one tick is one millisecond).
+ */
+
+#ifndef NATIVE_FREERTOS_H_DEFINITION
+#define NATIVE_FREERTOS_H_DEFINITION
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint32_t StackType_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdFAIL 0
+#define pdPASS 1
+#define errQUEUE_FULL 0
+#define errQUEUE_EMPTY 0
+
+#define portMAX_DELAY ((TickType_t)0xFFFFFFFFU)
+#define portTICK_PERIOD_MS ((TickType_t)1)
+#define configTICK_RATE_HZ 1000
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define pdTICKS_TO_MS(ticks) ((uint32_t)(ticks))
+
+// the critical sections of the tested code are short, one process-wide lock stands in for the spinlocks
+typedef struct {
+    int unused;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED {0}
+
+void nativeCriticalEnter(portMUX_TYPE * mux);
+void nativeCriticalExit(portMUX_TYPE * mux);
+
+#define portENTER_CRITICAL(mux) nativeCriticalEnter(mux)
+#define portEXIT_CRITICAL(mux) nativeCriticalExit(mux)
+#define portENTER_CRITICAL_ISR(mux) nativeCriticalEnter(mux)
+#define portEXIT_CRITICAL_ISR(mux) nativeCriticalExit(mux)
+
+#endif
@@ -0,0 +1,25 @@
+/**
+ * @file queue.h
+ * @brief Host stand-in of the FreeRTOS queues (thread safe, the timeouts are waited for in the host time).
+ */
+
+#ifndef NATIVE_FREERTOS_QUEUE_H_DEFINITION
+#define NATIVE_FREERTOS_QUEUE_H_DEFINITION
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct native_queue_t * QueueHandle_t;
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size);
+void vQueueDelete(QueueHandle_t queue);
+BaseType_t xQueueSend(QueueHandle_t queue, const void * item, TickType_t ticks);
+BaseType_t xQueueSendToBack(QueueHandle_t queue, const void * item, TickType_t ticks);
+BaseType_t xQueueSendToFront(QueueHandle_t queue, const void * item, TickType_t ticks);
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void * item);
+BaseType_t xQueueReceive(QueueHandle_t queue, void * item, TickType_t ticks);
+BaseType_t xQueuePeek(QueueHandle_t queue, void * item, TickType_t ticks);
+BaseType_t xQueueReset(QueueHandle_t queue);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue);
+
+#endif
@@ -0,0 +1,26 @@
+/**
+ * @file semphr.h
+ * @brief Host stand-in of the FreeRTOS semaphores and mutexes (queues without items, as in FreeRTOS).
+ */
+
+#ifndef NATIVE_FREERTOS_SEMPHR_H_DEFINITION
+#define NATIVE_FREERTOS_SEMPHR_H_DEFINITION
+
+#include "freertos/queue.h"
+
+typedef QueueHandle_t SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateMutex();
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex();
+SemaphoreHandle_t xSemaphoreCreateBinary();
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count);
+void vSemaphoreDelete(SemaphoreHandle_t semaphore);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t semaphore, TickType_t ticks);
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t semaphore);
+UBaseType_t uxSemaphoreGetCount(SemaphoreHandle_t semaphore);
+
+#define xSemaphoreGiveFromISR(semaphore, woken) xSemaphoreGive(semaphore)
+
+#endif
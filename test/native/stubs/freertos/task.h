@@ -0,0 +1,26 @@
+/**
+ * @file task.h
+ * @brief Host stand-in of the FreeRTOS tasks, every task runs in its own (detached) host thread.
+ */
+
+#ifndef NATIVE_FREERTOS_TASK_H_DEFINITION
+#define NATIVE_FREERTOS_TASK_H_DEFINITION
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct native_task_t * TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char * name, uint32_t stack_depth, void * parameters, UBaseType_t priority, TaskHandle_t * handle);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char * name, uint32_t stack_depth, void * parameters, UBaseType_t priority, TaskHandle_t * handle, BaseType_t core);
+void vTaskDelete(TaskHandle_t handle);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount();
+TaskHandle_t xTaskGetCurrentTaskHandle();
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t handle);
+BaseType_t xTaskNotifyGive(TaskHandle_t handle);
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks);
+
+#define taskYIELD() vTaskDelay(0)
+
+#endif
@@ -0,0 +1,146 @@
+#include <atomic>
+
+#include "native.h"
+
+// the heap is counted by replacing malloc() on glibc, the sanitizers replace it themselves
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__)
+#define NATIVE_HEAP_COUNTED 0
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer) || __has_feature(thread_sanitizer) || __has_feature(memory_sanitizer)
+#define NATIVE_HEAP_COUNTED 0
+#endif
+#endif
+
+#ifndef NATIVE_HEAP_COUNTED
+#if defined(__GLIBC__)
+#define NATIVE_HEAP_COUNTED 1
+#else
+#define NATIVE_HEAP_COUNTED 0
+#endif
+#endif
+
+static std::atomic<uint64_t> native_heap_allocations(0);
+static std::atomic<uint64_t> native_heap_frees(0);
+static std::atomic<size_t> native_heap_used(0);
+static std::atomic<size_t> native_heap_peak(0);
+static std::atomic<uint64_t> native_heap_allocated(0);
+
+#if NATIVE_HEAP_COUNTED
+
+#include <errno.h>
+#include <malloc.h>
+
+extern "C" {
+    void * __libc_malloc(size_t size);
+    void * __libc_calloc(size_t count, size_t size);
+    void * __libc_realloc(void * ptr, size_t size);
+    void * __libc_memalign(size_t alignment, size_t size);
+    void __libc_free(void * ptr);
+}
+
+static void native_heap_add(void * ptr) {
+    if (ptr == NULL) {
+        return;
+    }
+
+    size_t size = malloc_usable_size(ptr);
+    size_t used = native_heap_used += size;
+    native_heap_allocated += size;
+    size_t peak = native_heap_peak;
+    while (used > peak && !native_heap_peak.compare_exchange_weak(peak, used)) {
+    }
+    native_heap_allocations++;
+}
+
+static void native_heap_remove(void * ptr) {
+    if (ptr == NULL) {
+        return;
+    }
+
+    native_heap_used -= malloc_usable_size(ptr);
+    native_heap_frees++;
+}
+
+extern "C" void * malloc(size_t size) {
+    void * ptr = __libc_malloc(size);
+    native_heap_add(ptr);
+    return ptr;
+}
+
+extern "C" void * calloc(size_t count, size_t size) {
+    void * ptr = __libc_calloc(count, size);
+    native_heap_add(ptr);
+    return ptr;
+}
+
+extern "C" void * realloc(void * ptr, size_t size) {
+    size_t old = ptr != NULL ? malloc_usable_size(ptr) : 0;
+    void * moved = __libc_realloc(ptr, size);
+
+    // a failed realloc() keeps the block, realloc(ptr, 0) frees it
+    if (moved == NULL) {
+        if (ptr != NULL && size == 0) {
+            native_heap_used -= old;
+            native_heap_frees++;
+        }
+        return NULL;
+    }
+    native_heap_used -= old;
+    if (ptr != NULL) {
+        native_heap_frees++;
+    }
+    native_heap_add(moved);
+    return moved;
+}
+
+// the aligned blocks are counted too, otherwise their free() would be subtracted from the bytes in use
+extern "C" void * memalign(size_t alignment, size_t size) {
+    void * ptr = __libc_memalign(alignment, size);
+    native_heap_add(ptr);
+    return ptr;
+}
+
+extern "C" void * aligned_alloc(size_t alignment, size_t size) {
+    return memalign(alignment, size);
+}
+
+extern "C" int posix_memalign(void ** ptr, size_t alignment, size_t size) {
+    if (alignment < sizeof(void *) || (alignment & (alignment - 1)) != 0) {
+        return EINVAL;
+    }
+
+    void * block = memalign(alignment, size);
+    if (block == NULL) {
+        return ENOMEM;
+    }
+    *ptr = block;
+    return 0;
+}
+
+extern "C" void free(void * ptr) {
+    native_heap_remove(ptr);
+    __libc_free(ptr);
+}
+
+#endif
+
+bool nativeHeapCounted() {
+    return NATIVE_HEAP_COUNTED;
+}
+
+native_heap_t nativeHeapStats() {
+    native_heap_t stats;
+    stats.allocations = native_heap_allocations;
+    stats.frees = native_heap_frees;
+    stats.used = native_heap_used;
+    stats.peak = native_heap_peak;
+    stats.allocated = native_heap_allocated;
+    return stats;
+}
+
+void nativeHeapReset() {
+    native_heap_allocations = 0;
+    native_heap_frees = 0;
+    native_heap_allocated = 0;
+    native_heap_peak = (size_t)native_heap_used;
+}
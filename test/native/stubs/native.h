@@ -0,0 +1,191 @@
+/**
+ * @file native.h
+ * @brief Controls of the host stand-ins used by the native tests and benchmarks.
+ *
+ * The stand-ins keep the state a test needs to drive or check: the clock, the SD card directory and its call counters,
+ * the received and written UART bytes, the broker and the heap statistics. The application globals defined by
+ * `src/main.cpp` on the device (`g_vars_ptr`, `g_config_ptr`, the task handles and queues) are defined by the stand-ins
+ * as well.
+ */
+
+#ifndef NATIVE_H_DEFINITION
+#define NATIVE_H_DEFINITION
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include "Arduino.h"
+#include "driver/uart.h"
+
+// *********************************************************************************************************************
+// clock, serial monitor, reset
+
+/**
+ * @brief Moves `millis()` (and the tick count) forward without waiting, e.g. to expire a timeout.
+ */
+void nativeAdvanceMillis(uint32_t ms);
+
+/**
+ * @brief Stops (or resumes) writing the serial monitor output (the log records) to the standard output.
+ */
+void nativeSerialMute(bool mute);
+
+/**
+ * @brief Sets the reason returned by `esp_reset_reason()`, e.g. `ESP_RST_PANIC` to recover the crash log.
+ */
+void nativeSetResetReason(esp_reset_reason_t reason);
+
+/**
+ * @brief Returns the number of the display notifications shown by the tested code.
+ */
+uint32_t nativeNotifications();
+
+// *********************************************************************************************************************
+// SD card
+
+/**
+ * @brief Returns the host directory which is the root of the SD card (it is created when missing).
+ */
+const char * nativeSdRoot();
+
+/**
+ * @brief Returns the host path of a path on the SD card.
+ */
+std::string nativeSdPath(const char * path);
+
+/**
+ * @brief Removes everything from the SD card.
+ */
+void nativeSdClear();
+
+typedef struct {
+    uint64_t calls;                     // every call below
+    uint64_t opens;                     // SD.open()
+    uint64_t lookups;                   // SD.exists(), File::size(), File::seek()
+    uint64_t changes;                   // SD.mkdir(), SD.rmdir(), SD.remove(), SD.rename()
+    uint64_t writes;                    // File::write() (Print::printf() writes once per call)
+    uint64_t flushes;                   // File::flush()
+    uint64_t closes;                    // File::close() of an open file
+    uint64_t written;                   // bytes written
+} native_sd_t;
+
+/**
+ * @brief Returns the SD card calls counted since the last `nativeSdReset()` (the reads are not counted).
+ */
+native_sd_t nativeSdStats();
+
+/**
+ * @brief Zeroes the SD card call counters.
+ */
+void nativeSdReset();
+
+// *********************************************************************************************************************
+// UART
+
+/**
+ * @brief Adds received bytes to the UART buffer and posts a `UART_DATA` event to the driver queue.
+ */
+void nativeUartFeed(uart_port_t uart, const uint8_t * data, size_t len);
+
+/**
+ * @brief Drops the buffered bytes and posts a `UART_FIFO_OVF` event (the same as a lost RX interrupt).
+ */
+void nativeUartOverflow(uart_port_t uart);
+
+/**
+ * @brief Connects the UART to a host file descriptor (e.g. a pseudo-terminal), the bytes read from it are received
+ *        by a reader thread and the written bytes are written to it.
+ *
+ * The descriptor may be attached before the driver is installed (e.g. before `initSerialZigbee()`), the reader thread
+ * is started by `uart_driver_install()` then.
+ *
+ * @return `true` if the descriptor was attached.
+ */
+bool nativeUartAttach(uart_port_t uart, int fd);
+
+/**
+ * @brief Stops the reader thread of the attached file descriptor (the descriptor is not closed).
+ */
+void nativeUartDetach(uart_port_t uart);
+
+/**
+ * @brief Returns the bytes written to the UART since the last call and forgets them (nothing is kept while a file
+ *        descriptor is attached).
+ */
+std::vector<uint8_t> nativeUartTaken(uart_port_t uart);
+
+// *********************************************************************************************************************
+// MQTT broker
+
+typedef struct {
+    std::string topic;
+    std::string load;
+    bool retained;
+} native_mqtt_message_t;
+
+/**
+ * @brief Starts or stops the broker, the connected clients lose the connection when it is stopped.
+ */
+void nativeBrokerSetUp(bool up);
+
+/**
+ * @brief Drops the connection in the middle of the publish after the given number of accepted messages
+ *        (`-1` never drops it).
+ */
+void nativeBrokerDropAfter(int messages);
+
+/**
+ * @brief Keeps the accepted messages (the default) or only counts them, e.g. so a benchmark sees the heap of the
+ *        tested code only.
+ */
+void nativeBrokerKeep(bool keep);
+
+/**
+ * @brief Returns the messages accepted by the broker in the order they arrived.
+ */
+const std::vector<native_mqtt_message_t> & nativeBrokerMessages();
+
+/**
+ * @brief Returns the number of the messages accepted by the broker (kept or not).
+ */
+uint64_t nativeBrokerAccepted();
+
+/**
+ * @brief Forgets the accepted messages and zeroes their number.
+ */
+void nativeBrokerClear();
+
+/**
+ * @brief Queues a message for the subscribed client, it is delivered to the callback by `PubSubClient::loop()`.
+ */
+void nativeBrokerInject(const char * topic, const char * load);
+
+// *********************************************************************************************************************
+// heap
+
+typedef struct {
+    uint64_t allocations;               // malloc(), calloc() and realloc() calls (new and std containers included)
+    uint64_t frees;
+    size_t used;                        // bytes in use (as reported by the allocator, including its rounding)
+    size_t peak;                        // highest `used` since the last nativeHeapReset()
+    uint64_t allocated;                 // bytes of the blocks allocated since the last nativeHeapReset() (freed or not)
+} native_heap_t;
+
+/**
+ * @brief Returns whether the heap operations are counted (glibc without the sanitizers).
+ */
+bool nativeHeapCounted();
+
+/**
+ * @brief Returns the heap statistics.
+ */
+native_heap_t nativeHeapStats();
+
+/**
+ * @brief Zeroes the counters and sets the peak to the bytes in use.
+ */
+void nativeHeapReset();
+
+#endif
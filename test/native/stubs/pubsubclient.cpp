@@ -0,0 +1,261 @@
+#include <mutex>
+#include <deque>
+#include <vector>
+#include <string>
+
+#include "PubSubClient.h"
+#include "native.h"
+
+typedef struct {
+    std::recursive_mutex lock;
+    bool up = true;
+    uint32_t session = 1;               // changes on every outage, the clients of the previous session are disconnected
+    int drop_after = -1;
+    bool keep = true;                   // the accepted messages are kept (otherwise only counted)
+    uint64_t accepted = 0;
+    std::vector<native_mqtt_message_t> messages;
+    std::vector<std::string> subscriptions;
+    std::deque<native_mqtt_message_t> injected;
+} native_broker_t;
+
+static native_broker_t native_broker;
+
+// topic filter with the MQTT wildcards ('+' one level, '#' the rest)
+static bool native_topic_match(const std::string & filter, const std::string & topic) {
+    size_t f = 0;
+    size_t t = 0;
+
+    while (f < filter.length()) {
+        if (filter[f] == '#') {
+            return true;
+        }
+
+        if (filter[f] == '+') {
+            while (t < topic.length() && topic[t] != '/') {
+                t++;
+            }
+            f++;
+            continue;
+        }
+
+        if (t >= topic.length() || filter[f] != topic[t]) {
+            return false;
+        }
+        f++;
+        t++;
+    }
+    return t == topic.length();
+}
+
+// accepts the message unless the connection is dropped in the middle of it
+static bool native_broker_accept(const std::string & topic, const std::string & load, bool retained) {
+    std::lock_guard<std::recursive_mutex> guard(native_broker.lock);
+
+    if (native_broker.drop_after == 0) {
+        native_broker.drop_after = -1;
+        native_broker.session++;
+        return false;
+    }
+    if (native_broker.drop_after > 0) {
+        native_broker.drop_after--;
+    }
+
+    native_broker.accepted++;
+    if (native_broker.keep) {
+        native_broker.messages.push_back({topic, load, retained});
+    }
+    return true;
+}
+
+// *********************************************************************************************************************
+// test controls
+
+void nativeBrokerSetUp(bool up) {
+    std::lock_guard<std::recursive_mutex> guard(native_broker.lock);
+
+    if (native_broker.up && !up) {
+        native_broker.session++;
+        native_broker.subscriptions.clear();
+    }
+    native_broker.up = up;
+}
+
+void nativeBrokerDropAfter(int messages) {
+    std::lock_guard<std::recursive_mutex> guard(native_broker.lock);
+    native_broker.drop_after = messages;
+}
+
+void nativeBrokerKeep(bool keep) {
+    std::lock_guard<std::recursive_mutex> guard(native_broker.lock);
+    native_broker.keep = keep;
+}
+
+const std::vector<native_mqtt_message_t> & nativeBrokerMessages() {
+    return native_broker.messages;
+}
+
+uint64_t nativeBrokerAccepted() {
+    std::lock_guard<std::recursive_mutex> guard(native_broker.lock);
+    return native_broker.accepted;
+}
+
+void nativeBrokerClear() {
+    std::lock_guard<std::recursive_mutex> guard(native_broker.lock);
+    native_broker.accepted = 0;
+    native_broker.messages.clear();
+    native_broker.injected.clear();
+}
+
+void nativeBrokerInject(const char * topic, const char * load) {
+    std::lock_guard<std::recursive_mutex> guard(native_broker.lock);
+    native_broker.injected.push_back({topic, load, false});
+}
+
+// *********************************************************************************************************************
+// client
+
+PubSubClient & PubSubClient::setCallback(MQTT_CALLBACK_SIGNATURE) {
+    this->callback = callback;
+    return *this;
+}
+
+bool PubSubClient::connect(const char * id) {
+    (void)id;
+    std::lock_guard<std::recursive_mutex> guard(native_broker.lock);
+
+    session = native_broker.up ? native_broker.session : 0;
+    publishing = false;
+    return session != 0;
+}
+
+bool PubSubClient::connect(const char * id, const char * user, const char * pass) {
+    (void)user;
+    (void)pass;
+    return connect(id);
+}
+
+void PubSubClient::disconnect() {
+    session = 0;
+}
+
+bool PubSubClient::connected() {
+    std::lock_guard<std::recursive_mutex> guard(native_broker.lock);
+    return session != 0 && native_broker.up && session == native_broker.session;
+}
+
+int PubSubClient::state() {
+    return connected() ? MQTT_CONNECTED : session != 0 ? MQTT_CONNECTION_LOST : MQTT_DISCONNECTED;
+}
+
+bool PubSubClient::subscribe(const char * topic, uint8_t qos) {
+    (void)qos;
+    std::lock_guard<std::recursive_mutex> guard(native_broker.lock);
+
+    if (!connected()) {
+        return false;
+    }
+    native_broker.subscriptions.push_back(topic);
+    return true;
+}
+
+bool PubSubClient::unsubscribe(const char * topic) {
+    std::lock_guard<std::recursive_mutex> guard(native_broker.lock);
+
+    if (!connected()) {
+        return false;
+    }
+    for (auto it = native_broker.subscriptions.begin(); it != native_broker.subscriptions.end(); ++it) {
+        if (*it == topic) {
+            native_broker.subscriptions.erase(it);
+            break;
+        }
+    }
+    return true;
+}
+
+bool PubSubClient::loop() {
+    native_mqtt_message_t message;
+
+    while (true) {
+        {
+            std::lock_guard<std::recursive_mutex> guard(native_broker.lock);
+            if (!connected()) {
+                return false;
+            }
+            if (native_broker.injected.empty()) {
+                return true;
+            }
+            message = native_broker.injected.front();
+            native_broker.injected.pop_front();
+
+            bool subscribed = false;
+            for (const std::string & filter : native_broker.subscriptions) {
+                subscribed = subscribed || native_topic_match(filter, message.topic);
+            }
+            if (!subscribed) {
+                continue;
+            }
+        }
+
+        // delivered outside the broker lock, the callback may publish
+        if (callback) {
+            std::vector<char> topic_copy(message.topic.begin(), message.topic.end());
+            topic_copy.push_back('\0');
+            callback(topic_copy.data(), (uint8_t *)&message.load[0], message.load.length());
+        }
+    }
+}
+
+bool PubSubClient::publish(const char * topic, const char * payload, bool retained) {
+    return publish(topic, (const uint8_t *)payload, payload != NULL ? strlen(payload) : 0, retained);
+}
+
+bool PubSubClient::publish(const char * topic, const uint8_t * payload, unsigned int length, bool retained) {
+    // the whole packet (fixed header, topic and payload) must fit into the client buffer
+    if (!connected() || 5 + 2 + strlen(topic) + length > buffer_size) {
+        return false;
+    }
+    return native_broker_accept(topic, std::string((const char *)payload, length), retained);
+}
+
+bool PubSubClient::beginPublish(const char * topic, unsigned int length, bool retained) {
+    if (!connected()) {
+        return false;
+    }
+
+    this->topic = topic;
+    this->load.clear();
+    this->load_len = length;
+    this->retained = retained;
+    publishing = true;
+    return true;
+}
+
+size_t PubSubClient::write(uint8_t c) {
+    return write(&c, 1);
+}
+
+size_t PubSubClient::write(const uint8_t * buffer, size_t size) {
+    if (!publishing || !connected()) {
+        return 0;
+    }
+    load.append((const char *)buffer, size);
+    return size;
+}
+
+int PubSubClient::endPublish() {
+    if (!publishing) {
+        return 0;
+    }
+    publishing = false;
+
+    // a message shorter or longer than announced is a broken packet, the broker closes the connection
+    if (load.length() != load_len) {
+        std::lock_guard<std::recursive_mutex> guard(native_broker.lock);
+        if (session == native_broker.session) {
+            native_broker.session++;
+        }
+        return 0;
+    }
+    return connected() && native_broker_accept(topic, load, retained) ? 1 : 0;
+}
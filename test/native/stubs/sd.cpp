@@ -0,0 +1,340 @@
+#include <atomic>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "SD.h"
+#include "native.h"
+
+SDClass SD;
+
+struct native_file_t {
+    std::string path;                   // path on the card
+    FILE * fp = NULL;
+    bool directory = false;
+    std::vector<std::string> entries;   // names of a directory, read by openNextFile()
+    size_t next = 0;
+
+    ~native_file_t() {
+        if (fp != NULL) {
+            fclose(fp);
+        }
+    }
+};
+
+static std::string native_sd_root;
+
+static std::atomic<uint64_t> native_sd_opens(0);
+static std::atomic<uint64_t> native_sd_lookups(0);
+static std::atomic<uint64_t> native_sd_changes(0);
+static std::atomic<uint64_t> native_sd_writes(0);
+static std::atomic<uint64_t> native_sd_flushes(0);
+static std::atomic<uint64_t> native_sd_closes(0);
+static std::atomic<uint64_t> native_sd_written(0);
+
+static void native_sd_remove(const std::string & host_path) {
+    struct stat st;
+    if (lstat(host_path.c_str(), &st) != 0) {
+        return;
+    }
+
+    if (S_ISDIR(st.st_mode)) {
+        DIR * dir = opendir(host_path.c_str());
+        if (dir != NULL) {
+            struct dirent * entry;
+            while ((entry = readdir(dir)) != NULL) {
+                if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+                    native_sd_remove(host_path + "/" + entry->d_name);
+                }
+            }
+            closedir(dir);
+        }
+        rmdir(host_path.c_str());
+    } else {
+        unlink(host_path.c_str());
+    }
+}
+
+static void native_sd_cleanup() {
+    if (!native_sd_root.empty() && getenv("NATIVE_SD_ROOT") == NULL) {
+        native_sd_remove(native_sd_root);
+    }
+}
+
+const char * nativeSdRoot() {
+    if (native_sd_root.empty()) {
+        const char * root = getenv("NATIVE_SD_ROOT");
+        if (root != NULL && root[0] != '\0') {
+            native_sd_root = root;
+        } else {
+            const char * tmp = getenv("TMPDIR");
+            native_sd_root = std::string(tmp != NULL && tmp[0] != '\0' ? tmp : "/tmp") + "/iot-alarm-sd-" + std::to_string(getpid());
+            atexit(native_sd_cleanup);
+        }
+        ::mkdir(native_sd_root.c_str(), 0755);
+    }
+    return native_sd_root.c_str();
+}
+
+std::string nativeSdPath(const char * path) {
+    std::string host = nativeSdRoot();
+    if (path == NULL || path[0] != '/') {
+        host += "/";
+    }
+    return host + (path != NULL ? path : "");
+}
+
+void nativeSdClear() {
+    native_sd_remove(nativeSdRoot());
+    ::mkdir(nativeSdRoot(), 0755);
+}
+
+native_sd_t nativeSdStats() {
+    native_sd_t stats;
+    stats.opens = native_sd_opens;
+    stats.lookups = native_sd_lookups;
+    stats.changes = native_sd_changes;
+    stats.writes = native_sd_writes;
+    stats.flushes = native_sd_flushes;
+    stats.closes = native_sd_closes;
+    stats.written = native_sd_written;
+    stats.calls = stats.opens + stats.lookups + stats.changes + stats.writes + stats.flushes + stats.closes;
+    return stats;
+}
+
+void nativeSdReset() {
+    native_sd_opens = 0;
+    native_sd_lookups = 0;
+    native_sd_changes = 0;
+    native_sd_writes = 0;
+    native_sd_flushes = 0;
+    native_sd_closes = 0;
+    native_sd_written = 0;
+}
+
+static uint64_t native_sd_used(const std::string & host_path) {
+    struct stat st;
+    if (lstat(host_path.c_str(), &st) != 0) {
+        return 0;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        return st.st_size;
+    }
+
+    uint64_t used = 0;
+    DIR * dir = opendir(host_path.c_str());
+    if (dir != NULL) {
+        struct dirent * entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+                used += native_sd_used(host_path + "/" + entry->d_name);
+            }
+        }
+        closedir(dir);
+    }
+    return used;
+}
+
+// *********************************************************************************************************************
+// SDClass
+
+uint64_t SDClass::usedBytes() {
+    return native_sd_used(nativeSdRoot());
+}
+
+File SDClass::open(const char * path, const char * mode) {
+    native_sd_opens++;
+    if (path == NULL || path[0] != '/') {
+        return File();
+    }
+
+    std::string host = nativeSdPath(path);
+    auto impl = std::make_shared<native_file_t>();
+    impl->path = path;
+
+    struct stat st;
+    if (stat(host.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+        if (strcmp(mode, FILE_READ) != 0) {
+            return File();
+        }
+
+        DIR * dir = opendir(host.c_str());
+        if (dir == NULL) {
+            return File();
+        }
+        struct dirent * entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+                impl->entries.push_back(entry->d_name);
+            }
+        }
+        closedir(dir);
+        std::sort(impl->entries.begin(), impl->entries.end());
+        impl->directory = true;
+        return File(impl);
+    }
+
+    impl->fp = fopen(host.c_str(), strcmp(mode, FILE_READ) == 0 ? "rb" : strcmp(mode, FILE_APPEND) == 0 ? "ab" : "wb");
+    if (impl->fp == NULL) {
+        return File();
+    }
+    return File(impl);
+}
+
+bool SDClass::exists(const char * path) {
+    native_sd_lookups++;
+    struct stat st;
+    return path != NULL && stat(nativeSdPath(path).c_str(), &st) == 0;
+}
+
+bool SDClass::remove(const char * path) {
+    native_sd_changes++;
+    return path != NULL && unlink(nativeSdPath(path).c_str()) == 0;
+}
+
+bool SDClass::rename(const char * from, const char * to) {
+    native_sd_changes++;
+    return from != NULL && to != NULL && ::rename(nativeSdPath(from).c_str(), nativeSdPath(to).c_str()) == 0;
+}
+
+bool SDClass::mkdir(const char * path) {
+    native_sd_changes++;
+    return path != NULL && ::mkdir(nativeSdPath(path).c_str(), 0755) == 0;
+}
+
+bool SDClass::rmdir(const char * path) {
+    native_sd_changes++;
+    return path != NULL && ::rmdir(nativeSdPath(path).c_str()) == 0;
+}
+
+// *********************************************************************************************************************
+// File
+
+File::operator bool() const {
+    return impl != nullptr && (impl->fp != NULL || impl->directory);
+}
+
+bool File::isDirectory() const {
+    return impl != nullptr && impl->directory;
+}
+
+const char * File::name() const {
+    if (impl == nullptr) {
+        return "";
+    }
+    size_t slash = impl->path.rfind('/');
+    return impl->path.c_str() + (slash == std::string::npos ? 0 : slash + 1);
+}
+
+const char * File::path() const {
+    return impl != nullptr ? impl->path.c_str() : "";
+}
+
+static size_t native_file_size(const native_file_t * impl) {
+    if (impl == nullptr || impl->fp == NULL) {
+        return 0;
+    }
+
+    struct stat st;
+    fflush(impl->fp);
+    return fstat(fileno(impl->fp), &st) == 0 ? (size_t)st.st_size : 0;
+}
+
+size_t File::size() const {
+    native_sd_lookups++;
+    return native_file_size(impl.get());
+}
+
+size_t File::position() const {
+    if (impl == nullptr || impl->fp == NULL) {
+        return 0;
+    }
+    long position = ftell(impl->fp);
+    return position < 0 ? 0 : (size_t)position;
+}
+
+bool File::seek(uint32_t position, SeekMode mode) {
+    native_sd_lookups++;
+    if (impl == nullptr || impl->fp == NULL) {
+        return false;
+    }
+    int whence = mode == SeekCur ? SEEK_CUR : mode == SeekEnd ? SEEK_END : SEEK_SET;
+    return fseek(impl->fp, (long)position, whence) == 0;
+}
+
+File File::openNextFile(const char * mode) {
+    if (impl == nullptr || !impl->directory || impl->next >= impl->entries.size()) {
+        return File();
+    }
+
+    std::string path = impl->path;
+    if (path.empty() || path.back() != '/') {
+        path += "/";
+    }
+    return SD.open((path + impl->entries[impl->next++]).c_str(), mode);
+}
+
+void File::close() {
+    if (impl != nullptr) {
+        native_sd_closes++;
+    }
+    impl.reset();
+}
+
+int File::available() {
+    if (impl == nullptr || impl->fp == NULL) {
+        return 0;
+    }
+    return (int)(native_file_size(impl.get()) - position());
+}
+
+int File::read() {
+    if (impl == nullptr || impl->fp == NULL) {
+        return -1;
+    }
+    int c = fgetc(impl->fp);
+    return c == EOF ? -1 : c;
+}
+
+int File::peek() {
+    if (impl == nullptr || impl->fp == NULL) {
+        return -1;
+    }
+    int c = fgetc(impl->fp);
+    if (c == EOF) {
+        return -1;
+    }
+    ungetc(c, impl->fp);
+    return c;
+}
+
+size_t File::read(uint8_t * buffer, size_t size) {
+    if (impl == nullptr || impl->fp == NULL) {
+        return 0;
+    }
+    return fread(buffer, 1, size, impl->fp);
+}
+
+size_t File::write(uint8_t c) {
+    return write(&c, 1);
+}
+
+size_t File::write(const uint8_t * buffer, size_t size) {
+    native_sd_writes++;
+    if (impl == nullptr || impl->fp == NULL) {
+        return 0;
+    }
+    size_t written = fwrite(buffer, 1, size, impl->fp);
+    native_sd_written += written;
+    return written;
+}
+
+void File::flush() {
+    native_sd_flushes++;
+    if (impl != nullptr && impl->fp != NULL) {
+        fflush(impl->fp);
+    }
+}
@@ -0,0 +1,329 @@
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <vector>
+#include <poll.h>
+#include <unistd.h>
+
+#include "driver/uart.h"
+#include "native.h"
+
+typedef struct {
+    std::mutex lock;
+    std::condition_variable changed;
+    bool installed = false;
+    bool loop_back = false;
+    std::vector<uint8_t> rx;            // ring of the received bytes, allocated by uart_driver_install()
+    size_t rx_head = 0;
+    size_t rx_count = 0;
+    std::vector<uint8_t> tx;            // written bytes, taken by nativeUartTaken()
+    QueueHandle_t events = NULL;
+    int fd = -1;
+    std::atomic<bool> reading{false};
+    std::thread reader;
+} native_uart_t;
+
+static native_uart_t native_uarts[UART_NUM_MAX];
+
+static native_uart_t * native_uart(uart_port_t uart) {
+    return uart >= 0 && uart < UART_NUM_MAX ? &native_uarts[uart] : NULL;
+}
+
+static void native_uart_read(native_uart_t * port);
+
+static void native_uart_event(native_uart_t * port, uart_event_type_t type, size_t size) {
+    uart_event_t event = {type, size, type == UART_DATA};
+
+    // the driver drops the event when its queue is full, the same happens here
+    if (port->events != NULL) {
+        xQueueSend(port->events, &event, 0);
+    }
+}
+
+// stores the bytes which fit, the caller holds the lock
+static size_t native_uart_store(native_uart_t * port, const uint8_t * data, size_t len) {
+    size_t stored = 0;
+    while (stored < len && port->rx_count < port->rx.size()) {
+        port->rx[(port->rx_head + port->rx_count) % port->rx.size()] = data[stored++];
+        port->rx_count++;
+    }
+    if (stored > 0) {
+        port->changed.notify_all();
+    }
+    return stored;
+}
+
+// *********************************************************************************************************************
+// driver
+
+esp_err_t uart_driver_install(uart_port_t uart, int rx_buffer_size, int tx_buffer_size, int queue_size, QueueHandle_t * queue, int flags) {
+    native_uart_t * port = native_uart(uart);
+    (void)tx_buffer_size;
+    (void)flags;
+
+    if (port == NULL || port->installed || rx_buffer_size <= 0) {
+        return ESP_FAIL;
+    }
+
+    std::lock_guard<std::mutex> guard(port->lock);
+    port->rx.assign(rx_buffer_size, 0);
+    port->rx_head = 0;
+    port->rx_count = 0;
+    port->tx.clear();
+    port->tx.reserve(4096);
+    if (queue_size > 0) {
+        port->events = xQueueCreate(queue_size, sizeof(uart_event_t));
+        if (queue != NULL) {
+            *queue = port->events;
+        }
+    }
+    port->installed = true;
+    if (port->fd >= 0 && !port->reading) {
+        port->reading = true;
+        port->reader = std::thread(native_uart_read, port);
+    }
+    return ESP_OK;
+}
+
+esp_err_t uart_driver_delete(uart_port_t uart) {
+    native_uart_t * port = native_uart(uart);
+    if (port == NULL || !port->installed) {
+        return ESP_FAIL;
+    }
+
+    nativeUartDetach(uart);
+    std::lock_guard<std::mutex> guard(port->lock);
+    if (port->events != NULL) {
+        vQueueDelete(port->events);
+        port->events = NULL;
+    }
+    port->rx.clear();
+    port->rx_count = 0;
+    port->installed = false;
+    return ESP_OK;
+}
+
+esp_err_t uart_param_config(uart_port_t uart, const uart_config_t * config) {
+    (void)config;
+    return native_uart(uart) != NULL ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t uart_set_pin(uart_port_t uart, int tx, int rx, int rts, int cts) {
+    (void)tx;
+    (void)rx;
+    (void)rts;
+    (void)cts;
+    return native_uart(uart) != NULL ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t uart_set_rx_timeout(uart_port_t uart, uint8_t symbols) {
+    (void)symbols;
+    return native_uart(uart) != NULL ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t uart_set_rx_full_threshold(uart_port_t uart, int threshold) {
+    (void)threshold;
+    return native_uart(uart) != NULL ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t uart_set_loop_back(uart_port_t uart, bool enable) {
+    native_uart_t * port = native_uart(uart);
+    if (port == NULL) {
+        return ESP_FAIL;
+    }
+
+    std::lock_guard<std::mutex> guard(port->lock);
+    port->loop_back = enable;
+    return ESP_OK;
+}
+
+esp_err_t uart_wait_tx_done(uart_port_t uart, TickType_t ticks) {
+    (void)ticks;
+    return native_uart(uart) != NULL ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t uart_flush_input(uart_port_t uart) {
+    native_uart_t * port = native_uart(uart);
+    if (port == NULL) {
+        return ESP_FAIL;
+    }
+
+    std::lock_guard<std::mutex> guard(port->lock);
+    port->rx_head = 0;
+    port->rx_count = 0;
+    port->changed.notify_all();
+    return ESP_OK;
+}
+
+esp_err_t uart_get_buffered_data_len(uart_port_t uart, size_t * size) {
+    native_uart_t * port = native_uart(uart);
+    if (port == NULL || size == NULL) {
+        return ESP_FAIL;
+    }
+
+    std::lock_guard<std::mutex> guard(port->lock);
+    *size = port->rx_count;
+    return ESP_OK;
+}
+
+int uart_read_bytes(uart_port_t uart, void * buffer, uint32_t length, TickType_t ticks) {
+    native_uart_t * port = native_uart(uart);
+    if (port == NULL || !port->installed) {
+        return -1;
+    }
+
+    std::unique_lock<std::mutex> guard(port->lock);
+    auto ready = [port, length] {return port->rx_count >= length;};
+    if (ticks == portMAX_DELAY) {
+        port->changed.wait(guard, ready);
+    } else if (ticks > 0) {
+        port->changed.wait_for(guard, std::chrono::milliseconds(ticks), ready);
+    }
+
+    uint32_t read = 0;
+    while (read < length && port->rx_count > 0) {
+        ((uint8_t *)buffer)[read++] = port->rx[port->rx_head];
+        port->rx_head = (port->rx_head + 1) % port->rx.size();
+        port->rx_count--;
+    }
+    port->changed.notify_all();
+    return (int)read;
+}
+
+int uart_write_bytes(uart_port_t uart, const void * data, size_t size) {
+    native_uart_t * port = native_uart(uart);
+    if (port == NULL || !port->installed) {
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> guard(port->lock);
+    // the bytes written to an attached descriptor are not kept (nobody takes them)
+    if (port->fd < 0) {
+        port->tx.insert(port->tx.end(), (const uint8_t *)data, (const uint8_t *)data + size);
+    }
+    if (port->loop_back) {
+        native_uart_store(port, (const uint8_t *)data, size);
+        native_uart_event(port, UART_DATA, size);
+    } else if (port->fd >= 0) {
+        size_t written = 0;
+        while (written < size) {
+            ssize_t n = ::write(port->fd, (const uint8_t *)data + written, size - written);
+            if (n <= 0) {
+                break;
+            }
+            written += n;
+        }
+    }
+    return (int)size;
+}
+
+// *********************************************************************************************************************
+// test controls
+
+void nativeUartFeed(uart_port_t uart, const uint8_t * data, size_t len) {
+    native_uart_t * port = native_uart(uart);
+    if (port == NULL || !port->installed || len == 0) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard(port->lock);
+    size_t stored = native_uart_store(port, data, len);
+    native_uart_event(port, UART_DATA, stored);
+    if (stored < len) {
+        native_uart_event(port, UART_BUFFER_FULL, 0);
+    }
+}
+
+void nativeUartOverflow(uart_port_t uart) {
+    native_uart_t * port = native_uart(uart);
+    if (port == NULL || !port->installed) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard(port->lock);
+    port->rx_head = 0;
+    port->rx_count = 0;
+    native_uart_event(port, UART_FIFO_OVF, 0);
+}
+
+// the reader waits for the space in the RX buffer (a pseudo-terminal keeps the bytes), so nothing is lost
+static void native_uart_read(native_uart_t * port) {
+    uint8_t buffer[512];
+
+    while (port->reading) {
+        struct pollfd pfd = {port->fd, POLLIN, 0};
+        int ready = poll(&pfd, 1, 50);
+        if (ready < 0 || (ready > 0 && (pfd.revents & POLLIN) == 0)) {
+            break;
+        }
+        if (ready == 0) {
+            continue;
+        }
+
+        ssize_t n = ::read(port->fd, buffer, sizeof(buffer));
+        if (n <= 0) {
+            break;
+        }
+
+        size_t stored = 0;
+        std::unique_lock<std::mutex> guard(port->lock);
+        while (stored < (size_t)n && port->reading) {
+            size_t chunk = native_uart_store(port, buffer + stored, n - stored);
+            if (chunk > 0) {
+                stored += chunk;
+                native_uart_event(port, UART_DATA, chunk);
+            } else {
+                port->changed.wait_for(guard, std::chrono::milliseconds(50));
+            }
+        }
+    }
+    port->reading = false;
+}
+
+bool nativeUartAttach(uart_port_t uart, int fd) {
+    native_uart_t * port = native_uart(uart);
+    if (port == NULL || fd < 0 || port->fd >= 0) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> guard(port->lock);
+    port->fd = fd;
+    if (!port->installed) {
+        // the reader is started by uart_driver_install()
+        return true;
+    }
+    port->reading = true;
+    port->reader = std::thread(native_uart_read, port);
+    return true;
+}
+
+void nativeUartDetach(uart_port_t uart) {
+    native_uart_t * port = native_uart(uart);
+    if (port == NULL || port->fd < 0) {
+        return;
+    }
+
+    port->reading = false;
+    port->changed.notify_all();
+    if (port->reader.joinable()) {
+        port->reader.join();
+    }
+
+    std::lock_guard<std::mutex> guard(port->lock);
+    port->fd = -1;
+}
+
+std::vector<uint8_t> nativeUartTaken(uart_port_t uart) {
+    std::vector<uint8_t> taken;
+    native_uart_t * port = native_uart(uart);
+    if (port == NULL) {
+        return taken;
+    }
+
+    std::lock_guard<std::mutex> guard(port->lock);
+    taken.swap(port->tx);
+    port->tx.reserve(4096);
+    return taken;
+}
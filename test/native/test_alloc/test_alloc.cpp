@@ -0,0 +1,131 @@
+/**
+ * Heap operations of the Zigbee reception path per 10k messages.
+ *
+ * The frames are fed to the UART and received the same as by the receiving task: `receive_message()` into the message
+ * created once, `deserialize_attr()` / `deserialize_attr_batch()` into the attributes created once. After the first
+ * message of each kind grew the load buffer, no message may allocate. The heap is counted on glibc only, the test is
+ * ignored in `[env:native_asan]`:
+ *
+ *   pio test -e native -f native/test_alloc -v
+ */
+
+#include <unity.h>
+#include <stdio.h>
+#include <vector>
+
+#include "libZigbee.h"
+#include "native.h"
+#include "../ncp.h"
+
+#define ALLOC_MESSAGES 10000
+
+static esp_zb_ieee_addr_t alloc_ieee = {0x01, 0x00, 0x00, 0x00, 0x00, 0x4B, 0x12, 0x00};
+static std::vector<std::vector<uint8_t>> alloc_reports;
+static std::vector<std::vector<uint8_t>> alloc_batches;
+
+static void alloc_frames() {
+    char load[512];
+    size_t length = 0;
+    iot_alarm_attr_load_t * attr = create_attr("SIM", "sensor", "IAS zone", 0x0500000D, alloc_ieee, 0x1234, 1, 1,
+                                               0x0500, 0x0002, ESP_ZB_ZCL_ATTR_TYPE_U32, 0);
+    iot_alarm_attr_load_t batch[ZIGBEE_ATTR_BATCH_MAX];
+
+    for (uint32_t i = 0; i < ALLOC_MESSAGES / 2; i++) {
+        attr->value = i;
+        serialize_attr(attr, load, &length);
+        alloc_reports.push_back(ncpFrame(IOT_ALARM_MSGDIR_NOTIFICATION, IOT_ALARM_MSGSTATUS_SUCCESS,
+                                         IOT_ALARM_MSGTYPE_ZB_DATA_REPORT, (uint8_t)i, load, length));
+
+        for (uint32_t j = 0; j < ZIGBEE_ATTR_BATCH_MAX; j++) {
+            batch[j] = *attr;
+            batch[j].attr_id = (uint16_t)j;
+            batch[j].value = i + j;
+        }
+        serialize_attr_batch(batch, ZIGBEE_ATTR_BATCH_MAX, load, sizeof(load), &length);
+        alloc_batches.push_back(ncpFrame(IOT_ALARM_MSGDIR_NOTIFICATION, IOT_ALARM_MSGSTATUS_SUCCESS,
+                                         IOT_ALARM_MSGTYPE_ZB_DATA_READ_BATCH, (uint8_t)i, load, length));
+    }
+    destroy_attr(&attr);
+}
+
+// receives one frame and decodes its load, the same as the receiving task
+static bool alloc_receive(const std::vector<uint8_t> & frame, iot_alarm_message_t ** msg, iot_alarm_attr_load_t ** attr,
+                          iot_alarm_attr_load_t * batch, size_t * count) {
+    nativeUartFeed(UART, frame.data(), frame.size());
+    if (receive_message(UART, rx_buffer, msg, RX_BUF_SIZE-1, 0) <= 0) {
+        return false;
+    }
+
+    if ((*msg)->id == IOT_ALARM_MSGTYPE_ZB_DATA_READ_BATCH) {
+        return deserialize_attr_batch(batch, ZIGBEE_ATTR_BATCH_MAX, count, (uint8_t*)(*msg)->load, (*msg)->length);
+    }
+    *count = 1;
+    return deserialize_attr(attr, (uint8_t*)(*msg)->load, (*msg)->length);
+}
+
+// *********************************************************************************************************************
+
+void test_alloc_receive() {
+    if (!nativeHeapCounted()) {
+        TEST_IGNORE_MESSAGE("the heap is not counted in this build");
+    }
+
+    iot_alarm_message_t * msg = create_message(IOT_ALARM_MSGDIR_MAX, IOT_ALARM_MSGSTATUS_MAX, IOT_ALARM_MSGTYPE_MAX, 1, "\0");
+    iot_alarm_attr_load_t * attr = create_attr("\0", "\0", "\0", 0, alloc_ieee, 0, 0, 0, 0, 0, ESP_ZB_ZCL_ATTR_TYPE_U8, 0);
+    iot_alarm_attr_load_t batch[ZIGBEE_ATTR_BATCH_MAX];
+    size_t count = 0;
+
+    // the first message of each kind grows the load buffer
+    nativeHeapReset();
+    TEST_ASSERT_TRUE(alloc_receive(alloc_reports[0], &msg, &attr, batch, &count));
+    TEST_ASSERT_TRUE(alloc_receive(alloc_batches[0], &msg, &attr, batch, &count));
+    native_heap_t warm_up = nativeHeapStats();
+
+    nativeHeapReset();
+    uint32_t received = 0;
+    uint64_t attributes = 0;
+    for (uint32_t i = 0; i < ALLOC_MESSAGES / 2; i++) {
+        TEST_ASSERT_TRUE(alloc_receive(alloc_reports[i], &msg, &attr, batch, &count));
+        TEST_ASSERT_EQUAL_UINT32(i, attr->value);
+        attributes += count;
+        TEST_ASSERT_TRUE(alloc_receive(alloc_batches[i], &msg, &attr, batch, &count));
+        TEST_ASSERT_EQUAL_size_t(ZIGBEE_ATTR_BATCH_MAX, count);
+        TEST_ASSERT_EQUAL_UINT32(i + ZIGBEE_ATTR_BATCH_MAX - 1, batch[ZIGBEE_ATTR_BATCH_MAX - 1].value);
+        attributes += count;
+        received += 2;
+    }
+    native_heap_t heap = nativeHeapStats();
+
+    destroy_message(&msg);
+    destroy_attr(&attr);
+
+    char line[160];
+    snprintf(line, sizeof(line), "first report and batch: %llu allocations; %u messages (%llu attributes): %llu allocations, %llu frees",
+             (unsigned long long)warm_up.allocations, (unsigned)received, (unsigned long long)attributes,
+             (unsigned long long)heap.allocations, (unsigned long long)heap.frees);
+    TEST_MESSAGE(line);
+    TEST_ASSERT_EQUAL_UINT32(ALLOC_MESSAGES, received);
+    TEST_ASSERT_EQUAL_UINT64(0, heap.allocations);
+    TEST_ASSERT_EQUAL_UINT64(0, heap.frees);
+}
+
+// *********************************************************************************************************************
+
+void setUp() {}
+
+void tearDown() {}
+
+int main() {
+    nativeSerialMute(true);
+    bool ready = ncpStart();
+    // the stand-in of the module allocates, nothing is sent to it here
+    ncpStop();
+    alloc_frames();
+
+    UNITY_BEGIN();
+    if (ready) {
+        RUN_TEST(test_alloc_receive);
+    }
+    int failures = UNITY_END();
+    return failures || !ready;
+}
@@ -0,0 +1,275 @@
+/**
+ * Encode and decode microbenchmarks of the Zigbee message and attribute codecs.
+ *
+ * Every benchmark checks that the decoded value equals the encoded one and prints the time per call and the encoded
+ * size. The times are not asserted, they depend on the host:
+ *
+ *   pio test -e native -f native/test_bench_codec -v
+ *   BENCH_ITERATIONS=1000000 pio test -e native -f native/test_bench_codec -v
+ */
+
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include <ArduinoJson.h>
+
+#include "libZigbee.h"
+#include "native.h"
+#include "../ncp.h"
+
+#define BENCH_ITERATIONS_DEFAULT 100000
+#define BENCH_DEVICE_HANDLE 0x0101
+
+static uint32_t bench_iterations = BENCH_ITERATIONS_DEFAULT;
+static bool bench_ready = false;
+static volatile uint32_t bench_sink = 0;
+
+static esp_zb_ieee_addr_t bench_ieee = {0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88};
+static iot_alarm_attr_load_t bench_attr;
+static iot_alarm_attr_load_t bench_batch[ZIGBEE_ATTR_BATCH_MAX];
+
+// runs the body the given number of times and prints the time per call with the encoded size (read after the run)
+template <typename F>
+static void bench_run(const char * name, const size_t & bytes, F body) {
+    // the first calls allocate the reused buffers (e.g. the load of the received message)
+    for (uint32_t i = 0; i < 100; i++) {
+        body(i);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < bench_iterations; i++) {
+        body(i);
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+    char line[160];
+    snprintf(line, sizeof(line), "%-28s %9.1f ns/call %6u bytes", name, (double)elapsed / bench_iterations, (unsigned)bytes);
+    TEST_MESSAGE(line);
+}
+
+static void bench_assert_key(const iot_alarm_attr_load_t * expected, const iot_alarm_attr_load_t * actual) {
+    TEST_ASSERT_EQUAL_MEMORY(expected->ieee_addr, actual->ieee_addr, sizeof(expected->ieee_addr));
+    TEST_ASSERT_EQUAL_UINT8(expected->endpoint_id, actual->endpoint_id);
+    TEST_ASSERT_EQUAL_UINT16(expected->cluster_id, actual->cluster_id);
+    TEST_ASSERT_EQUAL_UINT16(expected->attr_id, actual->attr_id);
+    TEST_ASSERT_EQUAL_UINT32(expected->value_type, actual->value_type);
+    TEST_ASSERT_EQUAL_UINT32(expected->value, actual->value);
+}
+
+// *********************************************************************************************************************
+
+void test_bench_message() {
+    char load[256];
+    size_t load_len = 0;
+    serialize_attr(&bench_attr, load, &load_len);
+
+    iot_alarm_message_t msg = {IOT_ALARM_MSGDIR_NOTIFICATION, IOT_ALARM_MSGSTATUS_SUCCESS, IOT_ALARM_MSGTYPE_ZB_DATA_REPORT,
+                               (uint32_t)load_len, load, 0, 0};
+    uint8_t buffer[512];
+    size_t bytes = 0;
+    bench_run("serialize_message", bytes, [&](uint32_t i) {
+        msg.seq = (uint8_t)i;
+        serialize_message(&msg, buffer, &bytes);
+        bench_sink += bytes;
+    });
+
+    iot_alarm_message_t * rx = create_message(IOT_ALARM_MSGDIR_MAX, IOT_ALARM_MSGSTATUS_MAX, IOT_ALARM_MSGTYPE_MAX, 1, "\0");
+    TEST_ASSERT_NOT_NULL(rx);
+    bench_run("deserialize_message", bytes, [&](uint32_t i) {
+        (void)i;
+        bench_sink += deserialize_message(&rx, buffer, bytes);
+    });
+    TEST_ASSERT_TRUE(deserialize_message(&rx, buffer, bytes));
+    TEST_ASSERT_EQUAL_UINT32(load_len, rx->length);
+    TEST_ASSERT_EQUAL_MEMORY(load, rx->load, load_len);
+    destroy_message(&rx);
+}
+
+void test_bench_frame() {
+    uint8_t payload[128];
+    memset(payload, 0xA5, sizeof(payload));
+    uint8_t frame[sizeof(payload) + ZIGBEE_FRAME_OVERHEAD];
+    size_t length = 0;
+    bench_run("encode_frame", length, [&](uint32_t i) {
+        length = encode_frame((uint8_t)i, payload, sizeof(payload), frame, sizeof(frame));
+        bench_sink += length;
+    });
+    TEST_ASSERT_EQUAL_size_t(sizeof(frame), length);
+
+    uint8_t buffer[256];
+    zigbee_frame_parser_t parser;
+    frame_parser_init(&parser, buffer, sizeof(buffer));
+    bench_run("frame_parser_feed (frame)", length, [&](uint32_t i) {
+        (void)i;
+        for (size_t j = 0; j < length; j++) {
+            bench_sink += frame_parser_feed(&parser, frame[j]);
+        }
+    });
+    TEST_ASSERT_EQUAL_UINT32(0, parser.crc_errors);
+    TEST_ASSERT_EQUAL_MEMORY(payload, buffer, sizeof(payload));
+}
+
+void test_bench_attr() {
+    char buffer[256];
+    size_t bytes = 0;
+    bench_run("serialize_attr", bytes, [&](uint32_t i) {
+        (void)i;
+        serialize_attr(&bench_attr, buffer, &bytes);
+        bench_sink += bytes;
+    });
+
+    iot_alarm_attr_load_t * attr = create_attr("\0", "\0", "\0", 0, bench_ieee, 0, 0, 0, 0, 0, ESP_ZB_ZCL_ATTR_TYPE_U8, 0);
+    TEST_ASSERT_NOT_NULL(attr);
+    bench_run("deserialize_attr", bytes, [&](uint32_t i) {
+        (void)i;
+        bench_sink += deserialize_attr(&attr, (uint8_t *)buffer, bytes);
+    });
+    TEST_ASSERT_TRUE(compare_attr(bench_attr, *attr));
+
+    size_t compact = 0;
+    serialize_attr_compact(&bench_attr, BENCH_DEVICE_HANDLE, buffer, &compact);
+    TEST_ASSERT_EQUAL_size_t(ZIGBEE_ATTR_COMPACT_SIZE, compact);
+    bench_run("deserialize_attr (compact)", compact, [&](uint32_t i) {
+        (void)i;
+        bench_sink += deserialize_attr(&attr, (uint8_t *)buffer, compact);
+    });
+    TEST_ASSERT_TRUE(compare_attr(bench_attr, *attr));
+    destroy_attr(&attr);
+}
+
+void test_bench_attr_batch() {
+    char buffer[ZIGBEE_COMMAND_FRAME_MAX];
+    size_t bytes = 0;
+    bench_run("serialize_attr_batch (24)", bytes, [&](uint32_t i) {
+        (void)i;
+        bench_sink += serialize_attr_batch(bench_batch, ZIGBEE_ATTR_BATCH_MAX, buffer, sizeof(buffer), &bytes);
+    });
+
+    static iot_alarm_attr_load_t attrs[ZIGBEE_ATTR_BATCH_MAX];
+    size_t count = 0;
+    bench_run("deserialize_attr_batch (24)", bytes, [&](uint32_t i) {
+        (void)i;
+        bench_sink += deserialize_attr_batch(attrs, ZIGBEE_ATTR_BATCH_MAX, &count, (uint8_t *)buffer, bytes);
+    });
+    TEST_ASSERT_EQUAL_size_t(ZIGBEE_ATTR_BATCH_MAX, count);
+    for (size_t i = 0; i < count; i++) {
+        bench_assert_key(&bench_batch[i], &attrs[i]);
+    }
+}
+
+void test_bench_attr_json() {
+    char ieee_str[ZIGBEE_IEEE_STR_SIZE];
+    char buffer[ZIGBEE_ATTR_JSON_MAX];
+    size_t bytes = 0;
+    zigbee_ieee_str(bench_attr.ieee_addr, ieee_str);
+    bench_run("pack_attr_json", bytes, [&](uint32_t i) {
+        (void)i;
+        bytes = pack_attr_json(&bench_attr, ieee_str, buffer, sizeof(buffer));
+        bench_sink += bytes;
+    });
+    TEST_ASSERT_TRUE(bytes > 0);
+
+    String json(buffer);
+    iot_alarm_attr_load_t attr = {};
+    bench_run("unpack_attr", bytes, [&](uint32_t i) {
+        (void)i;
+        bench_sink += unpack_attr(&attr, json);
+    });
+    bench_assert_key(&bench_attr, &attr);
+}
+
+void test_bench_attr_msgpack() {
+    char ieee_str[ZIGBEE_IEEE_STR_SIZE];
+    uint8_t buffer[ZIGBEE_ATTR_JSON_MAX];
+    size_t bytes = 0;
+    zigbee_ieee_str(bench_attr.ieee_addr, ieee_str);
+    bench_run("pack_attr_msgpack", bytes, [&](uint32_t i) {
+        (void)i;
+        bytes = pack_attr_msgpack(&bench_attr, ieee_str, buffer, sizeof(buffer));
+        bench_sink += bytes;
+    });
+    TEST_ASSERT_TRUE(bytes > 0);
+
+    iot_alarm_attr_load_t attr = {};
+    bench_run("unpack_attr_msgpack", bytes, [&](uint32_t i) {
+        (void)i;
+        bench_sink += unpack_attr_msgpack(&attr, buffer, bytes);
+    });
+    bench_assert_key(&bench_attr, &attr);
+}
+
+void test_bench_attr_batch_msgpack() {
+    std::vector<uint8_t> buffer(ZIGBEE_ATTR_BATCH_MSGPACK_MAX);
+    size_t bytes = 0;
+    bench_run("pack_attr_batch_msgpack (24)", bytes, [&](uint32_t i) {
+        (void)i;
+        bytes = pack_attr_batch_msgpack(bench_batch, ZIGBEE_ATTR_BATCH_MAX, buffer.data(), buffer.size());
+        bench_sink += bytes;
+    });
+    TEST_ASSERT_TRUE(bytes > 0);
+
+    // the batched command is the array of the attributes of the report
+    JsonDocument doc;
+    TEST_ASSERT_FALSE(deserializeMsgPack(doc, buffer.data(), bytes));
+    size_t command = serializeMsgPack(doc["attrs"], buffer.data(), buffer.size());
+    TEST_ASSERT_TRUE(command > 0);
+
+    static iot_alarm_attr_load_t attrs[ZIGBEE_ATTR_BATCH_MAX];
+    size_t count = 0;
+    bench_run("unpack_attr_batch_msgpack (24)", command, [&](uint32_t i) {
+        (void)i;
+        bench_sink += unpack_attr_batch_msgpack(attrs, ZIGBEE_ATTR_BATCH_MAX, &count, buffer.data(), command);
+    });
+    TEST_ASSERT_EQUAL_size_t(ZIGBEE_ATTR_BATCH_MAX, count);
+    for (size_t i = 0; i < count; i++) {
+        bench_assert_key(&bench_batch[i], &attrs[i]);
+    }
+}
+
+// *********************************************************************************************************************
+
+void setUp() {
+    TEST_ASSERT_TRUE_MESSAGE(bench_ready, "The Zigbee stack could not be initialized!");
+}
+
+void tearDown() {}
+
+int main() {
+    const char * iterations = getenv("BENCH_ITERATIONS");
+    if (iterations != NULL && atoi(iterations) > 0) {
+        bench_iterations = (uint32_t)atoi(iterations);
+    }
+
+    nativeSerialMute(true);
+
+    iot_alarm_attr_load_t * attr = create_attr("LUMI", "lumi.sensor_motion.aq2", "motion", 0x0402, bench_ieee, 0x1234, 2, 1,
+                                               0x0500, 0x0002, ESP_ZB_ZCL_ATTR_TYPE_16BITMAP, 0x0001);
+    bench_attr = *attr;
+    destroy_attr(&attr);
+    for (size_t i = 0; i < ZIGBEE_ATTR_BATCH_MAX; i++) {
+        bench_batch[i] = bench_attr;
+        bench_batch[i].endpoint_id = 1 + i % 4;
+        bench_batch[i].attr_id = (uint16_t)i;
+        bench_batch[i].value = 1000 * i;
+    }
+
+    // the compact attribute is decoded with the metadata of the registered device
+    std::vector<uint8_t> info = ncpDevInfo(BENCH_DEVICE_HANDLE, &bench_attr);
+    bench_ready = ncpStart() && device_registry_update(info.data(), info.size());
+
+    UNITY_BEGIN();
+    RUN_TEST(test_bench_message);
+    RUN_TEST(test_bench_frame);
+    RUN_TEST(test_bench_attr);
+    RUN_TEST(test_bench_attr_batch);
+    RUN_TEST(test_bench_attr_json);
+    RUN_TEST(test_bench_attr_msgpack);
+    RUN_TEST(test_bench_attr_batch_msgpack);
+    int failures = UNITY_END();
+
+    ncpStop();
+    return failures;
+}
@@ -0,0 +1,139 @@
+/**
+ * Bytes saved on the UART and on MQTT by the device registry (compact attribute frames, metadata published once).
+ *
+ * One IAS zone report is encoded the way it was before the registry (the full attribute in the frame, the
+ * manufacturer, name and type strings in every MQTT message) and the way it is now (compact frame, retained device
+ * message). The totals for a device which sends 1 to 1000 reports include the `IOT_ALARM_MSGTYPE_ZB_DEV_INFO` frame
+ * and the device message sent once. MQTT bytes are payload bytes (the topics are not counted):
+ *
+ *   pio test -e native -f native/test_byte_savings -v
+ */
+
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <ArduinoJson.h>
+
+#include "libZigbee.h"
+#include "native.h"
+#include "../ncp.h"
+
+#define SAVINGS_HANDLE 0x0101
+
+static esp_zb_ieee_addr_t savings_ieee = {0x01, 0x00, 0x00, 0x00, 0x00, 0x4B, 0x12, 0x00};
+static iot_alarm_attr_load_t * savings_attr = NULL;
+static zigbee_device_t savings_dev;
+static bool savings_registered = false;
+
+static size_t savings_frame(message_type_t id, const void * load, size_t len) {
+    return ncpFrame(IOT_ALARM_MSGDIR_NOTIFICATION, IOT_ALARM_MSGSTATUS_SUCCESS, id, 1, load, len).size();
+}
+
+// attribute message of the format before the registry (the metadata repeated in every message)
+static size_t savings_json_legacy(iot_alarm_attr_load_t * attr) {
+    String json;
+    TEST_ASSERT_TRUE(pack_attr(attr, &json));
+
+    JsonDocument doc;
+    TEST_ASSERT_FALSE(deserializeJson(doc, json));
+    doc["device"]["manufacturer"] = attr->manuf;
+    doc["device"]["name"] = attr->name;
+    doc["device"]["type"] = attr->type;
+
+    String legacy;
+    serializeJson(doc, legacy);
+    return legacy.length();
+}
+
+// *********************************************************************************************************************
+
+void test_savings_compact_frame() {
+    TEST_ASSERT_TRUE(savings_registered);
+
+    char load[256];
+    size_t length = 0;
+    serialize_attr_compact(savings_attr, SAVINGS_HANDLE, load, &length);
+    TEST_ASSERT_EQUAL_size_t(ZIGBEE_ATTR_COMPACT_SIZE, length);
+
+    // the receiver completes the compact attribute from the registry
+    iot_alarm_attr_load_t * attr = create_attr("\0", "\0", "\0", 0, savings_ieee, 0, 0, 0, 0, 0, ESP_ZB_ZCL_ATTR_TYPE_U8, 0);
+    TEST_ASSERT_TRUE(deserialize_attr(&attr, (uint8_t *)load, length));
+    TEST_ASSERT_TRUE(compare_attr(*savings_attr, *attr));
+    destroy_attr(&attr);
+}
+
+void test_savings_uart_mqtt() {
+    TEST_ASSERT_TRUE(savings_registered);
+
+    char load[256];
+    size_t full = 0;
+    size_t compact = 0;
+    serialize_attr(savings_attr, load, &full);
+    size_t uart_full = savings_frame(IOT_ALARM_MSGTYPE_ZB_DATA_REPORT, load, full);
+    serialize_attr_compact(savings_attr, SAVINGS_HANDLE, load, &compact);
+    size_t uart_compact = savings_frame(IOT_ALARM_MSGTYPE_ZB_DATA_REPORT, load, compact);
+    std::vector<uint8_t> info = ncpDevInfo(SAVINGS_HANDLE, savings_attr);
+    size_t uart_dev_info = savings_frame(IOT_ALARM_MSGTYPE_ZB_DEV_INFO, info.data(), info.size());
+
+    String json;
+    String device;
+    TEST_ASSERT_TRUE(pack_attr(savings_attr, &json));
+    TEST_ASSERT_TRUE(pack_device(&savings_dev, &device));
+    size_t mqtt_full = savings_json_legacy(savings_attr);
+    size_t mqtt_compact = json.length();
+    size_t mqtt_device = device.length();
+
+    char line[160];
+    snprintf(line, sizeof(line), "UART frame: %u B -> %u B (%+.0f%%), DEV_INFO frame %u B once per device",
+             (unsigned)uart_full, (unsigned)uart_compact, 100.0 * ((double)uart_compact - uart_full) / uart_full, (unsigned)uart_dev_info);
+    TEST_MESSAGE(line);
+    snprintf(line, sizeof(line), "MQTT attribute: %u B -> %u B (%+.0f%%), device message %u B once per device (retained)",
+             (unsigned)mqtt_full, (unsigned)mqtt_compact, 100.0 * ((double)mqtt_compact - mqtt_full) / mqtt_full, (unsigned)mqtt_device);
+    TEST_MESSAGE(line);
+
+    const uint32_t reports[] = {1, 10, 100, 1000};
+    for (uint32_t n : reports) {
+        uint64_t uart_before = (uint64_t)n * uart_full;
+        uint64_t uart_after = uart_dev_info + (uint64_t)n * uart_compact;
+        uint64_t mqtt_before = (uint64_t)n * mqtt_full;
+        uint64_t mqtt_after = mqtt_device + (uint64_t)n * mqtt_compact;
+        snprintf(line, sizeof(line), "%4u reports: UART %7llu B -> %7llu B, MQTT %7llu B -> %7llu B",
+                 (unsigned)n, (unsigned long long)uart_before, (unsigned long long)uart_after,
+                 (unsigned long long)mqtt_before, (unsigned long long)mqtt_after);
+        TEST_MESSAGE(line);
+
+        // the metadata sent once pay off after a few reports
+        if (n >= 10) {
+            TEST_ASSERT_TRUE(uart_after < uart_before);
+            TEST_ASSERT_TRUE(mqtt_after < mqtt_before);
+        }
+    }
+    TEST_ASSERT_TRUE(uart_compact < uart_full);
+    TEST_ASSERT_TRUE(mqtt_compact < mqtt_full);
+}
+
+// *********************************************************************************************************************
+
+void setUp() {}
+
+void tearDown() {}
+
+int main() {
+    nativeSerialMute(true);
+    bool ready = ncpStart();
+
+    savings_attr = create_attr("LUMI", "lumi.sensor_magnet.aq2", "IAS zone contact sensor", 0x0500000D, savings_ieee,
+                               0x1234, 1, 1, 0x0500, 0x0002, ESP_ZB_ZCL_ATTR_TYPE_U32, 0x21);
+    std::vector<uint8_t> info = ncpDevInfo(SAVINGS_HANDLE, savings_attr);
+    savings_registered = ready && device_registry_update(info.data(), info.size(), &savings_dev);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_savings_compact_frame);
+    RUN_TEST(test_savings_uart_mqtt);
+    int failures = UNITY_END();
+
+    destroy_attr(&savings_attr);
+    ncpStop();
+    return failures;
+}
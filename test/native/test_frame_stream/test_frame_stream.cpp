@@ -0,0 +1,348 @@
+/**
+ * Fragmented and noisy byte streams through the frame parser and `receive_message()`, and the parser throughput.
+ *
+ * The frames are split at every byte, fed in random UART chunks, surrounded by garbage and corrupted. A corrupted
+ * frame must never be accepted and the parser must pick up the next frames again. The throughput of the parser alone
+ * and of the whole UART reception path is printed (not asserted):
+ *
+ *   pio test -e native -f native/test_frame_stream -v
+ */
+
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "libZigbee.h"
+#include "native.h"
+#include "../ncp.h"
+
+typedef std::vector<uint8_t> bytes_t;
+
+static uint32_t stream_state = 0x9E3779B9U;
+
+static uint32_t stream_rand() {
+    stream_state ^= stream_state << 13;
+    stream_state ^= stream_state >> 17;
+    stream_state ^= stream_state << 5;
+    return stream_state;
+}
+
+static esp_zb_ieee_addr_t stream_ieee = {0x01, 0x00, 0x00, 0x00, 0x00, 0x4B, 0x12, 0x00};
+
+// attribute report of the given value, the value is the key which identifies the frame
+static bytes_t stream_report(uint32_t value, uint8_t seq) {
+    char load[256];
+    size_t length = 0;
+    iot_alarm_attr_load_t * attr = create_attr("SIM", "sensor", "IAS zone", 0x0500000D, stream_ieee, 0x1234, 1, 1,
+                                               0x0500, 0x0002, ESP_ZB_ZCL_ATTR_TYPE_U32, value);
+    TEST_ASSERT_NOT_NULL(attr);
+    serialize_attr(attr, load, &length);
+    destroy_attr(&attr);
+    return ncpFrame(IOT_ALARM_MSGDIR_NOTIFICATION, IOT_ALARM_MSGSTATUS_SUCCESS, IOT_ALARM_MSGTYPE_ZB_DATA_REPORT, seq, load, length);
+}
+
+// value of the report in the received payload, the value is the key of the frame
+static uint32_t stream_value(uint8_t * payload, size_t length) {
+    static iot_alarm_message_t * msg = create_message(IOT_ALARM_MSGDIR_MAX, IOT_ALARM_MSGSTATUS_MAX, IOT_ALARM_MSGTYPE_MAX, 1, "\0");
+    static iot_alarm_attr_load_t * attr = create_attr("\0", "\0", "\0", 0, stream_ieee, 0, 0, 0, 0, 0, ESP_ZB_ZCL_ATTR_TYPE_U8, 0);
+
+    TEST_ASSERT_TRUE(deserialize_message(&msg, payload, length));
+    TEST_ASSERT_TRUE(deserialize_attr(&attr, (uint8_t*)msg->load, msg->length));
+    return attr->value;
+}
+
+static bytes_t stream_garbage(size_t len, bool sof) {
+    bytes_t garbage(len);
+    for (uint8_t & byte : garbage) {
+        do {
+            byte = (uint8_t)stream_rand();
+        } while (!sof && byte == ZIGBEE_FRAME_SOF);
+    }
+    return garbage;
+}
+
+// feeds the stream to a parser and returns the values of the accepted frames
+static std::vector<uint32_t> stream_parse(zigbee_frame_parser_t * parser, const bytes_t & stream) {
+    std::vector<uint32_t> values;
+    for (uint8_t byte : stream) {
+        int length = frame_parser_feed(parser, byte);
+        if (length > 0) {
+            values.push_back(stream_value(parser->buffer, length));
+        }
+    }
+    return values;
+}
+
+// *********************************************************************************************************************
+// parser
+
+void test_frame_split_at_every_byte() {
+    bytes_t stream;
+    for (uint32_t i = 0; i < 3; i++) {
+        bytes_t frame = stream_report(100 + i, i + 1);
+        stream.insert(stream.end(), frame.begin(), frame.end());
+    }
+
+    uint8_t buffer[RX_BUF_SIZE];
+    for (size_t split = 1; split < stream.size(); split++) {
+        zigbee_frame_parser_t parser;
+        frame_parser_init(&parser, buffer, sizeof(buffer));
+
+        std::vector<uint32_t> values = stream_parse(&parser, bytes_t(stream.begin(), stream.begin() + split));
+        std::vector<uint32_t> rest = stream_parse(&parser, bytes_t(stream.begin() + split, stream.end()));
+        values.insert(values.end(), rest.begin(), rest.end());
+
+        TEST_ASSERT_EQUAL_size_t(3, values.size());
+        for (uint32_t i = 0; i < 3; i++) {
+            TEST_ASSERT_EQUAL_UINT32(100 + i, values[i]);
+        }
+    }
+}
+
+void test_frame_garbage_between_frames() {
+    uint8_t buffer[RX_BUF_SIZE];
+    zigbee_frame_parser_t parser;
+    frame_parser_init(&parser, buffer, sizeof(buffer));
+
+    // the garbage without the start of frame byte is skipped, no frame is lost
+    bytes_t stream;
+    for (uint32_t i = 0; i < 500; i++) {
+        bytes_t garbage = stream_garbage(stream_rand() % 40, false);
+        bytes_t frame = stream_report(i, (uint8_t)i);
+        stream.insert(stream.end(), garbage.begin(), garbage.end());
+        stream.insert(stream.end(), frame.begin(), frame.end());
+    }
+
+    std::vector<uint32_t> values = stream_parse(&parser, stream);
+    TEST_ASSERT_EQUAL_size_t(500, values.size());
+    for (uint32_t i = 0; i < values.size(); i++) {
+        TEST_ASSERT_EQUAL_UINT32(i, values[i]);
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, parser.crc_errors);
+}
+
+void test_frame_corrupted_payload_dropped() {
+    uint8_t buffer[RX_BUF_SIZE];
+    zigbee_frame_parser_t parser;
+    frame_parser_init(&parser, buffer, sizeof(buffer));
+
+    // a flipped bit behind the header (payload or CRC) drops only its frame
+    bytes_t stream;
+    std::vector<uint32_t> expected;
+    uint32_t corrupted = 0;
+    for (uint32_t i = 0; i < 1000; i++) {
+        bytes_t frame = stream_report(i, (uint8_t)i);
+        if (stream_rand() % 4 == 0) {
+            size_t pos = ZIGBEE_FRAME_HEADER_SIZE + stream_rand() % (frame.size() - ZIGBEE_FRAME_HEADER_SIZE);
+            frame[pos] ^= 1 << (stream_rand() % 8);
+            corrupted++;
+        } else {
+            expected.push_back(i);
+        }
+        stream.insert(stream.end(), frame.begin(), frame.end());
+    }
+
+    std::vector<uint32_t> values = stream_parse(&parser, stream);
+    TEST_ASSERT_TRUE(corrupted > 0);
+    TEST_ASSERT_EQUAL_UINT32(corrupted, parser.crc_errors);
+    TEST_ASSERT_EQUAL_size_t(expected.size(), values.size());
+    TEST_ASSERT_EQUAL_MEMORY(expected.data(), values.data(), expected.size() * sizeof(uint32_t));
+}
+
+void test_frame_noise_resync() {
+    uint8_t buffer[RX_BUF_SIZE];
+    zigbee_frame_parser_t parser;
+    frame_parser_init(&parser, buffer, sizeof(buffer));
+
+    // any noise (start of frame bytes and corrupted headers included): nothing invalid is accepted, the frames are
+    // lost only while a false length is being consumed, and the reception continues behind the noise
+    bytes_t stream;
+    const uint32_t bursts = 200;
+    const uint32_t frames = 20;
+    for (uint32_t b = 0; b < bursts; b++) {
+        bytes_t noise = stream_garbage(1 + stream_rand() % 64, true);
+        stream.insert(stream.end(), noise.begin(), noise.end());
+        for (uint32_t i = 0; i < frames; i++) {
+            bytes_t frame = stream_report(b * frames + i, (uint8_t)i);
+            if (i == 0 && stream_rand() % 2 == 0) {
+                frame[1 + stream_rand() % (frame.size() - 1)] ^= 1 << (stream_rand() % 8);
+            }
+            stream.insert(stream.end(), frame.begin(), frame.end());
+        }
+    }
+
+    std::vector<uint32_t> values = stream_parse(&parser, stream);
+    uint32_t last = 0;
+    for (size_t i = 0; i < values.size(); i++) {
+        // in order, every accepted frame is one of the sent ones
+        TEST_ASSERT_TRUE(values[i] < bursts * frames);
+        TEST_ASSERT_TRUE(i == 0 || values[i] > last);
+        last = values[i];
+    }
+
+    char line[128];
+    snprintf(line, sizeof(line), "noise: %u/%u frames received, %u CRC errors, %u length errors",
+             (unsigned)values.size(), (unsigned)(bursts * frames), (unsigned)parser.crc_errors, (unsigned)parser.length_errors);
+    TEST_MESSAGE(line);
+    // a false length swallows at most the buffer size, i.e. a few frames of every burst
+    TEST_ASSERT_TRUE(values.size() >= bursts * frames * 3 / 4);
+}
+
+void test_frame_oversized_length() {
+    uint8_t buffer[64];
+    zigbee_frame_parser_t parser;
+    frame_parser_init(&parser, buffer, sizeof(buffer));
+
+    // the report does not fit the buffer, the short frame behind it still does
+    uint8_t small[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+    bytes_t small_frame(sizeof(small) + ZIGBEE_FRAME_OVERHEAD);
+    encode_frame(7, small, sizeof(small), small_frame.data(), small_frame.size());
+
+    bytes_t stream = stream_report(1, 1);
+    stream.insert(stream.end(), small_frame.begin(), small_frame.end());
+
+    int accepted = 0;
+    for (uint8_t byte : stream) {
+        if (frame_parser_feed(&parser, byte) > 0) {
+            accepted++;
+            TEST_ASSERT_EQUAL_UINT8(7, parser.seq);
+            TEST_ASSERT_EQUAL_MEMORY(small, buffer, sizeof(small));
+        }
+    }
+    TEST_ASSERT_EQUAL_INT(1, accepted);
+    TEST_ASSERT_EQUAL_UINT32(1, parser.length_errors);
+}
+
+// *********************************************************************************************************************
+// UART reception
+
+void test_receive_random_chunks() {
+    const uint32_t count = 2000;
+    bytes_t stream;
+    for (uint32_t i = 0; i < count; i++) {
+        bytes_t garbage = stream_garbage(stream_rand() % 8, false);
+        bytes_t frame = stream_report(i, (uint8_t)(i + 1));
+        stream.insert(stream.end(), garbage.begin(), garbage.end());
+        stream.insert(stream.end(), frame.begin(), frame.end());
+    }
+
+    // the chunks arrive from another thread, the same as from the UART interrupt (never more than the driver buffers)
+    std::atomic<bool> feeding(true);
+    std::thread feeder([&] {
+        size_t pos = 0;
+        uint32_t state = 12345;
+        while (pos < stream.size()) {
+            size_t buffered = 0;
+            uart_get_buffered_data_len(UART, &buffered);
+            if (buffered > (size_t)RX_BUF_SIZE) {
+                std::this_thread::yield();
+                continue;
+            }
+            state = state * 1103515245 + 12345;
+            size_t chunk = std::min<size_t>(1 + (state >> 16) % 97, stream.size() - pos);
+            nativeUartFeed(UART, stream.data() + pos, chunk);
+            pos += chunk;
+        }
+        feeding = false;
+    });
+
+    iot_alarm_message_t * msg = create_message(IOT_ALARM_MSGDIR_MAX, IOT_ALARM_MSGSTATUS_MAX, IOT_ALARM_MSGTYPE_MAX, 1, "\0");
+    iot_alarm_attr_load_t * attr = create_attr("\0", "\0", "\0", 0, stream_ieee, 0, 0, 0, 0, 0, ESP_ZB_ZCL_ATTR_TYPE_U8, 0);
+    uint32_t received = 0;
+    while (received < count) {
+        int rx_bytes = receive_message(UART, rx_buffer, &msg, RX_BUF_SIZE-1, pdMS_TO_TICKS(1000));
+        if (rx_bytes <= 0) {
+            break;
+        }
+        TEST_ASSERT_EQUAL_UINT8((uint8_t)(received + 1), msg->seq);
+        TEST_ASSERT_EQUAL_INT(IOT_ALARM_MSGTYPE_ZB_DATA_REPORT, msg->id);
+        TEST_ASSERT_TRUE(deserialize_attr(&attr, (uint8_t*)msg->load, msg->length));
+        TEST_ASSERT_EQUAL_UINT32(received, attr->value);
+        received++;
+    }
+    feeder.join();
+
+    destroy_message(&msg);
+    destroy_attr(&attr);
+    TEST_ASSERT_EQUAL_UINT32(count, received);
+}
+
+// *********************************************************************************************************************
+// throughput
+
+void test_parser_throughput() {
+    bytes_t stream;
+    uint32_t frames = 0;
+    while (stream.size() < 4 * 1024 * 1024) {
+        bytes_t frame = stream_report(frames, (uint8_t)frames);
+        stream.insert(stream.end(), frame.begin(), frame.end());
+        frames++;
+    }
+
+    uint8_t buffer[RX_BUF_SIZE];
+    zigbee_frame_parser_t parser;
+    frame_parser_init(&parser, buffer, sizeof(buffer));
+
+    auto start = std::chrono::steady_clock::now();
+    uint32_t accepted = 0;
+    for (uint8_t byte : stream) {
+        accepted += frame_parser_feed(&parser, byte) > 0;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    char line[128];
+    snprintf(line, sizeof(line), "frame_parser_feed: %.1f MB/s, %.0f frames/s (%u-byte frames)",
+             stream.size() / seconds / 1e6, accepted / seconds, (unsigned)(stream.size() / frames));
+    TEST_MESSAGE(line);
+    TEST_ASSERT_EQUAL_UINT32(frames, accepted);
+
+    // the whole reception path: driver buffer, events, chunked reads, parser and message decoding
+    iot_alarm_message_t * msg = create_message(IOT_ALARM_MSGDIR_MAX, IOT_ALARM_MSGSTATUS_MAX, IOT_ALARM_MSGTYPE_MAX, 1, "\0");
+    size_t pos = 0;
+    uint32_t received = 0;
+    start = std::chrono::steady_clock::now();
+    while (pos < stream.size()) {
+        size_t chunk = std::min<size_t>(RX_BUF_SIZE, stream.size() - pos);
+        nativeUartFeed(UART, stream.data() + pos, chunk);
+        pos += chunk;
+        while (receive_message(UART, rx_buffer, &msg, RX_BUF_SIZE-1, 0) > 0) {
+            received++;
+        }
+    }
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    destroy_message(&msg);
+
+    snprintf(line, sizeof(line), "receive_message: %.1f MB/s, %.0f messages/s", stream.size() / seconds / 1e6, received / seconds);
+    TEST_MESSAGE(line);
+    TEST_ASSERT_EQUAL_UINT32(frames, received);
+}
+
+// *********************************************************************************************************************
+
+void setUp() {}
+
+void tearDown() {}
+
+int main() {
+    nativeSerialMute(true);
+    bool ready = ncpStart();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_frame_split_at_every_byte);
+    RUN_TEST(test_frame_garbage_between_frames);
+    RUN_TEST(test_frame_corrupted_payload_dropped);
+    RUN_TEST(test_frame_noise_resync);
+    RUN_TEST(test_frame_oversized_length);
+    if (ready) {
+        RUN_TEST(test_receive_random_chunks);
+        RUN_TEST(test_parser_throughput);
+    }
+    int failures = UNITY_END();
+
+    ncpStop();
+    return failures || !ready;
+}
@@ -0,0 +1,445 @@
+/**
+ * Mutation fuzzing of the decoders which take bytes from the Zigbee UART or the MQTT broker.
+ *
+ * Every target starts from a corpus made by the matching encoder and decodes mutated copies of it (bit flips, random
+ * and boundary bytes, inserted, removed and repeated bytes, truncation, splices of two inputs). Every input is decoded
+ * from a heap block of its exact size, so the `native_asan` environment reports any read behind its end. The decoded
+ * values are checked against the ranges the rest of the code relies on.
+ *
+ *   pio test -e native -f native/test_fuzz
+ *   FUZZ_ITERATIONS=1000000 FUZZ_SEED=7 pio test -e native_asan -f native/test_fuzz
+ */
+
+#include <unity.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <ArduinoJson.h>
+
+#include "libZigbee.h"
+#include "native.h"
+#include "../ncp.h"
+
+typedef std::vector<uint8_t> fuzz_input_t;
+
+#define FUZZ_ITERATIONS_DEFAULT 20000
+#define FUZZ_SEED_DEFAULT 0x2545F491U
+#define FUZZ_DEVICE_HANDLE 0x0101
+
+static uint32_t fuzz_state = FUZZ_SEED_DEFAULT;
+static uint32_t fuzz_iterations = FUZZ_ITERATIONS_DEFAULT;
+static bool fuzz_ready = false;
+
+static uint32_t fuzz_env(const char * name, uint32_t fallback) {
+    const char * value = getenv(name);
+    return value != NULL && *value != '\0' ? (uint32_t)strtoul(value, NULL, 0) : fallback;
+}
+
+// xorshift32, the same seed gives the same inputs on every host
+static uint32_t fuzz_rand() {
+    fuzz_state ^= fuzz_state << 13;
+    fuzz_state ^= fuzz_state >> 17;
+    fuzz_state ^= fuzz_state << 5;
+    return fuzz_state;
+}
+
+static uint32_t fuzz_below(uint32_t n) {
+    return n > 0 ? fuzz_rand() % n : 0;
+}
+
+static const uint8_t fuzz_interesting[] = {0x00, 0x01, 0x7E, 0x7F, 0x80, 0xC7, 0xFE, 0xFF};
+
+static fuzz_input_t fuzz_mutate(const std::vector<fuzz_input_t> & corpus) {
+    fuzz_input_t input = corpus[fuzz_below(corpus.size())];
+    uint32_t mutations = 1 + fuzz_below(4);
+
+    for (uint32_t m = 0; m < mutations; m++) {
+        size_t pos = fuzz_below(input.size() + 1);
+        switch (fuzz_below(8)) {
+            case 0:
+                if (!input.empty()) {
+                    input[fuzz_below(input.size())] ^= 1 << fuzz_below(8);
+                }
+                break;
+            case 1:
+                if (!input.empty()) {
+                    input[fuzz_below(input.size())] = (uint8_t)fuzz_rand();
+                }
+                break;
+            case 2:
+                if (!input.empty()) {
+                    input[fuzz_below(input.size())] = fuzz_interesting[fuzz_below(sizeof(fuzz_interesting))];
+                }
+                break;
+            case 3:
+                input.insert(input.begin() + pos, 1 + fuzz_below(8), (uint8_t)fuzz_rand());
+                break;
+            case 4:
+                if (pos < input.size()) {
+                    input.erase(input.begin() + pos, input.begin() + pos + 1 + fuzz_below(input.size() - pos));
+                }
+                break;
+            case 5:
+                input.resize(fuzz_below(input.size() + 1));
+                break;
+            case 6:
+                if (pos < input.size()) {
+                    fuzz_input_t chunk(input.begin() + pos, input.begin() + pos + 1 + fuzz_below(input.size() - pos));
+                    input.insert(input.begin() + fuzz_below(input.size() + 1), chunk.begin(), chunk.end());
+                }
+                break;
+            default: {
+                const fuzz_input_t & other = corpus[fuzz_below(corpus.size())];
+                size_t from = fuzz_below(other.size() + 1);
+                input.resize(pos);
+                input.insert(input.end(), other.begin() + from, other.end());
+                break;
+            }
+        }
+    }
+
+    return input;
+}
+
+// copies the input to a heap block of its exact size (the sanitizers see the reads behind the end)
+static uint8_t * fuzz_block(const fuzz_input_t & input) {
+    uint8_t * block = (uint8_t *)malloc(input.empty() ? 1 : input.size());
+    TEST_ASSERT_NOT_NULL(block);
+    if (!input.empty()) {
+        memcpy(block, input.data(), input.size());
+    }
+    return block;
+}
+
+static void fuzz_check_attr(const iot_alarm_attr_load_t * attr) {
+    TEST_ASSERT_TRUE(strnlen(attr->manuf, sizeof(attr->manuf)) < sizeof(attr->manuf));
+    TEST_ASSERT_TRUE(strnlen(attr->name, sizeof(attr->name)) < sizeof(attr->name));
+    TEST_ASSERT_TRUE(strnlen(attr->type, sizeof(attr->type)) < sizeof(attr->type));
+}
+
+// *********************************************************************************************************************
+// corpus
+
+static esp_zb_ieee_addr_t fuzz_ieee = {0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88};
+
+static std::vector<iot_alarm_attr_load_t> fuzz_attrs() {
+    static const struct {
+        const char * type;
+        uint16_t cluster_id;
+        uint16_t attr_id;
+        esp_zb_zcl_attr_type_t value_type;
+        uint32_t value;
+    } samples[] = {
+        {"motion", 0x0500, 0x0002, ESP_ZB_ZCL_ATTR_TYPE_16BITMAP, 0x0001},
+        {"contact", 0x0006, 0x0000, ESP_ZB_ZCL_ATTR_TYPE_BOOL, 1},
+        {"temperature", 0x0402, 0x0000, ESP_ZB_ZCL_ATTR_TYPE_S16, (uint32_t)(uint16_t)-1250},
+        {"humidity", 0x0405, 0x0000, ESP_ZB_ZCL_ATTR_TYPE_U16, 5530},
+        {"battery", 0x0001, 0x0021, ESP_ZB_ZCL_ATTR_TYPE_U8, 200},
+        {"energy", 0x0702, 0x0000, ESP_ZB_ZCL_ATTR_TYPE_U32, 0xFFFFFFFFU},
+    };
+    std::vector<iot_alarm_attr_load_t> attrs;
+
+    for (size_t i = 0; i < sizeof(samples) / sizeof(samples[0]); i++) {
+        iot_alarm_attr_load_t * attr = create_attr("LUMI", "lumi.sensor", samples[i].type, 0x0400 + i, fuzz_ieee, 0x1234, 2, 1,
+                                                   samples[i].cluster_id, samples[i].attr_id, samples[i].value_type, samples[i].value);
+        TEST_ASSERT_NOT_NULL(attr);
+        attrs.push_back(*attr);
+        destroy_attr(&attr);
+    }
+    return attrs;
+}
+
+static std::vector<fuzz_input_t> fuzz_attr_corpus() {
+    std::vector<fuzz_input_t> corpus;
+    char buffer[512];
+    size_t bytes = 0;
+
+    for (iot_alarm_attr_load_t & attr : fuzz_attrs()) {
+        serialize_attr(&attr, buffer, &bytes);
+        corpus.push_back(fuzz_input_t(buffer, buffer + bytes));
+        serialize_attr_compact(&attr, FUZZ_DEVICE_HANDLE, buffer, &bytes);
+        corpus.push_back(fuzz_input_t(buffer, buffer + bytes));
+    }
+    return corpus;
+}
+
+static std::vector<fuzz_input_t> fuzz_message_corpus() {
+    std::vector<fuzz_input_t> corpus;
+    std::vector<fuzz_input_t> loads = fuzz_attr_corpus();
+    loads.push_back(fuzz_input_t(1, 0));
+    loads.push_back(fuzz_input_t(64, 'x'));
+
+    for (size_t i = 0; i < loads.size(); i++) {
+        iot_alarm_message_t msg = {(message_direction_t)(i % IOT_ALARM_MSGDIR_MAX), IOT_ALARM_MSGSTATUS_SUCCESS,
+                                   (message_type_t)(i % IOT_ALARM_MSGTYPE_MAX), (uint32_t)loads[i].size(), (char *)loads[i].data(), 0, 0};
+        std::vector<uint8_t> buffer(16 + loads[i].size() + 1);
+        size_t bytes = 0;
+        serialize_message(&msg, buffer.data(), &bytes);
+        buffer.resize(bytes);
+        corpus.push_back(buffer);
+    }
+    return corpus;
+}
+
+static std::vector<fuzz_input_t> fuzz_batch_corpus() {
+    std::vector<fuzz_input_t> corpus;
+    std::vector<iot_alarm_attr_load_t> attrs = fuzz_attrs();
+    std::vector<iot_alarm_attr_load_t> full(ZIGBEE_ATTR_BATCH_MAX, attrs[0]);
+    char buffer[ZIGBEE_COMMAND_FRAME_MAX];
+    size_t bytes = 0;
+
+    for (size_t count = 0; count <= attrs.size(); count += 2) {
+        TEST_ASSERT_TRUE(serialize_attr_batch(attrs.data(), count, buffer, sizeof(buffer), &bytes));
+        corpus.push_back(fuzz_input_t(buffer, buffer + bytes));
+    }
+    TEST_ASSERT_TRUE(serialize_attr_batch(full.data(), full.size(), buffer, sizeof(buffer), &bytes));
+    corpus.push_back(fuzz_input_t(buffer, buffer + bytes));
+    return corpus;
+}
+
+static std::vector<fuzz_input_t> fuzz_json_corpus() {
+    std::vector<fuzz_input_t> corpus;
+    char ieee_str[ZIGBEE_IEEE_STR_SIZE];
+    char buffer[ZIGBEE_ATTR_JSON_MAX];
+    String batch;
+
+    std::vector<iot_alarm_attr_load_t> attrs = fuzz_attrs();
+    for (iot_alarm_attr_load_t & attr : attrs) {
+        size_t bytes = pack_attr_json(&attr, zigbee_ieee_str(attr.ieee_addr, ieee_str), buffer, sizeof(buffer));
+        TEST_ASSERT_TRUE(bytes > 0);
+        corpus.push_back(fuzz_input_t(buffer, buffer + bytes));
+    }
+    // the batched command is the array of the attributes of the report
+    JsonDocument doc;
+    TEST_ASSERT_TRUE(pack_attr_batch(attrs.data(), attrs.size(), &batch));
+    TEST_ASSERT_FALSE(deserializeJson(doc, batch));
+    corpus.push_back(fuzz_input_t(batch.c_str(), batch.c_str() + batch.length()));
+    batch = "";
+    serializeJson(doc["attrs"], batch);
+    corpus.push_back(fuzz_input_t(batch.c_str(), batch.c_str() + batch.length()));
+    return corpus;
+}
+
+static std::vector<fuzz_input_t> fuzz_msgpack_corpus() {
+    std::vector<fuzz_input_t> corpus;
+    char ieee_str[ZIGBEE_IEEE_STR_SIZE];
+    std::vector<uint8_t> buffer(ZIGBEE_ATTR_BATCH_MSGPACK_MAX);
+
+    std::vector<iot_alarm_attr_load_t> attrs = fuzz_attrs();
+    for (iot_alarm_attr_load_t & attr : attrs) {
+        size_t bytes = pack_attr_msgpack(&attr, zigbee_ieee_str(attr.ieee_addr, ieee_str), buffer.data(), buffer.size());
+        TEST_ASSERT_TRUE(bytes > 0);
+        corpus.push_back(fuzz_input_t(buffer.begin(), buffer.begin() + bytes));
+    }
+    size_t bytes = pack_attr_batch_msgpack(attrs.data(), attrs.size(), buffer.data(), buffer.size());
+    TEST_ASSERT_TRUE(bytes > 0);
+    corpus.push_back(fuzz_input_t(buffer.begin(), buffer.begin() + bytes));
+
+    JsonDocument doc;
+    TEST_ASSERT_FALSE(deserializeMsgPack(doc, buffer.data(), bytes));
+    bytes = serializeMsgPack(doc["attrs"], buffer.data(), buffer.size());
+    corpus.push_back(fuzz_input_t(buffer.begin(), buffer.begin() + bytes));
+    return corpus;
+}
+
+// *********************************************************************************************************************
+// targets
+
+void test_fuzz_ready() {
+    TEST_ASSERT_TRUE_MESSAGE(fuzz_ready, "The Zigbee stack could not be initialized!");
+}
+
+void test_fuzz_deserialize_message() {
+    std::vector<fuzz_input_t> corpus = fuzz_message_corpus();
+    iot_alarm_message_t * msg = create_message(IOT_ALARM_MSGDIR_MAX, IOT_ALARM_MSGSTATUS_MAX, IOT_ALARM_MSGTYPE_MAX, 1, "\0");
+    TEST_ASSERT_NOT_NULL(msg);
+    uint32_t decoded = 0;
+
+    for (uint32_t i = 0; i < fuzz_iterations; i++) {
+        fuzz_input_t input = fuzz_mutate(corpus);
+        uint8_t * block = fuzz_block(input);
+
+        if (deserialize_message(&msg, block, input.size())) {
+            TEST_ASSERT_TRUE(msg->dir < IOT_ALARM_MSGDIR_MAX);
+            TEST_ASSERT_TRUE(msg->st < IOT_ALARM_MSGSTATUS_MAX);
+            TEST_ASSERT_TRUE(msg->id < IOT_ALARM_MSGTYPE_MAX);
+            TEST_ASSERT_TRUE(msg->length <= input.size());
+            TEST_ASSERT_TRUE(msg->length <= msg->size);
+            if (msg->length > 0) {
+                TEST_ASSERT_EQUAL_MEMORY(block + input.size() - msg->length, msg->load, msg->length);
+            }
+            decoded++;
+        }
+        free(block);
+    }
+
+    destroy_message(&msg);
+    TEST_ASSERT_TRUE(decoded > 0);
+}
+
+void test_fuzz_deserialize_attr() {
+    std::vector<fuzz_input_t> corpus = fuzz_attr_corpus();
+    iot_alarm_attr_load_t * attr = create_attr("\0", "\0", "\0", 0, fuzz_ieee, 0, 0, 0, 0, 0, ESP_ZB_ZCL_ATTR_TYPE_U8, 0);
+    TEST_ASSERT_NOT_NULL(attr);
+    uint32_t decoded = 0;
+
+    for (uint32_t i = 0; i < fuzz_iterations; i++) {
+        fuzz_input_t input = fuzz_mutate(corpus);
+        uint8_t * block = fuzz_block(input);
+
+        if (deserialize_attr(&attr, block, input.size())) {
+            TEST_ASSERT_TRUE((uint32_t)attr->value_type <= 0xFF);
+            fuzz_check_attr(attr);
+            decoded++;
+        }
+        free(block);
+    }
+
+    destroy_attr(&attr);
+    TEST_ASSERT_TRUE(decoded > 0);
+}
+
+void test_fuzz_deserialize_attr_batch() {
+    std::vector<fuzz_input_t> corpus = fuzz_batch_corpus();
+    static iot_alarm_attr_load_t attrs[ZIGBEE_ATTR_BATCH_MAX];
+    uint32_t decoded = 0;
+
+    for (uint32_t i = 0; i < fuzz_iterations; i++) {
+        fuzz_input_t input = fuzz_mutate(corpus);
+        uint8_t * block = fuzz_block(input);
+        size_t count = 0;
+
+        if (deserialize_attr_batch(attrs, ZIGBEE_ATTR_BATCH_MAX, &count, block, input.size())) {
+            TEST_ASSERT_TRUE(count <= ZIGBEE_ATTR_BATCH_MAX);
+            for (size_t j = 0; j < count; j++) {
+                TEST_ASSERT_TRUE((uint32_t)attrs[j].value_type <= 0xFF);
+                fuzz_check_attr(&attrs[j]);
+            }
+            decoded++;
+        }
+        free(block);
+    }
+
+    TEST_ASSERT_TRUE(decoded > 0);
+}
+
+void test_fuzz_unpack_attr() {
+    std::vector<fuzz_input_t> corpus = fuzz_json_corpus();
+    static iot_alarm_attr_load_t attrs[ZIGBEE_ATTR_BATCH_MAX];
+    iot_alarm_attr_load_t attr = {};
+    uint32_t decoded = 0;
+
+    for (uint32_t i = 0; i < fuzz_iterations; i++) {
+        fuzz_input_t input = fuzz_mutate(corpus);
+        // the JSON text comes as a String from the MQTT callback, so it ends at the first null
+        std::string text(input.begin(), input.end());
+        String json(text.c_str());
+        size_t count = 0;
+
+        if (unpack_attr(&attr, json)) {
+            fuzz_check_attr(&attr);
+            decoded++;
+        }
+        if (unpack_attr_batch(attrs, ZIGBEE_ATTR_BATCH_MAX, &count, json)) {
+            TEST_ASSERT_TRUE(count <= ZIGBEE_ATTR_BATCH_MAX);
+            decoded++;
+        }
+    }
+
+    TEST_ASSERT_TRUE(decoded > 0);
+}
+
+void test_fuzz_unpack_attr_msgpack() {
+    std::vector<fuzz_input_t> corpus = fuzz_msgpack_corpus();
+    static iot_alarm_attr_load_t attrs[ZIGBEE_ATTR_BATCH_MAX];
+    iot_alarm_attr_load_t attr = {};
+    uint32_t decoded = 0;
+
+    for (uint32_t i = 0; i < fuzz_iterations; i++) {
+        fuzz_input_t input = fuzz_mutate(corpus);
+        uint8_t * block = fuzz_block(input);
+        size_t count = 0;
+
+        if (unpack_attr_msgpack(&attr, block, input.size())) {
+            fuzz_check_attr(&attr);
+            decoded++;
+        }
+        if (unpack_attr_batch_msgpack(attrs, ZIGBEE_ATTR_BATCH_MAX, &count, block, input.size())) {
+            TEST_ASSERT_TRUE(count <= ZIGBEE_ATTR_BATCH_MAX);
+            decoded++;
+        }
+        free(block);
+    }
+
+    TEST_ASSERT_TRUE(decoded > 0);
+}
+
+void test_fuzz_frame_parser_feed() {
+    std::vector<fuzz_input_t> corpus;
+    for (fuzz_input_t & payload : fuzz_message_corpus()) {
+        fuzz_input_t frame(payload.size() + ZIGBEE_FRAME_OVERHEAD);
+        frame.resize(encode_frame((uint8_t)corpus.size(), payload.data(), payload.size(), frame.data(), frame.size()));
+        TEST_ASSERT_TRUE(frame.size() > 0);
+        corpus.push_back(frame);
+    }
+
+    // a small buffer, so the frames over its size are dropped too
+    uint8_t buffer[128];
+    zigbee_frame_parser_t parser;
+    frame_parser_init(&parser, buffer, sizeof(buffer));
+    uint32_t frames = 0;
+
+    for (uint32_t i = 0; i < fuzz_iterations; i++) {
+        // the stream keeps the parser state from the previous inputs, as the UART does
+        fuzz_input_t input = fuzz_mutate(corpus);
+        for (uint8_t byte : input) {
+            int length = frame_parser_feed(&parser, byte);
+            TEST_ASSERT_TRUE(length >= 0 && (size_t)length <= sizeof(buffer));
+            TEST_ASSERT_TRUE(parser.index <= sizeof(buffer));
+            if (length > 0) {
+                frames++;
+            }
+        }
+    }
+
+    TEST_ASSERT_EQUAL_UINT32(frames, parser.frames);
+    TEST_ASSERT_TRUE(frames > 0);
+}
+
+// *********************************************************************************************************************
+
+void setUp() {}
+
+void tearDown() {}
+
+int main() {
+    fuzz_iterations = fuzz_env("FUZZ_ITERATIONS", FUZZ_ITERATIONS_DEFAULT);
+    fuzz_state = fuzz_env("FUZZ_SEED", FUZZ_SEED_DEFAULT);
+    if (fuzz_state == 0) {
+        fuzz_state = FUZZ_SEED_DEFAULT;
+    }
+
+    // the decoders log every rejected input
+    nativeSerialMute(true);
+
+    // the compact attributes are decoded only for the registered devices
+    fuzz_ready = ncpStart();
+    iot_alarm_attr_load_t * attr = create_attr("LUMI", "lumi.sensor", "motion", 0x0400, fuzz_ieee, 0, 0, 0, 0, 0, ESP_ZB_ZCL_ATTR_TYPE_U8, 0);
+    std::vector<uint8_t> info = ncpDevInfo(FUZZ_DEVICE_HANDLE, attr);
+    destroy_attr(&attr);
+    fuzz_ready = fuzz_ready && device_registry_update(info.data(), info.size());
+
+    UNITY_BEGIN();
+    RUN_TEST(test_fuzz_ready);
+    RUN_TEST(test_fuzz_deserialize_message);
+    RUN_TEST(test_fuzz_deserialize_attr);
+    RUN_TEST(test_fuzz_deserialize_attr_batch);
+    RUN_TEST(test_fuzz_unpack_attr);
+    RUN_TEST(test_fuzz_unpack_attr_msgpack);
+    RUN_TEST(test_fuzz_frame_parser_feed);
+    int failures = UNITY_END();
+
+    ncpStop();
+    return failures;
+}
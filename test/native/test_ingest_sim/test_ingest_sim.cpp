@@ -0,0 +1,233 @@
+/**
+ * Throughput, latency and memory benchmark of the Zigbee ingestion against the NCP simulator (tools/zigbee_ncp_sim.py).
+ *
+ * The simulator plays its scenario over a pseudo-terminal, which is attached to the Zigbee UART of the host build.
+ * The reception task runs the loop of `rtosZigbee` (src/main.cpp): `zigbee_message_dispatch()` acknowledges the frames,
+ * decodes the attributes, updates the cache and the device registry, runs the report rules and queues the publish jobs.
+ * The publishing task runs the loop of `rtosZigbeePublish`: `mqtt_zigbee_publish()` publishes the jobs in the configured
+ * format (JSON, the telemetry is not batched), so the messages reach the broker stand-in.
+ *
+ * Printed: the throughput and the ingestion latency (queued in the simulator -> acknowledged) measured by the
+ * simulator, the time spent per frame by the reception task, and the heap allocations and peak during the run.
+ * The test is ignored without python3 or the simulator (run it from the project directory).
+ *
+ *   pio test -e native -f native/test_ingest_sim -v
+ *   SIM_DEVICES=50 SIM_RATE=10 SIM_DURATION=20 SIM_ARGS="--bitflip 0.01" pio test -e native -f native/test_ingest_sim -v
+ */
+
+#include <unity.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <ArduinoJson.h>
+
+#include "libZigbee.h"
+#include "libMqtt.h"
+#include "native.h"
+
+#define SIM_SCRIPT "tools/zigbee_ncp_sim.py"
+#define SIM_LISTENING "NCP simulator listening on: "
+
+extern g_config_t * g_config_ptr;
+extern TaskHandle_t handleTaskZigbee;
+static TaskHandle_t handleTaskPublish = NULL;
+// the stand-in keeps the task object, so the handle stays valid after the task deleted itself
+static TaskHandle_t volatile ingest_task_handle = NULL;
+
+static std::atomic<bool> ingest_running(false);
+static std::atomic<int> ingest_tasks(0);
+static std::vector<uint32_t> ingest_frame_us;       // written by the reception task only
+static std::atomic<uint32_t> ingest_frames(0);
+static std::atomic<uint32_t> ingest_published(0);
+
+static std::string sim_env(const char * name, const char * fallback) {
+    const char * value = getenv(name);
+    return value != NULL && *value != '\0' ? value : fallback;
+}
+
+static uint32_t ingest_percentile(std::vector<uint32_t> values, int p) {
+    if (values.empty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, values.size() * p / 100)];
+}
+
+// *********************************************************************************************************************
+// tasks
+
+// the loop of rtosZigbee until the test stops it
+static void ingest_task(void * parameters) {
+    (void)parameters;
+    iot_alarm_message_t * msg = create_message(IOT_ALARM_MSGDIR_MAX, IOT_ALARM_MSGSTATUS_MAX, IOT_ALARM_MSGTYPE_MAX, 1, "\0");
+
+    while (ingest_running) {
+        int rx_bytes = receive_message(UART, rx_buffer, &msg, RX_BUF_SIZE-1, zigbee_command_poll());
+        zigbee_debounce_poll();
+        if (rx_bytes <= 0) {
+            continue;
+        }
+
+        int64_t started = esp_timer_get_time();
+        zigbee_message_dispatch(msg, rx_bytes);
+        ingest_frame_us.push_back((uint32_t)(esp_timer_get_time() - started));
+        ingest_frames++;
+    }
+
+    destroy_message(&msg);
+    ingest_tasks--;
+    vTaskDelete(NULL);
+}
+
+// the loop of rtosZigbeePublish until the test stops it
+static void publish_task(void * parameters) {
+    (void)parameters;
+    zigbee_publish_job_t job;
+    mqtt_zigbee_init();
+
+    while (ingest_running) {
+        device_registry_save();
+        uint32_t wait_ms = std::min<uint32_t>(mqtt_batch_poll(), 50);
+        if (zigbee_publish_dequeue(&job, pdMS_TO_TICKS(wait_ms)) && mqtt_zigbee_publish(&job)) {
+            ingest_published++;
+        }
+    }
+
+    ingest_tasks--;
+    vTaskDelete(NULL);
+}
+
+// *********************************************************************************************************************
+
+void test_ingest_sim() {
+    if (access(SIM_SCRIPT, R_OK) != 0 || system("python3 -c '' >/dev/null 2>&1") != 0) {
+        TEST_IGNORE_MESSAGE("python3 or " SIM_SCRIPT " is not available (the test runs from the project directory)");
+    }
+
+    std::string command = "python3 -u " SIM_SCRIPT " --json --wait 1 --seed 1";
+    command += " --devices " + sim_env("SIM_DEVICES", "20");
+    command += " --rate " + sim_env("SIM_RATE", "5");
+    command += " --duration " + sim_env("SIM_DURATION", "5");
+    command += " --burst " + sim_env("SIM_BURST", "2:300");
+    command += " " + sim_env("SIM_ARGS", "") + " 2>&1";
+
+    FILE * sim = popen(command.c_str(), "r");
+    TEST_ASSERT_NOT_NULL(sim);
+
+    char line[256];
+    std::string pty;
+    while (pty.empty() && fgets(line, sizeof(line), sim) != NULL) {
+        if (strncmp(line, SIM_LISTENING, strlen(SIM_LISTENING)) == 0) {
+            pty.assign(line + strlen(SIM_LISTENING));
+            pty.erase(pty.find_last_not_of("\r\n") + 1);
+        }
+    }
+    if (pty.empty()) {
+        pclose(sim);
+        TEST_IGNORE_MESSAGE("The simulator did not create a pseudo-terminal");
+    }
+
+    int fd = open(pty.c_str(), O_RDWR | O_NOCTTY);
+    TEST_ASSERT_TRUE_MESSAGE(fd >= 0, pty.c_str());
+    struct termios attrs;
+    tcgetattr(fd, &attrs);
+    cfmakeraw(&attrs);
+    tcsetattr(fd, TCSANOW, &attrs);
+
+    // the simulator answers the echo of initSerialZigbee() over the pseudo-terminal
+    TEST_ASSERT_TRUE(nativeUartAttach(UART, fd));
+    TEST_ASSERT_TRUE(initSerialZigbee());
+
+    g_config_ptr->mqtt_topic = "iot-alarm";
+    TEST_ASSERT_TRUE(mqtt_client_init());
+    TEST_ASSERT_TRUE(mqtt.connect("ingest"));
+    mqtt_outbox_link(true);
+    nativeBrokerKeep(false);
+    nativeBrokerClear();
+
+    ingest_frame_us.reserve(1 << 20);
+    nativeHeapReset();
+    native_heap_t heap_start = nativeHeapStats();
+
+    ingest_running = true;
+    ingest_tasks = 2;
+    xTaskCreate(ingest_task, "zigbee", 8192, NULL, 4, &handleTaskZigbee);
+    ingest_task_handle = handleTaskZigbee;
+    xTaskCreate(publish_task, "zigbeepub", 8192, NULL, 2, &handleTaskPublish);
+
+    // the simulator prints the summary when every notification is acknowledged (or the acknowledges stop)
+    std::string output;
+    while (fgets(line, sizeof(line), sim) != NULL) {
+        output += line;
+    }
+    int status = pclose(sim);
+
+    // the last publish jobs are taken before the tasks stop
+    vTaskDelay(pdMS_TO_TICKS(200));
+    ingest_running = false;
+    while (ingest_tasks > 0) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    handleTaskZigbee = NULL;
+    native_heap_t heap_end = nativeHeapStats();
+
+    nativeUartDetach(UART);
+    close(fd);
+
+    JsonDocument summary;
+    size_t json_start = output.find('{');
+    TEST_ASSERT_TRUE_MESSAGE(json_start != std::string::npos, output.c_str());
+    TEST_ASSERT_FALSE_MESSAGE(deserializeJson(summary, output.c_str() + json_start), output.c_str());
+
+    uint32_t notifications = summary["notifications"];
+    uint32_t acked = summary["acked"];
+    uint32_t lost = summary["lost"];
+
+    snprintf(line, sizeof(line), "simulator: %u/%u acknowledged, %.1f reports/s, %u resends, %u lost, max queue %u",
+             (unsigned)acked, (unsigned)notifications, summary["throughput_per_s"].as<float>(),
+             summary["resends"].as<unsigned>(), (unsigned)lost, summary["queue_max"].as<unsigned>());
+    TEST_MESSAGE(line);
+    snprintf(line, sizeof(line), "ingestion latency ms: p50 %.2f, p90 %.2f, p99 %.2f, max %.2f",
+             summary["latency_ms"]["p50"].as<float>(), summary["latency_ms"]["p90"].as<float>(),
+             summary["latency_ms"]["p99"].as<float>(), summary["latency_ms"]["max"].as<float>());
+    TEST_MESSAGE(line);
+    snprintf(line, sizeof(line), "reception task per frame us: p50 %u, p99 %u, max %u (%u frames, %u published)",
+             (unsigned)ingest_percentile(ingest_frame_us, 50), (unsigned)ingest_percentile(ingest_frame_us, 99),
+             (unsigned)ingest_percentile(ingest_frame_us, 100), (unsigned)ingest_frames.load(), (unsigned)ingest_published.load());
+    TEST_MESSAGE(line);
+    if (nativeHeapCounted()) {
+        snprintf(line, sizeof(line), "heap: %.2f allocations per frame, peak %u bytes over the start",
+                 ingest_frames > 0 ? (double)heap_end.allocations / ingest_frames : 0.0, (unsigned)(heap_end.peak - heap_start.used));
+        TEST_MESSAGE(line);
+    }
+
+    TEST_ASSERT_EQUAL_INT_MESSAGE(0, status, output.c_str());
+    TEST_ASSERT_TRUE(notifications > 0);
+    TEST_ASSERT_EQUAL_UINT32(notifications, acked);
+    TEST_ASSERT_EQUAL_UINT32(0, lost);
+    TEST_ASSERT_TRUE(ingest_published > 0);
+    TEST_ASSERT_EQUAL_UINT64(ingest_published.load(), nativeBrokerAccepted());
+}
+
+// *********************************************************************************************************************
+
+void setUp() {}
+
+void tearDown() {}
+
+int main() {
+    nativeSerialMute(true);
+    tx_buffer = (uint8_t*)malloc(TX_BUF_SIZE + 1);
+    rx_buffer = (uint8_t*)malloc(RX_BUF_SIZE + 1);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_ingest_sim);
+    return UNITY_END();
+}
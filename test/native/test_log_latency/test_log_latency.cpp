@@ -0,0 +1,188 @@
+/**
+ * Per-call latency of `esplogI()` before and after the log ring buffer.
+ *
+ * Before: the record was formatted by the calling task, printed by `Serial.printf()` and appended to the log file
+ * (`SD.open()`, `printf()`, `close()` per call), see `log_legacy()`. After: the call captures the arguments into a slot
+ * of the ring and the log writer task (the same loop as `rtosLog`) formats and writes the records. The records which
+ * do not fit into the ring are dropped and counted by `logGetStats().dropped`: the calls are timed once paced
+ * (`LOG_LATENCY_PACE_US` apart, the writer keeps up) and once as a burst of back-to-back calls. The times are not
+ * asserted, only that the median call got faster:
+ *
+ *   pio test -e native -f native/test_log_latency -v
+ *   LOG_LATENCY_CALLS=100000 pio test -e native -f native/test_log_latency -v
+ */
+
+#include <unity.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+#include "libLog.h"
+#include "utils.h"
+#include "native.h"
+
+#define LOG_LATENCY_CALLS_DEFAULT 5000
+#define LOG_LATENCY_PACE_US 200
+
+static uint32_t log_latency_calls = LOG_LATENCY_CALLS_DEFAULT;
+static std::atomic<bool> log_writer_running(false);
+static std::atomic<bool> log_writer_stopped(true);
+// the stand-in keeps the task objects, so the handles stay valid after the tasks deleted themselves
+static TaskHandle_t log_writers[2];
+static size_t log_writer_count = 0;
+static uint64_t log_legacy_p50 = 0;
+
+// esplogI() before the ring buffer (lib/utils/utils.cpp)
+static bool log_legacy(const char * tag, const char * format, ...) {
+    unsigned long timestamp = millis();
+    va_list args;
+
+    char * message;
+    va_start(args, format);
+    if (vasprintf(&message, format, args) < 0) {
+        va_end(args);
+        return false;
+    }
+    va_end(args);
+
+    Serial.printf("\033[1;32mI [%lu]\033[1;39m %s: %s\033[0m\n", timestamp, tag, message);
+
+    File file = SD.open(LOG_FILE, FILE_APPEND);
+    if (!file) {
+        free(message);
+        return false;
+    }
+    file.printf("I [%lu] %s: %s\n", timestamp, tag, message);
+
+    free(message);
+    file.close();
+    return true;
+}
+
+// the loop of rtosLog (src/main.cpp) until it is stopped
+static void log_writer(void * parameters) {
+    (void)parameters;
+    while (log_writer_running) {
+        ulTaskNotifyTake(pdTRUE, LOG_WRITER_PERIOD_MS / portTICK_PERIOD_MS);
+        logFlush();
+    }
+    log_writer_stopped = true;
+    vTaskDelete(NULL);
+}
+
+static uint64_t log_percentile(std::vector<uint64_t> values, int p) {
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, values.size() * p / 100)];
+}
+
+static void log_report(const char * name, const std::vector<uint64_t> & ns) {
+    char line[160];
+    snprintf(line, sizeof(line), "%-24s ns/call: p50 %6llu, p99 %7llu, max %8llu (%u calls)", name,
+             (unsigned long long)log_percentile(ns, 50), (unsigned long long)log_percentile(ns, 99),
+             (unsigned long long)log_percentile(ns, 100), (unsigned)ns.size());
+    TEST_MESSAGE(line);
+}
+
+// times every call of the body, the calls start `pace_us` apart (0 = back to back)
+template <typename F>
+static std::vector<uint64_t> log_time(uint32_t pace_us, F body) {
+    std::vector<uint64_t> ns;
+    ns.reserve(log_latency_calls);
+    auto next = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < log_latency_calls; i++) {
+        while (std::chrono::steady_clock::now() < next) {
+        }
+        auto start = std::chrono::steady_clock::now();
+        body(i);
+        ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+        next = start + std::chrono::microseconds(pace_us);
+    }
+    return ns;
+}
+
+// the calls of esplogI() with the log writer task running, the records left in the ring are written out after it stops
+static void log_ring(const char * name, uint32_t pace_us, uint32_t * dropped) {
+    log_stats_t before = logGetStats();
+    log_writer_running = true;
+    log_writer_stopped = false;
+    xTaskCreate(log_writer, "log", 4096, NULL, 1, &handleTaskLog);
+    log_writers[log_writer_count++ % 2] = handleTaskLog;
+
+    std::vector<uint64_t> ns = log_time(pace_us, [](uint32_t i) {
+        esplogI(TAG_LIB_UTILS, NULL, "latency record %lu, value %d", (unsigned long)i, (int)(i * 7));
+    });
+
+    log_writer_running = false;
+    xTaskNotifyGive(handleTaskLog);
+    while (!log_writer_stopped) {
+        vTaskDelay(1);
+    }
+    handleTaskLog = NULL;
+    logFlush(true);
+    log_stats_t after = logGetStats();
+
+    log_report(name, ns);
+    uint32_t enqueued = after.enqueued - before.enqueued;
+    *dropped = after.dropped - before.dropped;
+    char line[160];
+    snprintf(line, sizeof(line), "%-24s %u enqueued, %u dropped (logGetStats().dropped), %u written", "",
+             (unsigned)enqueued, (unsigned)*dropped, (unsigned)(after.written - before.written));
+    TEST_MESSAGE(line);
+
+    // every call is either in the ring or counted as dropped, every enqueued record is written out
+    TEST_ASSERT_EQUAL_UINT32(log_latency_calls, enqueued + *dropped);
+    TEST_ASSERT_EQUAL_UINT32(enqueued, after.written - before.written);
+    TEST_ASSERT_TRUE(log_percentile(ns, 50) < log_legacy_p50);
+}
+
+// *********************************************************************************************************************
+
+void test_log_latency_legacy() {
+    std::vector<uint64_t> ns = log_time(0, [](uint32_t i) {
+        TEST_ASSERT_TRUE(log_legacy(TAG_LIB_UTILS->name, "latency record %lu, value %d", (unsigned long)i, (int)(i * 7)));
+    });
+    log_report("Serial.printf + SD append", ns);
+    log_legacy_p50 = log_percentile(ns, 50);
+}
+
+void test_log_latency_ring_paced() {
+    uint32_t dropped;
+    log_ring("esplogI (ring, paced)", LOG_LATENCY_PACE_US, &dropped);
+}
+
+void test_log_latency_ring_burst() {
+    // the writer wakes up when the ring is half full, a burst longer than the ring drops the records it does not fit
+    uint32_t dropped;
+    log_ring("esplogI (ring, burst)", 0, &dropped);
+    TEST_ASSERT_TRUE(log_latency_calls <= LOG_QUEUE_SLOTS || dropped > 0);
+}
+
+// *********************************************************************************************************************
+
+void setUp() {}
+
+void tearDown() {}
+
+int main() {
+    const char * calls = getenv("LOG_LATENCY_CALLS");
+    if (calls != NULL && atoi(calls) > 0) {
+        log_latency_calls = (uint32_t)atoi(calls);
+    }
+
+    nativeSerialMute(true);
+    nativeSdClear();
+    bool ready = initLog();
+
+    UNITY_BEGIN();
+    if (ready) {
+        RUN_TEST(test_log_latency_legacy);
+        RUN_TEST(test_log_latency_ring_paced);
+        RUN_TEST(test_log_latency_ring_burst);
+    }
+    int failures = UNITY_END();
+    return failures || !ready;
+}
@@ -0,0 +1,217 @@
+/**
+ * Rotating log segment store on the SD card stand-in (text log format).
+ *
+ * The records are numbered, so every segment can be checked for the records it holds. The tests cover the
+ * wrap-around of the segment ring (the oldest segments are removed, nothing is lost between the kept ones), the
+ * recovery after reboot (`initLog()` again), a torn final write of the active segment, the segments left over the limit
+ * by an interrupted rotation and `logClear()`:
+ *
+ *   pio test -e native -f native/test_log_segments
+ */
+
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "libLog.h"
+#include "utils.h"
+#include "native.h"
+
+static uint32_t log_record_next = 0;
+
+// the numbered records are flushed to the active segment one by one (no log writer task runs)
+static void log_records(uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        esplogI(TAG_LIB_UTILS, NULL, "segment test record %lu", (unsigned long)log_record_next++);
+    }
+}
+
+static std::string log_read(const char * path) {
+    std::string content;
+    File file = SD.open(path, FILE_READ);
+    if (file) {
+        int c;
+        while ((c = file.read()) >= 0) {
+            content += (char)c;
+        }
+        file.close();
+    }
+    return content;
+}
+
+// numbers of the test records in the content, every line has to be complete
+static std::vector<uint32_t> log_numbers(const std::string & content) {
+    std::vector<uint32_t> numbers;
+    size_t start = 0;
+    while (start < content.size()) {
+        size_t end = content.find('\n', start);
+        TEST_ASSERT_TRUE_MESSAGE(end != std::string::npos, "torn record in a segment");
+        const char * record = strstr(content.substr(start, end - start).c_str(), "segment test record ");
+        if (record != NULL) {
+            numbers.push_back((uint32_t)strtoul(record + strlen("segment test record "), NULL, 10));
+        }
+        start = end + 1;
+    }
+    return numbers;
+}
+
+// simulated reboot, the logger state is recovered from the SD card only
+static void log_reboot() {
+    logClose();
+    TEST_ASSERT_TRUE(initLog());
+}
+
+// *********************************************************************************************************************
+
+void test_log_segments_wrap_around() {
+    uint32_t first, next;
+    char path[32];
+
+    // enough records for more rotations than the kept segments
+    while (!logGetSegments(&first, &next) || next - first < LOG_SEGMENTS || next < LOG_SEGMENTS + 4) {
+        log_records(50);
+    }
+    log_records(10);
+    logClose();
+
+    TEST_ASSERT_TRUE(logGetSegments(&first, &next));
+    TEST_ASSERT_EQUAL_UINT32(LOG_SEGMENTS, next - first);
+    TEST_ASSERT_FALSE(SD.exists(logSegmentPath(first - 1, path, sizeof(path))));
+
+    // the kept segments and the active one hold a contiguous run of the newest records
+    std::vector<uint32_t> numbers;
+    for (uint32_t generation = first; generation != next; generation++) {
+        std::string content = log_read(logSegmentPath(generation, path, sizeof(path)));
+        TEST_ASSERT_TRUE(content.size() >= LOG_FILE_MAX_SIZE);
+        std::vector<uint32_t> segment = log_numbers(content);
+        numbers.insert(numbers.end(), segment.begin(), segment.end());
+    }
+    std::vector<uint32_t> active = log_numbers(log_read(LOG_FILE));
+    numbers.insert(numbers.end(), active.begin(), active.end());
+
+    TEST_ASSERT_TRUE(numbers.size() > 0);
+    TEST_ASSERT_EQUAL_UINT32(log_record_next - 1, numbers.back());
+    for (size_t i = 1; i < numbers.size(); i++) {
+        TEST_ASSERT_EQUAL_UINT32(numbers[i - 1] + 1, numbers[i]);
+    }
+}
+
+void test_log_segments_kept_across_reboot() {
+    uint32_t first, next, first_reboot, next_reboot;
+    logGetSegments(&first, &next);
+    std::string active = log_read(LOG_FILE);
+
+    log_reboot();
+    TEST_ASSERT_TRUE(logGetSegments(&first_reboot, &next_reboot));
+    TEST_ASSERT_EQUAL_UINT32(first, first_reboot);
+    TEST_ASSERT_EQUAL_UINT32(next, next_reboot);
+
+    // a complete active segment is continued
+    log_records(1);
+    logClose();
+    std::string content = log_read(LOG_FILE);
+    TEST_ASSERT_TRUE(content.compare(0, active.size(), active) == 0);
+    TEST_ASSERT_EQUAL_UINT32(log_record_next - 1, log_numbers(content).back());
+}
+
+void test_log_segments_torn_write_sealed() {
+    uint32_t first, next;
+    char path[32];
+    logGetSegments(&first, &next);
+
+    // power lost in the middle of a write: the record has no new line
+    File file = SD.open(LOG_FILE, FILE_APPEND);
+    TEST_ASSERT_TRUE(file);
+    const char * torn = "I [123] UTILS  : segment test rec";
+    file.write((const uint8_t*)torn, strlen(torn));
+    file.close();
+    std::string sealed = log_read(LOG_FILE);
+
+    // the torn segment is rotated as it is, the new run starts in a clean segment
+    log_reboot();
+    uint32_t first_reboot, next_reboot;
+    TEST_ASSERT_TRUE(logGetSegments(&first_reboot, &next_reboot));
+    TEST_ASSERT_EQUAL_UINT32(next + 1, next_reboot);
+    TEST_ASSERT_EQUAL_UINT32(next_reboot - LOG_SEGMENTS, first_reboot);
+    TEST_ASSERT_TRUE(sealed == log_read(logSegmentPath(next, path, sizeof(path))));
+    TEST_ASSERT_FALSE(SD.exists(LOG_FILE));
+
+    log_records(3);
+    logClose();
+    std::vector<uint32_t> numbers = log_numbers(log_read(LOG_FILE));
+    TEST_ASSERT_EQUAL_size_t(3, numbers.size());
+    TEST_ASSERT_EQUAL_UINT32(log_record_next - 3, numbers[0]);
+}
+
+void test_log_segments_extra_pruned() {
+    char path[32];
+    logClear();
+    logClose();
+
+    // segments over the limit left by an interrupted rotation (the oldest were not removed yet)
+    const uint32_t first = 1000;
+    const uint32_t next = first + LOG_SEGMENTS + 5;
+    for (uint32_t generation = first; generation < next; generation++) {
+        File file = SD.open(logSegmentPath(generation, path, sizeof(path)), FILE_WRITE);
+        TEST_ASSERT_TRUE(file);
+        file.print("I [1] UTILS  : old segment\n");
+        file.close();
+    }
+
+    log_reboot();
+    uint32_t first_reboot, next_reboot;
+    TEST_ASSERT_TRUE(logGetSegments(&first_reboot, &next_reboot));
+    TEST_ASSERT_EQUAL_UINT32(next, next_reboot);
+    TEST_ASSERT_EQUAL_UINT32(next - LOG_SEGMENTS, first_reboot);
+    for (uint32_t generation = first; generation < next; generation++) {
+        TEST_ASSERT_EQUAL(generation >= first_reboot, SD.exists(logSegmentPath(generation, path, sizeof(path))));
+    }
+}
+
+void test_log_segments_clear() {
+    uint32_t first, next;
+    char path[32];
+    log_records(10);
+    logGetSegments(&first, &next);
+
+    logClear();
+    TEST_ASSERT_FALSE(SD.exists(LOG_FILE));
+    for (uint32_t generation = first; generation != next; generation++) {
+        TEST_ASSERT_FALSE(SD.exists(logSegmentPath(generation, path, sizeof(path))));
+    }
+
+    // the generations continue after the removed segments
+    uint32_t first_clear, next_clear;
+    TEST_ASSERT_FALSE(logGetSegments(&first_clear, &next_clear));
+    TEST_ASSERT_EQUAL_UINT32(next, next_clear);
+    while (!logGetSegments(&first_clear, &next_clear)) {
+        log_records(50);
+    }
+    TEST_ASSERT_EQUAL_UINT32(next, first_clear);
+    TEST_ASSERT_TRUE(SD.exists(logSegmentPath(next, path, sizeof(path))));
+}
+
+// *********************************************************************************************************************
+
+void setUp() {}
+
+void tearDown() {}
+
+int main() {
+    nativeSerialMute(true);
+    nativeSdClear();
+    bool ready = initLog();
+
+    UNITY_BEGIN();
+    if (ready) {
+        RUN_TEST(test_log_segments_wrap_around);
+        RUN_TEST(test_log_segments_kept_across_reboot);
+        RUN_TEST(test_log_segments_torn_write_sealed);
+        RUN_TEST(test_log_segments_extra_pruned);
+        RUN_TEST(test_log_segments_clear);
+    }
+    int failures = UNITY_END();
+    return failures || !ready;
+}
@@ -0,0 +1,120 @@
+/**
+ * SD card calls per message of the MQTT archive (the daily NDJSON file).
+ *
+ * The messages are passed to `logMqttMessage()` at a fixed rate on the stand-in clock and the log task calls
+ * `mqtt_log_flush()` every second. The archive buffers the lines and writes them (one write and one flush) when the
+ * buffer is full or the oldest line is `MQTT_LOG_FLUSH_MS` old, the file is opened once and kept open. The SD card
+ * calls are counted by the stand-in (`nativeSdStats()`) and asserted against the writes the buffer and the flush
+ * period allow, the file has to hold every message:
+ *
+ *   pio test -e native -f native/test_mqtt_archive -v
+ */
+
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "libZigbee.h"
+#include "libMqtt.h"
+#include "native.h"
+
+extern g_vars_t * g_vars_ptr;
+
+#define ARCHIVE_MESSAGES 3600
+#define ARCHIVE_FLUSH_PERIOD_MS 1000
+// the folder of the month is checked and created and the file of the day is opened once
+#define ARCHIVE_OPEN_CALLS 3
+
+static esp_zb_ieee_addr_t archive_ieee = {0x01, 0x00, 0x00, 0x00, 0x00, 0x4B, 0x12, 0x00};
+static char archive_load[ZIGBEE_ATTR_JSON_MAX];
+static size_t archive_len = 0;
+static bool archive_ready = false;
+
+static size_t archive_file_size() {
+    File file = SD.open(MQTT_LOG_FILES_PATH "/2025-10/2025-10-09" MQTT_LOG_FILE_EXT, FILE_READ);
+    size_t size = file ? file.size() : 0;
+    file.close();
+    return size;
+}
+
+// passes the messages `interval_ms` apart, the log task flushes the archive every ARCHIVE_FLUSH_PERIOD_MS
+static void archive_run(const char * name, uint32_t interval_ms) {
+    TEST_ASSERT_TRUE(archive_ready);
+    TEST_ASSERT_TRUE(mqtt_log_flush(true));
+    size_t size_before = archive_file_size();
+    nativeSdReset();
+
+    uint32_t since_flush = 0;
+    for (uint32_t i = 0; i < ARCHIVE_MESSAGES; i++) {
+        TEST_ASSERT_TRUE(logMqttMessage(archive_load));
+        nativeAdvanceMillis(interval_ms);
+        since_flush += interval_ms;
+        if (since_flush >= ARCHIVE_FLUSH_PERIOD_MS) {
+            TEST_ASSERT_TRUE(mqtt_log_flush(false));
+            since_flush = 0;
+        }
+    }
+    TEST_ASSERT_TRUE(mqtt_log_flush(true));
+    native_sd_t sd = nativeSdStats();
+
+    // a write takes the lines of a full buffer or of one flush period, whichever is fewer
+    uint32_t buffer_lines = MQTT_LOG_BUFFER_SIZE / (archive_len + 1);
+    uint32_t period_lines = MQTT_LOG_FLUSH_MS / interval_ms;
+    uint32_t write_lines = buffer_lines < period_lines ? buffer_lines : period_lines;
+    uint32_t max_writes = (ARCHIVE_MESSAGES + write_lines - 1) / write_lines + 1;
+    uint64_t max_calls = 2 * max_writes + ARCHIVE_OPEN_CALLS;
+
+    char line[200];
+    snprintf(line, sizeof(line), "%-12s %.3f SD calls per message (%llu calls: %llu opens, %llu writes, %llu flushes, "
+             "%llu other; at most %llu)", name, (double)sd.calls / ARCHIVE_MESSAGES, (unsigned long long)sd.calls,
+             (unsigned long long)sd.opens, (unsigned long long)sd.writes, (unsigned long long)sd.flushes,
+             (unsigned long long)(sd.lookups + sd.changes + sd.closes), (unsigned long long)max_calls);
+    TEST_MESSAGE(line);
+
+    TEST_ASSERT_TRUE(sd.calls <= max_calls);
+    TEST_ASSERT_TRUE(sd.opens <= 1);
+    TEST_ASSERT_EQUAL_UINT64(0, sd.closes);
+    TEST_ASSERT_EQUAL_UINT64((uint64_t)ARCHIVE_MESSAGES * (archive_len + 1), sd.written);
+    TEST_ASSERT_EQUAL_UINT32(size_before + ARCHIVE_MESSAGES * (archive_len + 1), archive_file_size());
+}
+
+// *********************************************************************************************************************
+
+void test_mqtt_archive_slow() {
+    // 1 message per second, the lines of one flush period are written together
+    archive_run("1 msg/s", 1000);
+}
+
+void test_mqtt_archive_fast() {
+    // 50 messages per second, the lines of one full buffer are written together
+    archive_run("50 msg/s", 20);
+}
+
+// *********************************************************************************************************************
+
+void setUp() {}
+
+void tearDown() {}
+
+int main() {
+    nativeSerialMute(true);
+    nativeSdClear();
+    // the archive folder of the month is created in it
+    SD.mkdir(MQTT_LOG_FILES_PATH);
+
+    // 2025-10-09 12:00 UTC, the messages of the test stay in one day
+    g_vars_ptr->datetime = 1760011200;
+    iot_alarm_attr_load_t * attr = create_attr("LUMI", "lumi.weather", "temperature", 0x0402, archive_ieee,
+                                               0x1234, 1, 1, 0x0402, 0x0000, ESP_ZB_ZCL_ATTR_TYPE_S16, 2150);
+    char ieee_str[ZIGBEE_IEEE_STR_SIZE];
+    archive_len = pack_attr_json(attr, zigbee_ieee_str(attr->ieee_addr, ieee_str), archive_load, sizeof(archive_load) - 1);
+    archive_load[archive_len] = '\0';
+    destroy_attr(&attr);
+
+    archive_ready = archive_len > 0 && mqtt_log_init();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_mqtt_archive_slow);
+    RUN_TEST(test_mqtt_archive_fast);
+    return UNITY_END();
+}
@@ -0,0 +1,227 @@
+/**
+ * JSON and MessagePack encodings of the attribute messages decode into the same document.
+ *
+ * Random attributes (the integers at the boundaries of the MessagePack integer types included) are packed by the
+ * allocation-free writers and checked against ArduinoJson: the JSON text equals `pack_attr()` / `pack_attr_event()`,
+ * the MessagePack bytes equal ArduinoJson's encoding of the JSON document and decode back into the same JSON text.
+ * The batches and the commands (`unpack_attr()` / `unpack_attr_msgpack()`) are checked the same way:
+ *
+ *   pio test -e native -f native/test_msgpack_roundtrip -v
+ *   ROUNDTRIP_ITERATIONS=1000000 ROUNDTRIP_SEED=7 pio test -e native -f native/test_msgpack_roundtrip
+ */
+
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <ArduinoJson.h>
+
+#include "libZigbee.h"
+#include "native.h"
+
+extern g_vars_t * g_vars_ptr;
+
+#define ROUNDTRIP_ITERATIONS_DEFAULT 20000
+#define ROUNDTRIP_SEED_DEFAULT 0x2545F491U
+
+static uint32_t roundtrip_state = ROUNDTRIP_SEED_DEFAULT;
+static uint32_t roundtrip_iterations = ROUNDTRIP_ITERATIONS_DEFAULT;
+
+static uint32_t roundtrip_env(const char * name, uint32_t fallback) {
+    const char * value = getenv(name);
+    return value != NULL && *value != '\0' ? (uint32_t)strtoul(value, NULL, 0) : fallback;
+}
+
+// xorshift32, the same seed gives the same attributes on every host
+static uint32_t roundtrip_rand() {
+    roundtrip_state ^= roundtrip_state << 13;
+    roundtrip_state ^= roundtrip_state >> 17;
+    roundtrip_state ^= roundtrip_state << 5;
+    return roundtrip_state;
+}
+
+// integers of every MessagePack width, half of them at the boundaries of the widths
+static uint32_t roundtrip_uint(uint32_t max) {
+    static const uint32_t edges[] = {0, 0x7F, 0x80, 0xFF, 0x100, 0xFFFF, 0x10000, 0xFFFFFFFF};
+    uint32_t value;
+    if (roundtrip_rand() % 2 == 0) {
+        value = edges[roundtrip_rand() % (sizeof(edges) / sizeof(edges[0]))];
+    } else {
+        value = roundtrip_rand() >> (roundtrip_rand() % 32);
+    }
+    return value <= max ? value : value % (max + 1ULL);
+}
+
+static void roundtrip_attr(iot_alarm_attr_load_t * attr) {
+    memset(attr, 0, sizeof(*attr));
+    for (uint8_t & byte : attr->ieee_addr) {
+        byte = (uint8_t)roundtrip_rand();
+    }
+    attr->short_addr = (uint16_t)roundtrip_uint(0xFFFF);
+    attr->device_id = (uint8_t)roundtrip_uint(0xFF);
+    attr->type_id = roundtrip_uint(0xFFFFFFFF);
+    attr->endpoint_id = (uint8_t)roundtrip_uint(0xFF);
+    attr->cluster_id = (uint16_t)roundtrip_uint(0xFFFF);
+    attr->attr_id = (uint16_t)roundtrip_uint(0xFFFF);
+    attr->value_type = (esp_zb_zcl_attr_type_t)roundtrip_uint(0xFF);
+    attr->value = roundtrip_uint(0xFFFFFFFF);
+}
+
+static void roundtrip_assert_key(const iot_alarm_attr_load_t * expected, const iot_alarm_attr_load_t * actual) {
+    TEST_ASSERT_EQUAL_MEMORY(expected->ieee_addr, actual->ieee_addr, sizeof(expected->ieee_addr));
+    TEST_ASSERT_EQUAL_UINT16(expected->short_addr, actual->short_addr);
+    TEST_ASSERT_EQUAL_UINT8(expected->endpoint_id, actual->endpoint_id);
+    TEST_ASSERT_EQUAL_UINT16(expected->cluster_id, actual->cluster_id);
+    TEST_ASSERT_EQUAL_UINT16(expected->attr_id, actual->attr_id);
+    TEST_ASSERT_EQUAL_UINT32(expected->value_type, actual->value_type);
+    TEST_ASSERT_EQUAL_UINT32(expected->value, actual->value);
+}
+
+// the MessagePack message is ArduinoJson's encoding of the JSON message and it decodes back into the same text
+static void roundtrip_assert_same(const char * json, size_t json_len, const uint8_t * msgpack, size_t msgpack_len) {
+    JsonDocument doc;
+    TEST_ASSERT_FALSE(deserializeJson(doc, json, json_len));
+    std::vector<uint8_t> encoded(measureMsgPack(doc));
+    serializeMsgPack(doc, encoded.data(), encoded.size());
+    TEST_ASSERT_EQUAL_size_t(encoded.size(), msgpack_len);
+    TEST_ASSERT_EQUAL_MEMORY(encoded.data(), msgpack, msgpack_len);
+
+    JsonDocument decoded;
+    TEST_ASSERT_FALSE(deserializeMsgPack(decoded, msgpack, msgpack_len));
+    std::string text;
+    serializeJson(decoded, text);
+    TEST_ASSERT_TRUE(text == std::string(json, json_len));
+}
+
+// *********************************************************************************************************************
+
+void test_roundtrip_attr() {
+    iot_alarm_attr_load_t attr;
+    char ieee_str[ZIGBEE_IEEE_STR_SIZE];
+    char json[ZIGBEE_ATTR_JSON_MAX];
+    uint8_t msgpack[ZIGBEE_ATTR_JSON_MAX];
+    uint64_t json_bytes = 0;
+    uint64_t msgpack_bytes = 0;
+
+    for (uint32_t i = 0; i < roundtrip_iterations; i++) {
+        roundtrip_attr(&attr);
+        g_vars_ptr->datetime = roundtrip_uint(0xFFFFFFFF);
+        zigbee_ieee_str(attr.ieee_addr, ieee_str);
+
+        size_t json_len = pack_attr_json(&attr, ieee_str, json, sizeof(json));
+        size_t msgpack_len = pack_attr_msgpack(&attr, ieee_str, msgpack, sizeof(msgpack));
+        TEST_ASSERT_TRUE(json_len > 0);
+        TEST_ASSERT_TRUE(msgpack_len > 0);
+
+        // the same text as the ArduinoJson writer of pack_attr()
+        String reference;
+        TEST_ASSERT_TRUE(pack_attr(&attr, &reference));
+        TEST_ASSERT_EQUAL_STRING(reference.c_str(), json);
+        roundtrip_assert_same(json, json_len, msgpack, msgpack_len);
+
+        // the attribute comes back from both encodings (as a command)
+        iot_alarm_attr_load_t from_json = {};
+        iot_alarm_attr_load_t from_msgpack = {};
+        TEST_ASSERT_TRUE(unpack_attr(&from_json, String(json)));
+        TEST_ASSERT_TRUE(unpack_attr_msgpack(&from_msgpack, msgpack, msgpack_len));
+        roundtrip_assert_key(&attr, &from_json);
+        roundtrip_assert_key(&attr, &from_msgpack);
+
+        json_bytes += json_len;
+        msgpack_bytes += msgpack_len;
+    }
+
+    char line[128];
+    snprintf(line, sizeof(line), "%u attributes: JSON %.1f B, MessagePack %.1f B per message (%+.0f%%)",
+             (unsigned)roundtrip_iterations, (double)json_bytes / roundtrip_iterations, (double)msgpack_bytes / roundtrip_iterations,
+             100.0 * ((double)msgpack_bytes - json_bytes) / json_bytes);
+    TEST_MESSAGE(line);
+}
+
+void test_roundtrip_event() {
+    iot_alarm_attr_load_t attr;
+    char ieee_str[ZIGBEE_IEEE_STR_SIZE];
+    char json[ZIGBEE_ATTR_JSON_MAX];
+    uint8_t msgpack[ZIGBEE_ATTR_JSON_MAX];
+
+    for (uint32_t i = 0; i < roundtrip_iterations / 4; i++) {
+        roundtrip_attr(&attr);
+        g_vars_ptr->datetime = roundtrip_uint(0xFFFFFFFF);
+        zigbee_ieee_str(attr.ieee_addr, ieee_str);
+        uint32_t count = roundtrip_uint(0xFFFFFFFF);
+        uint32_t span_ms = roundtrip_uint(0xFFFFFFFF);
+
+        size_t json_len = pack_attr_event_json(&attr, ieee_str, count, span_ms, json, sizeof(json));
+        size_t msgpack_len = pack_attr_event_msgpack(&attr, ieee_str, count, span_ms, msgpack, sizeof(msgpack));
+        TEST_ASSERT_TRUE(json_len > 0);
+        TEST_ASSERT_TRUE(msgpack_len > 0);
+
+        String reference;
+        TEST_ASSERT_TRUE(pack_attr_event(&attr, count, span_ms, &reference));
+        TEST_ASSERT_EQUAL_STRING(reference.c_str(), json);
+        roundtrip_assert_same(json, json_len, msgpack, msgpack_len);
+    }
+}
+
+void test_roundtrip_batch() {
+    iot_alarm_attr_load_t batch[ZIGBEE_ATTR_BATCH_MAX];
+    iot_alarm_attr_load_t from_json[ZIGBEE_ATTR_BATCH_MAX];
+    iot_alarm_attr_load_t from_msgpack[ZIGBEE_ATTR_BATCH_MAX];
+    std::vector<uint8_t> msgpack(8192);
+
+    for (uint32_t i = 0; i < roundtrip_iterations / 100 + 1; i++) {
+        size_t count = 1 + roundtrip_rand() % ZIGBEE_ATTR_BATCH_MAX;
+        for (size_t j = 0; j < count; j++) {
+            roundtrip_attr(&batch[j]);
+        }
+        g_vars_ptr->datetime = roundtrip_uint(0xFFFFFFFF);
+
+        String json;
+        TEST_ASSERT_TRUE(pack_attr_batch(batch, count, &json));
+        size_t msgpack_len = pack_attr_batch_msgpack(batch, count, msgpack.data(), msgpack.size());
+        TEST_ASSERT_TRUE(msgpack_len > 0);
+        roundtrip_assert_same(json.c_str(), json.length(), msgpack.data(), msgpack_len);
+
+        // the batched command is the array of the attributes of the response
+        JsonDocument doc;
+        TEST_ASSERT_FALSE(deserializeJson(doc, json));
+        String command_json;
+        std::vector<uint8_t> command_msgpack(measureMsgPack(doc["attrs"]));
+        serializeJson(doc["attrs"], command_json);
+        serializeMsgPack(doc["attrs"], command_msgpack.data(), command_msgpack.size());
+
+        size_t json_count = 0;
+        size_t msgpack_count = 0;
+        TEST_ASSERT_TRUE(unpack_attr_batch(from_json, ZIGBEE_ATTR_BATCH_MAX, &json_count, command_json));
+        TEST_ASSERT_TRUE(unpack_attr_batch_msgpack(from_msgpack, ZIGBEE_ATTR_BATCH_MAX, &msgpack_count, command_msgpack.data(), command_msgpack.size()));
+        TEST_ASSERT_EQUAL_size_t(count, json_count);
+        TEST_ASSERT_EQUAL_size_t(count, msgpack_count);
+        for (size_t j = 0; j < count; j++) {
+            roundtrip_assert_key(&batch[j], &from_json[j]);
+            roundtrip_assert_key(&batch[j], &from_msgpack[j]);
+        }
+    }
+}
+
+// *********************************************************************************************************************
+
+void setUp() {}
+
+void tearDown() {}
+
+int main() {
+    roundtrip_iterations = roundtrip_env("ROUNDTRIP_ITERATIONS", ROUNDTRIP_ITERATIONS_DEFAULT);
+    roundtrip_state = roundtrip_env("ROUNDTRIP_SEED", ROUNDTRIP_SEED_DEFAULT);
+    if (roundtrip_state == 0) {
+        roundtrip_state = ROUNDTRIP_SEED_DEFAULT;
+    }
+    nativeSerialMute(true);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_roundtrip_attr);
+    RUN_TEST(test_roundtrip_event);
+    RUN_TEST(test_roundtrip_batch);
+    return UNITY_END();
+}
@@ -0,0 +1,227 @@
+/**
+ * Store-and-forward MQTT outbox against the broker stand-in which is killed and restarted.
+ *
+ * The messages are numbered, the broker must receive every one of them in order. The MQTT task is mirrored by
+ * `outbox_service()` (reconnect, `mqtt_outbox_link()`, `mqtt_outbox_drain()`), the clock is moved forward instead of
+ * waiting for the drain rate. A reset is simulated by `mqtt_outbox_init()` with the client disconnected, the outbox is
+ * then replayed from the SD card (at-least-once: the messages drained after the last saved position come again):
+ *
+ *   pio test -e native -f native/test_outbox
+ */
+
+#include <unity.h>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "libMqtt.h"
+#include "native.h"
+
+extern g_config_t * g_config_ptr;
+
+#define OUTBOX_TOPIC "iot-alarm/attr"
+
+static uint32_t outbox_next = 0;
+
+static void outbox_publish(uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        char load[32];
+        snprintf(load, sizeof(load), "{\"n\":%lu}", (unsigned long)outbox_next++);
+        TEST_ASSERT_TRUE(mqtt_publish(OUTBOX_TOPIC, load));
+    }
+}
+
+// one iteration of the MQTT task, one second later than the previous one
+static void outbox_service() {
+    if (!mqtt_client_connected()) {
+        mqtt_outbox_link(false);
+        mqtt_client_lock();
+        bool connected = mqtt.connect("outbox");
+        mqtt_client_unlock();
+        if (connected) {
+            mqtt_outbox_link(true);
+        }
+    }
+    nativeAdvanceMillis(1000);
+    mqtt_outbox_drain();
+}
+
+static void outbox_drain() {
+    for (uint32_t i = 0; i < 1000 && mqtt_outbox_get_stats().pending > 0; i++) {
+        outbox_service();
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, mqtt_outbox_get_stats().pending);
+}
+
+// numbers of the messages accepted by the broker (the outbox statistics are counted separately)
+static std::vector<uint32_t> outbox_received(uint32_t * reports) {
+    std::vector<uint32_t> numbers;
+    *reports = 0;
+    for (const native_mqtt_message_t & msg : nativeBrokerMessages()) {
+        if (msg.topic == OUTBOX_TOPIC) {
+            numbers.push_back((uint32_t)strtoul(msg.load.c_str() + strlen("{\"n\":"), NULL, 10));
+        } else if (msg.topic == "iot-alarm/outbox") {
+            (*reports)++;
+        }
+    }
+    return numbers;
+}
+
+// every published message arrived once and in order
+static void outbox_assert_exact() {
+    uint32_t reports;
+    std::vector<uint32_t> numbers = outbox_received(&reports);
+    TEST_ASSERT_EQUAL_size_t(outbox_next, numbers.size());
+    for (uint32_t i = 0; i < numbers.size(); i++) {
+        TEST_ASSERT_EQUAL_UINT32(i, numbers[i]);
+    }
+}
+
+// *********************************************************************************************************************
+
+void test_outbox_broker_restart() {
+    outbox_publish(100);
+    TEST_ASSERT_EQUAL_UINT32(0, mqtt_outbox_get_stats().pending);
+
+    // the broker is killed, the messages wait in the outbox
+    nativeBrokerSetUp(false);
+    outbox_publish(300);
+    outbox_service();
+    outbox_service();
+    TEST_ASSERT_EQUAL_UINT32(300, mqtt_outbox_get_stats().pending);
+
+    // restarted: the new messages are queued behind the backlog, the backlog is drained at the drain rate
+    nativeBrokerSetUp(true);
+    outbox_service();
+    outbox_publish(50);
+    mqtt_outbox_stats_t stats = mqtt_outbox_get_stats();
+    TEST_ASSERT_EQUAL_UINT32(350 - MQTT_OUTBOX_DRAIN_RATE, stats.pending);
+
+    // killed again in the middle of the drain
+    outbox_service();
+    nativeBrokerSetUp(false);
+    outbox_publish(100);
+    outbox_service();
+    nativeBrokerSetUp(true);
+    outbox_drain();
+
+    // once drained, the messages are published right away again
+    outbox_publish(10);
+    TEST_ASSERT_EQUAL_UINT32(0, mqtt_outbox_get_stats().pending);
+    outbox_assert_exact();
+
+    uint32_t reports;
+    outbox_received(&reports);
+    stats = mqtt_outbox_get_stats();
+    TEST_ASSERT_EQUAL_UINT32(2, stats.outages);
+    TEST_ASSERT_EQUAL_UINT32(450, stats.queued);
+    TEST_ASSERT_EQUAL_UINT32(450, stats.sent);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.dropped);
+    TEST_ASSERT_TRUE(reports >= 1);
+}
+
+void test_outbox_connection_dropped_mid_publish() {
+    nativeBrokerSetUp(false);
+    outbox_publish(200);
+    nativeBrokerSetUp(true);
+
+    // the connection is lost in the middle of a replayed message, it stays in the outbox and comes after reconnect
+    nativeBrokerDropAfter(17);
+    outbox_drain();
+    nativeBrokerDropAfter(-1);
+    outbox_assert_exact();
+}
+
+void test_outbox_replay_after_reset() {
+    uint32_t sent = mqtt_outbox_get_stats().sent;
+    nativeBrokerSetUp(false);
+    outbox_publish(500);
+    outbox_service();
+
+    // the broker is back, part of the backlog is drained before the reset
+    nativeBrokerSetUp(true);
+    outbox_service();
+    outbox_service();
+    uint32_t drained = mqtt_outbox_get_stats().sent - sent;
+    TEST_ASSERT_TRUE(drained > 0);
+
+    // a message torn by the power loss ends the last segment
+    std::vector<std::string> segments;
+    File dir = SD.open(MQTT_OUTBOX_DIR);
+    File entry;
+    while ((entry = dir.openNextFile())) {
+        if (strstr(entry.name(), MQTT_OUTBOX_SEGMENT_PREFIX) != NULL) {
+            segments.push_back(entry.name());
+        }
+        entry.close();
+    }
+    dir.close();
+    TEST_ASSERT_FALSE(segments.empty());
+    std::string last = *std::max_element(segments.begin(), segments.end());
+    std::string path = std::string(MQTT_OUTBOX_DIR) + "/" + last.substr(last.rfind('/') + 1);
+    File file = SD.open(path.c_str(), FILE_APPEND);
+    TEST_ASSERT_TRUE(file);
+    const uint8_t torn[] = {0xA5, 0x00, 0x0E, 0x00, 0x40};
+    file.write(torn, sizeof(torn));
+    file.close();
+
+    // reset: the client is gone, the outbox is recovered from the SD card
+    mqtt.disconnect();
+    nativeBrokerSetUp(false);
+    TEST_ASSERT_TRUE(mqtt_outbox_init());
+    uint32_t pending = mqtt_outbox_get_stats().pending;
+    TEST_ASSERT_TRUE(pending >= 500 - drained);
+    TEST_ASSERT_TRUE(pending <= 500);
+
+    // the new run appends behind the recovered messages
+    outbox_publish(20);
+    nativeBrokerSetUp(true);
+    outbox_drain();
+
+    // at least once: the messages drained after the last saved position may come twice, but in order and none is lost
+    uint32_t reports;
+    std::vector<uint32_t> numbers = outbox_received(&reports);
+    uint32_t expected = 0;
+    for (uint32_t number : numbers) {
+        TEST_ASSERT_TRUE(number <= expected);
+        if (number == expected) {
+            expected++;
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT32(outbox_next, expected);
+    TEST_ASSERT_EQUAL_size_t(outbox_next + (pending - (500 - drained)), numbers.size());
+}
+
+// *********************************************************************************************************************
+
+void setUp() {
+    nativeBrokerClear();
+    outbox_next = 0;
+}
+
+void tearDown() {
+    nativeBrokerSetUp(true);
+    nativeBrokerDropAfter(-1);
+}
+
+int main() {
+    nativeSerialMute(true);
+    nativeSdClear();
+
+    g_config_ptr->mqtt_topic = "iot-alarm";
+    bool ready = mqtt_client_init() && mqtt_outbox_init();
+    ready = ready && mqtt.connect("outbox");
+    mqtt_outbox_link(true);
+
+    UNITY_BEGIN();
+    if (ready) {
+        RUN_TEST(test_outbox_broker_restart);
+        RUN_TEST(test_outbox_connection_dropped_mid_publish);
+        RUN_TEST(test_outbox_replay_after_reset);
+    }
+    int failures = UNITY_END();
+    return failures || !ready;
+}
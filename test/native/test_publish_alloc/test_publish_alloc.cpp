@@ -0,0 +1,154 @@
+/**
+ * Heap operations and bytes of the Zigbee report publish path per message, before and after the fixed buffers.
+ *
+ * Before: the topic was concatenated from Strings, the message was packed by `pack_attr()` into a String and published
+ * by `mqtt_publish(String, String)`. After: the topic prefix is written once, the path and the address are written
+ * after it per message, the message is packed by `pack_attr_json()` into a fixed buffer and published by
+ * `mqtt_publish_attr()` (the same as `rtosZigbeePublish`). Both paths publish to the connected broker stand-in, which
+ * only counts the messages (`nativeBrokerKeep(false)`), and log them to the MQTT archive. Printed per publish: the heap
+ * operations, the bytes of the allocated blocks (every String copy of the topic and the message is one) and the
+ * message bytes. After the first message (the client and the archive file), the new path may not allocate.
+ * The heap is counted on glibc only, the test is ignored in `[env:native_asan]`:
+ *
+ *   pio test -e native -f native/test_publish_alloc -v
+ */
+
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "libZigbee.h"
+#include "libMqtt.h"
+#include "libLog.h"
+#include "native.h"
+
+extern g_vars_t * g_vars_ptr;
+extern g_config_t * g_config_ptr;
+
+#define PUBLISH_MESSAGES 10000
+#define PUBLISH_PATH "/report/"
+
+static esp_zb_ieee_addr_t publish_ieee = {0x01, 0x00, 0x00, 0x00, 0x00, 0x4B, 0x12, 0x00};
+static iot_alarm_attr_load_t publish_attr;
+static bool publish_ready = false;
+// the stand-in keeps the task object, so the handle stays valid
+static TaskHandle_t publish_log_writer = NULL;
+
+// the log writer is parked: the publishing task only enqueues its records (the writer formats them on the device),
+// the records it does not fit into the ring are dropped without allocation as well
+static void publish_log_parked(void * parameters) {
+    (void)parameters;
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+}
+
+static void publish_report(const char * name, const native_heap_t * heap, uint64_t wire_bytes) {
+    char line[160];
+    snprintf(line, sizeof(line), "%-40s %6.2f allocations, %7.1f heap bytes, %5.1f message bytes per publish", name,
+             (double)heap->allocations / PUBLISH_MESSAGES, (double)heap->allocated / PUBLISH_MESSAGES,
+             (double)wire_bytes / PUBLISH_MESSAGES);
+    TEST_MESSAGE(line);
+}
+
+// the publish path before the fixed buffers
+static size_t publish_legacy(uint32_t value) {
+    char ieee_str[ZIGBEE_IEEE_STR_SIZE];
+    publish_attr.value = value;
+
+    String topic = g_config_ptr->mqtt_topic + String(PUBLISH_PATH) + zigbee_ieee_str(publish_attr.ieee_addr, ieee_str);
+    String load;
+    TEST_ASSERT_TRUE(pack_attr(&publish_attr, &load));
+    TEST_ASSERT_TRUE(mqtt_publish(topic, load));
+    return load.length();
+}
+
+// the publish path of rtosZigbeePublish, the prefix is written to the topic by the caller
+static size_t publish_fixed(uint32_t value, char * topic, size_t prefix) {
+    char load[ZIGBEE_ATTR_JSON_MAX];
+    publish_attr.value = value;
+
+    memcpy(topic + prefix, PUBLISH_PATH, strlen(PUBLISH_PATH));
+    const char * ieee_str = zigbee_ieee_str(publish_attr.ieee_addr, topic + prefix + strlen(PUBLISH_PATH));
+    size_t len = pack_attr_json(&publish_attr, ieee_str, load, sizeof(load));
+    TEST_ASSERT_TRUE(len > 0);
+    TEST_ASSERT_TRUE(mqtt_publish_attr(topic, load, len));
+    return len;
+}
+
+// *********************************************************************************************************************
+
+void test_publish_alloc_legacy() {
+    if (!nativeHeapCounted()) {
+        TEST_IGNORE_MESSAGE("the heap is not counted in this build");
+    }
+    TEST_ASSERT_TRUE(publish_ready);
+
+    publish_legacy(0);
+    nativeBrokerClear();
+    nativeHeapReset();
+    uint64_t wire_bytes = 0;
+    for (uint32_t i = 0; i < PUBLISH_MESSAGES; i++) {
+        wire_bytes += publish_legacy(i);
+    }
+    native_heap_t heap = nativeHeapStats();
+
+    publish_report("pack_attr() + mqtt_publish(String)", &heap, wire_bytes);
+    TEST_ASSERT_EQUAL_UINT64(PUBLISH_MESSAGES, nativeBrokerAccepted());
+}
+
+void test_publish_alloc_fixed() {
+    if (!nativeHeapCounted()) {
+        TEST_IGNORE_MESSAGE("the heap is not counted in this build");
+    }
+    TEST_ASSERT_TRUE(publish_ready);
+
+    char topic[MQTT_OUTBOX_TOPIC_MAX];
+    size_t prefix = strlcpy(topic, g_config_ptr->mqtt_topic.c_str(), sizeof(topic));
+
+    publish_fixed(0, topic, prefix);
+    nativeBrokerClear();
+    nativeHeapReset();
+    uint64_t wire_bytes = 0;
+    for (uint32_t i = 0; i < PUBLISH_MESSAGES; i++) {
+        wire_bytes += publish_fixed(i, topic, prefix);
+    }
+    native_heap_t heap = nativeHeapStats();
+
+    publish_report("pack_attr_json() + mqtt_publish_attr()", &heap, wire_bytes);
+    TEST_ASSERT_EQUAL_UINT64(PUBLISH_MESSAGES, nativeBrokerAccepted());
+    TEST_ASSERT_EQUAL_UINT64(0, heap.allocations);
+    TEST_ASSERT_EQUAL_UINT64(0, heap.frees);
+}
+
+// *********************************************************************************************************************
+
+void setUp() {}
+
+void tearDown() {}
+
+int main() {
+    nativeSerialMute(true);
+    nativeSdClear();
+    // the archive folder of the month is created in it (the archive file stays open)
+    SD.mkdir(MQTT_LOG_FILES_PATH);
+    bool logger = initLog();
+    xTaskCreate(publish_log_parked, "log", 4096, NULL, 1, &publish_log_writer);
+    handleTaskLog = publish_log_writer;
+
+    g_config_ptr->mqtt_topic = "iot-alarm";
+    g_vars_ptr->datetime = 1760000000;
+    iot_alarm_attr_load_t * attr = create_attr("LUMI", "lumi.sensor_magnet.aq2", "IAS zone", 0x0500000D, publish_ieee,
+                                               0x1234, 1, 1, 0x0500, 0x0002, ESP_ZB_ZCL_ATTR_TYPE_U32, 0);
+    publish_attr = *attr;
+    destroy_attr(&attr);
+
+    publish_ready = logger && mqtt_client_init() && mqtt_outbox_init() && mqtt_log_init() && mqtt.connect("publish");
+    mqtt_outbox_link(true);
+    nativeBrokerKeep(false);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_publish_alloc_legacy);
+    RUN_TEST(test_publish_alloc_fixed);
+    return UNITY_END();
+}
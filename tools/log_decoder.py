@@ -0,0 +1,333 @@
+#!/usr/bin/env python3
+"""
+Decoder of the binary log files written by libLog when the firmware is built with `LOG_BINARY`.
+
+The binary records contain only the tag id, FNV-1a hashes of the format string and function name, timestamp and
+raw argument bytes. The decoder rebuilds the readable text by hashing all string literals of the firmware sources
+(the sources have to match the firmware which wrote the log) and formatting the arguments on the host.
+
+Usage:
+    python3 tools/log_decoder.py log/seg*.bin log/logfile.bin [--src <project directory>] [--color]
+
+The rotated segments (`segNNNNNNNN.bin`) sort by generation, so the shell glob passes them oldest first,
+followed by the active segment `logfile.bin`.
+
+The output has the same format as the text log file:
+    I [12345] SETUP       : message (fx: (function))
+"""
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+FILE_MAGIC = b"ESPLOGB1"
+RECORD_MAGIC = 0xA5
+HEADER_SIZE = 16
+TAG_NONE = 0xFF
+
+LEVEL_CHARS = "IWE"
+LEVEL_COLORS = ["\033[1;32m", "\033[1;33m", "\033[1;31m"]
+
+SOURCE_DIRS = ["src", "lib", "include"]
+SOURCE_EXTENSIONS = (".c", ".cpp", ".h", ".hpp", ".ino")
+
+SPEC_RE = re.compile(r"%([-+ #0']*)(\*|\d+)?(?:\.(\*|\d*))?([hlLqjzt]*)(.?)", re.DOTALL)
+
+ESCAPES = {"n": 10, "t": 9, "r": 13, "a": 7, "b": 8, "f": 12, "v": 11, "e": 27, "\\": 92, "'": 39, '"': 34, "?": 63}
+
+
+# **********************************************************************************************************************
+
+
+def fnv1a(data):
+    h = 2166136261
+    for b in data:
+        h ^= b
+        h = (h * 16777619) & 0xFFFFFFFF
+    return h
+
+
+def unescape(body):
+    out = bytearray()
+    i = 0
+    while i < len(body):
+        c = body[i]
+        if c != "\\":
+            out += c.encode("utf-8")
+            i += 1
+            continue
+        i += 1
+        c = body[i] if i < len(body) else ""
+        if c in ESCAPES:
+            out.append(ESCAPES[c])
+            i += 1
+        elif c == "x":
+            j = i + 1
+            while j < len(body) and body[j] in "0123456789abcdefABCDEF":
+                j += 1
+            out.append(int(body[i + 1:j] or "0", 16) & 0xFF)
+            i = j
+        elif c in "01234567":
+            j = i
+            while j < len(body) and j < i + 3 and body[j] in "01234567":
+                j += 1
+            out.append(int(body[i:j], 8) & 0xFF)
+            i = j
+        else:
+            out += c.encode("utf-8")
+            i += 1
+    return bytes(out)
+
+
+def scan_literals(text):
+    """Yields all string literals of a C/C++ source, adjacent literals are yielded also concatenated."""
+    i = 0
+    n = len(text)
+    group = []
+    while i < n:
+        c = text[i]
+        if text.startswith("//", i):
+            i = text.find("\n", i)
+            i = n if i < 0 else i
+        elif text.startswith("/*", i):
+            i = text.find("*/", i + 2)
+            i = n if i < 0 else i + 2
+        elif c == "'":
+            i += 1
+            while i < n and text[i] != "'":
+                i += 2 if text[i] == "\\" else 1
+            i += 1
+        elif c == '"':
+            j = i + 1
+            while j < n and text[j] != '"':
+                j += 2 if text[j] == "\\" else 1
+            group.append(unescape(text[i + 1:j]))
+            i = j + 1
+        elif c.isspace():
+            i += 1
+        else:
+            if group:
+                yield from flush_group(group)
+                group = []
+            i += 1
+    if group:
+        yield from flush_group(group)
+
+
+def flush_group(group):
+    for literal in group:
+        yield literal
+    if len(group) > 1:
+        yield b"".join(group)
+
+
+def build_string_table(src_dir):
+    table = {}
+    for sub in SOURCE_DIRS:
+        root_dir = os.path.join(src_dir, sub)
+        for root, _, files in os.walk(root_dir):
+            for name in files:
+                if not name.endswith(SOURCE_EXTENSIONS):
+                    continue
+                with open(os.path.join(root, name), encoding="utf-8", errors="replace") as f:
+                    text = f.read()
+                for literal in scan_literals(text):
+                    table.setdefault(fnv1a(literal), set()).add(literal)
+    return table
+
+
+def build_tag_table(src_dir):
+    tags = {}
+    header = os.path.join(src_dir, "lib", "utils", "utils.h")
+    source = os.path.join(src_dir, "lib", "utils", "utils.cpp")
+    try:
+        with open(header, encoding="utf-8") as f:
+            enum = re.search(r"typedef enum \{(.*?)\} log_tag_id_t;", f.read(), re.DOTALL)
+        ids = {name: i for i, name in enumerate(re.findall(r"(TAG_ID_\w+)\s*,", enum.group(1)))}
+        with open(source, encoding="utf-8") as f:
+            for name, tag in re.findall(r"\{\s*(TAG_ID_\w+)\s*,\s*\"([^\"]*)\"", f.read()):
+                tags[ids[name]] = tag
+    except (OSError, AttributeError, KeyError) as e:
+        print("warning: failed to load tag table: %s" % e, file=sys.stderr)
+    return tags
+
+
+# **********************************************************************************************************************
+
+
+class Args:
+    def __init__(self, data):
+        self.data = data
+        self.offset = 0
+
+    def take(self, size):
+        if self.offset + size > len(self.data):
+            raise IndexError
+        chunk = self.data[self.offset:self.offset + size]
+        self.offset += size
+        return chunk
+
+    def u32(self):
+        return struct.unpack("<I", self.take(4))[0]
+
+    def u64(self):
+        return struct.unpack("<Q", self.take(8))[0]
+
+    def f64(self):
+        return struct.unpack("<d", self.take(8))[0]
+
+    def string(self):
+        length = self.take(1)[0]
+        # the last string may be stored partially, if the arguments were truncated
+        available = min(length, len(self.data) - self.offset)
+        return self.take(available).decode("utf-8", errors="replace")
+
+
+def signed(value, bits):
+    value &= (1 << bits) - 1
+    return value - (1 << bits) if value & (1 << (bits - 1)) else value
+
+
+def render(fmt, data):
+    args = Args(data)
+    out = []
+    pos = 0
+    exhausted = False
+
+    while True:
+        start = fmt.find("%", pos)
+        if start < 0:
+            out.append(fmt[pos:])
+            break
+        out.append(fmt[pos:start])
+
+        m = SPEC_RE.match(fmt, start)
+        flags, width, precision, length, conv = m.groups()
+        pos = m.end()
+
+        if conv == "%" or not conv or conv not in "diouxXcfFeEgGaAspn":
+            out.append("%" if conv == "%" else m.group(0))
+            continue
+        if conv == "n":
+            continue
+        if exhausted:
+            out.append("<?>")
+            continue
+
+        try:
+            stars = [signed(args.u32(), 32) for s in (width, precision) if s == "*"]
+            is64 = "ll" in length or any(c in length for c in "Lqj")
+
+            if conv in "di":
+                bits = 64 if is64 else (8 if "hh" in length else (16 if "h" in length else 32))
+                value = signed(args.u64() if is64 else args.u32(), bits)
+                conv = "d"
+            elif conv in "ouxXc":
+                bits = 64 if is64 else (8 if "hh" in length else (16 if "h" in length else 32))
+                value = (args.u64() if is64 else args.u32()) & ((1 << bits) - 1)
+                if conv == "u":
+                    conv = "d"
+                elif conv == "c":
+                    value = chr(value & 0xFF)
+            elif conv in "fFeEgGaA":
+                value = args.f64()
+                if conv in "aA":
+                    value, conv = value.hex(), "s"
+            elif conv == "s":
+                value = args.string()
+            else:
+                value, conv = "0x%x" % args.u32(), "s"
+        except IndexError:
+            exhausted = True
+            out.append("<?>")
+            continue
+
+        spec = "%" + flags.replace("'", "") + (width or "") + ("." + precision if precision is not None else "") + conv
+        try:
+            out.append(spec % tuple(stars + [value]))
+        except (TypeError, ValueError):
+            out.append("<%s?>" % m.group(0))
+
+    return "".join(out)
+
+
+def lookup(table, ident):
+    candidates = table.get(ident)
+    if not candidates:
+        return None
+    if len(candidates) > 1:
+        print("warning: hash collision 0x%08x: %s" % (ident, sorted(candidates)), file=sys.stderr)
+    return sorted(candidates)[0].decode("utf-8", errors="replace")
+
+
+def decode_file(path, strings, tags, color, out):
+    with open(path, "rb") as f:
+        data = f.read()
+
+    offset = 0
+    if data.startswith(FILE_MAGIC):
+        offset = len(FILE_MAGIC)
+    else:
+        print("warning: %s: missing file header" % path, file=sys.stderr)
+
+    skipped = 0
+    while offset + HEADER_SIZE <= len(data):
+        magic, length, level, tag_id = data[offset:offset + 4]
+        if magic != RECORD_MAGIC or length < HEADER_SIZE or offset + length > len(data) or (level & 0x7F) > 2:
+            # torn or corrupted record, resynchronise on the next record magic
+            offset += 1
+            skipped += 1
+            continue
+
+        timestamp, fmt_id, fx_id = struct.unpack("<III", data[offset + 4:offset + HEADER_SIZE])
+        args = data[offset + HEADER_SIZE:offset + length]
+        offset += length
+
+        fmt = lookup(strings, fmt_id)
+        if fmt is None:
+            message = "<unknown format 0x%08x> args: %s" % (fmt_id, args.hex())
+        else:
+            message = render(fmt, args)
+        if level & 0x80:
+            message += " <truncated>"
+
+        level &= 0x7F
+        tag = tags.get(tag_id, "TAG-%d" % tag_id) if tag_id != TAG_NONE else None
+        fx = lookup(strings, fx_id) if fx_id != 0 else None
+        if fx_id != 0 and fx is None:
+            fx = "0x%08x" % fx_id
+
+        line = "%c [%d]" % (LEVEL_CHARS[level], timestamp)
+        if tag is not None and fx is not None:
+            line += " %s: %s (fx: %s)" % (tag, message, fx)
+        elif tag is not None:
+            line += " %s: %s" % (tag, message)
+        else:
+            line += " %s" % message
+
+        out.write(LEVEL_COLORS[level] + line + "\033[0m\n" if color else line + "\n")
+
+    skipped += len(data) - offset
+    if skipped:
+        print("warning: %s: skipped %d bytes of corrupted or incomplete data" % (path, skipped), file=sys.stderr)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decodes binary log files written by the IoT Alarm firmware.")
+    parser.add_argument("files", nargs="+", help="binary log files (oldest first)")
+    parser.add_argument("--src", default=os.path.join(os.path.dirname(os.path.abspath(__file__)), ".."),
+                        help="project directory with the firmware sources (default: parent of this script)")
+    parser.add_argument("--color", action="store_true", help="color the output by log level")
+    args = parser.parse_args()
+
+    strings = build_string_table(args.src)
+    tags = build_tag_table(args.src)
+
+    for path in args.files:
+        decode_file(path, strings, tags, args.color, sys.stdout)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,559 @@
+#!/usr/bin/env python3
+"""
+Simulator of the Zigbee module (NCP) speaking the libZigbee UART protocol, used to load-test the `rtosZigbee` path
+without coordinator hardware.
+
+The simulator creates a pseudo-terminal (or opens a serial port connected to the ESP32) and plays a scenario:
+devices join and leave the network, send attribute reports at the configured rates and in bursts, and the commands
+of the firmware are acknowledged (with optional drops, delays and errors). Frames can be corrupted on purpose to
+exercise the resynchronisation of the frame parser.
+
+Every notification is sent again until the firmware acknowledges it (the same as the real module does), the time
+from the first transmission to the acknowledge is the ingestion latency. The summary contains the throughput, latency
+percentiles and the counters of the protocol errors, `--json` prints it as a JSON object for automated runs.
+
+Usage:
+    python3 tools/zigbee_ncp_sim.py [--port /dev/ttyUSB0] [--scenario scenario.json] [options]
+
+Without `--port` the path of the created pseudo-terminal is printed, a host build of the firmware (or `socat`) can
+be connected to it. The scenario file is a JSON object, all keys are optional (the command line options override it):
+    {
+        "duration": 60,
+        "devices": [{"ieee": "00:12:4B:00:00:00:00:01", "type_id": "0x0500000D", "cluster": "0x0500", "attr": 2,
+                     "value_type": "0x21", "values": "toggle", "rate": 0.5, "join": 0, "leave": 50,
+                     "manufacturer": "SIM", "name": "sensor-1", "type": "IAS zone"}],
+        "bursts": [{"at": 10, "count": 200}],
+        "corruption": {"bitflip": 0.01, "truncate": 0.005, "garbage": 0.005},
+        "acks": {"drop": 0.05, "delay_ms": 20, "error": 0.0},
+        "compact": true
+    }
+"""
+
+import argparse
+import collections
+import heapq
+import json
+import os
+import random
+import select
+import struct
+import sys
+import termios
+import time
+import tty
+
+FRAME_SOF = 0x7E
+FRAME_HEADER_SIZE = 4
+FRAME_CRC_SIZE = 2
+MESSAGE_HEADER = struct.Struct("<IIII")
+
+DIR_COMMAND = 0x00
+DIR_COMMAND_ACK = 0x01
+DIR_NOTIFICATION = 0x02
+DIR_NOTIFICATION_ACK = 0x03
+
+STATUS_SUCCESS = 0x00
+STATUS_ERROR = 0x01
+
+MSG_ECHO = 0x01
+MSG_CTL_RESTART = 0x02
+MSG_CTL_FACTORY = 0x03
+MSG_ZB_DEV_UNLOCK = 0x04
+MSG_ZB_DEV_LOCK = 0x05
+MSG_ZB_DEV_CLEAR = 0x06
+MSG_ZB_DEV_NEW = 0x07
+MSG_ZB_DEV_LEAVE = 0x08
+MSG_DEV_COUNT = 0x09
+MSG_ZB_DATA_READ = 0x0A
+MSG_ZB_DATA_WRITE = 0x0B
+MSG_ZB_DATA_REPORT = 0x0C
+MSG_ZB_DEV_INFO = 0x0D
+MSG_ZB_DATA_READ_BATCH = 0x0E
+MSG_ZB_DATA_WRITE_BATCH = 0x0F
+
+ATTR_COMPACT_TAG = 0xC7
+ATTR_BATCH_ITEM = struct.Struct("<8sBHHBI")
+ATTR_COMPACT = struct.Struct("<BHBHHBI")
+DEV_INFO = struct.Struct("<H8sHBI50s50s50s")
+PROFILE_HA = 0x0104
+
+# value types serialized with a value by serialize_attr()
+VALUE_TYPES = {0x08, 0x18, 0x30, 0x20, 0x09, 0x19, 0x31, 0x21, 0x0B, 0x1B, 0x23}
+
+ACK_TIMEOUT_S = 0.55
+NOTIFICATION_RETRIES = 18
+NOTIFICATION_WINDOW = 16  # notifications waiting for an acknowledge at once, the rest is queued
+BAUDRATE = termios.B115200
+
+DEFAULT_DEVICE = {
+    "type_id": 0x04020000,
+    "cluster": 0x0402,
+    "attr": 0x0000,
+    "value_type": 0x21,
+    "values": "random",
+    "rate": 1.0,
+    "join": 0.0,
+    "leave": None,
+    "manufacturer": "SIM",
+    "type": "Temperature sensor",
+}
+
+
+# **********************************************************************************************************************
+
+
+def crc16(data, crc=0xFFFF):
+    # CRC16-CCITT, the same as zigbee_crc16()
+    for b in data:
+        x = ((crc >> 8) ^ b) & 0xFF
+        x ^= x >> 4
+        crc = ((crc << 8) ^ (x << 12) ^ (x << 5) ^ x) & 0xFFFF
+    return crc
+
+
+def encode_frame(seq, payload):
+    header = struct.pack("<HB", len(payload), seq)
+    crc = crc16(header + payload)
+    return bytes([FRAME_SOF]) + header + payload + struct.pack("<H", crc)
+
+
+def encode_message(direction, status, msg_id, load=b""):
+    return MESSAGE_HEADER.pack(direction, status, msg_id, len(load)) + load
+
+
+def number(value):
+    return int(value, 0) if isinstance(value, str) else int(value)
+
+
+def parse_ieee(text):
+    # printed MSB first ("A4:..."), stored little endian
+    return bytes(reversed([int(part, 16) for part in text.split(":")]))
+
+
+def format_ieee(ieee):
+    return ":".join("%02X" % b for b in reversed(ieee))
+
+
+def percentile(values, p):
+    if not values:
+        return 0.0
+    values = sorted(values)
+    k = min(len(values) - 1, max(0, int(round(p / 100.0 * (len(values) - 1)))))
+    return values[k]
+
+
+class FrameParser:
+    """Frame parser of the frames sent by the firmware (searches for the next start of frame byte after an error)."""
+
+    def __init__(self, max_len=1024):
+        self.max_len = max_len
+        self.buffer = bytearray()
+        self.crc_errors = 0
+        self.length_errors = 0
+
+    def feed(self, data):
+        self.buffer += data
+        frames = []
+        while True:
+            start = self.buffer.find(bytes([FRAME_SOF]))
+            if start < 0:
+                self.buffer.clear()
+                return frames
+            del self.buffer[:start]
+            if len(self.buffer) < FRAME_HEADER_SIZE:
+                return frames
+            length, seq = struct.unpack_from("<HB", self.buffer, 1)
+            if length == 0 or length > self.max_len:
+                self.length_errors += 1
+                del self.buffer[:1]
+                continue
+            total = FRAME_HEADER_SIZE + length + FRAME_CRC_SIZE
+            if len(self.buffer) < total:
+                return frames
+            body = bytes(self.buffer[1:FRAME_HEADER_SIZE + length])
+            (crc,) = struct.unpack_from("<H", self.buffer, FRAME_HEADER_SIZE + length)
+            if crc16(body) != crc:
+                self.crc_errors += 1
+                del self.buffer[:1]
+                continue
+            frames.append((seq, body[FRAME_HEADER_SIZE - 1:]))
+            del self.buffer[:total]
+
+
+class Device:
+    def __init__(self, index, spec):
+        cfg = dict(DEFAULT_DEVICE)
+        cfg.update(spec)
+        self.handle = index + 1
+        self.ieee = parse_ieee(cfg["ieee"]) if "ieee" in cfg else struct.pack("<Q", 0x00124B0000000000 + index + 1)
+        self.short = 0x1000 + index
+        self.device_id = 1 + index % 250
+        self.type_id = number(cfg["type_id"])
+        self.cluster = number(cfg["cluster"])
+        self.attr = number(cfg["attr"])
+        self.value_type = number(cfg["value_type"])
+        self.values = cfg["values"]
+        self.rate = float(cfg["rate"])
+        self.join = float(cfg["join"])
+        self.leave = None if cfg["leave"] is None else float(cfg["leave"])
+        self.manufacturer = cfg["manufacturer"]
+        self.name = cfg.get("name", "sim-%d" % self.handle)
+        self.type = cfg["type"]
+        self.value = 0
+        self.joined = False
+
+    def next_value(self, rng):
+        if self.values == "toggle":
+            self.value ^= 1
+        elif self.values == "random":
+            self.value = (self.value + rng.randint(-20, 20)) & 0xFFFF
+        return self.value
+
+    def dev_info(self):
+        # followed by the interview result: one endpoint with the basic and the reported cluster
+        clusters = [0x0000, self.cluster] if self.cluster != 0x0000 else [0x0000]
+        endpoints = struct.pack("<BBHHBBB", 1, 1, PROFILE_HA, self.type_id & 0xFFFF, 1, len(clusters), 0)
+        endpoints += struct.pack("<%dH" % len(clusters), *clusters)
+        return DEV_INFO.pack(self.handle, self.ieee, self.short, self.device_id, self.type_id,
+                             self.type.encode()[:49], self.manufacturer.encode()[:49], self.name.encode()[:49]) + endpoints
+
+    def attr_load(self, compact, attr=None, value=None):
+        attr = self.attr if attr is None else attr
+        value = self.value if value is None else value
+        if compact:
+            return ATTR_COMPACT.pack(ATTR_COMPACT_TAG, self.handle, 1, self.cluster, attr, self.value_type, value)
+        load = struct.pack("<8sHBBHHI", self.ieee, self.short, self.device_id, 1, self.cluster, attr, self.value_type)
+        if self.value_type in VALUE_TYPES:
+            load += struct.pack("<I", value)
+        load += struct.pack("<I", self.type_id)
+        for text in (self.type, self.manufacturer, self.name):
+            load += text.encode()[:49].ljust(50, b"\0")
+        return load
+
+
+class Simulator:
+    def __init__(self, fd, scenario, rng):
+        self.fd = fd
+        self.rng = rng
+        self.duration = float(scenario.get("duration", 30))
+        self.compact = bool(scenario.get("compact", True))
+        self.corruption = {k: float(v) for k, v in scenario.get("corruption", {}).items()}
+        acks = scenario.get("acks", {})
+        self.ack_drop = float(acks.get("drop", 0.0))
+        self.ack_delay = float(acks.get("delay_ms", 0.0)) / 1000.0
+        self.ack_error = float(acks.get("error", 0.0))
+        self.devices = [Device(i, spec) for i, spec in enumerate(scenario.get("devices", []))]
+        self.bursts = scenario.get("bursts", [])
+        self.parser = FrameParser()
+        self.events = []
+        self.event_id = 0
+        self.seq = 0
+        self.pending = {}
+        self.queue = collections.deque()
+        self.latencies = []
+        self.last_ack = 0.0
+        self.stats = {
+            "notifications": 0, "acked": 0, "resends": 0, "lost": 0, "corrupted": 0, "queue_max": 0,
+            "commands": {}, "acks_dropped": 0, "foreign_acks": 0, "bytes_tx": 0, "bytes_rx": 0,
+        }
+
+    # ---------------------------------------------------------------------------------------------------------- time
+
+    def schedule(self, at, action, *args):
+        self.event_id += 1
+        heapq.heappush(self.events, (at, self.event_id, action, args))
+
+    def next_seq(self):
+        # sequence number 0 is used for the frames which are not acknowledged
+        self.seq = 1 if self.seq >= 255 else self.seq + 1
+        return self.seq
+
+    # ----------------------------------------------------------------------------------------------------------- I/O
+
+    def write(self, frame):
+        if self.rng.random() < self.corruption.get("bitflip", 0.0):
+            frame = bytearray(frame)
+            frame[self.rng.randrange(1, len(frame))] ^= 1 << self.rng.randrange(8)
+            self.stats["corrupted"] += 1
+        elif self.rng.random() < self.corruption.get("truncate", 0.0):
+            frame = frame[:self.rng.randrange(1, len(frame))]
+            self.stats["corrupted"] += 1
+        if self.rng.random() < self.corruption.get("garbage", 0.0):
+            frame = bytes(self.rng.randrange(256) for _ in range(self.rng.randrange(1, 32))) + bytes(frame)
+            self.stats["corrupted"] += 1
+        self.stats["bytes_tx"] += len(frame)
+        os.write(self.fd, bytes(frame))
+
+    def notify(self, now, msg_id, load):
+        # the latency includes the time spent in the queue, so the bursts are visible in the percentiles
+        self.queue.append((msg_id, load, now))
+        self.stats["notifications"] += 1
+        self.stats["queue_max"] = max(self.stats["queue_max"], len(self.queue))
+        self.pump(now)
+
+    def pump(self, now):
+        while self.queue and len(self.pending) < NOTIFICATION_WINDOW:
+            msg_id, load, queued = self.queue.popleft()
+            seq = self.next_seq()
+            while seq in self.pending:
+                seq = self.next_seq()
+            frame = encode_frame(seq, encode_message(DIR_NOTIFICATION, STATUS_SUCCESS, msg_id, load))
+            self.pending[seq] = {"id": msg_id, "frame": frame, "queued": queued, "sent": now, "retries": 0}
+            self.write(frame)
+            self.schedule(now + ACK_TIMEOUT_S, self.resend, seq, now)
+
+    def resend(self, now, seq, first_sent):
+        entry = self.pending.get(seq)
+        if entry is None or entry["sent"] != first_sent:
+            return
+        if entry["retries"] >= NOTIFICATION_RETRIES:
+            del self.pending[seq]
+            self.stats["lost"] += 1
+            self.pump(now)
+            return
+        entry["retries"] += 1
+        self.stats["resends"] += 1
+        self.write(entry["frame"])
+        self.schedule(now + ACK_TIMEOUT_S, self.resend, seq, first_sent)
+
+    def ack(self, now, seq, msg_id, status):
+        self.write(encode_frame(seq, encode_message(DIR_COMMAND_ACK, status, msg_id)))
+
+    # ------------------------------------------------------------------------------------------------------ scenario
+
+    def join(self, now, dev):
+        dev.joined = True
+        self.notify(now, MSG_ZB_DEV_NEW, b"\0")
+        self.notify(now, MSG_ZB_DEV_INFO, dev.dev_info())
+        if dev.rate > 0:
+            self.schedule(now + self.rng.expovariate(dev.rate), self.report, dev)
+
+    def leave(self, now, dev):
+        dev.joined = False
+        self.notify(now, MSG_ZB_DEV_LEAVE, b"\0")
+
+    def report(self, now, dev):
+        if not dev.joined:
+            return
+        dev.next_value(self.rng)
+        self.notify(now, MSG_ZB_DATA_REPORT, dev.attr_load(self.compact))
+        self.schedule(now + self.rng.expovariate(dev.rate), self.report, dev)
+
+    def burst(self, now, count):
+        joined = [dev for dev in self.devices if dev.joined]
+        for i in range(count if joined else 0):
+            dev = joined[i % len(joined)]
+            dev.next_value(self.rng)
+            self.notify(now, MSG_ZB_DATA_REPORT, dev.attr_load(self.compact))
+
+    # ------------------------------------------------------------------------------------------------------ commands
+
+    def find_device(self, ieee):
+        return next((dev for dev in self.devices if dev.ieee == ieee), None)
+
+    def handle_command(self, now, seq, msg_id, load):
+        self.stats["commands"][msg_id] = self.stats["commands"].get(msg_id, 0) + 1
+
+        if self.rng.random() < self.ack_drop:
+            self.stats["acks_dropped"] += 1
+            return
+        status = STATUS_ERROR if self.rng.random() < self.ack_error else STATUS_SUCCESS
+        if self.ack_delay > 0:
+            self.schedule(now + self.ack_delay, self.ack, seq, msg_id, status)
+        else:
+            self.ack(now, seq, msg_id, status)
+        if status != STATUS_SUCCESS:
+            return
+
+        if msg_id == MSG_DEV_COUNT:
+            self.notify(now, MSG_DEV_COUNT, str(sum(dev.joined for dev in self.devices)).encode())
+        elif msg_id == MSG_ZB_DEV_INFO:
+            dev = None
+            if len(load) == 2:
+                (handle,) = struct.unpack("<H", load)
+                dev = next((d for d in self.devices if d.handle == handle), None)
+            elif len(load) == 8:
+                dev = self.find_device(load)
+            if dev is not None:
+                self.notify(now, MSG_ZB_DEV_INFO, dev.dev_info())
+        elif msg_id in (MSG_ZB_DATA_READ, MSG_ZB_DATA_WRITE):
+            # the reads are answered with the current value, the writes with the written one
+            if len(load) == ATTR_COMPACT.size and load[0] == ATTR_COMPACT_TAG:
+                _, handle, _, _, attr, _, value = ATTR_COMPACT.unpack(load)
+                dev = next((d for d in self.devices if d.handle == handle), None)
+            else:
+                dev, attr, value = self.find_device(load[:8]), struct.unpack_from("<H", load, 14)[0], None
+                if len(load) >= 24:
+                    value = struct.unpack_from("<I", load, 20)[0]
+            if dev is not None:
+                value = dev.value if msg_id == MSG_ZB_DATA_READ or value is None else value
+                self.notify(now, msg_id, dev.attr_load(self.compact, attr, value))
+        elif msg_id in (MSG_ZB_DATA_READ_BATCH, MSG_ZB_DATA_WRITE_BATCH) and load:
+            items = []
+            for i in range(load[0]):
+                ieee, ep, cluster, attr, value_type, value = ATTR_BATCH_ITEM.unpack_from(load, 1 + i * ATTR_BATCH_ITEM.size)
+                dev = self.find_device(ieee)
+                if dev is not None and msg_id == MSG_ZB_DATA_READ_BATCH:
+                    value = dev.value
+                items.append(ATTR_BATCH_ITEM.pack(ieee, ep, cluster, attr, value_type, value))
+            self.notify(now, msg_id, bytes([len(items)]) + b"".join(items))
+
+    def handle_frame(self, now, seq, payload):
+        if len(payload) < MESSAGE_HEADER.size:
+            return
+        direction, status, msg_id, length = MESSAGE_HEADER.unpack_from(payload)
+        load = payload[MESSAGE_HEADER.size:MESSAGE_HEADER.size + length]
+
+        if direction == DIR_NOTIFICATION_ACK:
+            entry = self.pending.get(seq)
+            if entry is None or entry["id"] != msg_id:
+                self.stats["foreign_acks"] += 1
+                return
+            del self.pending[seq]
+            self.stats["acked"] += 1
+            self.latencies.append(now - entry["queued"])
+            self.last_ack = now
+            self.pump(now)
+        elif direction == DIR_COMMAND:
+            self.handle_command(now, seq, msg_id, load)
+
+    # ----------------------------------------------------------------------------------------------------------- run
+
+    def run(self):
+        start = time.monotonic()
+        for dev in self.devices:
+            self.schedule(start + dev.join, self.join, dev)
+            if dev.leave is not None:
+                self.schedule(start + dev.leave, self.leave, dev)
+        for burst in self.bursts:
+            self.schedule(start + float(burst["at"]), self.burst, int(burst["count"]))
+
+        end = start + self.duration
+        while True:
+            now = time.monotonic()
+            while self.events and self.events[0][0] <= now:
+                _, _, action, args = heapq.heappop(self.events)
+                # after the scenario ends only the queued and pending notifications are finished
+                if now < end or action == self.resend:
+                    action(now, *args)
+            # the scenario ends when everything is acknowledged or the firmware stops acknowledging
+            if now >= end and (not self.pending and not self.queue or now - max(end, self.last_ack) > ACK_TIMEOUT_S * 4):
+                break
+            timeout = max(0.0, min(self.events[0][0] - now if self.events else 0.05, 0.05))
+            readable, _, _ = select.select([self.fd], [], [], timeout)
+            if readable:
+                try:
+                    data = os.read(self.fd, 4096)
+                except OSError:
+                    data = b""
+                self.stats["bytes_rx"] += len(data)
+                for seq, payload in self.parser.feed(data):
+                    self.handle_frame(time.monotonic(), seq, payload)
+        self.stats["lost"] += len(self.pending) + len(self.queue)
+        return time.monotonic() - start
+
+    def summary(self, elapsed):
+        ms = [v * 1000.0 for v in self.latencies]
+        return {
+            "elapsed_s": round(elapsed, 3),
+            "notifications": self.stats["notifications"],
+            "acked": self.stats["acked"],
+            "throughput_per_s": round(self.stats["acked"] / elapsed, 1) if elapsed > 0 else 0.0,
+            "latency_ms": {
+                "p50": round(percentile(ms, 50), 2), "p90": round(percentile(ms, 90), 2),
+                "p99": round(percentile(ms, 99), 2), "max": round(max(ms), 2) if ms else 0.0,
+            },
+            "queue_max": self.stats["queue_max"],
+            "resends": self.stats["resends"],
+            "lost": self.stats["lost"],
+            "corrupted_tx": self.stats["corrupted"],
+            "rx_crc_errors": self.parser.crc_errors,
+            "rx_length_errors": self.parser.length_errors,
+            "commands": {"0x%02x" % k: v for k, v in sorted(self.stats["commands"].items())},
+            "acks_dropped": self.stats["acks_dropped"],
+            "foreign_acks": self.stats["foreign_acks"],
+            "bytes_tx": self.stats["bytes_tx"],
+            "bytes_rx": self.stats["bytes_rx"],
+        }
+
+
+# **********************************************************************************************************************
+
+
+def open_port(path):
+    fd = os.open(path, os.O_RDWR | os.O_NOCTTY)
+    tty.setraw(fd)
+    attrs = termios.tcgetattr(fd)
+    attrs[4] = attrs[5] = BAUDRATE
+    termios.tcsetattr(fd, termios.TCSANOW, attrs)
+    return fd
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Zigbee NCP simulator for the libZigbee UART protocol.")
+    parser.add_argument("--port", help="serial port connected to the firmware (default: create a pseudo-terminal)")
+    parser.add_argument("--scenario", help="scenario JSON file")
+    parser.add_argument("--duration", type=float, help="scenario duration in seconds")
+    parser.add_argument("--devices", type=int, help="number of generated devices (replaces the scenario devices)")
+    parser.add_argument("--rate", type=float, default=1.0, help="reports per second of each generated device")
+    parser.add_argument("--burst", action="append", default=[], metavar="AT:COUNT", help="burst of COUNT reports at AT seconds")
+    parser.add_argument("--bitflip", type=float, help="probability of a flipped bit in a sent frame")
+    parser.add_argument("--truncate", type=float, help="probability of a truncated sent frame")
+    parser.add_argument("--garbage", type=float, help="probability of garbage bytes before a sent frame")
+    parser.add_argument("--ack-drop", type=float, help="probability of a dropped command acknowledge")
+    parser.add_argument("--ack-delay", type=float, help="command acknowledge delay in milliseconds")
+    parser.add_argument("--ack-error", type=float, help="probability of an acknowledge with the error status")
+    parser.add_argument("--full", action="store_true", help="send the full attribute form instead of the compact one")
+    parser.add_argument("--wait", type=float, default=0.0, help="seconds to wait for the firmware before the scenario starts")
+    parser.add_argument("--seed", type=int, default=1, help="random seed")
+    parser.add_argument("--json", action="store_true", help="print the summary as JSON")
+    args = parser.parse_args()
+
+    scenario = {}
+    if args.scenario:
+        with open(args.scenario) as f:
+            scenario = json.load(f)
+    if args.duration is not None:
+        scenario["duration"] = args.duration
+    if args.devices is not None:
+        scenario["devices"] = [{"rate": args.rate} for _ in range(args.devices)]
+    scenario.setdefault("devices", [{"rate": args.rate}])
+    for burst in args.burst:
+        at, count = burst.split(":")
+        scenario.setdefault("bursts", []).append({"at": float(at), "count": int(count)})
+    for key in ("bitflip", "truncate", "garbage"):
+        if getattr(args, key) is not None:
+            scenario.setdefault("corruption", {})[key] = getattr(args, key)
+    for key, option in (("drop", "ack_drop"), ("delay_ms", "ack_delay"), ("error", "ack_error")):
+        if getattr(args, option) is not None:
+            scenario.setdefault("acks", {})[key] = getattr(args, option)
+    if args.full:
+        scenario["compact"] = False
+
+    if args.port:
+        fd = open_port(args.port)
+    else:
+        fd, slave = os.openpty()
+        tty.setraw(fd)
+        tty.setraw(slave)
+        print("NCP simulator listening on: %s" % os.ttyname(slave), file=sys.stderr, flush=True)
+
+    time.sleep(args.wait)
+    sim = Simulator(fd, scenario, random.Random(args.seed))
+    summary = sim.summary(sim.run())
+
+    if args.json:
+        print(json.dumps(summary, indent=2))
+    else:
+        lat = summary["latency_ms"]
+        print("reports acked: %d/%d in %.1f s (%.1f/s)" % (summary["acked"], summary["notifications"], summary["elapsed_s"], summary["throughput_per_s"]))
+        print("latency ms: p50 %.2f, p90 %.2f, p99 %.2f, max %.2f" % (lat["p50"], lat["p90"], lat["p99"], lat["max"]))
+        print("resends: %d, lost: %d, corrupted frames sent: %d, max queue: %d" % (summary["resends"], summary["lost"], summary["corrupted_tx"], summary["queue_max"]))
+        print("received: %d B, CRC errors: %d, length errors: %d, foreign acks: %d" % (summary["bytes_rx"], summary["rx_crc_errors"], summary["rx_length_errors"], summary["foreign_acks"]))
+        print("commands: %s (acks dropped: %d)" % (summary["commands"], summary["acks_dropped"]))
+
+    return 0 if summary["lost"] == 0 else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())